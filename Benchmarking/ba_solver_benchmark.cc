@@ -0,0 +1,328 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Cost reduction per millisecond of a local bundle adjustment with points and lines on synthetic windows
+// (TUM freiburg1 intrinsics, keyframes moving forward, each landmark observed by a few consecutive keyframes).
+// The same graph (same edges, Huber kernels and thresholds of Optimizer::BundleAdjustment(), first two keyframes fixed)
+// is optimized for 10 iterations with:
+// - the g2o algorithm of Optimizer::BundleAdjustment() (BlockSolverX with lines, BlockSolver_6_3 with points only);
+// - BASolver, the Schur-complement solver enabled by Optimizer.schurBASolver.
+
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+
+#include "Thirdparty/g2o/g2o/core/block_solver.h"
+#include "Thirdparty/g2o/g2o/core/optimization_algorithm_levenberg.h"
+#include "Thirdparty/g2o/g2o/solvers/linear_solver_eigen.h"
+#include "Thirdparty/g2o/g2o/types/types_six_dof_expmap.h"
+#include "Thirdparty/g2o/g2o/core/robust_kernel_impl.h"
+
+#include "g2o/types_sba_line.h"
+#include "g2o/types_six_dof_expmap2.h"
+
+#include "BASolver.h"
+
+using namespace std;
+
+static const double fx = 517.306408, fy = 516.469215, cx = 318.643040, cy = 255.313989, bf = 40.;
+static const double kInvSigma2PointLineDistance = 1./(0.05*0.05); // Optimizer::kInvSigma2PointLineDistance
+static const double kMuWeightForLine3dDist = 0.5;                // Optimizer::skMuWeightForLine3dDist
+
+struct Observation
+{
+    int kf;
+    int landmark;
+    bool bStereo;
+    Eigen::Vector3d obs;            // (u,v,uR) for points, (nx,ny,-d) for lines
+    Eigen::Vector3d XSc, XEc;       // back-projected endpoints of stereo lines
+    double invSigma2;
+};
+
+struct Scene
+{
+    vector<g2o::SE3Quat> vTcw;                          // initial guesses
+    vector<Eigen::Vector3d> vPoints;
+    vector<g2o::Vector6d, Eigen::aligned_allocator<g2o::Vector6d> > vLines;
+    vector<Observation> vPointObs, vLineObs;
+};
+
+static double ElapsedMs(const std::chrono::steady_clock::time_point& t0, const std::chrono::steady_clock::time_point& t1)
+{
+    return std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t1 - t0).count();
+}
+
+static Scene GenerateScene(std::mt19937& gen, const int nKFs, const int nPoints, const int nLines, const double outlierRatio)
+{
+    std::normal_distribution<double> gauss(0., 1.);
+    std::uniform_real_distribution<double> uniform(0., 1.);
+
+    Scene scene;
+    vector<g2o::SE3Quat> vTcw_true(nKFs);
+    for(int k=0; k<nKFs; k++)
+    {
+        const Eigen::Vector3d twc(0.1*k, 0.02*gauss(gen), 0.1*k);
+        const Eigen::Quaterniond qwc = Eigen::Quaterniond(Eigen::AngleAxisd(0.02*k, Eigen::Vector3d::UnitY()));
+        vTcw_true[k] = g2o::SE3Quat(qwc, twc).inverse();
+
+        const Eigen::Matrix<double,6,1> noise = (Eigen::Matrix<double,6,1>() << 0.01*gauss(gen), 0.01*gauss(gen), 0.01*gauss(gen),
+                                                                                0.02*gauss(gen), 0.02*gauss(gen), 0.02*gauss(gen)).finished();
+        scene.vTcw.push_back(k < 2 ? vTcw_true[k] : g2o::SE3Quat::exp(noise)*vTcw_true[k]);
+    }
+
+    // a landmark is sampled in the frustum of an anchor keyframe and observed by a few consecutive keyframes
+    auto sampleInKF = [&](const int k)
+    {
+        const double depth = 1. + 5.*uniform(gen);
+        const Eigen::Vector3d Xc((640.*uniform(gen) - cx)*depth/fx, (480.*uniform(gen) - cy)*depth/fy, depth);
+        return vTcw_true[k].inverse().map(Xc);
+    };
+    auto observers = [&](const int anchor)
+    {
+        const int span = 2 + (int)(7*uniform(gen));
+        vector<int> vKFs;
+        for(int k=anchor; k<std::min(nKFs, anchor+span); k++)
+            vKFs.push_back(k);
+        return vKFs;
+    };
+    auto project = [&](const Eigen::Vector3d& Xc, const double sigma)
+    {
+        return Eigen::Vector3d(fx*Xc(0)/Xc(2) + cx + sigma*gauss(gen), fy*Xc(1)/Xc(2) + cy + sigma*gauss(gen), 1.);
+    };
+
+    for(int i=0; i<nPoints; i++)
+    {
+        const int anchor = (int)(uniform(gen)*(nKFs-1));
+        const Eigen::Vector3d Xw = sampleInKF(anchor);
+        scene.vPoints.push_back(Xw + 0.05*Eigen::Vector3d(gauss(gen), gauss(gen), gauss(gen)));
+        for(const int k : observers(anchor))
+        {
+            Observation o;
+            o.kf = k; o.landmark = i; o.bStereo = uniform(gen) < 0.5;
+            const int octave = (int)(8*uniform(gen));
+            o.invSigma2 = 1./pow(1.2, 2*octave);
+            const double sigma = (uniform(gen) < outlierRatio) ? 30. : pow(1.2, octave);
+            const Eigen::Vector3d Xc = vTcw_true[k].map(Xw);
+            const Eigen::Vector3d p = project(Xc, sigma);
+            o.obs << p(0), p(1), p(0) - bf/Xc(2) + 0.5*sigma*gauss(gen);
+            scene.vPointObs.push_back(o);
+        }
+    }
+
+    for(int i=0; i<nLines; i++)
+    {
+        const int anchor = (int)(uniform(gen)*(nKFs-1));
+        const Eigen::Vector3d XSw = sampleInKF(anchor);
+        const Eigen::Vector3d XEw = sampleInKF(anchor);
+        g2o::Vector6d line;
+        line << XSw + 0.05*Eigen::Vector3d(gauss(gen), gauss(gen), gauss(gen)), XEw + 0.05*Eigen::Vector3d(gauss(gen), gauss(gen), gauss(gen));
+        scene.vLines.push_back(line);
+        for(const int k : observers(anchor))
+        {
+            Observation o;
+            o.kf = k; o.landmark = i; o.bStereo = uniform(gen) < 0.5;
+            const int octave = (int)(8*uniform(gen));
+            o.invSigma2 = 1./pow(1.2, 2*octave);
+            const double sigma = (uniform(gen) < outlierRatio) ? 30. : pow(1.2, octave);
+            const Eigen::Vector3d XSc = vTcw_true[k].map(XSw);
+            const Eigen::Vector3d XEc = vTcw_true[k].map(XEw);
+            const Eigen::Vector3d l = project(XSc, sigma).cross(project(XEc, sigma));
+            o.obs = l/l.head<2>().norm();
+            o.XSc = XSc + 0.01*sigma*Eigen::Vector3d(gauss(gen), gauss(gen), gauss(gen));
+            o.XEc = XEc + 0.01*sigma*Eigen::Vector3d(gauss(gen), gauss(gen), gauss(gen));
+            scene.vLineObs.push_back(o);
+        }
+    }
+    return scene;
+}
+
+// The graph of Optimizer::BundleAdjustment() (pinhole camera, default information matrices)
+static void BuildGraph(g2o::SparseOptimizer& optimizer, const Scene& scene, const int numThreads)
+{
+    g2o::OptimizationAlgorithmLevenberg* solver;
+    if(!scene.vLines.empty())
+        solver = new g2o::OptimizationAlgorithmLevenberg(new g2o::BlockSolverX(new g2o::LinearSolverEigen<g2o::BlockSolverX::PoseMatrixType>()));
+    else
+        solver = new g2o::OptimizationAlgorithmLevenberg(new g2o::BlockSolver_6_3(new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>()));
+    optimizer.setAlgorithm(solver);
+    optimizer.setNumThreads(numThreads);
+    optimizer.setVerbose(false);
+
+    const int nKFs = scene.vTcw.size();
+    for(int k=0; k<nKFs; k++)
+    {
+        g2o::VertexSE3Expmap* vSE3 = new g2o::VertexSE3Expmap();
+        vSE3->setEstimate(scene.vTcw[k]);
+        vSE3->setId(k);
+        vSE3->setFixed(k < 2);
+        optimizer.addVertex(vSE3);
+    }
+
+    const int pointIdOffset = nKFs;
+    for(size_t i=0; i<scene.vPoints.size(); i++)
+    {
+        g2o::VertexSBAPointXYZ* vPoint = new g2o::VertexSBAPointXYZ();
+        vPoint->setEstimate(scene.vPoints[i]);
+        vPoint->setId(pointIdOffset + i);
+        vPoint->setMarginalized(true);
+        optimizer.addVertex(vPoint);
+    }
+
+    const int lineIdOffset = pointIdOffset + scene.vPoints.size();
+    for(size_t i=0; i<scene.vLines.size(); i++)
+    {
+        g2o::VertexSBALine* vLine = new g2o::VertexSBALine();
+        vLine->setEstimate(scene.vLines[i]);
+        vLine->setId(lineIdOffset + i);
+        vLine->setMarginalized(true);
+        optimizer.addVertex(vLine);
+    }
+
+    for(const Observation& o : scene.vPointObs)
+    {
+        g2o::OptimizableGraph::Edge* pEdge;
+        g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
+        if(!o.bStereo)
+        {
+            g2o::EdgeSE3ProjectXYZ* e = new g2o::EdgeSE3ProjectXYZ();
+            e->setMeasurement(o.obs.head<2>());
+            e->setInformation(Eigen::Matrix2d::Identity()*o.invSigma2);
+            e->fx = fx; e->fy = fy; e->cx = cx; e->cy = cy;
+            rk->setDelta(sqrt(5.99));
+            pEdge = e;
+        }
+        else
+        {
+            g2o::EdgeStereoSE3ProjectXYZ* e = new g2o::EdgeStereoSE3ProjectXYZ();
+            e->setMeasurement(o.obs);
+            e->setInformation(Eigen::Matrix3d::Identity()*o.invSigma2);
+            e->fx = fx; e->fy = fy; e->cx = cx; e->cy = cy; e->bf = bf;
+            rk->setDelta(sqrt(7.815));
+            pEdge = e;
+        }
+        pEdge->setVertex(0, optimizer.vertex(pointIdOffset + o.landmark));
+        pEdge->setVertex(1, optimizer.vertex(o.kf));
+        pEdge->setRobustKernel(rk);
+        optimizer.addEdge(pEdge);
+    }
+
+    for(const Observation& o : scene.vLineObs)
+    {
+        g2o::OptimizableGraph::Edge* pEdge;
+        g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
+        if(!o.bStereo)
+        {
+            g2o::EdgeSE3ProjectLine* e = new g2o::EdgeSE3ProjectLine();
+            e->setMeasurement(o.obs);
+            e->setInformation(Eigen::Matrix2d::Identity()*o.invSigma2);
+            e->fx = fx; e->fy = fy; e->cx = cx; e->cy = cy;
+            rk->setDelta(sqrt(5.99));
+            pEdge = e;
+        }
+        else
+        {
+            g2o::EdgeSE3ProjectStereoLine* e = new g2o::EdgeSE3ProjectStereoLine();
+            e->setVertex(0, optimizer.vertex(lineIdOffset + o.landmark)); // needed by init()
+            e->setVertex(1, optimizer.vertex(o.kf));
+            e->setMeasurement(o.obs);
+            e->fx = fx; e->fy = fy; e->cx = cx; e->cy = cy;
+            e->XSbc = o.XSc;
+            e->XEbc = o.XEc;
+            e->lineLenghtInv = 1.0/(o.XSc - o.XEc).norm();
+            e->mu = kMuWeightForLine3dDist;
+            e->init();
+            Eigen::Matrix4d Info = Eigen::Matrix4d::Identity()*o.invSigma2;
+            Info(2,2) *= kInvSigma2PointLineDistance;
+            Info(3,3) *= kInvSigma2PointLineDistance;
+            e->setInformation(Info);
+            rk->setDelta(sqrt(9.49));
+            pEdge = e;
+        }
+        pEdge->setVertex(0, optimizer.vertex(lineIdOffset + o.landmark));
+        pEdge->setVertex(1, optimizer.vertex(o.kf));
+        pEdge->setRobustKernel(rk);
+        optimizer.addEdge(pEdge);
+    }
+
+    optimizer.initializeOptimization();
+}
+
+int main(int argc, char **argv)
+{
+    const int nWindows = (argc > 1) ? atoi(argv[1]) : 20;
+    const int nKFs = (argc > 2) ? atoi(argv[2]) : 20;
+    const int nPoints = (argc > 3) ? atoi(argv[3]) : 3000;
+    const int nLines = (argc > 4) ? atoi(argv[4]) : 300;
+    const int numThreads = (argc > 5) ? atoi(argv[5]) : 4;
+    const double outlierRatio = (argc > 6) ? atof(argv[6]) : 0.05;
+    const int nIterations = 10;
+
+    std::mt19937 gen(0);
+
+    double g2oMs = 0, solverMs = 0;
+    double g2oReduction = 0, solverReduction = 0;
+    double maxChi2RelDiff = 0;
+    int g2oIterations = 0, solverIterations = 0;
+    for(int w=0; w<nWindows; w++)
+    {
+        const Scene scene = GenerateScene(gen, nKFs, nPoints, nLines, outlierRatio);
+
+        g2o::SparseOptimizer g2oOptimizer;
+        BuildGraph(g2oOptimizer, scene, numThreads);
+        g2oOptimizer.computeActiveErrors();
+        const double g2oChi2Start = g2oOptimizer.activeRobustChi2();
+        auto t0 = std::chrono::steady_clock::now();
+        g2oIterations += g2oOptimizer.optimize(nIterations);
+        auto t1 = std::chrono::steady_clock::now();
+        g2oOptimizer.computeActiveErrors();
+        const double g2oChi2End = g2oOptimizer.activeRobustChi2();
+
+        g2o::SparseOptimizer solverOptimizer;
+        BuildGraph(solverOptimizer, scene, numThreads);
+        PLVS2::BASolver solver;
+        PLVS2::BASolver::Params params;
+        params.numThreads = numThreads;
+        solver.SetParams(params);
+        auto t2 = std::chrono::steady_clock::now();
+        if(!solver.Init(&solverOptimizer))
+        {
+            cerr << "BASolver: unsupported graph" << endl;
+            return 1;
+        }
+        solverIterations += solver.Optimize(nIterations);
+        auto t3 = std::chrono::steady_clock::now();
+
+        g2oMs += ElapsedMs(t0,t1);
+        solverMs += ElapsedMs(t2,t3);
+        g2oReduction += g2oChi2Start - g2oChi2End;
+        solverReduction += solver.InitialChi2() - solver.FinalChi2();
+        maxChi2RelDiff = std::max(maxChi2RelDiff, fabs(solver.FinalChi2() - g2oChi2End)/g2oChi2End);
+    }
+
+    cout << "windows: " << nWindows << ", keyframes/window: " << nKFs << " (2 fixed), points: " << nPoints << ", lines: " << nLines
+         << ", threads: " << numThreads << ", outlier ratio: " << outlierRatio << endl;
+    cout << "g2o        - time/window: " << g2oMs/nWindows << " ms, iterations/window: " << (double)g2oIterations/nWindows
+         << ", cost reduction/ms: " << g2oReduction/g2oMs << endl;
+    cout << "BASolver   - time/window: " << solverMs/nWindows << " ms, iterations/window: " << (double)solverIterations/nWindows
+         << ", cost reduction/ms: " << solverReduction/solverMs << ", speedup: " << g2oMs/solverMs << endl;
+    cout << "max relative difference of the final costs: " << maxChi2RelDiff << endl;
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Check that the atlas files keep their format with FeatureGrid.
+// The former KeyFrame grids were nested vectors [cols][rows][indices] serialized with "ar & mGrid": an archive with
+// a sequence of such grids (as in KeyFrame::serialize()) is written with the former types, then
+// - it is loaded into FeatureGrid objects, which must have the same cells;
+// - the FeatureGrid objects are saved again, which must give the same bytes.
+// Both the text archive and the binary archive (without header, as in System) are checked.
+
+#include <iostream>
+#include <sstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+
+#include "FeatureGrid.h"
+
+using namespace std;
+using namespace PLVS2;
+
+typedef vector<vector<vector<size_t> > > NestedGrid;
+
+NestedGrid RandomGrid(int cols, int rows, int numFeatures, std::mt19937& rng)
+{
+    NestedGrid grid(cols, vector<vector<size_t> >(rows));
+    std::uniform_int_distribution<int> cell(0, cols*rows-1);
+    for(int i=0; i<numFeatures; i++)
+    {
+        const int c = cell(rng);
+        grid[c/rows][c%rows].push_back(i);
+    }
+    return grid;
+}
+
+bool SameCells(const NestedGrid& nested, const FeatureGrid& grid)
+{
+    if(nested.empty()) return grid.IsEmpty();
+    if(grid.Cols() != (int)nested.size() || grid.Rows() != (int)nested[0].size()) return false;
+    for(int ix=0; ix<grid.Cols(); ix++)
+    {
+        for(int iy=0; iy<grid.Rows(); iy++)
+        {
+            const FeatureGrid::Span cell = grid.Cell(ix, iy);
+            if(!std::equal(cell.begin(), cell.end(), nested[ix][iy].begin(), nested[ix][iy].end())) return false;
+        }
+    }
+    return true;
+}
+
+template<class OArchive, class IArchive>
+bool Check(const string& name, const vector<NestedGrid>& vNested, const int sentinel)
+{
+    // archive written with the former types
+    std::stringstream ssFormer;
+    {
+        OArchive oa(ssFormer, boost::archive::no_header);
+        for(const NestedGrid& nested : vNested) oa & nested;
+        oa & sentinel;
+    }
+
+    // loaded into FeatureGrid
+    vector<FeatureGrid> vGrids(vNested.size());
+    int loadedSentinel = 0;
+    {
+        std::stringstream ss(ssFormer.str());
+        IArchive ia(ss, boost::archive::no_header);
+        for(FeatureGrid& grid : vGrids) ia & grid;
+        ia & loadedSentinel;
+    }
+
+    bool bOk = (loadedSentinel == sentinel);
+    for(size_t i=0; i<vNested.size(); i++)
+        bOk = bOk && SameCells(vNested[i], vGrids[i]);
+
+    // saved again from FeatureGrid
+    std::stringstream ssNew;
+    {
+        OArchive oa(ssNew, boost::archive::no_header);
+        for(const FeatureGrid& grid : vGrids) oa & grid;
+        oa & sentinel;
+    }
+    const bool bSameBytes = (ssNew.str() == ssFormer.str());
+
+    cout << name << ": load " << (bOk ? "ok" : "FAILED") << ", bytes " << (bSameBytes ? "identical" : "DIFFERENT")
+         << " (" << ssFormer.str().size() << " bytes)" << endl;
+    return bOk && bSameBytes;
+}
+
+int main()
+{
+    std::mt19937 rng(0);
+
+    // as in KeyFrame::serialize(): point and line grids of the left and right images (the right ones are empty without a second camera)
+    vector<NestedGrid> vNested;
+    vNested.push_back(RandomGrid(64, 48, 1500, rng));
+    vNested.push_back(RandomGrid(160, 36, 300, rng));
+    vNested.push_back(NestedGrid());
+    vNested.push_back(RandomGrid(64, 48, 0, rng));
+
+    bool bOk = true;
+    bOk = Check<boost::archive::text_oarchive, boost::archive::text_iarchive>("text archive", vNested, 12345) && bOk;
+    bOk = Check<boost::archive::binary_oarchive, boost::archive::binary_iarchive>("binary archive", vNested, 12345) && bOk;
+
+    cout << (bOk ? "PASSED" : "FAILED") << endl;
+    return bOk ? 0 : 1;
+}
@@ -0,0 +1,187 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Count the heap allocations of the grid searches issued by the matchers on the frames of a TUM sequence.
+// Each keypoint of frame k is used as a projected map point and searched in frame k+1 (same window and levels as
+// ORBmatcher::SearchByProjection()) with:
+// - the former API, which returns a new vector for each query;
+// - the buffer API, which writes the indices in a vector reused across the queries (as the matchers do now).
+// Allocations are counted by replacing the global operator new/delete of this executable.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "Frame.h"
+#include "ORBextractor.h"
+#include "CameraModels/Pinhole.h"
+
+using namespace std;
+
+static std::atomic<size_t> gNumAllocations(0);
+static std::atomic<size_t> gNumAllocatedBytes(0);
+
+void* operator new(size_t size)
+{
+    gNumAllocations++;
+    gNumAllocatedBytes += size;
+    void* p = std::malloc(size ? size : 1);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+void LoadImages(const string &strFile, vector<string> &vstrImageFilenames);
+
+static double ElapsedMs(const std::chrono::steady_clock::time_point& t0, const std::chrono::steady_clock::time_point& t1)
+{
+    return std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t1 - t0).count();
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2)
+    {
+        cerr << endl << "Usage: ./grid_search_alloc_benchmark path_to_tum_sequence [max_num_images] [search_radius]" << endl;
+        return 1;
+    }
+
+    vector<string> vstrImageFilenames;
+    LoadImages(string(argv[1])+"/rgb.txt", vstrImageFilenames);
+
+    const int nImages = (argc > 2) ? std::min(atoi(argv[2]), (int)vstrImageFilenames.size()) : vstrImageFilenames.size();
+    const float th = (argc > 3) ? atof(argv[3]) : 3.f;
+
+    // TUM freiburg1 intrinsics (the images are used as they are: no undistortion)
+    vector<float> vCamCalib = {517.306408f, 516.469215f, 318.643040f, 255.313989f};
+    PLVS2::Pinhole camera(vCamCalib);
+    cv::Mat distCoef = cv::Mat::zeros(4,1,CV_32F);
+
+    PLVS2::ORBextractor extractor(1000, 1.2, 8, 20, 7);
+
+    vector<PLVS2::Frame> vFrames;
+    vFrames.reserve(nImages);
+    for(int ni=0; ni<nImages; ni++)
+    {
+        cv::Mat im = cv::imread(string(argv[1])+"/"+vstrImageFilenames[ni], cv::IMREAD_GRAYSCALE);
+        if(im.empty())
+        {
+            cerr << "Failed to load image at: " << vstrImageFilenames[ni] << endl;
+            return 1;
+        }
+        vFrames.push_back(PLVS2::Frame(im, ni, &extractor, nullptr, &camera, distCoef, 0.f, 0.f));
+    }
+    if(vFrames.size() < 2)
+    {
+        cerr << "At least two images are needed" << endl;
+        return 1;
+    }
+
+    const int nFramePairs = vFrames.size()-1;
+    size_t numQueries = 0;
+    for(int k=0; k<nFramePairs; k++) numQueries += vFrames[k].N;
+
+    // former API: a new vector for each query
+    size_t referenceChecksum = 0;
+    size_t allocations0 = gNumAllocations, bytes0 = gNumAllocatedBytes;
+    auto t0 = std::chrono::steady_clock::now();
+    for(int k=0; k<nFramePairs; k++)
+    {
+        const PLVS2::Frame& F1 = vFrames[k];
+        const PLVS2::Frame& F2 = vFrames[k+1];
+        for(int i=0; i<F1.N; i++)
+        {
+            const cv::KeyPoint& kp = F1.mvKeysUn[i];
+            const vector<size_t> vIndices = F2.GetFeaturesInArea(kp.pt.x, kp.pt.y, th*F2.mvScaleFactors[kp.octave], kp.octave-1, kp.octave);
+            for(const size_t idx : vIndices) referenceChecksum += idx;
+        }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    const size_t valueAllocations = gNumAllocations - allocations0;
+    const size_t valueBytes = gNumAllocatedBytes - bytes0;
+
+    // buffer API: one vector reused across the queries of a frame
+    size_t checksum = 0;
+    allocations0 = gNumAllocations; bytes0 = gNumAllocatedBytes;
+    auto t2 = std::chrono::steady_clock::now();
+    for(int k=0; k<nFramePairs; k++)
+    {
+        const PLVS2::Frame& F1 = vFrames[k];
+        const PLVS2::Frame& F2 = vFrames[k+1];
+        vector<size_t> vIndices;
+        for(int i=0; i<F1.N; i++)
+        {
+            const cv::KeyPoint& kp = F1.mvKeysUn[i];
+            F2.GetFeaturesInArea(kp.pt.x, kp.pt.y, th*F2.mvScaleFactors[kp.octave], kp.octave-1, kp.octave, false, vIndices);
+            for(const size_t idx : vIndices) checksum += idx;
+        }
+    }
+    auto t3 = std::chrono::steady_clock::now();
+    const size_t bufferAllocations = gNumAllocations - allocations0;
+    const size_t bufferBytes = gNumAllocatedBytes - bytes0;
+
+    cout << "frame pairs: " << nFramePairs << ", queries: " << numQueries << endl;
+    cout << "returned vector - allocations/frame: " << (double)valueAllocations/nFramePairs
+         << ", KB/frame: " << (double)valueBytes/nFramePairs/1024. << ", time: " << ElapsedMs(t0,t1) << " ms" << endl;
+    cout << "reused buffer   - allocations/frame: " << (double)bufferAllocations/nFramePairs
+         << ", KB/frame: " << (double)bufferBytes/nFramePairs/1024. << ", time: " << ElapsedMs(t2,t3) << " ms"
+         << (checksum == referenceChecksum ? "" : " MISMATCH") << endl;
+
+    return (checksum == referenceChecksum) ? 0 : 1;
+}
+
+void LoadImages(const string &strFile, vector<string> &vstrImageFilenames)
+{
+    ifstream f;
+    f.open(strFile.c_str());
+
+    // skip first three lines
+    string s0;
+    getline(f,s0);
+    getline(f,s0);
+    getline(f,s0);
+
+    while(!f.eof())
+    {
+        string s;
+        getline(f,s);
+        if(!s.empty())
+        {
+            stringstream ss;
+            ss << s;
+            double t;
+            string sRGB;
+            ss >> t;
+            ss >> sRGB;
+            vstrImageFilenames.push_back(sRGB);
+        }
+    }
+}
@@ -0,0 +1,337 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Replay recorded matcher workloads with the per-pair descriptor distance and with the batch Hamming distance engine.
+// A workload is recorded from consecutive frames of a TUM sequence:
+// - points: each ORB keypoint of frame k is compared with the keypoints of frame k+1 inside a window around its position
+//   and in the adjacent pyramid levels (as in ORBmatcher::SearchByProjection());
+// - lines: the LBD descriptors of frame k are 2-NN matched against the ones of frame k+1 (as in LineMatcher::SearchByKnn()).
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <line_descriptor_custom.hpp>
+
+#include "ORBextractor.h"
+#include "ORBmatcher.h"
+#include "LineExtractor.h"
+#include "HammingDistance.h"
+
+using namespace std;
+
+struct FramePairWorkload
+{
+    cv::Mat pointQueries, pointTrain;
+    vector<vector<int> > vPointCandidates; // for each point query, the indices of the train candidates
+    cv::Mat lineQueries, lineTrain;
+};
+
+void LoadImages(const string &strFile, vector<string> &vstrImageFilenames);
+bool RecordWorkload(const string& strSequence, const int nMaxImages, const float radius, vector<FramePairWorkload>& vWorkload);
+void SaveWorkload(const string& strFile, const vector<FramePairWorkload>& vWorkload);
+bool LoadWorkload(const string& strFile, vector<FramePairWorkload>& vWorkload);
+
+static double ElapsedMs(const std::chrono::steady_clock::time_point& t0, const std::chrono::steady_clock::time_point& t1)
+{
+    return std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t1 - t0).count();
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2)
+    {
+        cerr << endl << "Usage: ./hamming_distance_benchmark workload_file [path_to_tum_sequence] [max_num_images] [search_radius]" << endl;
+        cerr << "If the sequence is given, the workload is first recorded in workload_file and then replayed." << endl;
+        return 1;
+    }
+
+    const string strWorkloadFile = argv[1];
+    vector<FramePairWorkload> vWorkload;
+
+    if(argc > 2)
+    {
+        const int nMaxImages = (argc > 3) ? atoi(argv[3]) : 100;
+        const float radius = (argc > 4) ? atof(argv[4]) : 15.f;
+        if(!RecordWorkload(argv[2], nMaxImages, radius, vWorkload))
+            return 1;
+        SaveWorkload(strWorkloadFile, vWorkload);
+        cout << "recorded " << vWorkload.size() << " frame pairs in " << strWorkloadFile << endl;
+    }
+    else if(!LoadWorkload(strWorkloadFile, vWorkload))
+    {
+        cerr << "Failed to load workload " << strWorkloadFile << endl;
+        return 1;
+    }
+
+    size_t numPointQueries = 0, numPointPairs = 0, numLineQueries = 0;
+    for(const FramePairWorkload& w : vWorkload)
+    {
+        numPointQueries += w.vPointCandidates.size();
+        for(const vector<int>& vCandidates : w.vPointCandidates) numPointPairs += vCandidates.size();
+        numLineQueries += w.lineQueries.rows;
+    }
+    cout << "frame pairs: " << vWorkload.size() << ", point queries: " << numPointQueries << ", point distances: " << numPointPairs
+         << ", line queries: " << numLineQueries << endl;
+
+    // points: per-pair distance on cv::Mat rows (the former matcher loops)
+    long referenceChecksum = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for(const FramePairWorkload& w : vWorkload)
+    {
+        for(size_t i=0; i<w.vPointCandidates.size(); i++)
+        {
+            const cv::Mat q = w.pointQueries.row(i);
+            for(const int idx : w.vPointCandidates[i])
+            {
+                const cv::Mat &d = w.pointTrain.row(idx);
+                referenceChecksum += PLVS2::ORBmatcher::DescriptorDistance(q, d);
+            }
+        }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    cout << "points - per-pair distance: " << ElapsedMs(t0,t1) << " ms" << endl;
+
+    // points: batch one-vs-many distances with each supported implementation
+    bool bOk = true;
+    const PLVS2::HammingDistance::SimdType bestType = PLVS2::HammingDistance::GetBestSimdType();
+    vector<PLVS2::HammingDistance::SimdType> vTypes = {PLVS2::HammingDistance::kScalar};
+    if(bestType == PLVS2::HammingDistance::kAVX512) vTypes.push_back(PLVS2::HammingDistance::kAVX2);
+    if(bestType != PLVS2::HammingDistance::kScalar) vTypes.push_back(bestType);
+
+    vector<int> vDistances;
+    for(const PLVS2::HammingDistance::SimdType type : vTypes)
+    {
+        PLVS2::HammingDistance::SetSimdType(type);
+        long checksum = 0;
+        t0 = std::chrono::steady_clock::now();
+        for(const FramePairWorkload& w : vWorkload)
+        {
+            for(size_t i=0; i<w.vPointCandidates.size(); i++)
+            {
+                PLVS2::HammingDistance::ComputeDistances(w.pointQueries.row(i), w.pointTrain, w.vPointCandidates[i], vDistances);
+                for(const int dist : vDistances) checksum += dist;
+            }
+        }
+        t1 = std::chrono::steady_clock::now();
+        cout << "points - batch " << PLVS2::HammingDistance::GetSimdTypeName(type) << ": " << ElapsedMs(t0,t1) << " ms"
+             << (checksum == referenceChecksum ? "" : " MISMATCH") << endl;
+        bOk = bOk && (checksum == referenceChecksum);
+    }
+
+    // lines: 2-NN search with the multi-index hashing matcher (the former LineMatcher path) and with the batch engine
+    cv::Ptr<cv::line_descriptor_c::BinaryDescriptorMatcher> bdm = cv::line_descriptor_c::BinaryDescriptorMatcher::createBinaryDescriptorMatcher();
+    long referenceLineChecksum = 0;
+    t0 = std::chrono::steady_clock::now();
+    for(const FramePairWorkload& w : vWorkload)
+    {
+        if(w.lineQueries.empty() || w.lineTrain.rows < 2) continue;
+        vector<vector<cv::DMatch> > lmatches;
+        bdm->knnMatch(w.lineQueries, w.lineTrain, lmatches, 2, cv::Mat(), true);
+        for(const vector<cv::DMatch>& m : lmatches) referenceLineChecksum += (long)m[0].distance + (long)m[1].distance;
+    }
+    t1 = std::chrono::steady_clock::now();
+    cout << "lines - knnMatch: " << ElapsedMs(t0,t1) << " ms" << endl;
+
+    for(const PLVS2::HammingDistance::SimdType type : vTypes)
+    {
+        PLVS2::HammingDistance::SetSimdType(type);
+        long checksum = 0;
+        t0 = std::chrono::steady_clock::now();
+        for(const FramePairWorkload& w : vWorkload)
+        {
+            if(w.lineQueries.empty() || w.lineTrain.rows < 2) continue;
+            vector<int> vBestIdx, vBestDist, vSecondIdx, vSecondDist;
+            PLVS2::HammingDistance::MatchBestTwo(w.lineQueries, w.lineTrain, cv::Mat(), vBestIdx, vBestDist, vSecondIdx, vSecondDist);
+            for(size_t i=0; i<vBestDist.size(); i++) checksum += vBestDist[i] + vSecondDist[i];
+        }
+        t1 = std::chrono::steady_clock::now();
+        // N.B.: ties can be resolved with different train indices, the distances must be the same
+        cout << "lines - batch 2-NN " << PLVS2::HammingDistance::GetSimdTypeName(type) << ": " << ElapsedMs(t0,t1) << " ms"
+             << (checksum == referenceLineChecksum ? "" : " MISMATCH") << endl;
+        bOk = bOk && (checksum == referenceLineChecksum);
+    }
+
+    PLVS2::HammingDistance::SetSimdType(bestType);
+
+    return bOk ? 0 : 1;
+}
+
+bool RecordWorkload(const string& strSequence, const int nMaxImages, const float radius, vector<FramePairWorkload>& vWorkload)
+{
+    vector<string> vstrImageFilenames;
+    LoadImages(strSequence+"/rgb.txt", vstrImageFilenames);
+    const int nImages = std::min(nMaxImages, (int)vstrImageFilenames.size());
+
+    PLVS2::ORBextractor orbExtractor(1000, 1.2, 8, 20, 7);
+
+    cv::line_descriptor_c::LSDDetectorC::LSDOptions lsdOptions;
+    lsdOptions.numOctaves = PLVS2::LineExtractor::kNumOctavesForBdDefault;
+    lsdOptions.scale = PLVS2::LineExtractor::kScaleFactorDefault;
+    lsdOptions.min_length = 0.025;
+    PLVS2::LineExtractor lineExtractor(100, lsdOptions);
+
+    vector<cv::KeyPoint> vPrevKeys;
+    cv::Mat prevDescriptors, prevLineDescriptors;
+
+    for(int ni=0; ni<nImages; ni++)
+    {
+        cv::Mat im = cv::imread(strSequence+"/"+vstrImageFilenames[ni], cv::IMREAD_GRAYSCALE);
+        if(im.empty())
+        {
+            cerr << "Failed to load image at: " << vstrImageFilenames[ni] << endl;
+            return false;
+        }
+
+        vector<cv::KeyPoint> vKeys;
+        cv::Mat descriptors;
+        vector<int> vLapping = {0,0};
+        orbExtractor(im, cv::Mat(), vKeys, descriptors, vLapping);
+
+        vector<cv::line_descriptor_c::KeyLine> vKeyLines;
+        cv::Mat lineDescriptors;
+        lineExtractor(im, vKeyLines, lineDescriptors);
+
+        if(ni > 0)
+        {
+            FramePairWorkload w;
+            w.pointQueries = prevDescriptors;
+            w.pointTrain = descriptors;
+            w.vPointCandidates.resize(vPrevKeys.size());
+            for(size_t i=0; i<vPrevKeys.size(); i++)
+            {
+                const cv::KeyPoint& kp1 = vPrevKeys[i];
+                for(size_t j=0; j<vKeys.size(); j++)
+                {
+                    const cv::KeyPoint& kp2 = vKeys[j];
+                    if(kp2.octave < kp1.octave-1 || kp2.octave > kp1.octave+1) continue;
+                    if(fabs(kp2.pt.x-kp1.pt.x) > radius || fabs(kp2.pt.y-kp1.pt.y) > radius) continue;
+                    w.vPointCandidates[i].push_back(j);
+                }
+            }
+            w.lineQueries = prevLineDescriptors;
+            w.lineTrain = lineDescriptors;
+            vWorkload.push_back(w);
+        }
+
+        vPrevKeys = vKeys;
+        prevDescriptors = descriptors.clone();
+        prevLineDescriptors = lineDescriptors.clone();
+    }
+    return true;
+}
+
+static void WriteMat(ofstream& f, const cv::Mat& mat)
+{
+    const int rows = mat.rows, cols = mat.cols;
+    f.write((const char*)&rows, sizeof(int));
+    f.write((const char*)&cols, sizeof(int));
+    for(int i=0; i<rows; i++)
+        f.write((const char*)mat.ptr(i), cols);
+}
+
+static void ReadMat(ifstream& f, cv::Mat& mat)
+{
+    int rows = 0, cols = 0;
+    f.read((char*)&rows, sizeof(int));
+    f.read((char*)&cols, sizeof(int));
+    mat = cv::Mat(rows, cols, CV_8UC1);
+    for(int i=0; i<rows; i++)
+        f.read((char*)mat.ptr(i), cols);
+}
+
+void SaveWorkload(const string& strFile, const vector<FramePairWorkload>& vWorkload)
+{
+    ofstream f(strFile.c_str(), ios::binary);
+    const int numPairs = vWorkload.size();
+    f.write((const char*)&numPairs, sizeof(int));
+    for(const FramePairWorkload& w : vWorkload)
+    {
+        WriteMat(f, w.pointQueries);
+        WriteMat(f, w.pointTrain);
+        for(const vector<int>& vCandidates : w.vPointCandidates)
+        {
+            const int n = vCandidates.size();
+            f.write((const char*)&n, sizeof(int));
+            if(n > 0) f.write((const char*)vCandidates.data(), n*sizeof(int));
+        }
+        WriteMat(f, w.lineQueries);
+        WriteMat(f, w.lineTrain);
+    }
+}
+
+bool LoadWorkload(const string& strFile, vector<FramePairWorkload>& vWorkload)
+{
+    ifstream f(strFile.c_str(), ios::binary);
+    if(!f.is_open())
+        return false;
+
+    int numPairs = 0;
+    f.read((char*)&numPairs, sizeof(int));
+    vWorkload.resize(numPairs);
+    for(FramePairWorkload& w : vWorkload)
+    {
+        ReadMat(f, w.pointQueries);
+        ReadMat(f, w.pointTrain);
+        w.vPointCandidates.resize(w.pointQueries.rows);
+        for(vector<int>& vCandidates : w.vPointCandidates)
+        {
+            int n = 0;
+            f.read((char*)&n, sizeof(int));
+            vCandidates.resize(n);
+            if(n > 0) f.read((char*)vCandidates.data(), n*sizeof(int));
+        }
+        ReadMat(f, w.lineQueries);
+        ReadMat(f, w.lineTrain);
+    }
+    return f.good();
+}
+
+void LoadImages(const string &strFile, vector<string> &vstrImageFilenames)
+{
+    ifstream f;
+    f.open(strFile.c_str());
+
+    // skip first three lines
+    string s0;
+    getline(f,s0);
+    getline(f,s0);
+    getline(f,s0);
+
+    while(!f.eof())
+    {
+        string s;
+        getline(f,s);
+        if(!s.empty())
+        {
+            stringstream ss;
+            ss << s;
+            double t;
+            string sRGB;
+            ss >> t;
+            ss >> sRGB;
+            vstrImageFilenames.push_back(sRGB);
+        }
+    }
+}
@@ -0,0 +1,148 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Compare the scalar rBRIEF descriptor loop with the vectorized kernel selected at runtime on the frames of a TUM sequence.
+// Keypoints are extracted with the standard ORBextractor; the descriptors of each pyramid level are then recomputed
+// with both implementations on the same filtered pyramid images and checked for equality.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "ORBextractor.h"
+#include "ORBdescriptorKernel.h"
+
+using namespace std;
+
+void LoadImages(const string &strFile, vector<string> &vstrImageFilenames);
+
+int main(int argc, char **argv)
+{
+    if(argc < 2)
+    {
+        cerr << endl << "Usage: ./orb_descriptor_benchmark path_to_tum_sequence [max_num_images] [num_features]" << endl;
+        return 1;
+    }
+
+    vector<string> vstrImageFilenames;
+    LoadImages(string(argv[1])+"/rgb.txt", vstrImageFilenames);
+
+    const int nImages = (argc > 2) ? std::min(atoi(argv[2]), (int)vstrImageFilenames.size()) : vstrImageFilenames.size();
+    const int nFeatures = (argc > 3) ? atoi(argv[3]) : 1000;
+
+    PLVS2::ORBextractor extractor(nFeatures, 1.2, 8, 20, 7);
+    PLVS2::ORBdescriptorKernel scalarKernel(extractor.GetPattern());
+    scalarKernel.SetSimdType(PLVS2::ORBdescriptorKernel::kScalar);
+    PLVS2::ORBdescriptorKernel simdKernel(extractor.GetPattern());
+
+    cout << "descriptor kernel: " << PLVS2::ORBdescriptorKernel::GetSimdTypeName(simdKernel.GetSimdType()) << endl;
+
+    double scalarTimeMs = 0, simdTimeMs = 0;
+    size_t numKeypoints = 0, numMismatches = 0;
+
+    for(int ni=0; ni<nImages; ni++)
+    {
+        cv::Mat im = cv::imread(string(argv[1])+"/"+vstrImageFilenames[ni], cv::IMREAD_GRAYSCALE);
+        if(im.empty())
+        {
+            cerr << "Failed to load image at: " << vstrImageFilenames[ni] << endl;
+            return 1;
+        }
+
+        vector<cv::KeyPoint> vKeys;
+        cv::Mat descriptors;
+        vector<int> vLapping = {0,0};
+        extractor(im, cv::Mat(), vKeys, descriptors, vLapping);
+
+        // group keypoints by level and bring them back to the level coordinates
+        const vector<float> vScaleFactors = extractor.GetScaleFactors();
+        vector<vector<cv::KeyPoint> > vLevelKeys(extractor.GetLevels());
+        for(const cv::KeyPoint& kp : vKeys)
+        {
+            cv::KeyPoint kpl = kp;
+            kpl.pt *= 1.f/vScaleFactors[kp.octave];
+            vLevelKeys[kp.octave].push_back(kpl);
+        }
+
+        for(int level=0; level<extractor.GetLevels(); level++)
+        {
+            if(vLevelKeys[level].empty()) continue;
+            const cv::Mat& img = extractor.mvImagePyramidFiltered[level];
+
+            cv::Mat descScalar, descSimd;
+
+            auto t0 = std::chrono::steady_clock::now();
+            scalarKernel.Compute(img, vLevelKeys[level], descScalar);
+            auto t1 = std::chrono::steady_clock::now();
+            simdKernel.Compute(img, vLevelKeys[level], descSimd);
+            auto t2 = std::chrono::steady_clock::now();
+
+            scalarTimeMs += std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t1 - t0).count();
+            simdTimeMs += std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t2 - t1).count();
+
+            numKeypoints += vLevelKeys[level].size();
+            for(int i=0; i<descScalar.rows; i++)
+            {
+                if(cv::norm(descScalar.row(i), descSimd.row(i), cv::NORM_HAMMING) != 0)
+                    numMismatches++;
+            }
+        }
+    }
+
+    cout << "images: " << nImages << ", keypoints: " << numKeypoints << endl;
+    cout << "scalar descriptors: " << scalarTimeMs << " ms (" << 1e3*scalarTimeMs/std::max(numKeypoints,size_t(1)) << " us/keypoint)" << endl;
+    cout << "simd descriptors: " << simdTimeMs << " ms (" << 1e3*simdTimeMs/std::max(numKeypoints,size_t(1)) << " us/keypoint)" << endl;
+    cout << "speed-up: " << scalarTimeMs/std::max(simdTimeMs,1e-9) << endl;
+    cout << "mismatching descriptors: " << numMismatches << endl;
+
+    return numMismatches == 0 ? 0 : 1;
+}
+
+void LoadImages(const string &strFile, vector<string> &vstrImageFilenames)
+{
+    ifstream f;
+    f.open(strFile.c_str());
+
+    // skip first three lines
+    string s0;
+    getline(f,s0);
+    getline(f,s0);
+    getline(f,s0);
+
+    while(!f.eof())
+    {
+        string s;
+        getline(f,s);
+        if(!s.empty())
+        {
+            stringstream ss;
+            ss << s;
+            double t;
+            string sRGB;
+            ss >> t;
+            ss >> sRGB;
+            vstrImageFilenames.push_back(sRGB);
+        }
+    }
+}
@@ -0,0 +1,282 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Latency of the essential graph optimization over a sequence of loop closures.
+// The pose graph is the essential graph of Optimizer::OptimizeEssentialGraph() (spanning tree, loop edges and covisibility
+// edges with weight >= 100) of the largest map of a saved atlas (.osa), or of a synthetic trajectory running several laps
+// of the same circuit if no atlas is given. Each loop closure optimizes the subgraph of the keyframes created so far
+// (the graph grows between two closures) starting from drifted poses, with 20 iterations and:
+// - the g2o linear solver of Optimizer::OptimizeEssentialGraph() (LinearSolverEigen: new ordering and analysis each time);
+// - PoseGraphLinearSolver, enabled by Optimizer.poseGraphSolver, with its symbolic analysis cached across the closures.
+//
+// usage: ./pose_graph_benchmark [atlas file (.osa) | -] [binary (0/1)] [number of loop closures] [number of synthetic keyframes]
+
+#include <iostream>
+#include <fstream>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+#include <unordered_map>
+
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/archive/binary_iarchive.hpp>
+
+#include "Thirdparty/g2o/g2o/core/block_solver.h"
+#include "Thirdparty/g2o/g2o/core/optimization_algorithm_levenberg.h"
+#include "Thirdparty/g2o/g2o/solvers/linear_solver_eigen.h"
+#include "Thirdparty/g2o/g2o/types/types_seven_dof_expmap.h"
+
+#include "Atlas.h"
+#include "KeyFrameDatabase.h"
+#include "PoseGraphSolver.h"
+
+using namespace std;
+
+struct PoseGraph
+{
+    vector<int> vIds;                                                // keyframe ids (ascending)
+    vector<g2o::Sim3, Eigen::aligned_allocator<g2o::Sim3> > vScw;   // consistent poses
+    vector<pair<int,int> > vEdges;                                   // (i,j) indices in vIds with j<i
+};
+
+static double ElapsedMs(const std::chrono::steady_clock::time_point& t0, const std::chrono::steady_clock::time_point& t1)
+{
+    return std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t1 - t0).count();
+}
+
+// The essential graph of the largest map of the atlas
+static bool LoadAtlasGraph(const string& filename, const bool bBinary, PoseGraph& graph)
+{
+    std::ifstream in(filename, std::ios_base::binary);
+    if(!in)
+    {
+        cerr << "Cannot open atlas file: " << filename << endl;
+        return false;
+    }
+
+    string strFileVoc, strVocChecksum;
+    PLVS2::Atlas* pAtlas;
+    PLVS2::KeyFrameDatabase* pKeyFrameDatabase;
+    if(bBinary)
+    {
+        boost::archive::binary_iarchive ia(in);
+        ia >> strFileVoc >> strVocChecksum >> pAtlas >> pKeyFrameDatabase;
+    }
+    else
+    {
+        boost::archive::text_iarchive ia(in);
+        ia >> strFileVoc >> strVocChecksum >> pAtlas >> pKeyFrameDatabase;
+    }
+
+    PLVS2::Map* pMap = nullptr;
+    for(PLVS2::Map* pMi : pAtlas->GetAllMaps())
+        if(!pMap || pMi->KeyFramesInMap() > pMap->KeyFramesInMap())
+            pMap = pMi;
+    if(!pMap)
+        return false;
+
+    vector<PLVS2::KeyFramePtr> vpKFs;
+    for(PLVS2::KeyFramePtr pKF : pMap->GetAllKeyFrames())
+        if(!pKF->isBad())
+            vpKFs.push_back(pKF);
+    sort(vpKFs.begin(), vpKFs.end(), PLVS2::KeyFrame::lId);
+
+    std::unordered_map<unsigned long,int> indexOfId;
+    for(const PLVS2::KeyFramePtr& pKF : vpKFs)
+    {
+        indexOfId[pKF->mnId] = graph.vIds.size();
+        graph.vIds.push_back(pKF->mnId);
+        const Sophus::SE3d Tcw = pKF->GetPose().cast<double>();
+        graph.vScw.push_back(g2o::Sim3(Tcw.unit_quaternion(), Tcw.translation(), 1.0));
+    }
+
+    const int minFeat = 100;
+    set<pair<int,int> > sEdges;
+    auto addEdge = [&](const PLVS2::KeyFramePtr& pKFi, const PLVS2::KeyFramePtr& pKFj)
+    {
+        const auto iti = indexOfId.find(pKFi->mnId), itj = indexOfId.find(pKFj->mnId);
+        if(iti == indexOfId.end() || itj == indexOfId.end() || iti->second == itj->second)
+            return;
+        const pair<int,int> edge(max(iti->second, itj->second), min(iti->second, itj->second));
+        if(sEdges.insert(edge).second)
+            graph.vEdges.push_back(edge);
+    };
+    for(const PLVS2::KeyFramePtr& pKF : vpKFs)
+    {
+        if(pKF->GetParent())
+            addEdge(pKF, pKF->GetParent());
+        for(const PLVS2::KeyFramePtr& pLKF : pKF->GetLoopEdges())
+            addEdge(pKF, pLKF);
+        for(const PLVS2::KeyFramePtr& pKFn : pKF->GetCovisiblesByWeight(minFeat))
+            if(!pKFn->isBad())
+                addEdge(pKF, pKFn);
+    }
+    return true;
+}
+
+// A trajectory running laps of a circuit of 200 keyframes: spanning tree, covisibility with the previous keyframes
+// and with the keyframes of the previous lap at the same place
+static PoseGraph GenerateGraph(const int nKFs)
+{
+    const int nKFsPerLap = 200;
+    PoseGraph graph;
+    for(int k=0; k<nKFs; k++)
+    {
+        const double angle = 2*M_PI*(k % nKFsPerLap)/nKFsPerLap;
+        const Eigen::Vector3d twc(10.*cos(angle), 0.5*sin(3*angle), 10.*sin(angle));
+        const Eigen::Quaterniond qwc(Eigen::AngleAxisd(-angle, Eigen::Vector3d::UnitY()));
+        const g2o::Sim3 Swc(qwc, twc, 1.0);
+        graph.vIds.push_back(k);
+        graph.vScw.push_back(Swc.inverse());
+
+        for(int j=max(0,k-4); j<k; j++)
+            graph.vEdges.push_back(make_pair(k,j));
+        if(k >= nKFsPerLap)
+        {
+            graph.vEdges.push_back(make_pair(k,k-nKFsPerLap));
+            graph.vEdges.push_back(make_pair(k,k-nKFsPerLap+1));
+        }
+    }
+    return graph;
+}
+
+// The subgraph of the first nKFs keyframes with drifted initial poses (first keyframe fixed) and noisy measurements
+static PLVS2::PoseGraphLinearSolver<7>* BuildGraph(g2o::SparseOptimizer& optimizer, const PoseGraph& graph, const int nKFs,
+                                                   PLVS2::PoseGraphSymbolicCache* pCache)
+{
+    g2o::BlockSolver_7_3::LinearSolverType* linearSolver;
+    PLVS2::PoseGraphLinearSolver<7>* pPoseGraphSolver = nullptr;
+    if(pCache)
+        linearSolver = pPoseGraphSolver = new PLVS2::PoseGraphLinearSolver<7>(pCache);
+    else
+        linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolver_7_3::PoseMatrixType>();
+    g2o::OptimizationAlgorithmLevenberg* solver = new g2o::OptimizationAlgorithmLevenberg(new g2o::BlockSolver_7_3(linearSolver));
+    solver->setUserLambdaInit(1e-16);
+    optimizer.setAlgorithm(solver);
+    optimizer.setVerbose(false);
+
+    std::mt19937 gen(0);
+    std::normal_distribution<double> gauss(0., 1.);
+    g2o::Sim3 drift;
+    for(int k=0; k<(int)graph.vIds.size(); k++)
+    {
+        Eigen::Matrix<double,7,1> noise;
+        noise << 0.002*gauss(gen), 0.002*gauss(gen), 0.002*gauss(gen), 0.005*gauss(gen), 0.005*gauss(gen), 0.005*gauss(gen), 0.001*gauss(gen);
+        drift = g2o::Sim3(noise)*drift;
+        if(k >= nKFs)
+            continue;
+
+        g2o::VertexSim3Expmap* VSim3 = new g2o::VertexSim3Expmap();
+        VSim3->setEstimate(graph.vScw[k]*drift);
+        VSim3->setId(graph.vIds[k]);
+        VSim3->setFixed(k == 0);
+        VSim3->_fix_scale = false;
+        optimizer.addVertex(VSim3);
+    }
+
+    // noisy relative poses (the same for all the subgraphs)
+    const Eigen::Matrix<double,7,7> matLambda = Eigen::Matrix<double,7,7>::Identity();
+    for(const pair<int,int>& edge : graph.vEdges)
+    {
+        Eigen::Matrix<double,7,1> noise;
+        noise << 0.001*gauss(gen), 0.001*gauss(gen), 0.001*gauss(gen), 0.002*gauss(gen), 0.002*gauss(gen), 0.002*gauss(gen), 0.;
+        const int i = edge.first, j = edge.second;
+        if(i >= nKFs)
+            continue;
+        g2o::EdgeSim3* e = new g2o::EdgeSim3();
+        e->setVertex(1, optimizer.vertex(graph.vIds[j]));
+        e->setVertex(0, optimizer.vertex(graph.vIds[i]));
+        e->setMeasurement(g2o::Sim3(noise)*graph.vScw[j]*graph.vScw[i].inverse());
+        e->information() = matLambda;
+        optimizer.addEdge(e);
+    }
+
+    optimizer.initializeOptimization();
+    optimizer.computeActiveErrors();
+    if(pPoseGraphSolver)
+        pPoseGraphSolver->SetBlockKeys(optimizer);
+    return pPoseGraphSolver;
+}
+
+int main(int argc, char **argv)
+{
+    const string strAtlasFile = (argc > 1) ? argv[1] : "-";
+    const bool bBinary = (argc > 2) ? atoi(argv[2]) != 0 : true;
+    const int nLoopClosures = (argc > 3) ? atoi(argv[3]) : 10;
+    const int nSyntheticKFs = (argc > 4) ? atoi(argv[4]) : 2000;
+    const int nIterations = 20;
+
+    PoseGraph graph;
+    if(strAtlasFile != "-")
+    {
+        if(!LoadAtlasGraph(strAtlasFile, bBinary, graph))
+            return 1;
+    }
+    else
+    {
+        graph = GenerateGraph(nSyntheticKFs);
+    }
+    const int nKFs = graph.vIds.size();
+    if(nKFs < 2 || nLoopClosures < 1)
+    {
+        cerr << "empty graph" << endl;
+        return 1;
+    }
+
+    PLVS2::PoseGraphSymbolicCache cache;
+    double g2oMs = 0, solverMs = 0, maxChi2RelDiff = 0;
+    for(int c=0; c<nLoopClosures; c++)
+    {
+        // the graph grows from half of the keyframes to all of them
+        const int nClosureKFs = (nLoopClosures > 1) ? nKFs/2 + (nKFs - nKFs/2)*c/(nLoopClosures-1) : nKFs;
+
+        g2o::SparseOptimizer g2oOptimizer;
+        BuildGraph(g2oOptimizer, graph, nClosureKFs, nullptr);
+        auto t0 = std::chrono::steady_clock::now();
+        g2oOptimizer.optimize(nIterations);
+        auto t1 = std::chrono::steady_clock::now();
+        g2oOptimizer.computeActiveErrors();
+
+        g2o::SparseOptimizer solverOptimizer;
+        BuildGraph(solverOptimizer, graph, nClosureKFs, &cache);
+        auto t2 = std::chrono::steady_clock::now();
+        solverOptimizer.optimize(nIterations);
+        auto t3 = std::chrono::steady_clock::now();
+        solverOptimizer.computeActiveErrors();
+
+        const double g2oChi2 = g2oOptimizer.activeChi2();
+        const double solverChi2 = solverOptimizer.activeChi2();
+        maxChi2RelDiff = std::max(maxChi2RelDiff, fabs(solverChi2 - g2oChi2)/std::max(g2oChi2, 1e-12));
+        g2oMs += ElapsedMs(t0,t1);
+        solverMs += ElapsedMs(t2,t3);
+
+        cout << "loop closure " << c << " - keyframes: " << nClosureKFs << ", g2o: " << ElapsedMs(t0,t1) << " ms (chi2 " << g2oChi2
+             << "), PoseGraphLinearSolver: " << ElapsedMs(t2,t3) << " ms (chi2 " << solverChi2 << ")" << endl;
+    }
+
+    const PLVS2::PoseGraphSymbolicCache::Stats& stats = cache.GetStats();
+    cout << "keyframes: " << nKFs << ", edges: " << graph.vEdges.size() << ", loop closures: " << nLoopClosures << endl;
+    cout << "g2o                   - time/closure: " << g2oMs/nLoopClosures << " ms" << endl;
+    cout << "PoseGraphLinearSolver - time/closure: " << solverMs/nLoopClosures << " ms, speedup: " << g2oMs/solverMs
+         << ", orderings: " << stats.numOrderings << ", symbolic analyses: " << stats.numAnalyses << ", reused analyses: " << stats.numReuses << endl;
+    cout << "max relative difference of the final costs: " << maxChi2RelDiff << endl;
+
+    return 0;
+}
@@ -0,0 +1,309 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Per-frame latency of the pose-only optimization on synthetic frames (RGBD/stereo-like, TUM freiburg1 intrinsics).
+// Each frame has mono points, stereo points, mono lines and stereo lines with a given outlier ratio, and it is solved with:
+// - the g2o graph built in Optimizer::PoseOptimization() (same edges, kernels, thresholds and 4 rounds of 10 iterations);
+// - PoseSolver, the fixed-size solver now used by Optimizer::PoseOptimization().
+// The outlier flags and the final poses of the two solvers are compared.
+
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+
+#include "Thirdparty/g2o/g2o/core/block_solver.h"
+#include "Thirdparty/g2o/g2o/core/optimization_algorithm_levenberg.h"
+#include "Thirdparty/g2o/g2o/solvers/linear_solver_dense.h"
+#include "Thirdparty/g2o/g2o/types/types_six_dof_expmap.h"
+#include "Thirdparty/g2o/g2o/core/robust_kernel_impl.h"
+
+#include "g2o/types_sba_line.h"
+#include "g2o/types_six_dof_expmap2.h"
+
+#include "PoseSolver.h"
+
+using namespace std;
+
+static const double fx = 517.306408, fy = 516.469215, cx = 318.643040, cy = 255.313989, bf = 40.;
+static const double kInvSigma2PointLineDistance = 1./(0.05*0.05); // Optimizer::kInvSigma2PointLineDistance
+
+enum ObservationType { kMonoPoint = 0, kStereoPoint, kMonoLine, kStereoLine };
+
+struct Observation
+{
+    ObservationType type;
+    Eigen::Vector3f XSw, XEw;       // point (XSw) or line endpoints
+    Eigen::Vector3d obs;            // (u,v,uR) for points, (nx,ny,-d) for lines
+    Eigen::Vector3d XSc, XEc;       // back-projected endpoints of stereo lines
+    float invSigma2;
+};
+
+static double ElapsedMs(const std::chrono::steady_clock::time_point& t0, const std::chrono::steady_clock::time_point& t1)
+{
+    return std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t1 - t0).count();
+}
+
+// The g2o graph of Optimizer::PoseOptimization() (pinhole camera, default information matrices)
+static vector<uint8_t> OptimizeG2o(const vector<Observation>& vObs, Sophus::SE3f& Tcw)
+{
+    g2o::SparseOptimizer optimizer;
+    g2o::BlockSolverX::LinearSolverType* linearSolver = new g2o::LinearSolverDense<g2o::BlockSolverX::PoseMatrixType>();
+    g2o::BlockSolverX* solver_ptr = new g2o::BlockSolverX(linearSolver);
+    optimizer.setAlgorithm(new g2o::OptimizationAlgorithmLevenberg(solver_ptr));
+
+    const g2o::SE3Quat Tcw0(Tcw.unit_quaternion().cast<double>(), Tcw.translation().cast<double>());
+    g2o::VertexSE3Expmap* vSE3 = new g2o::VertexSE3Expmap();
+    vSE3->setEstimate(Tcw0);
+    vSE3->setId(0);
+    vSE3->setFixed(false);
+    optimizer.addVertex(vSE3);
+
+    vector<g2o::OptimizableGraph::Edge*> vpEdges;
+    vector<float> vChi2;
+    vpEdges.reserve(vObs.size());
+    vChi2.reserve(vObs.size());
+    for(const Observation& o : vObs)
+    {
+        g2o::OptimizableGraph::Edge* pEdge = nullptr;
+        g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
+        switch(o.type)
+        {
+        case kMonoPoint:
+        {
+            g2o::EdgeSE3ProjectXYZOnlyPose* e = new g2o::EdgeSE3ProjectXYZOnlyPose();
+            e->setMeasurement(o.obs.head<2>());
+            e->setInformation(Eigen::Matrix2d::Identity()*o.invSigma2);
+            e->fx = fx; e->fy = fy; e->cx = cx; e->cy = cy;
+            e->Xw = o.XSw.cast<double>();
+            rk->setDelta(sqrt(5.991));
+            vChi2.push_back(5.991);
+            pEdge = e;
+            break;
+        }
+        case kStereoPoint:
+        {
+            g2o::EdgeStereoSE3ProjectXYZOnlyPose* e = new g2o::EdgeStereoSE3ProjectXYZOnlyPose();
+            e->setMeasurement(o.obs);
+            e->setInformation(Eigen::Matrix3d::Identity()*o.invSigma2);
+            e->fx = fx; e->fy = fy; e->cx = cx; e->cy = cy; e->bf = bf;
+            e->Xw = o.XSw.cast<double>();
+            rk->setDelta(sqrt(7.815));
+            vChi2.push_back(7.815);
+            pEdge = e;
+            break;
+        }
+        case kMonoLine:
+        {
+            g2o::EdgeSE3ProjectLineOnlyPose* e = new g2o::EdgeSE3ProjectLineOnlyPose();
+            e->setMeasurement(o.obs);
+            e->setInformation(Eigen::Matrix2d::Identity()*o.invSigma2);
+            e->fx = fx; e->fy = fy; e->cx = cx; e->cy = cy;
+            e->XSw = o.XSw.cast<double>();
+            e->XEw = o.XEw.cast<double>();
+            rk->setDelta(sqrt(5.991));
+            vChi2.push_back(5.991);
+            pEdge = e;
+            break;
+        }
+        case kStereoLine:
+        {
+            g2o::EdgeSE3ProjectStereoLineOnlyPose* e = new g2o::EdgeSE3ProjectStereoLineOnlyPose();
+            e->setVertex(0, vSE3); // needed by init()
+            e->setMeasurement(o.obs);
+            e->fx = fx; e->fy = fy; e->cx = cx; e->cy = cy;
+            e->XSw = o.XSw.cast<double>();
+            e->XEw = o.XEw.cast<double>();
+            e->XSbc = o.XSc;
+            e->XEbc = o.XEc;
+            e->lineLenghtInv = 1.0/(o.XSc - o.XEc).norm();
+            e->init();
+            Eigen::Matrix4d Info = Eigen::Matrix4d::Identity()*o.invSigma2;
+            Info(2,2) *= kInvSigma2PointLineDistance;
+            Info(3,3) *= kInvSigma2PointLineDistance;
+            e->setInformation(Info);
+            rk->setDelta(sqrt(9.49));
+            vChi2.push_back(9.49);
+            pEdge = e;
+            break;
+        }
+        }
+        pEdge->setVertex(0, vSE3);
+        pEdge->setRobustKernel(rk);
+        optimizer.addEdge(pEdge);
+        vpEdges.push_back(pEdge);
+    }
+
+    vector<uint8_t> vbOutliers(vObs.size(), 0);
+    for(size_t it=0; it<4; it++)
+    {
+        vSE3->setEstimate(Tcw0);
+        optimizer.initializeOptimization(0);
+        optimizer.optimize(10);
+
+        for(size_t i=0; i<vpEdges.size(); i++)
+        {
+            g2o::OptimizableGraph::Edge* e = vpEdges[i];
+            if(vbOutliers[i])
+                e->computeError();
+
+            const float chi2 = e->chi2();
+            vbOutliers[i] = chi2 > vChi2[i];
+            e->setLevel(vbOutliers[i] ? 1 : 0);
+            if(it==2)
+                e->setRobustKernel(0);
+        }
+
+        if(optimizer.edges().size()<10)
+            break;
+    }
+
+    const g2o::SE3Quat SE3quat = vSE3->estimate();
+    Tcw = Sophus::SE3f(SE3quat.rotation().cast<float>(), SE3quat.translation().cast<float>());
+    return vbOutliers;
+}
+
+static vector<uint8_t> OptimizePoseSolver(PLVS2::PoseSolver& solver, const vector<Observation>& vObs, Sophus::SE3f& Tcw)
+{
+    solver.Reset(fx, fy, cx, cy, bf);
+    for(const Observation& o : vObs)
+    {
+        switch(o.type)
+        {
+        case kMonoPoint:   solver.AddMonoPoint(o.XSw, o.obs(0), o.obs(1), o.invSigma2); break;
+        case kStereoPoint: solver.AddStereoPoint(o.XSw, o.obs(0), o.obs(1), o.obs(2), o.invSigma2); break;
+        case kMonoLine:    solver.AddMonoLine(o.XSw, o.XEw, o.obs, o.invSigma2); break;
+        case kStereoLine:  solver.AddStereoLine(o.XSw, o.XEw, o.obs, o.XSc, o.XEc, o.invSigma2, kInvSigma2PointLineDistance*o.invSigma2); break;
+        }
+    }
+    solver.Optimize(Tcw);
+
+    // back to the input order
+    vector<uint8_t> vbOutliers(vObs.size(), 0);
+    size_t iMonoPoint = 0, iStereoPoint = 0, iMonoLine = 0, iStereoLine = 0;
+    for(size_t i=0; i<vObs.size(); i++)
+    {
+        switch(vObs[i].type)
+        {
+        case kMonoPoint:   vbOutliers[i] = solver.MonoPointOutliers()[iMonoPoint++]; break;
+        case kStereoPoint: vbOutliers[i] = solver.StereoPointOutliers()[iStereoPoint++]; break;
+        case kMonoLine:    vbOutliers[i] = solver.MonoLineOutliers()[iMonoLine++]; break;
+        case kStereoLine:  vbOutliers[i] = solver.StereoLineOutliers()[iStereoLine++]; break;
+        }
+    }
+    return vbOutliers;
+}
+
+int main(int argc, char **argv)
+{
+    const int nFrames = (argc > 1) ? atoi(argv[1]) : 500;
+    const int nPoints = (argc > 2) ? atoi(argv[2]) : 600;
+    const int nLines = (argc > 3) ? atoi(argv[3]) : 100;
+    const double outlierRatio = (argc > 4) ? atof(argv[4]) : 0.15;
+
+    std::mt19937 gen(0);
+    std::normal_distribution<double> gauss(0., 1.);
+    std::uniform_real_distribution<double> uniform(0., 1.);
+
+    PLVS2::PoseSolver solver;
+
+    double g2oMs = 0, solverMs = 0;
+    double maxPoseDiff = 0;
+    size_t numObservations = 0, numFlagDifferences = 0;
+    for(int k=0; k<nFrames; k++)
+    {
+        const Sophus::SE3d Tcw_true = Sophus::SE3d::exp((Eigen::Matrix<double,6,1>() << 0.3*gauss(gen), 0.3*gauss(gen), 0.3*gauss(gen),
+                                                                                         0.2*gauss(gen), 0.2*gauss(gen), 0.2*gauss(gen)).finished());
+        const Sophus::SE3d Twc_true = Tcw_true.inverse();
+
+        auto samplePoint = [&]()
+        {
+            const double depth = 0.5 + 6.*uniform(gen);
+            const Eigen::Vector3d Xc((640.*uniform(gen) - cx)*depth/fx, (480.*uniform(gen) - cy)*depth/fy, depth);
+            return Eigen::Vector3f((Twc_true*Xc).cast<float>());
+        };
+
+        vector<Observation> vObs(nPoints + nLines);
+        for(size_t i=0; i<vObs.size(); i++)
+        {
+            Observation& o = vObs[i];
+            const bool bLine = (int)i >= nPoints;
+            const bool bStereo = uniform(gen) < 0.7;
+            o.type = bLine ? (bStereo ? kStereoLine : kMonoLine) : (bStereo ? kStereoPoint : kMonoPoint);
+
+            const int octave = i%8;
+            o.invSigma2 = 1./pow(1.2, 2*octave);
+            const double sigma = (uniform(gen) < outlierRatio) ? 30. : pow(1.2, octave);
+
+            o.XSw = samplePoint();
+            o.XEw = samplePoint();
+            const Eigen::Vector3d XSc = Tcw_true*o.XSw.cast<double>();
+            const Eigen::Vector3d XEc = Tcw_true*o.XEw.cast<double>();
+            auto project = [&](const Eigen::Vector3d& Xc)
+            {
+                return Eigen::Vector3d(fx*Xc(0)/Xc(2) + cx + sigma*gauss(gen), fy*Xc(1)/Xc(2) + cy + sigma*gauss(gen), 1.);
+            };
+
+            const Eigen::Vector3d pS = project(XSc);
+            if(!bLine)
+            {
+                o.obs << pS(0), pS(1), pS(0) - bf/XSc(2) + 0.5*sigma*gauss(gen);
+            }
+            else
+            {
+                const Eigen::Vector3d pE = project(XEc);
+                const Eigen::Vector3d l = pS.cross(pE);
+                o.obs = l/l.head<2>().norm();
+                o.XSc = XSc + 0.01*sigma*Eigen::Vector3d(gauss(gen), gauss(gen), gauss(gen));
+                o.XEc = XEc + 0.01*sigma*Eigen::Vector3d(gauss(gen), gauss(gen), gauss(gen));
+                if(uniform(gen) < 0.3) std::swap(o.XSc, o.XEc); // detected endpoints are not ordered as the map ones
+            }
+        }
+
+        // motion-model-like initial guess
+        const Sophus::SE3d dT = Sophus::SE3d::exp((Eigen::Matrix<double,6,1>() << 0.01*gauss(gen), 0.01*gauss(gen), 0.01*gauss(gen),
+                                                                                  0.02*gauss(gen), 0.02*gauss(gen), 0.02*gauss(gen)).finished());
+        const Sophus::SE3f Tcw0 = (dT*Tcw_true).cast<float>();
+
+        Sophus::SE3f Tcw_g2o = Tcw0;
+        auto t0 = std::chrono::steady_clock::now();
+        const vector<uint8_t> vbOutliersG2o = OptimizeG2o(vObs, Tcw_g2o);
+        auto t1 = std::chrono::steady_clock::now();
+
+        Sophus::SE3f Tcw_solver = Tcw0;
+        auto t2 = std::chrono::steady_clock::now();
+        const vector<uint8_t> vbOutliersSolver = OptimizePoseSolver(solver, vObs, Tcw_solver);
+        auto t3 = std::chrono::steady_clock::now();
+
+        g2oMs += ElapsedMs(t0,t1);
+        solverMs += ElapsedMs(t2,t3);
+        numObservations += vObs.size();
+        for(size_t i=0; i<vObs.size(); i++)
+            numFlagDifferences += (vbOutliersG2o[i] != vbOutliersSolver[i]);
+        maxPoseDiff = std::max(maxPoseDiff, (double)(Tcw_g2o.inverse()*Tcw_solver).log().norm());
+    }
+
+    cout << "frames: " << nFrames << ", observations/frame: " << nPoints + nLines << " (" << nPoints << " points, " << nLines << " lines)"
+         << ", outlier ratio: " << outlierRatio << endl;
+    cout << "g2o graph   - time/frame: " << g2oMs/nFrames << " ms" << endl;
+    cout << "PoseSolver  - time/frame: " << solverMs/nFrames << " ms, speedup: " << g2oMs/solverMs << endl;
+    cout << "outlier flag differences: " << numFlagDifferences << "/" << numObservations << ", max pose difference: " << maxPoseDiff << endl;
+
+    return 0;
+}
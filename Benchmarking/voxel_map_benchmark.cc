@@ -0,0 +1,173 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Cost of the keyframe cloud integration (InsertCloud() + UpdateMap()) of the point cloud maps based on voxels over a
+// long sequence. The keyframe clouds are ray-cast in a synthetic room (8 x 3 x 6 m) by an RGB-D camera (640x480 with
+// the downsampling step 4 of PointCloudMapping) running several laps of the same circuit, with depth noise.
+// The maps are:
+// - PointCloudMapVoxelGridFilter: pcl::VoxelGrid over the whole accumulated map at each update;
+// - PointCloudMapVoxelGridFilterActive (selected by PointCloudMapping.type: voxelgrid): the same with VoxelGridCustom;
+// - PointCloudMapVoxelHash (PointCloudMapping.type: voxelhash): incremental hashed voxels.
+//
+// usage: ./voxel_map_benchmark [number of keyframes] [resolution (m)] [number of laps]
+
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+#include <limits>
+
+#include <Eigen/Geometry>
+
+#include "Map.h"
+#include "PointDefinitions.h"
+#include "PointUtils.h"
+#include "PointCloudMapVoxelGridFilter.h"
+#include "PointCloudMapVoxelHash.h"
+
+using namespace std;
+
+typedef POINT_TYPE PointT;
+typedef pcl::PointCloud<PointT> PointCloudT;
+
+static const int kWidth = 160, kHeight = 120;       // 640x480 downsampled with step 4
+static const float kFx = 525.f/4, kFy = 525.f/4, kCx = 80.f, kCy = 60.f;
+static const float kMaxDepth = 4.f;                 // [m]
+static const Eigen::Vector3f kRoomMin(-4.f, -1.5f, -3.f), kRoomMax(4.f, 1.5f, 3.f);
+
+static double ElapsedMs(const std::chrono::steady_clock::time_point& t0, const std::chrono::steady_clock::time_point& t1)
+{
+    return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
+// world cloud seen by the camera at keyframe k
+static PointCloudT::Ptr GenerateKeyFrameCloud(const int k, const int nKFs, const int nLaps, std::mt19937& rng)
+{
+    const float angle = 2.f*M_PI*nLaps*k/nKFs;
+    const Eigen::Vector3f twc(2.f*cos(angle), 0.3f*sin(3.f*angle), 1.5f*sin(angle));
+    const Eigen::Matrix3f Rwc = (Eigen::AngleAxisf(-angle, Eigen::Vector3f::UnitY())*Eigen::AngleAxisf(0.2f*sin(2.f*angle), Eigen::Vector3f::UnitX())).toRotationMatrix();
+
+    std::normal_distribution<float> noise(0.f, 1.f);
+
+    PointCloudT::Ptr pCloud(new PointCloudT);
+    pCloud->reserve(kWidth*kHeight);
+    for(int v=0; v<kHeight; v++)
+    {
+        for(int u=0; u<kWidth; u++)
+        {
+            const Eigen::Vector3f rayc((u - kCx)/kFx, (v - kCy)/kFy, 1.f);
+            const Eigen::Vector3f rayw = Rwc*rayc;
+
+            // first wall hit by the ray (the camera is inside the room)
+            float depth = std::numeric_limits<float>::max();
+            int axis = 0;
+            for(int i=0; i<3; i++)
+            {
+                if(fabs(rayw[i]) < 1e-9f) continue;
+                const float t = ((rayw[i] > 0.f ? kRoomMax[i] : kRoomMin[i]) - twc[i])/rayw[i];
+                if(t < depth) { depth = t; axis = i; }
+            }
+            if(depth > kMaxDepth) continue;
+            depth += 0.0015f*depth*depth*noise(rng);
+
+            const Eigen::Vector3f pw = twc + depth*rayw;
+            Eigen::Vector3f nw = Eigen::Vector3f::Zero();
+            nw[axis] = rayw[axis] > 0.f ? -1.f : 1.f;
+
+            PointT p;
+            p.x = pw.x(); p.y = pw.y(); p.z = pw.z();
+            const bool bChecker = ((int)floor(2.f*pw.x()) + (int)floor(2.f*pw.y()) + (int)floor(2.f*pw.z())) & 1;
+            p.r = bChecker ? 200 : 50; p.g = 100 + 50*axis; p.b = bChecker ? 50 : 200;
+            PLVS2::PointUtils::updateNormal(nw.x(), nw.y(), nw.z(), p);
+            PLVS2::PointUtils::updateDepth(depth, p);
+            PLVS2::PointUtils::setKFid(p, (int)k);
+            pCloud->push_back(p);
+        }
+    }
+    return pCloud;
+}
+
+template<typename MapT>
+static void RunMap(const string& name, MapT& map, const vector<PointCloudT::Ptr>& vClouds)
+{
+    const int nKFs = vClouds.size();
+    const int nLastKFs = std::max(nKFs/10, 1);
+    double totalMs = 0, lastMs = 0, maxMs = 0;
+    int numPoints = 0;
+    for(int k=0; k<nKFs; k++)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        map.InsertCloud(vClouds[k], 0, 0, 0, kMaxDepth);
+        numPoints = map.UpdateMap();
+        auto t1 = std::chrono::steady_clock::now();
+
+        const double ms = ElapsedMs(t0,t1);
+        totalMs += ms;
+        maxMs = std::max(maxMs, ms);
+        if(k >= nKFs - nLastKFs) lastMs += ms;
+        if((k+1) % 500 == 0)
+            cout << name << " - keyframe " << k+1 << ", map points: " << numPoints << ", time/keyframe: " << totalMs/(k+1) << " ms" << endl;
+    }
+
+    cout << name << " - map points: " << numPoints << ", time/keyframe: " << totalMs/nKFs << " ms (last " << nLastKFs
+         << " keyframes: " << lastMs/nLastKFs << " ms, max: " << maxMs << " ms), total: " << totalMs/1000. << " s" << endl;
+}
+
+int main(int argc, char **argv)
+{
+    const int nKFs = (argc > 1) ? atoi(argv[1]) : 2000;
+    const double resolution = (argc > 2) ? atof(argv[2]) : 0.02;
+    const int nLaps = (argc > 3) ? atoi(argv[3]) : 4;
+    if(nKFs < 1 || resolution <= 0 || nLaps < 1)
+    {
+        cerr << "usage: " << argv[0] << " [number of keyframes] [resolution (m)] [number of laps]" << endl;
+        return 1;
+    }
+
+    std::mt19937 rng(0);
+    vector<PointCloudT::Ptr> vClouds(nKFs);
+    size_t numInputPoints = 0;
+    for(int k=0; k<nKFs; k++)
+    {
+        vClouds[k] = GenerateKeyFrameCloud(k, nKFs, nLaps, rng);
+        numInputPoints += vClouds[k]->size();
+    }
+    cout << "keyframes: " << nKFs << ", points/keyframe: " << numInputPoints/nKFs << ", resolution: " << resolution << " m" << endl;
+
+    std::shared_ptr<PLVS2::PointCloudMapParameters> pParams = std::make_shared<PLVS2::PointCloudMapParameters>();
+    pParams->resolution = resolution;
+
+    PLVS2::Map map;
+    {
+        PLVS2::PointCloudMapVoxelGridFilter<PointT> voxelGrid(&map, pParams);
+        RunMap("PointCloudMapVoxelGridFilter      ", voxelGrid, vClouds);
+    }
+    {
+        PLVS2::PointCloudMapVoxelGridFilterActive<PointT> voxelGridActive(&map, pParams);
+        RunMap("PointCloudMapVoxelGridFilterActive", voxelGridActive, vClouds);
+    }
+    {
+        PLVS2::PointCloudMapVoxelHash<PointT> voxelHash(&map, pParams);
+        RunMap("PointCloudMapVoxelHash            ", voxelHash, vClouds);
+        cout << "PointCloudMapVoxelHash - blocks: " << voxelHash.GetNumBlocks() << ", voxels: " << voxelHash.GetNumVoxels() << endl;
+    }
+
+    return 0;
+}
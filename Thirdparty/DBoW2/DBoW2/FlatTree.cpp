@@ -0,0 +1,511 @@
+/**
+ * File: FlatTree.cpp
+ * Date: October 2026
+ * Description: compact vocabulary tree layout for binary descriptors
+ * License: see the LICENSE.txt file
+ *
+ */
+
+#include <cstring>
+#include <cstdio>
+#include <limits>
+#include <fstream>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "FlatTree.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FLAT_TREE_X86 1
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FLAT_TREE_NEON 1
+#endif
+
+namespace DBoW2 {
+
+// --------------------------------------------------------------------------
+
+static inline int distanceScalar(const unsigned char *a,
+  const unsigned char *b, int length)
+{
+  int dist = 0;
+  int i = 0;
+  for(; i + 8 <= length; i += 8)
+  {
+    uint64_t va, vb;
+    memcpy(&va, a + i, 8);
+    memcpy(&vb, b + i, 8);
+    dist += __builtin_popcountll(va ^ vb);
+  }
+  for(; i < length; ++i)
+    dist += __builtin_popcount((unsigned int)(a[i] ^ b[i]));
+  return dist;
+}
+
+// --------------------------------------------------------------------------
+
+static int nearestScalar(const unsigned char *feature,
+  const unsigned char *block, int n, int stride, int length)
+{
+  int best = 0;
+  int best_d = distanceScalar(feature, block, length);
+  for(int i = 1; i < n; ++i)
+  {
+    const int d = distanceScalar(feature, block + i*stride, length);
+    if(d < best_d)
+    {
+      best_d = d;
+      best = i;
+    }
+  }
+  return best;
+}
+
+// --------------------------------------------------------------------------
+
+static inline void selectNearest(const int *d, int count, int offset,
+  int &best, int &best_d)
+{
+  for(int j = 0; j < count; ++j)
+  {
+    if(d[j] < best_d)
+    {
+      best_d = d[j];
+      best = offset + j;
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+
+#if FLAT_TREE_X86
+
+// popcount of each 64-bit lane by means of a nibble lookup table
+__attribute__((target("avx2")))
+static inline __m256i popcount256AVX2(const __m256i v)
+{
+  const __m256i lut = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+                                       0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+  const __m256i lo = _mm256_and_si256(v, low_mask);
+  const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+  const __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo),
+    _mm256_shuffle_epi8(lut, hi));
+  return _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+}
+
+// reduces the 64-bit lane counts of 4 rows into 4 distances
+__attribute__((target("avx2")))
+static inline void reduce4AVX2(const __m256i a, const __m256i b,
+  const __m256i c, const __m256i d, int *dists)
+{
+  const __m256i ab = _mm256_add_epi64(_mm256_unpacklo_epi64(a, b),
+    _mm256_unpackhi_epi64(a, b));
+  const __m256i cd = _mm256_add_epi64(_mm256_unpacklo_epi64(c, d),
+    _mm256_unpackhi_epi64(c, d));
+  const __m256i sum = _mm256_add_epi64(_mm256_permute2x128_si256(ab, cd, 0x20),
+    _mm256_permute2x128_si256(ab, cd, 0x31));
+  const __m256i packed = _mm256_permutevar8x32_epi32(sum,
+    _mm256_setr_epi32(0,2,4,6,0,2,4,6));
+  _mm_storeu_si128((__m128i*)dists, _mm256_castsi256_si128(packed));
+}
+
+// 32-byte descriptors only
+__attribute__((target("avx2")))
+static int nearestAVX2(const unsigned char *feature,
+  const unsigned char *block, int n, int stride, int length)
+{
+  const __m256i q = _mm256_loadu_si256((const __m256i*)feature);
+
+  int best = -1;
+  int best_d = std::numeric_limits<int>::max();
+  int d[4];
+  int i = 0;
+  for(; i + 4 <= n; i += 4)
+  {
+    const unsigned char *p = block + i*stride;
+    reduce4AVX2(
+      popcount256AVX2(_mm256_xor_si256(q, _mm256_load_si256((const __m256i*)p))),
+      popcount256AVX2(_mm256_xor_si256(q, _mm256_load_si256((const __m256i*)(p + stride)))),
+      popcount256AVX2(_mm256_xor_si256(q, _mm256_load_si256((const __m256i*)(p + 2*stride)))),
+      popcount256AVX2(_mm256_xor_si256(q, _mm256_load_si256((const __m256i*)(p + 3*stride)))),
+      d);
+    selectNearest(d, 4, i, best, best_d);
+  }
+  for(; i < n; ++i)
+  {
+    d[0] = distanceScalar(feature, block + i*stride, length);
+    selectNearest(d, 1, i, best, best_d);
+  }
+  return best;
+}
+
+// 32-byte descriptors only, native 64-bit popcount (AVX-512 VPOPCNTDQ + VL)
+__attribute__((target("avx2,avx512f,avx512vl,avx512vpopcntdq")))
+static int nearestAVX512(const unsigned char *feature,
+  const unsigned char *block, int n, int stride, int length)
+{
+  const __m256i q = _mm256_loadu_si256((const __m256i*)feature);
+
+  int best = -1;
+  int best_d = std::numeric_limits<int>::max();
+  int d[4];
+  int i = 0;
+  for(; i + 4 <= n; i += 4)
+  {
+    const unsigned char *p = block + i*stride;
+    reduce4AVX2(
+      _mm256_popcnt_epi64(_mm256_xor_si256(q, _mm256_load_si256((const __m256i*)p))),
+      _mm256_popcnt_epi64(_mm256_xor_si256(q, _mm256_load_si256((const __m256i*)(p + stride)))),
+      _mm256_popcnt_epi64(_mm256_xor_si256(q, _mm256_load_si256((const __m256i*)(p + 2*stride)))),
+      _mm256_popcnt_epi64(_mm256_xor_si256(q, _mm256_load_si256((const __m256i*)(p + 3*stride)))),
+      d);
+    selectNearest(d, 4, i, best, best_d);
+  }
+  for(; i < n; ++i)
+  {
+    d[0] = distanceScalar(feature, block + i*stride, length);
+    selectNearest(d, 1, i, best, best_d);
+  }
+  return best;
+}
+
+#endif // FLAT_TREE_X86
+
+// --------------------------------------------------------------------------
+
+#if FLAT_TREE_NEON
+
+// 32-byte descriptors only
+static int nearestNEON(const unsigned char *feature,
+  const unsigned char *block, int n, int stride, int /*length*/)
+{
+  const uint8x16_t q0 = vld1q_u8(feature);
+  const uint8x16_t q1 = vld1q_u8(feature + 16);
+
+  int best = -1;
+  int best_d = std::numeric_limits<int>::max();
+  for(int i = 0; i < n; ++i)
+  {
+    const unsigned char *p = block + i*stride;
+    const uint8x16_t x0 = veorq_u8(q0, vld1q_u8(p));
+    const uint8x16_t x1 = veorq_u8(q1, vld1q_u8(p + 16));
+    const int d = vaddlvq_u8(vaddq_u8(vcntq_u8(x0), vcntq_u8(x1)));
+    selectNearest(&d, 1, i, best, best_d);
+  }
+  return best;
+}
+
+#endif // FLAT_TREE_NEON
+
+// --------------------------------------------------------------------------
+
+static const char kMagic[8] = {'D','B','O','W','2','F','L','T'};
+static const uint64_t kVersion = 1;
+static const uint64_t kSectionAlignment = 64;
+
+static inline uint64_t alignUp(uint64_t x, uint64_t a)
+{
+  return (x + a - 1) / a * a;
+}
+
+// --------------------------------------------------------------------------
+
+FlatTree::FlatTree(): m_mapped(NULL), m_mapped_size(0), m_header(NULL),
+  m_descriptors(NULL), m_first_child(NULL), m_num_children(NULL),
+  m_node_ids(NULL), m_word_ids(NULL), m_weights(NULL), m_params({0,0,0,0}),
+  m_num_nodes(0), m_num_words(0), m_length(0), m_stride(0),
+  m_nearest(nearestScalar)
+{
+}
+
+// --------------------------------------------------------------------------
+
+FlatTree::~FlatTree()
+{
+  clear();
+}
+
+// --------------------------------------------------------------------------
+
+void FlatTree::clear()
+{
+  if(m_mapped != NULL) munmap(m_mapped, m_mapped_size);
+  m_mapped = NULL;
+  m_mapped_size = 0;
+  m_filename.clear();
+  m_buffer.reset();
+
+  m_header = NULL;
+  m_descriptors = NULL;
+  m_first_child = m_num_children = NULL;
+  m_node_ids = NULL;
+  m_word_ids = NULL;
+  m_weights = NULL;
+  m_params = {0,0,0,0};
+  m_num_nodes = m_num_words = 0;
+  m_length = m_stride = 0;
+  m_nearest = nearestScalar;
+}
+
+// --------------------------------------------------------------------------
+
+void FlatTree::computeLayout(Header &h)
+{
+  uint64_t offset = alignUp(sizeof(Header), kSectionAlignment);
+  h.descriptors_offset = offset;
+  offset = alignUp(offset + h.num_nodes * h.stride, kSectionAlignment);
+  h.first_child_offset = offset;
+  offset = alignUp(offset + h.num_nodes * sizeof(uint32_t), kSectionAlignment);
+  h.num_children_offset = offset;
+  offset = alignUp(offset + h.num_nodes * sizeof(uint32_t), kSectionAlignment);
+  h.node_ids_offset = offset;
+  offset = alignUp(offset + h.num_nodes * sizeof(NodeId), kSectionAlignment);
+  h.word_ids_offset = offset;
+  offset = alignUp(offset + h.num_nodes * sizeof(WordId), kSectionAlignment);
+  h.weights_offset = offset;
+  h.size = alignUp(offset + h.num_nodes * sizeof(WordValue), kSectionAlignment);
+}
+
+// --------------------------------------------------------------------------
+
+uint64_t FlatTree::computeDigest(const unsigned char *block, const Header &h)
+{
+  // 64-bit multiply-xor hash of the parameters and of all the sections
+  const uint64_t prime = 0x100000001b3ULL;
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  const uint64_t params[6] = {(uint64_t)h.k, (uint64_t)h.L,
+    (uint64_t)h.scoring, (uint64_t)h.weighting, h.descriptor_length,
+    h.num_nodes};
+  for(int i = 0; i < 6; ++i)
+  {
+    hash = (hash ^ params[i]) * prime;
+    hash ^= hash >> 29;
+  }
+
+  // the size of the sections is a multiple of 8 bytes
+  const unsigned char *p = block + h.descriptors_offset;
+  const unsigned char *end = block + h.size;
+  for(; p < end; p += 8)
+  {
+    uint64_t w;
+    memcpy(&w, p, 8);
+    hash = (hash ^ w) * prime;
+    hash ^= hash >> 29;
+  }
+  return hash;
+}
+
+// --------------------------------------------------------------------------
+
+void FlatTree::build(const Parameters &params, size_t numNodes,
+  int descriptorLength,
+  const std::function<const std::vector<NodeId>&(NodeId)> &getChildren,
+  const std::function<const unsigned char*(NodeId)> &getDescriptor,
+  const std::function<bool(NodeId, WordId&, WordValue&)> &getWord)
+{
+  clear();
+  if(numNodes == 0 || descriptorLength <= 0) return;
+
+  // breadth-first visit: the children of each node are appended as a block
+  std::vector<NodeId> node_ids;
+  std::vector<uint32_t> first_child, num_children;
+  node_ids.reserve(numNodes);
+  first_child.reserve(numNodes);
+  num_children.reserve(numNodes);
+
+  node_ids.push_back(0); // root
+  for(size_t f = 0; f < node_ids.size(); ++f)
+  {
+    const std::vector<NodeId> &children = getChildren(node_ids[f]);
+    first_child.push_back((uint32_t)node_ids.size());
+    num_children.push_back((uint32_t)children.size());
+    node_ids.insert(node_ids.end(), children.begin(), children.end());
+  }
+
+  Header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, kMagic, sizeof(kMagic));
+  h.version = kVersion;
+  h.k = params.k;
+  h.L = params.L;
+  h.scoring = params.scoring;
+  h.weighting = params.weighting;
+  h.descriptor_length = descriptorLength;
+  h.stride = alignUp(descriptorLength, 32);
+  h.num_nodes = node_ids.size();
+  computeLayout(h);
+
+  m_buffer.reset(static_cast<unsigned char*>(
+    std::aligned_alloc(kSectionAlignment, h.size)));
+  unsigned char *block = m_buffer.get();
+  memset(block, 0, h.size);
+
+  for(size_t f = 1; f < h.num_nodes; ++f)
+  {
+    const unsigned char *d = getDescriptor(node_ids[f]);
+    if(d != NULL)
+      memcpy(block + h.descriptors_offset + f * h.stride, d, descriptorLength);
+  }
+  memcpy(block + h.first_child_offset, first_child.data(),
+    h.num_nodes * sizeof(uint32_t));
+  memcpy(block + h.num_children_offset, num_children.data(),
+    h.num_nodes * sizeof(uint32_t));
+  memcpy(block + h.node_ids_offset, node_ids.data(),
+    h.num_nodes * sizeof(NodeId));
+
+  WordId *word_ids = reinterpret_cast<WordId*>(block + h.word_ids_offset);
+  WordValue *weights = reinterpret_cast<WordValue*>(block + h.weights_offset);
+  for(size_t f = 0; f < h.num_nodes; ++f)
+  {
+    if(getWord(node_ids[f], word_ids[f], weights[f]))
+      h.num_words = std::max<uint64_t>(h.num_words, word_ids[f] + 1);
+  }
+
+  h.digest = computeDigest(block, h);
+  memcpy(block, &h, sizeof(h));
+
+  attach(block);
+}
+
+// --------------------------------------------------------------------------
+
+void FlatTree::attach(const unsigned char *block)
+{
+  m_header = reinterpret_cast<const Header*>(block);
+  const Header &h = *m_header;
+
+  m_descriptors = block + h.descriptors_offset;
+  m_first_child = reinterpret_cast<const uint32_t*>(block + h.first_child_offset);
+  m_num_children = reinterpret_cast<const uint32_t*>(block + h.num_children_offset);
+  m_node_ids = reinterpret_cast<const NodeId*>(block + h.node_ids_offset);
+  m_word_ids = reinterpret_cast<const WordId*>(block + h.word_ids_offset);
+  m_weights = reinterpret_cast<const WordValue*>(block + h.weights_offset);
+
+  m_params = {(int)h.k, (int)h.L, (int)h.scoring, (int)h.weighting};
+  m_num_nodes = h.num_nodes;
+  m_num_words = h.num_words;
+  m_length = (int)h.descriptor_length;
+  m_stride = (int)h.stride;
+
+  m_nearest = nearestScalar;
+  if(m_length == 32)
+  {
+#if FLAT_TREE_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512vpopcntdq") &&
+      __builtin_cpu_supports("avx512vl"))
+      m_nearest = nearestAVX512;
+    else if(__builtin_cpu_supports("avx2"))
+      m_nearest = nearestAVX2;
+#endif
+#if FLAT_TREE_NEON
+    m_nearest = nearestNEON;
+#endif
+  }
+}
+
+// --------------------------------------------------------------------------
+
+bool FlatTree::saveToFile(const std::string &filename) const
+{
+  if(empty()) return false;
+
+  std::ofstream f(filename.c_str(), std::ios::out | std::ios::binary);
+  if(!f.is_open()) return false;
+
+  // the layout block is the file content
+  f.write(reinterpret_cast<const char*>(m_header), m_header->size);
+  return f.good();
+}
+
+// --------------------------------------------------------------------------
+
+bool FlatTree::mapFile(const std::string &filename, int descriptorLength)
+{
+  clear();
+
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if(fd < 0) return false;
+
+  struct stat st;
+  if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header))
+  {
+    close(fd);
+    return false;
+  }
+
+  void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd); // the mapping keeps a reference to the file
+  if(addr == MAP_FAILED) return false;
+
+  // check the header only: the sections are paged in on demand
+  const Header &h = *static_cast<const Header*>(addr);
+  Header expected = h;
+  computeLayout(expected);
+
+  const bool valid = memcmp(h.magic, kMagic, sizeof(kMagic)) == 0 &&
+    h.version == kVersion &&
+    h.descriptor_length == (uint64_t)descriptorLength &&
+    h.stride == alignUp(descriptorLength, 32) &&
+    h.num_nodes > 0 &&
+    memcmp(&h, &expected, sizeof(Header)) == 0 &&
+    h.size == (uint64_t)st.st_size;
+
+  if(!valid)
+  {
+    munmap(addr, st.st_size);
+    return false;
+  }
+
+  m_mapped = addr;
+  m_mapped_size = st.st_size;
+  m_filename = filename;
+  attach(static_cast<const unsigned char*>(addr));
+  return true;
+}
+
+// --------------------------------------------------------------------------
+
+std::string FlatTree::getDigest() const
+{
+  if(empty()) return std::string();
+
+  char buf[17];
+  snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)m_header->digest);
+  return std::string(buf);
+}
+
+// --------------------------------------------------------------------------
+
+uint32_t FlatTree::descend(const unsigned char *feature, int nid_level,
+  NodeId *nid) const
+{
+  uint32_t f = 0; // root
+  int current_level = 0;
+
+  while(m_num_children[f] > 0)
+  {
+    ++current_level;
+    const uint32_t first = m_first_child[f];
+    f = first + m_nearest(feature, m_descriptors + first * m_stride,
+      (int)m_num_children[f], m_stride, m_length);
+
+    if(nid != NULL && current_level == nid_level)
+      *nid = m_node_ids[f];
+  }
+
+  return f;
+}
+
+// --------------------------------------------------------------------------
+
+} // namespace DBoW2
@@ -0,0 +1,206 @@
+/**
+ * File: FlatTree.h
+ * Date: October 2026
+ * Description: compact vocabulary tree layout for binary descriptors
+ * License: see the LICENSE.txt file
+ *
+ */
+
+#ifndef __D_T_FLAT_TREE__
+#define __D_T_FLAT_TREE__
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdlib>
+#include <cstdint>
+#include <functional>
+
+#include "BowVector.h"
+
+namespace DBoW2 {
+
+/// Compact copy of a vocabulary tree of binary descriptors (compared with
+/// the Hamming distance), used to propagate features down the tree.
+/// Nodes are stored in breadth-first order: the children of a node are a
+/// contiguous block of descriptor rows (32-byte aligned) and children are
+/// implicit by index, so a descent touches a single block per level.
+/// The nearest child is searched with AVX-512 VPOPCNTDQ, AVX2 or NEON when
+/// available (selected at runtime). Ties are resolved in favour of the first
+/// child, as in TemplatedVocabulary::transform().
+///
+/// The whole layout (header included) is a single block with the same
+/// content as its file (see saveToFile()), so a saved tree can be mapped
+/// read-only with mapFile() and used in place: no parsing, no copies, and
+/// the pages are shared by all the processes that map the same file.
+class FlatTree
+{
+public:
+
+  /// Vocabulary parameters stored in the header (opaque to the tree)
+  struct Parameters
+  {
+    int k;
+    int L;
+    int scoring;
+    int weighting;
+  };
+
+public:
+
+  FlatTree();
+  ~FlatTree();
+
+  /**
+   * Builds the layout from a tree with numNodes nodes (root id 0)
+   * @param params vocabulary parameters
+   * @param numNodes number of nodes
+   * @param descriptorLength length of the descriptors in bytes
+   * @param getChildren returns the ordered children ids of a node
+   * @param getDescriptor returns the descriptor bytes of a (non-root) node
+   *   (NULL for a node without descriptor, which is stored as zeros)
+   * @param getWord returns whether a node is a word and, if so, its word id
+   *   and weight
+   */
+  void build(const Parameters &params, size_t numNodes, int descriptorLength,
+    const std::function<const std::vector<NodeId>&(NodeId)> &getChildren,
+    const std::function<const unsigned char*(NodeId)> &getDescriptor,
+    const std::function<bool(NodeId, WordId&, WordValue&)> &getWord);
+
+  /**
+   * Saves the layout to a file that can be mapped with mapFile()
+   * @param filename
+   * @return false if the layout is empty or the file cannot be written
+   */
+  bool saveToFile(const std::string &filename) const;
+
+  /**
+   * Maps (read-only) a file saved with saveToFile() and uses it in place
+   * @param filename
+   * @param descriptorLength expected length of the descriptors in bytes
+   * @return false if the file cannot be mapped or it is not valid
+   */
+  bool mapFile(const std::string &filename, int descriptorLength);
+
+  /**
+   * Releases the layout (and the mapping, if any)
+   */
+  void clear();
+
+  /**
+   * Returns whether the layout is available
+   */
+  inline bool empty() const { return m_num_nodes == 0; }
+
+  /**
+   * Returns whether the layout is a mapped file
+   */
+  inline bool isMapped() const { return m_mapped != NULL; }
+
+  /**
+   * Returns the name of the mapped file (empty if not mapped)
+   */
+  inline const std::string& getFilename() const { return m_filename; }
+
+  /**
+   * Returns the vocabulary parameters
+   */
+  inline const Parameters& getParameters() const { return m_params; }
+
+  /**
+   * Returns the number of words
+   */
+  inline size_t numWords() const { return m_num_words; }
+
+  /**
+   * Returns the digest of the layout content (hexadecimal string). It is
+   * computed when the layout is built and it is read from the header of a
+   * mapped file, so it identifies a vocabulary without hashing its file
+   */
+  std::string getDigest() const;
+
+  /**
+   * Propagates a feature down the tree
+   * @param feature descriptor bytes
+   * @param nid_level level at which the node is stored in nid (root level is 0)
+   * @param nid (out) if given, id of the node reached at level nid_level
+   * @return flat index of the leaf node
+   */
+  uint32_t descend(const unsigned char *feature, int nid_level, NodeId *nid) const;
+
+  /**
+   * Original node id, word id and word weight of a flat node
+   */
+  inline NodeId getNodeId(uint32_t f) const { return m_node_ids[f]; }
+  inline WordId getWordId(uint32_t f) const { return m_word_ids[f]; }
+  inline WordValue getWeight(uint32_t f) const { return m_weights[f]; }
+
+private:
+
+  /// File header (the first block of the layout)
+  struct Header
+  {
+    char magic[8];
+    uint64_t version;
+    int64_t k, L, scoring, weighting;
+    uint64_t descriptor_length, stride;
+    uint64_t num_nodes, num_words;
+    uint64_t digest;
+    uint64_t descriptors_offset, first_child_offset, num_children_offset;
+    uint64_t node_ids_offset, word_ids_offset, weights_offset;
+    uint64_t size;
+  };
+
+  /// Free-deleter of the aligned layout block
+  struct FreeDeleter
+  {
+    void operator()(unsigned char *p) const { std::free(p); }
+  };
+
+  typedef int (*NearestFunction)(const unsigned char *feature,
+    const unsigned char *block, int n, int stride, int length);
+
+  FlatTree(const FlatTree&) = delete;
+  FlatTree& operator=(const FlatTree&) = delete;
+
+  /// Computes the section offsets of a layout
+  static void computeLayout(Header &h);
+
+  /// Hashes the sections of a layout
+  static uint64_t computeDigest(const unsigned char *block, const Header &h);
+
+  /// Sets the section pointers and the nearest child search from a layout
+  void attach(const unsigned char *block);
+
+private:
+
+  /// Owned layout (if built)
+  std::unique_ptr<unsigned char[], FreeDeleter> m_buffer;
+
+  /// Mapped layout (if mapped)
+  void *m_mapped;
+  size_t m_mapped_size;
+  std::string m_filename;
+
+  /// Sections of the layout (owned or mapped)
+  const Header *m_header;
+  const unsigned char *m_descriptors; // rows in breadth-first order (row 0 is the root)
+  const uint32_t *m_first_child;      // flat index of the first child
+  const uint32_t *m_num_children;     // number of children (0 for leaves)
+  const NodeId *m_node_ids;           // original node ids
+  const WordId *m_word_ids;           // word ids (leaves only)
+  const WordValue *m_weights;         // word weights (leaves only)
+
+  Parameters m_params;
+  size_t m_num_nodes;
+  size_t m_num_words;
+  int m_length;
+  int m_stride;
+
+  /// Nearest child search selected for the running CPU
+  NearestFunction m_nearest;
+};
+
+} // namespace DBoW2
+
+#endif
@@ -25,11 +25,13 @@
 #include <string>
 #include <algorithm>
 #include <opencv2/core/core.hpp>
+#include <opencv2/core/utility.hpp>
 #include <limits>
 
 #include "FeatureVector.h"
 #include "BowVector.h"
 #include "ScoringObject.h"
+#include "FlatTree.h"
 
 #include "../DUtils/Random.h"
 
@@ -145,6 +147,18 @@ public:
   virtual void transform(const std::vector<TDescriptor>& features,
     BowVector &v, FeatureVector &fv, int levelsup) const;
 
+  /**
+   * Transform a set of descriptors, given as the rows of a matrix, into a bow
+   * vector and a feature vector. The words of the rows are looked up in
+   * parallel; the output is the same as the one of the vector version
+   * @param features descriptors (one per row)
+   * @param v (out) bow vector
+   * @param fv (out) feature vector of nodes and feature indexes
+   * @param levelsup levels to go up the vocabulary tree to get the node index
+   */
+  void transform(const cv::Mat &features,
+    BowVector &v, FeatureVector &fv, int levelsup) const;
+
   /**
    * Transforms a single feature into a word (without weight)
    * @param feature
@@ -301,6 +315,51 @@ public:
    */
   virtual int stopWords(double minWeight);
 
+  /**
+   * Enables/disables the compact tree layout (see FlatTree) in transform().
+   * The layout is built when the vocabulary is loaded or created and it is
+   * used by default. The output of transform() does not change.
+   * @param use
+   */
+  inline void setUseFlatTree(bool use) { m_use_flat_tree = use; }
+
+  /**
+   * Returns whether transform() uses the compact tree layout
+   */
+  inline bool isUsingFlatTree() const
+    { return !m_flat_tree.empty() && (m_use_flat_tree || isMapped()); }
+
+  /**
+   * Saves the compact tree layout to a file that can be loaded (mapped)
+   * with loadFromFlatFile()
+   * @param filename
+   * @return false if the file cannot be written
+   */
+  bool saveToFlatFile(const std::string &filename) const;
+
+  /**
+   * Maps a file saved with saveToFlatFile() read-only and uses it in place
+   * (the node tables are not loaded). Loading is almost instant and the
+   * pages are shared by the processes that map the same file.
+   * @note Only transform(), score(), size() and getDigest() are available
+   *   with a mapped vocabulary
+   * @param filename
+   * @return false if the file cannot be mapped or it is not valid
+   */
+  bool loadFromFlatFile(const std::string &filename);
+
+  /**
+   * Returns whether the vocabulary is a mapped file (see loadFromFlatFile())
+   */
+  inline bool isMapped() const { return m_flat_tree.isMapped(); }
+
+  /**
+   * Returns a digest of the vocabulary content (empty if the vocabulary is
+   * empty). It is computed when the vocabulary is loaded from a text or 
+   * binary file and read from the header of a flat file
+   */
+  inline std::string getDigest() const { return m_flat_tree.getDigest(); }
+
 protected:
 
   /// Pointer to descriptor
@@ -414,6 +473,24 @@ protected:
    * @param features
    */
   void setNodeWeights(const vector<vector<TDescriptor> > &features);
+
+  /**
+   * Builds the compact layout of the tree once the nodes have been created.
+   * It assumes binary descriptors of F::L bytes stored in CV_8U matrices
+   * and compared with the Hamming distance (as FORB)
+   */
+  void createFlatTree();
+
+  /**
+   * Propagates a feature (F::L bytes) down the compact tree
+   * @param feature
+   * @param id (out) word id
+   * @param weight (out) word weight
+   * @param nid (out) if given, id of the node "levelsup" levels up
+   * @param levelsup
+   */
+  void transformFlat(const unsigned char *feature,
+    WordId &id, WordValue &weight, NodeId* nid, int levelsup) const;
   
 protected:
 
@@ -438,6 +515,12 @@ protected:
   /// Words of the vocabulary (tree leaves)
   /// this condition holds: m_words[wid]->word_id == wid
   std::vector<Node*> m_words;
+
+  /// Compact copy of the tree used by transform()
+  FlatTree m_flat_tree;
+
+  /// Whether transform() uses m_flat_tree
+  bool m_use_flat_tree;
   
 };
 
@@ -447,7 +530,7 @@ template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
   (int k, int L, WeightingType weighting, ScoringType scoring)
   : m_k(k), m_L(L), m_weighting(weighting), m_scoring(scoring),
-  m_scoring_object(NULL)
+  m_scoring_object(NULL), m_use_flat_tree(true)
 {
   createScoringObject();
 }
@@ -456,7 +539,8 @@ TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
 
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
-  (const std::string &filename): m_scoring_object(NULL)
+  (const std::string &filename): m_scoring_object(NULL),
+  m_use_flat_tree(true)
 {
   load(filename);
 }
@@ -465,7 +549,8 @@ TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
 
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
-  (const char *filename): m_scoring_object(NULL)
+  (const char *filename): m_scoring_object(NULL),
+  m_use_flat_tree(true)
 {
   load(filename);
 }
@@ -529,7 +614,7 @@ void TemplatedVocabulary<TDescriptor,F>::setWeightingType(WeightingType type)
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary(
   const TemplatedVocabulary<TDescriptor, F> &voc)
-  : m_scoring_object(NULL)
+  : m_scoring_object(NULL), m_use_flat_tree(true)
 {
   *this = voc;
 }
@@ -561,6 +646,11 @@ TemplatedVocabulary<TDescriptor,F>::operator=
   
   this->m_nodes = voc.m_nodes;
   this->createWords();
+  if(voc.isMapped())
+    this->m_flat_tree.mapFile(voc.m_flat_tree.getFilename(), F::L);
+  else
+    this->createFlatTree();
+  this->m_use_flat_tree = voc.m_use_flat_tree;
   
   return *this;
 }
@@ -596,6 +686,8 @@ void TemplatedVocabulary<TDescriptor,F>::create(
 
   // and set the weight of each node of the tree
   setNodeWeights(training_features);
+
+  createFlatTree();
   
 }
 
@@ -927,6 +1019,33 @@ void TemplatedVocabulary<TDescriptor,F>::initiateClustersKMpp(
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::createFlatTree()
+{
+  if(m_nodes.empty())
+  {
+    m_flat_tree.clear();
+    return;
+  }
+
+  const FlatTree::Parameters params = {m_k, m_L, (int)m_scoring, 
+    (int)m_weighting};
+  m_flat_tree.build(params, m_nodes.size(), F::L,
+    [this](NodeId nid) -> const vector<NodeId>& 
+      { return m_nodes[nid].children; },
+    [this](NodeId nid) -> const unsigned char*
+      { return m_nodes[nid].descriptor.empty() ? 
+          NULL : m_nodes[nid].descriptor.ptr(); },
+    [this](NodeId nid, WordId &wid, WordValue &weight) -> bool
+      { 
+        wid = m_nodes[nid].word_id;
+        weight = m_nodes[nid].weight;
+        return nid != 0 && m_nodes[nid].isLeaf();
+      });
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor,F>::createWords()
 {
@@ -1013,6 +1132,7 @@ void TemplatedVocabulary<TDescriptor,F>::setNodeWeights
 template<class TDescriptor, class F>
 inline unsigned int TemplatedVocabulary<TDescriptor,F>::size() const
 {
+  if(isMapped()) return m_flat_tree.numWords();
   return m_words.size();
 }
 
@@ -1021,6 +1141,7 @@ inline unsigned int TemplatedVocabulary<TDescriptor,F>::size() const
 template<class TDescriptor, class F>
 inline bool TemplatedVocabulary<TDescriptor,F>::empty() const
 {
+  if(isMapped()) return m_flat_tree.numWords() == 0;
   return m_words.empty();
 }
 
@@ -1208,6 +1329,84 @@ void TemplatedVocabulary<TDescriptor,F>::transform(
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F> 
+void TemplatedVocabulary<TDescriptor,F>::transform(const cv::Mat &features,
+  BowVector &v, FeatureVector &fv, int levelsup) const
+{
+  v.clear();
+  fv.clear();
+  
+  if(empty()) // safe for subclasses
+  {
+    return;
+  }
+
+  // look up the words of all the rows (in parallel), then accumulate them
+  // in the order of the rows
+  const int N = features.rows;
+  vector<WordId> ids(N);
+  vector<NodeId> nids(N);
+  vector<WordValue> weights(N);
+
+  const bool use_flat_tree = isUsingFlatTree();
+  auto lookup = [&](const cv::Range &range)
+  {
+    for(int i = range.start; i < range.end; ++i)
+    {
+      if(use_flat_tree)
+        transformFlat(features.ptr(i), ids[i], weights[i], &nids[i], levelsup);
+      else
+        transform(features.row(i), ids[i], weights[i], &nids[i], levelsup);
+    }
+  };
+
+  const int kMinRowsPerStripe = 64;
+  if(N >= 2*kMinRowsPerStripe)
+    cv::parallel_for_(cv::Range(0, N), lookup, N / kMinRowsPerStripe);
+  else
+    lookup(cv::Range(0, N));
+  
+  // normalize 
+  LNorm norm;
+  bool must = m_scoring_object->mustNormalize(norm);
+  
+  if(m_weighting == TF || m_weighting == TF_IDF)
+  {
+    for(int i_feature = 0; i_feature < N; ++i_feature)
+    {
+      if(weights[i_feature] > 0) // not stopped
+      { 
+        v.addWeight(ids[i_feature], weights[i_feature]);
+        fv.addFeature(nids[i_feature], i_feature);
+      }
+    }
+    
+    if(!v.empty() && !must)
+    {
+      // unnecessary when normalizing
+      const double nd = v.size();
+      for(BowVector::iterator vit = v.begin(); vit != v.end(); vit++) 
+        vit->second /= nd;
+    }
+  
+  }
+  else // IDF || BINARY
+  {
+    for(int i_feature = 0; i_feature < N; ++i_feature)
+    {
+      if(weights[i_feature] > 0) // not stopped
+      {
+        v.addIfNotExist(ids[i_feature], weights[i_feature]);
+        fv.addFeature(nids[i_feature], i_feature);
+      }
+    }
+  } // if m_weighting == ...
+  
+  if(must) v.normalize(norm);
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F> 
 inline double TemplatedVocabulary<TDescriptor,F>::score
   (const BowVector &v1, const BowVector &v2) const
@@ -1231,6 +1430,12 @@ template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor,F>::transform(const TDescriptor &feature, 
   WordId &word_id, WordValue &weight, NodeId *nid, int levelsup) const
 { 
+  if(isUsingFlatTree())
+  {
+    transformFlat(feature.ptr(), word_id, weight, nid, levelsup);
+    return;
+  }
+
   // propagate the feature down the tree
   vector<NodeId> nodes;
   typename vector<NodeId>::const_iterator nit;
@@ -1273,6 +1478,24 @@ void TemplatedVocabulary<TDescriptor,F>::transform(const TDescriptor &feature,
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::transformFlat(
+  const unsigned char *feature, WordId &word_id, WordValue &weight,
+  NodeId *nid, int levelsup) const
+{
+  // level at which the node must be stored in nid, if given
+  const int nid_level = m_L - levelsup;
+  if(nid_level <= 0 && nid != NULL) *nid = 0; // root
+
+  const uint32_t final_f = m_flat_tree.descend(feature, nid_level, nid);
+
+  // turn node id into word id
+  word_id = m_flat_tree.getWordId(final_f);
+  weight = m_flat_tree.getWeight(final_f);
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 NodeId TemplatedVocabulary<TDescriptor,F>::getParentNode
   (WordId wid, int levelsup) const
@@ -1332,6 +1555,12 @@ void TemplatedVocabulary<TDescriptor,F>::getWordsFromNode
 template<class TDescriptor, class F>
 int TemplatedVocabulary<TDescriptor,F>::stopWords(double minWeight)
 {
+  if(isMapped())
+  {
+    std::cerr << "Vocabulary: cannot stop words of a mapped vocabulary" << endl;
+    return 0;
+  }
+
   int c = 0;
   typename vector<Node*>::iterator wit;
   for(wit = m_words.begin(); wit != m_words.end(); ++wit)
@@ -1342,6 +1571,8 @@ int TemplatedVocabulary<TDescriptor,F>::stopWords(double minWeight)
       (*wit)->weight = 0;
     }
   }
+
+  if(c > 0) createFlatTree(); // update the weights
   return c;
 }
 
@@ -1432,6 +1663,8 @@ bool TemplatedVocabulary<TDescriptor,F>::loadFromTextFile(const std::string &fil
         }
     }
 
+    createFlatTree();
+
     return true;
 
 }
@@ -1507,6 +1740,8 @@ bool TemplatedVocabulary<TDescriptor,F>::loadFromBinaryFile(const std::string &f
   f.close();
 
   delete[] buf;
+
+  createFlatTree();
   return true;
 }
 
@@ -1538,6 +1773,39 @@ void TemplatedVocabulary<TDescriptor,F>::saveToBinaryFile(const std::string &fil
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor,F>::saveToFlatFile(const std::string &filename) const
+{
+  return m_flat_tree.saveToFile(filename);
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor,F>::loadFromFlatFile(const std::string &filename)
+{
+  m_words.clear();
+  m_nodes.clear();
+
+  if(!m_flat_tree.mapFile(filename, F::L))
+  {
+    std::cerr << "Vocabulary loading failure: " << filename 
+      << " is not a valid flat file!" << endl;
+    return false;
+  }
+
+  const FlatTree::Parameters &params = m_flat_tree.getParameters();
+  m_k = params.k;
+  m_L = params.L;
+  m_scoring = (ScoringType)params.scoring;
+  m_weighting = (WeightingType)params.weighting;
+  createScoringObject();
+
+  return true;
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor,F>::save(const std::string &filename) const
 {
@@ -1707,6 +1975,8 @@ void TemplatedVocabulary<TDescriptor,F>::load(const cv::FileStorage &fs,
     m_nodes[nid].word_id = wid;
     m_words[wid] = &m_nodes[nid];
   }
+
+  createFlatTree();
 }
 
 // --------------------------------------------------------------------------
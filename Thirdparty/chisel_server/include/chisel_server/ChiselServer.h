@@ -201,15 +201,24 @@ public:
     
     void Deform(chisel::MapKfidRt& deformationMap);  
     
-    template <class PointType, typename std::enable_if<!pcl::traits::has_field<PointType, pcl::fields::normal_x>::value>::type* = nullptr>
+    // get the vertices of all the meshes 
+    template <class PointType>
     void GetPointCloud(pcl::PointCloud<PointType>& output_cloud);
     
-    template <class PointType, typename std::enable_if<pcl::traits::has_field<PointType, pcl::fields::normal_x>::value>::type* = nullptr,
-                               typename std::enable_if<!pcl::traits::has_field<PointType, pcl::fields::kfid>::value>::type* = nullptr>
-    void GetPointCloud(pcl::PointCloud<PointType>& output_cloud);
+    // get the vertices of the mesh of a chunk (returns false if the chunk has no mesh vertices)
+    template <class PointType>
+    bool GetMeshPointCloud(const chisel::ChunkID& chunkID, pcl::PointCloud<PointType>& output_cloud);
     
-    template <class PointType, typename std::enable_if<pcl::traits::has_all_fields<PointType, boost::mpl::vector<pcl::fields::kfid, pcl::fields::normal_x> >::value>::type* = nullptr>
-    void GetPointCloud(pcl::PointCloud<PointType>& output_cloud);    
+    // meshes recomputed by the last UpdateMesh()
+    inline const chisel::ChunkSet& GetUpdatedMeshes() const
+    {
+        return chiselMap->GetUpdatedMeshes();
+    }
+    
+    inline bool HasMesh(const chisel::ChunkID& chunkID) const
+    {
+        return chiselMap->GetChunkManager().HasMesh(chunkID);
+    }
     
     inline void SetBaseTransform(const std::string& frameName)
     {
@@ -288,6 +297,16 @@ public:
 protected:
     //            visualization_msgs::Marker CreateFrustumMarker(const chisel::Frustum& frustum);
 
+    template <class PointType, typename std::enable_if<!pcl::traits::has_field<PointType, pcl::fields::normal_x>::value>::type* = nullptr>
+    void AppendMeshToPointCloud(const chisel::MeshPtr& mesh, pcl::PointCloud<PointType>& output_cloud);
+    
+    template <class PointType, typename std::enable_if<pcl::traits::has_field<PointType, pcl::fields::normal_x>::value>::type* = nullptr,
+                               typename std::enable_if<!pcl::traits::has_field<PointType, pcl::fields::kfid>::value>::type* = nullptr>
+    void AppendMeshToPointCloud(const chisel::MeshPtr& mesh, pcl::PointCloud<PointType>& output_cloud);
+    
+    template <class PointType, typename std::enable_if<pcl::traits::has_all_fields<PointType, boost::mpl::vector<pcl::fields::kfid, pcl::fields::normal_x> >::value>::type* = nullptr>
+    void AppendMeshToPointCloud(const chisel::MeshPtr& mesh, pcl::PointCloud<PointType>& output_cloud);    
+
     //            ros::NodeHandle nh;
     
     chisel::ChiselPtr chiselMap;
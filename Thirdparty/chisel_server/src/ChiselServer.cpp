@@ -870,317 +870,270 @@ chisel::Vec3 LAMBERT(const chisel::Vec3& n, const chisel::Vec3& light)
 
 
 template <class PointType, typename std::enable_if<!pcl::traits::has_field<PointType, pcl::fields::normal_x>::value>::type*>
-void ChiselServer::GetPointCloud(pcl::PointCloud<PointType>& output_cloud)
+void ChiselServer::AppendMeshToPointCloud(const chisel::MeshPtr& mesh, pcl::PointCloud<PointType>& output_cloud)
 {
-    output_cloud.clear();
-
-    output_cloud.header.stamp = getTimestamp();
-
-    //    assert(marker != nullptr);
-    //    marker->header.stamp = ros::Time::now();
-    //    marker->header.frame_id = baseTransform;
-    //    marker->scale.x = 1;
-    //    marker->scale.y = 1;
-    //    marker->scale.z = 1;
-    //    marker->pose.orientation.x = 0;
-    //    marker->pose.orientation.y = 0;
-    //    marker->pose.orientation.z = 0;
-    //    marker->pose.orientation.w = 1;
-    //    marker->type = visualization_msgs::Marker::TRIANGLE_LIST;
-
-    const chisel::MeshMap& meshMap = chiselMap->GetChunkManager().GetAllMeshes();
-
-    if (meshMap.size() == 0)
-    {
-        return;
-    }
-
     chisel::Vec3 lightDir(0.8f, -0.2f, 0.7f);
     lightDir.normalize();
     chisel::Vec3 lightDir1(-0.5f, 0.2f, 0.2f);
     lightDir.normalize();
     const chisel::Vec3 ambient(0.2f, 0.2f, 0.2f);
     //int idx = 0;
-    for (const std::pair<chisel::ChunkID, chisel::MeshPtr>& meshes : meshMap)
+    for (size_t i = 0; i < mesh->vertices.size(); i++)
     {
-        const chisel::MeshPtr& mesh = meshes.second;
-        for (size_t i = 0; i < mesh->vertices.size(); i++)
-        {
-            const chisel::Vec3& vec = mesh->vertices[i];
+        const chisel::Vec3& vec = mesh->vertices[i];
 
-            //geometry_msgs::Point pt;
+        //geometry_msgs::Point pt;
 
-            PointType point;
+        PointType point;
 
-            point.x = vec[0];
-            point.y = vec[1];
-            point.z = vec[2];
+        point.x = vec[0];
+        point.y = vec[1];
+        point.z = vec[2];
 
-            //marker->points.push_back(pt);
+        //marker->points.push_back(pt);
 
-            if (mesh->HasColors())
+        if (mesh->HasColors())
+        {
+            //std::cout << "mesh has color " << std::endl; 
+            const chisel::Vec3& meshCol = mesh->colors[i];
+            //std_msgs::ColorRGBA color;
+            point.r = meshCol[0]*255;
+            point.g = meshCol[1]*255;
+            point.b = meshCol[2]*255;
+            //point.a = 255;
+            
+            //std::cout  << "rgb: " <<meshCol[0] <<", " <<meshCol[1] <<", "<<meshCol[2] << std::endl;
+            //marker->colors.push_back(color);
+        }
+        else
+        {
+            if (mesh->HasNormals())
             {
-                //std::cout << "mesh has color " << std::endl; 
-                const chisel::Vec3& meshCol = mesh->colors[i];
-                //std_msgs::ColorRGBA color;
-                point.r = meshCol[0]*255;
-                point.g = meshCol[1]*255;
-                point.b = meshCol[2]*255;
-                //point.a = 255;
+                std::cout << "mesh has normals " << std::endl; 
                 
-                //std::cout  << "rgb: " <<meshCol[0] <<", " <<meshCol[1] <<", "<<meshCol[2] << std::endl;
+                const chisel::Vec3 normal = mesh->normals[i];
+                //std_msgs::ColorRGBA color;
+                chisel::Vec3 lambert = LAMBERT(normal, lightDir) + LAMBERT(normal, lightDir1) + ambient;
+                point.r = fmin(lambert[0], 1.0)*255;
+                point.g = fmin(lambert[1], 1.0)*255;
+                point.b = fmin(lambert[2], 1.0)*255;
+                point.a = 255;
                 //marker->colors.push_back(color);
             }
             else
             {
-                if (mesh->HasNormals())
-                {
-                    std::cout << "mesh has normals " << std::endl; 
-                    
-                    const chisel::Vec3 normal = mesh->normals[i];
-                    //std_msgs::ColorRGBA color;
-                    chisel::Vec3 lambert = LAMBERT(normal, lightDir) + LAMBERT(normal, lightDir1) + ambient;
-                    point.r = fmin(lambert[0], 1.0)*255;
-                    point.g = fmin(lambert[1], 1.0)*255;
-                    point.b = fmin(lambert[2], 1.0)*255;
-                    point.a = 255;
-                    //marker->colors.push_back(color);
-                }
-                else
-                {
-                    std::cout << "mesh has nothing " << std::endl;
-                    
-                    //std_msgs::ColorRGBA color;
-                    point.r = (vec[0] * 0.25 + 0.5)*255;
-                    point.g = (vec[1] * 0.25 + 0.5)*255;
-                    point.b = (vec[2] * 0.25 + 0.5)*255;
-                    point.a = 255;
-                    //marker->colors.push_back(color);
-                }
+                std::cout << "mesh has nothing " << std::endl;
+                
+                //std_msgs::ColorRGBA color;
+                point.r = (vec[0] * 0.25 + 0.5)*255;
+                point.g = (vec[1] * 0.25 + 0.5)*255;
+                point.b = (vec[2] * 0.25 + 0.5)*255;
+                point.a = 255;
+                //marker->colors.push_back(color);
             }
-
-            output_cloud.push_back(point);
-            //marker->indicies.push_back(idx);
-            //idx++;
         }
+
+        output_cloud.push_back(point);
+        //marker->indicies.push_back(idx);
+        //idx++;
     }
 }
 
 template <class PointType, typename std::enable_if<pcl::traits::has_field<PointType, pcl::fields::normal_x>::value>::type*,
                            typename std::enable_if<!pcl::traits::has_field<PointType, pcl::fields::kfid>::value>::type*>
-void ChiselServer::GetPointCloud(pcl::PointCloud<PointType>& output_cloud)
+void ChiselServer::AppendMeshToPointCloud(const chisel::MeshPtr& mesh, pcl::PointCloud<PointType>& output_cloud)
 {
-    output_cloud.clear();  
-
-    output_cloud.header.stamp = getTimestamp();
-
-    //    assert(marker != nullptr);
-    //    marker->header.stamp = ros::Time::now();
-    //    marker->header.frame_id = baseTransform;
-    //    marker->scale.x = 1;
-    //    marker->scale.y = 1;
-    //    marker->scale.z = 1;
-    //    marker->pose.orientation.x = 0;
-    //    marker->pose.orientation.y = 0;
-    //    marker->pose.orientation.z = 0;
-    //    marker->pose.orientation.w = 1;
-    //    marker->type = visualization_msgs::Marker::TRIANGLE_LIST;
-
-    const chisel::MeshMap& meshMap = chiselMap->GetChunkManager().GetAllMeshes();
-
-    if (meshMap.size() == 0)
-    {
-        return;
-    }
-
     chisel::Vec3 lightDir(0.8f, -0.2f, 0.7f);
     lightDir.normalize();
     chisel::Vec3 lightDir1(-0.5f, 0.2f, 0.2f);
     lightDir.normalize();
     const chisel::Vec3 ambient(0.2f, 0.2f, 0.2f);
     //int idx = 0;
-    for (const std::pair<chisel::ChunkID, chisel::MeshPtr>& meshes : meshMap)
+    for (size_t i = 0; i < mesh->vertices.size(); i++)
     {
-        const chisel::MeshPtr& mesh = meshes.second;
-        for (size_t i = 0; i < mesh->vertices.size(); i++)
-        {
-            const chisel::Vec3& vec = mesh->vertices[i];
+        const chisel::Vec3& vec = mesh->vertices[i];
 
-            //geometry_msgs::Point pt;
+        //geometry_msgs::Point pt;
 
-            PointType point;
+        PointType point;
 
-            point.x = vec[0];
-            point.y = vec[1];
-            point.z = vec[2];
+        point.x = vec[0];
+        point.y = vec[1];
+        point.z = vec[2];
 
-            //marker->points.push_back(pt);
+        //marker->points.push_back(pt);
 
-            if (mesh->HasColors())
+        if (mesh->HasColors())
+        {
+            //std::cout << "mesh has color " << std::endl; 
+            const chisel::Vec3& meshCol = mesh->colors[i];
+            //std_msgs::ColorRGBA color;
+            point.r = meshCol[0]*255;
+            point.g = meshCol[1]*255;
+            point.b = meshCol[2]*255;
+            //point.a = 255;
+            
+            //std::cout  << "rgb: " <<meshCol[0] <<", " <<meshCol[1] <<", "<<meshCol[2] << std::endl;
+            //marker->colors.push_back(color);
+            
+            const chisel::Vec3& normal = mesh->normals[i];
+            
+            point.normal_x = normal[0];
+            point.normal_y = normal[1];
+            point.normal_z = normal[2];
+            //std::cout << "normal: " << normal << std::endl; 
+        }
+        else
+        {
+            if (mesh->HasNormals())
             {
-                //std::cout << "mesh has color " << std::endl; 
-                const chisel::Vec3& meshCol = mesh->colors[i];
-                //std_msgs::ColorRGBA color;
-                point.r = meshCol[0]*255;
-                point.g = meshCol[1]*255;
-                point.b = meshCol[2]*255;
-                //point.a = 255;
-                
-                //std::cout  << "rgb: " <<meshCol[0] <<", " <<meshCol[1] <<", "<<meshCol[2] << std::endl;
-                //marker->colors.push_back(color);
+                std::cout << "mesh has normals " << std::endl; 
                 
                 const chisel::Vec3& normal = mesh->normals[i];
-                
-                point.normal_x = normal[0];
-                point.normal_y = normal[1];
-                point.normal_z = normal[2];
-                //std::cout << "normal: " << normal << std::endl; 
+                //std_msgs::ColorRGBA color;
+                chisel::Vec3 lambert = LAMBERT(normal, lightDir) + LAMBERT(normal, lightDir1) + ambient;
+                point.r = fmin(lambert[0], 1.0)*255;
+                point.g = fmin(lambert[1], 1.0)*255;
+                point.b = fmin(lambert[2], 1.0)*255;
+                point.a = 255;
+                //marker->colors.push_back(color);
             }
             else
             {
-                if (mesh->HasNormals())
-                {
-                    std::cout << "mesh has normals " << std::endl; 
-                    
-                    const chisel::Vec3& normal = mesh->normals[i];
-                    //std_msgs::ColorRGBA color;
-                    chisel::Vec3 lambert = LAMBERT(normal, lightDir) + LAMBERT(normal, lightDir1) + ambient;
-                    point.r = fmin(lambert[0], 1.0)*255;
-                    point.g = fmin(lambert[1], 1.0)*255;
-                    point.b = fmin(lambert[2], 1.0)*255;
-                    point.a = 255;
-                    //marker->colors.push_back(color);
-                }
-                else
-                {
-                    std::cout << "mesh has nothing " << std::endl;
-                    
-                    //std_msgs::ColorRGBA color;
-                    point.r = (vec[0] * 0.25 + 0.5)*255;
-                    point.g = (vec[1] * 0.25 + 0.5)*255;
-                    point.b = (vec[2] * 0.25 + 0.5)*255;
-                    point.a = 255;
-                    //marker->colors.push_back(color);
-                }
+                std::cout << "mesh has nothing " << std::endl;
+                
+                //std_msgs::ColorRGBA color;
+                point.r = (vec[0] * 0.25 + 0.5)*255;
+                point.g = (vec[1] * 0.25 + 0.5)*255;
+                point.b = (vec[2] * 0.25 + 0.5)*255;
+                point.a = 255;
+                //marker->colors.push_back(color);
             }
-
-            output_cloud.push_back(point);
-            //marker->indicies.push_back(idx);
-            //idx++;
         }
+
+        output_cloud.push_back(point);
+        //marker->indicies.push_back(idx);
+        //idx++;
     }
 }
 
 
 template <class PointType, typename std::enable_if<pcl::traits::has_all_fields<PointType, boost::mpl::vector<pcl::fields::kfid, pcl::fields::normal_x> >::value>::type*>
-void ChiselServer::GetPointCloud(pcl::PointCloud<PointType>& output_cloud)
+void ChiselServer::AppendMeshToPointCloud(const chisel::MeshPtr& mesh, pcl::PointCloud<PointType>& output_cloud)
 {
-    output_cloud.clear();  
-
-    output_cloud.header.stamp = getTimestamp();
-
-    //    assert(marker != nullptr);
-    //    marker->header.stamp = ros::Time::now();
-    //    marker->header.frame_id = baseTransform;
-    //    marker->scale.x = 1;
-    //    marker->scale.y = 1;
-    //    marker->scale.z = 1;
-    //    marker->pose.orientation.x = 0;
-    //    marker->pose.orientation.y = 0;
-    //    marker->pose.orientation.z = 0;
-    //    marker->pose.orientation.w = 1;
-    //    marker->type = visualization_msgs::Marker::TRIANGLE_LIST;
-
-    const chisel::MeshMap& meshMap = chiselMap->GetChunkManager().GetAllMeshes();
-
-    if (meshMap.size() == 0)
-    {
-        return;
-    }
-
     chisel::Vec3 lightDir(0.8f, -0.2f, 0.7f);
     lightDir.normalize();
     chisel::Vec3 lightDir1(-0.5f, 0.2f, 0.2f);
     lightDir.normalize();
     const chisel::Vec3 ambient(0.2f, 0.2f, 0.2f);
     //int idx = 0;
-    for (const std::pair<chisel::ChunkID, chisel::MeshPtr>& meshes : meshMap)
+    for (size_t i = 0; i < mesh->vertices.size(); i++)
     {
-        const chisel::MeshPtr& mesh = meshes.second;
-        for (size_t i = 0; i < mesh->vertices.size(); i++)
-        {
-            const chisel::Vec3& vec = mesh->vertices[i];
+        const chisel::Vec3& vec = mesh->vertices[i];
 
-            //geometry_msgs::Point pt;
+        //geometry_msgs::Point pt;
 
-            PointType point;
+        PointType point;
 
-            point.x = vec[0];
-            point.y = vec[1];
-            point.z = vec[2];
+        point.x = vec[0];
+        point.y = vec[1];
+        point.z = vec[2];
 
-            //marker->points.push_back(pt);
+        //marker->points.push_back(pt);
 
-            //if (mesh->HasColors())
+        //if (mesh->HasColors())
+        {
+            //std::cout << "mesh has color " << std::endl; 
+            const chisel::Vec3& meshCol = mesh->colors[i];
+            //std_msgs::ColorRGBA color;
+            point.r = meshCol[0]*255;
+            point.g = meshCol[1]*255;
+            point.b = meshCol[2]*255;
+            //point.a = 255;
+            
+            //std::cout  << "rgb: " <<meshCol[0] <<", " <<meshCol[1] <<", "<<meshCol[2] << std::endl;
+            //marker->colors.push_back(color);
+            
+            const chisel::Vec3& normal = mesh->normals[i];
+            
+            point.normal_x = normal[0];
+            point.normal_y = normal[1];
+            point.normal_z = normal[2];
+            //std::cout << "normal: " << normal << std::endl; 
+            
+            point.kfid = mesh->kfids[i];
+            //std::cout << "kfid: " << point.kfid << std::endl; 
+        }
+        /*else
+        {
+            if (mesh->HasNormals())
             {
-                //std::cout << "mesh has color " << std::endl; 
-                const chisel::Vec3& meshCol = mesh->colors[i];
-                //std_msgs::ColorRGBA color;
-                point.r = meshCol[0]*255;
-                point.g = meshCol[1]*255;
-                point.b = meshCol[2]*255;
-                //point.a = 255;
-                
-                //std::cout  << "rgb: " <<meshCol[0] <<", " <<meshCol[1] <<", "<<meshCol[2] << std::endl;
-                //marker->colors.push_back(color);
+                std::cout << "mesh has normals " << std::endl; 
                 
                 const chisel::Vec3& normal = mesh->normals[i];
-                
-                point.normal_x = normal[0];
-                point.normal_y = normal[1];
-                point.normal_z = normal[2];
-                //std::cout << "normal: " << normal << std::endl; 
-                
-                point.kfid = mesh->kfids[i];
-                //std::cout << "kfid: " << point.kfid << std::endl; 
+                //std_msgs::ColorRGBA color;
+                chisel::Vec3 lambert = LAMBERT(normal, lightDir) + LAMBERT(normal, lightDir1) + ambient;
+                point.r = fmin(lambert[0], 1.0)*255;
+                point.g = fmin(lambert[1], 1.0)*255;
+                point.b = fmin(lambert[2], 1.0)*255;
+                point.a = 255;
+                //marker->colors.push_back(color);
             }
-            /*else
+            else
             {
-                if (mesh->HasNormals())
-                {
-                    std::cout << "mesh has normals " << std::endl; 
-                    
-                    const chisel::Vec3& normal = mesh->normals[i];
-                    //std_msgs::ColorRGBA color;
-                    chisel::Vec3 lambert = LAMBERT(normal, lightDir) + LAMBERT(normal, lightDir1) + ambient;
-                    point.r = fmin(lambert[0], 1.0)*255;
-                    point.g = fmin(lambert[1], 1.0)*255;
-                    point.b = fmin(lambert[2], 1.0)*255;
-                    point.a = 255;
-                    //marker->colors.push_back(color);
-                }
-                else
-                {
-                    std::cout << "mesh has nothing " << std::endl;
-                    
-                    //std_msgs::ColorRGBA color;
-                    point.r = (vec[0] * 0.25 + 0.5)*255;
-                    point.g = (vec[1] * 0.25 + 0.5)*255;
-                    point.b = (vec[2] * 0.25 + 0.5)*255;
-                    point.a = 255;
-                    //marker->colors.push_back(color);
-                }
+                std::cout << "mesh has nothing " << std::endl;
                 
-                point.kfid = mesh->kfids[i];                
-            }*/
+                //std_msgs::ColorRGBA color;
+                point.r = (vec[0] * 0.25 + 0.5)*255;
+                point.g = (vec[1] * 0.25 + 0.5)*255;
+                point.b = (vec[2] * 0.25 + 0.5)*255;
+                point.a = 255;
+                //marker->colors.push_back(color);
+            }
+            
+            point.kfid = mesh->kfids[i];                
+        }*/
 
-            output_cloud.push_back(point);
-            //marker->indicies.push_back(idx);
-            //idx++;
-        }
+        output_cloud.push_back(point);
+        //marker->indicies.push_back(idx);
+        //idx++;
     }
 }
 
+template <class PointType>
+void ChiselServer::GetPointCloud(pcl::PointCloud<PointType>& output_cloud)
+{
+    output_cloud.clear();
+
+    output_cloud.header.stamp = getTimestamp();
+
+    const chisel::MeshMap& meshMap = chiselMap->GetChunkManager().GetAllMeshes();
+
+    for (const std::pair<chisel::ChunkID, chisel::MeshPtr>& meshes : meshMap)
+    {
+        AppendMeshToPointCloud(meshes.second, output_cloud);
+    }
+}
+
+template <class PointType>
+bool ChiselServer::GetMeshPointCloud(const chisel::ChunkID& chunkID, pcl::PointCloud<PointType>& output_cloud)
+{
+    output_cloud.clear();
+
+    output_cloud.header.stamp = getTimestamp();
+
+    const chisel::MeshMap& meshMap = chiselMap->GetChunkManager().GetAllMeshes();
+
+    chisel::MeshMap::const_iterator itm = meshMap.find(chunkID);
+    if (itm == meshMap.end() || itm->second->vertices.empty())
+    {
+        return false;
+    }
+
+    AppendMeshToPointCloud(itm->second, output_cloud);
+    return true;
+}
+
 
 //    bool ChiselServer::SaveMesh(chisel_msgs::SaveMeshService::Request& request, chisel_msgs::SaveMeshService::Response& response)
 //    {
@@ -1219,8 +1172,12 @@ template void ChiselServer::SetPointCloud(const pcl::PointCloud<pcl::PointXYZRGB
 template void ChiselServer::SetPointCloud(const pcl::PointCloud<pcl::PointSurfelSegment>& cloud_camera, chisel::Transform& transform);
 
 template void ChiselServer::GetPointCloud(pcl::PointCloud<pcl::PointXYZRGBA>& output_cloud);
-template void ChiselServer::GetPointCloud<pcl::PointXYZRGBNormal, (void*)0>(pcl::PointCloud<pcl::PointXYZRGBNormal>& output_cloud); 
-template void ChiselServer::GetPointCloud<pcl::PointSurfelSegment, (void*)0>(pcl::PointCloud<pcl::PointSurfelSegment>& output_cloud); 
+template void ChiselServer::GetPointCloud(pcl::PointCloud<pcl::PointXYZRGBNormal>& output_cloud); 
+template void ChiselServer::GetPointCloud(pcl::PointCloud<pcl::PointSurfelSegment>& output_cloud); 
+
+template bool ChiselServer::GetMeshPointCloud(const chisel::ChunkID& chunkID, pcl::PointCloud<pcl::PointXYZRGBA>& output_cloud);
+template bool ChiselServer::GetMeshPointCloud(const chisel::ChunkID& chunkID, pcl::PointCloud<pcl::PointXYZRGBNormal>& output_cloud); 
+template bool ChiselServer::GetMeshPointCloud(const chisel::ChunkID& chunkID, pcl::PointCloud<pcl::PointSurfelSegment>& output_cloud); 
 
 template void ChiselServer::IntegrateWorldPointCloud(const pcl::PointCloud<pcl::PointXYZRGBNormal>& cloud, chisel::Transform& Twc);
 template void ChiselServer::IntegrateWorldPointCloud(const pcl::PointCloud<pcl::PointSurfelSegment>& cloud, chisel::Transform& Twc);
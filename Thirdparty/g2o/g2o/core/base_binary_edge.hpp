@@ -130,6 +130,8 @@ void BaseBinaryEdge<D, E, VertexXiType, VertexXjType>::linearizeOplus(JacobianWo
 template <int D, typename E, typename VertexXiType, typename VertexXjType>
 void BaseBinaryEdge<D, E, VertexXiType, VertexXjType>::linearizeOplus()
 {
+  OptimizableGraph::Edge::markNumericJacobian();
+
   VertexXiType* vi = static_cast<VertexXiType*>(_vertices[0]);
   VertexXjType* vj = static_cast<VertexXjType*>(_vertices[1]);
 
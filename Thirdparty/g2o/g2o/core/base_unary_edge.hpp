@@ -81,6 +81,8 @@ void BaseUnaryEdge<D, E, VertexXiType>::linearizeOplus(JacobianWorkspace& jacobi
 template <int D, typename E, typename VertexXiType>
 void BaseUnaryEdge<D, E, VertexXiType>::linearizeOplus()
 {
+  OptimizableGraph::Edge::markNumericJacobian();
+
   //Xi - estimate the jacobian numerically
   VertexXiType* vi = static_cast<VertexXiType*>(_vertices[0]);
 
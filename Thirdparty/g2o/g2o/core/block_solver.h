@@ -162,9 +162,13 @@ namespace g2o {
       std::vector<PoseVectorType, Eigen::aligned_allocator<PoseVectorType> > _diagonalBackupPose;
       std::vector<LandmarkVectorType, Eigen::aligned_allocator<LandmarkVectorType> > _diagonalBackupLandmark;
 
-#    ifdef G2O_OPENMP
-      std::vector<OpenMPMutex> _coefficientsMutex;
-#    endif
+      // landmark blocks of each pose row of Hpl (CSR, landmarks in increasing order) for computing the
+      // Schur complement in parallel over the poses
+      std::vector<int> _poseLandmarkStart;
+      std::vector<int> _poseLandmarkIndices;
+      std::vector<PoseLandmarkMatrixType*> _poseLandmarkBlocks;
+
+      void computeSchurComplementParallel(int numThreads);
 
       bool _doSchur;
 
@@ -50,6 +50,22 @@ namespace g2o {
 
   using namespace std;
 
+  namespace {
+    thread_local bool numericJacobianMark = false;
+  }
+
+  void OptimizableGraph::Edge::markNumericJacobian()
+  {
+    numericJacobianMark = true;
+  }
+
+  bool OptimizableGraph::Edge::numericJacobianMarked()
+  {
+    const bool marked = numericJacobianMark;
+    numericJacobianMark = false;
+    return marked;
+  }
+
   OptimizableGraph::Data::Data(){
     _next = 0;
   }
@@ -389,6 +389,15 @@ namespace g2o {
 
         // indicates if all vertices are fixed
         virtual bool allVerticesFixed() const = 0;
+
+        /**
+         * The numeric Jacobian of the base edges (default linearizeOplus()) perturbs the estimates of the
+         * vertices, hence it cannot be evaluated in parallel with the other edges. It calls markNumericJacobian()
+         * so that the optimizer can detect the edge types using it (see SparseOptimizer::linearizeActiveEdges()).
+         * The mark is per thread. numericJacobianMarked() returns it and resets it.
+         */
+        static void markNumericJacobian();
+        static bool numericJacobianMarked();
         
         // computes the error of the edge and stores it in an internal structure
         virtual void computeError() = 0;
@@ -32,6 +32,9 @@
 #include <iterator>
 #include <cassert>
 #include <algorithm>
+#include <mutex>
+#include <typeindex>
+#include <unordered_map>
 
 #include "estimate_propagator.h"
 #include "optimization_algorithm.h"
@@ -46,9 +49,16 @@
 namespace g2o{
   using namespace std;
 
+  namespace {
+    // edge type -> its linearizeOplus() is the numeric Jacobian of the base edges (shared by all the optimizers)
+    std::mutex numericJacobianTypesMutex;
+    std::unordered_map<std::type_index, bool> numericJacobianTypes;
+  }
+
 
   SparseOptimizer::SparseOptimizer() :
-    _forceStopFlag(0), _verbose(false), _algorithm(0), _computeBatchStatistics(false)
+    _forceStopFlag(0), _verbose(false), _algorithm(0), _computeBatchStatistics(false),
+    _numThreads(1), _edgeWorkspacesDirty(true)
   {
     _graphActions.resize(AT_NUM_ELEMENTS);
   }
@@ -67,9 +77,8 @@ namespace g2o{
         (*(*it))(this);
     }
 
-#   ifdef G2O_OPENMP
-#   pragma omp parallel for default (shared) if (_activeEdges.size() > 50)
-#   endif
+    // each edge writes only its own error
+#   pragma omp parallel for default (shared) schedule(static) num_threads(_numThreads) if (_numThreads > 1 && _activeEdges.size() > 50)
     for (int k = 0; k < static_cast<int>(_activeEdges.size()); ++k) {
       OptimizableGraph::Edge* e = _activeEdges[k];
       e->computeError();
@@ -87,6 +96,63 @@ namespace g2o{
 
   }
 
+  void SparseOptimizer::setupEdgeWorkspaces()
+  {
+    const int numEdges = static_cast<int>(_activeEdges.size());
+    _edgeWorkspaces.resize(numEdges);
+    _parallelEdges.clear();
+    _sequentialEdges.clear();
+
+    std::lock_guard<std::mutex> lock(numericJacobianTypesMutex);
+    for (int k = 0; k < numEdges; ++k) {
+      OptimizableGraph::Edge* e = _activeEdges[k];
+      _edgeWorkspaces[k].updateSize(e);
+      bool workspaceAllocated = _edgeWorkspaces[k].allocate(); (void) workspaceAllocated;
+      assert(workspaceAllocated && "Error while allocating memory for the Jacobians");
+
+      std::unordered_map<std::type_index, bool>::const_iterator it = numericJacobianTypes.find(std::type_index(typeid(*e)));
+      if (it != numericJacobianTypes.end() && !it->second)
+        _parallelEdges.push_back(k);
+      else
+        _sequentialEdges.push_back(k);
+    }
+    _edgeWorkspacesDirty = false;
+  }
+
+  void SparseOptimizer::linearizeActiveEdges()
+  {
+    if (_edgeWorkspacesDirty || _edgeWorkspaces.size() != _activeEdges.size())
+      setupEdgeWorkspaces();
+
+    // analytic Jacobians: each edge reads the estimates of its vertices and writes only its own workspace
+#   pragma omp parallel for default (shared) schedule(static) num_threads(_numThreads) if (_numThreads > 1 && _parallelEdges.size() > 50)
+    for (int i = 0; i < static_cast<int>(_parallelEdges.size()); ++i) {
+      const int k = _parallelEdges[i];
+      _activeEdges[k]->linearizeOplus(_edgeWorkspaces[k]);
+    }
+
+    // numeric Jacobians (they perturb the estimates of the vertices) and edge types not seen yet
+    if (_sequentialEdges.empty())
+      return;
+    bool newTypes = false;
+    for (size_t i = 0; i < _sequentialEdges.size(); ++i) {
+      const int k = _sequentialEdges[i];
+      OptimizableGraph::Edge* e = _activeEdges[k];
+      OptimizableGraph::Edge::numericJacobianMarked(); // reset the mark
+      e->linearizeOplus(_edgeWorkspaces[k]);
+      const bool numeric = OptimizableGraph::Edge::numericJacobianMarked();
+
+      std::lock_guard<std::mutex> lock(numericJacobianTypesMutex);
+      std::pair<std::unordered_map<std::type_index, bool>::iterator, bool> res = numericJacobianTypes.insert(std::make_pair(std::type_index(typeid(*e)), numeric));
+      if (res.second)
+        newTypes = true;
+      else
+        res.first->second = res.first->second || numeric; // a type is analytic only if it never used the numeric Jacobian
+    }
+    if (newTypes)
+      _edgeWorkspacesDirty = true; // classify again the edges at the next call
+  }
+
   double SparseOptimizer::activeChi2( ) const
   {
     double chi = 0.0;
@@ -210,6 +276,7 @@ namespace g2o{
     }
     bool workspaceAllocated = _jacobianWorkspace.allocate(); (void) workspaceAllocated;
     assert(workspaceAllocated && "Error while allocating memory for the Jacobians");
+    _edgeWorkspacesDirty = true;
     clearIndexMapping();
     _activeVertices.clear();
     _activeVertices.reserve(vset.size());
@@ -269,6 +336,7 @@ namespace g2o{
   bool SparseOptimizer::initializeOptimization(HyperGraph::EdgeSet& eset){
     bool workspaceAllocated = _jacobianWorkspace.allocate(); (void) workspaceAllocated;
     assert(workspaceAllocated && "Error while allocating memory for the Jacobians");
+    _edgeWorkspacesDirty = true;
     clearIndexMapping();
     _activeVertices.clear();
     _activeEdges.clear();
@@ -490,6 +558,7 @@ namespace g2o{
     _ivMap.clear();
     _activeVertices.clear();
     _activeEdges.clear();
+    _edgeWorkspacesDirty = true;
     OptimizableGraph::clear();
   }
 
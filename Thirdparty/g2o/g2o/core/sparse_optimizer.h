@@ -34,6 +34,7 @@
 #include "batch_stats.h"
 
 #include <map>
+#include <vector>
 
 namespace g2o {
 
@@ -249,6 +250,21 @@ namespace g2o {
      */
     void computeActiveErrors();
 
+    /**
+     * Computes the Jacobians of all the edges in the activeSet. Each edge gets its own workspace, so that
+     * the Jacobians are computed in parallel (see setNumThreads()) and the quadratic forms can be then
+     * accumulated in the order of the active edges: the result does not depend on the number of threads.
+     * The edge types using the numeric Jacobian of the base edges are linearized sequentially.
+     */
+    void linearizeActiveEdges();
+
+    /**
+     * Number of threads used to compute the errors, the Jacobians and the Schur complement of this
+     * optimizer (requires OpenMP). The default 1 runs everything in the calling thread.
+     */
+    void setNumThreads(int numThreads) { _numThreads = numThreads > 1 ? numThreads : 1; }
+    int numThreads() const { return _numThreads; }
+
     /**
      * Linearizes the system by computing the Jacobians for the nodes
      * and edges in the graph
@@ -306,6 +322,14 @@ namespace g2o {
 
     BatchStatisticsContainer _batchStatistics;   ///< global statistics of the optimizer, e.g., timing, num-non-zeros
     bool _computeBatchStatistics;
+
+    int _numThreads;
+    bool _edgeWorkspacesDirty;                        ///< the active edges changed since the last linearizeActiveEdges()
+    std::vector<JacobianWorkspace> _edgeWorkspaces;   ///< one workspace for each active edge
+    std::vector<int> _parallelEdges;                  ///< indices of the active edges with analytic Jacobians
+    std::vector<int> _sequentialEdges;                ///< indices of the other active edges (numeric or unknown Jacobians)
+
+    void setupEdgeWorkspaces();
   };
 } // end namespace
 
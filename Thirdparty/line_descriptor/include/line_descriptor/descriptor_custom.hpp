@@ -854,6 +854,9 @@ void computeGaussianPyramid( const Mat& image, const int numOctaves );
 /* compute Sobel's derivatives */
 void computeSobel( const Mat& image, int numOctaves );
 
+/* compute Sobel's derivatives only on the octaves and image regions covered by the support regions of the input lines */
+void computeSobelForLines( const Mat& image, const std::vector<KeyLine>& keylines, int numOctaves );
+
 /* conversion of an LBD descriptor to its binary representation */
 unsigned char binaryConversion( float* f1, float* f2 );
 
@@ -934,7 +937,8 @@ struct LSDOptions{
         log_eps(0), 
         density_th(0.7),
         n_bins(1024),
-        min_length()
+        min_length(),
+        parallelOctaves(false)
     {}
 
     int    numOctaves;
@@ -947,6 +951,7 @@ struct LSDOptions{
     double density_th;
     int    n_bins;
     double min_length;
+    bool   parallelOctaves; // detect the lines of the different octaves in parallel (one LSD instance per octave)
 };    
     
 /* constructor */
@@ -201,25 +201,38 @@ void LSDDetectorC::detectImpl( const Mat& imageSrc, std::vector<KeyLine>& keylin
     lsd->computeGaussianPyramid( image, numOctaves, scale );      
   }
 
-  /* create an LSD extractor */
-  cv::Ptr<cv::lsd::LineSegmentDetector> ls = cv::lsd::createLineSegmentDetector( opts.refine,
-                                                                       opts.scale,
-                                                                       opts.sigma_scale,
-                                                                       opts.quant,
-                                                                       opts.ang_th,
-                                                                       opts.log_eps,
-                                                                       opts.density_th,
-                                                                       opts.n_bins);
-
   /* prepare a vector to host extracted segments */
-  std::vector<std::vector<cv::Vec4f> > lines_lsd;
+  std::vector<std::vector<cv::Vec4f> > lines_lsd( numOctaves );
 
   /* extract lines */
-  for ( int i = 0; i < numOctaves; i++ )
+  if( opts.parallelOctaves && numOctaves > 1 )
   {
-    std::vector<Vec4f> octave_lines;
-    ls->detect( vImagePyramid[i], octave_lines );
-    lines_lsd.push_back( octave_lines );
+    /* the LSD extractor keeps per-image state: each octave gets its own instance */
+    cv::parallel_for_( cv::Range( 0, numOctaves ), [&]( const cv::Range& range )
+    {
+      for ( int i = range.start; i < range.end; i++ )
+      {
+        cv::Ptr<cv::lsd::LineSegmentDetector> ls = cv::lsd::createLineSegmentDetector( opts.refine, opts.scale, opts.sigma_scale, opts.quant,
+                                                                                       opts.ang_th, opts.log_eps, opts.density_th, opts.n_bins );
+        ls->detect( vImagePyramid[i], lines_lsd[i] );
+      }
+    } );
+  }
+  else
+  {
+    /* create an LSD extractor */
+    cv::Ptr<cv::lsd::LineSegmentDetector> ls = cv::lsd::createLineSegmentDetector( opts.refine,
+                                                                         opts.scale,
+                                                                         opts.sigma_scale,
+                                                                         opts.quant,
+                                                                         opts.ang_th,
+                                                                         opts.log_eps,
+                                                                         opts.density_th,
+                                                                         opts.n_bins);
+    for ( int i = 0; i < numOctaves; i++ )
+    {
+      ls->detect( vImagePyramid[i], lines_lsd[i] );
+    }
   }
 
   const int diagSize = cvRound( sqrt((float)image.cols*image.cols + (float)image.rows*image.rows ) ); 
@@ -403,11 +403,12 @@ void BinaryDescriptor::computeSobel( const cv::Mat& image, int numOctaves )
 //  dxImg_vector.resize( params.numOfOctave_ );
 //  dyImg_vector.resize( params.numOfOctave_ );
 
-  dxImg_vector.resize( octaveImages.size() );
-  dyImg_vector.resize( octaveImages.size() );
+  const size_t numSobelOctaves = std::min( octaveImages.size(), images_sizes.size() );
+  dxImg_vector.resize( numSobelOctaves );
+  dyImg_vector.resize( numSobelOctaves );
 
   /* compute derivatives */
-  for ( size_t sobelCnt = 0; sobelCnt < octaveImages.size(); sobelCnt++ )
+  for ( size_t sobelCnt = 0; sobelCnt < numSobelOctaves; sobelCnt++ )
   {
     dxImg_vector[sobelCnt].create( images_sizes[sobelCnt].height, images_sizes[sobelCnt].width, CV_16SC1 );
     dyImg_vector[sobelCnt].create( images_sizes[sobelCnt].height, images_sizes[sobelCnt].width, CV_16SC1 );
@@ -417,6 +418,59 @@ void BinaryDescriptor::computeSobel( const cv::Mat& image, int numOctaves )
   }
 }
 
+/* compute Sobel's derivatives only where the LBD of the input lines will read them */
+void BinaryDescriptor::computeSobelForLines( const cv::Mat& image, const std::vector<KeyLine>& keylines, int numOctaves )
+{
+  if(!bSetGaussianPyramid)
+  {
+      computeGaussianPyramid( image, numOctaves );
+  }
+
+  const size_t numSobelOctaves = std::min( octaveImages.size(), images_sizes.size() );
+  dxImg_vector.resize( numSobelOctaves );
+  dyImg_vector.resize( numSobelOctaves );
+
+  /* half extent of the line support region along the orthogonal direction (see computeLBD()) */
+  const float halfHeight = (float) ( ( params.widthOfBand_ * NUM_OF_BANDS - 1 ) / 2 + 1 );
+
+  /* bounding box (in octave coordinates) of the support regions of the lines of each octave */
+  std::vector<cv::Rect> rois( numSobelOctaves );
+  for ( size_t l = 0; l < keylines.size(); l++ )
+  {
+    const KeyLine& kl = keylines[l];
+    if( kl.octave < 0 || kl.octave >= (int) numSobelOctaves )
+      continue;
+
+    const float c = std::fabs( std::cos( kl.angle ) );
+    const float s = std::fabs( std::sin( kl.angle ) );
+    const float halfWidth = (float) ( ( kl.numOfPixels - 1 ) / 2 + 1 );
+    const float extX = c * halfWidth + s * halfHeight + 1.f;  // +1 for rounding
+    const float extY = s * halfWidth + c * halfHeight + 1.f;
+    const float midX = 0.5f * ( kl.sPointInOctaveX + kl.ePointInOctaveX );
+    const float midY = 0.5f * ( kl.sPointInOctaveY + kl.ePointInOctaveY );
+
+    const cv::Rect lineRoi( cvFloor( midX - extX ), cvFloor( midY - extY ), cvCeil( 2.f * extX ) + 2, cvCeil( 2.f * extY ) + 2 );
+    rois[kl.octave] = rois[kl.octave].area() > 0 ? ( rois[kl.octave] | lineRoi ) : lineRoi;
+  }
+
+  for ( size_t sobelCnt = 0; sobelCnt < numSobelOctaves; sobelCnt++ )
+  {
+    /* N.B.: the buffers keep their allocation across frames */
+    dxImg_vector[sobelCnt].create( images_sizes[sobelCnt].height, images_sizes[sobelCnt].width, CV_16SC1 );
+    dyImg_vector[sobelCnt].create( images_sizes[sobelCnt].height, images_sizes[sobelCnt].width, CV_16SC1 );
+
+    const cv::Rect roi = rois[sobelCnt] & cv::Rect( 0, 0, images_sizes[sobelCnt].width, images_sizes[sobelCnt].height );
+    if( roi.area() == 0 )
+      continue;
+
+    /* Sobel on a submatrix reads the neighbouring pixels of the parent image: the result matches the one of the full image */
+    cv::Mat dxRoi = dxImg_vector[sobelCnt]( roi );
+    cv::Mat dyRoi = dyImg_vector[sobelCnt]( roi );
+    cv::Sobel( octaveImages[sobelCnt]( roi ), dxRoi, CV_16SC1, 1, 0, 3 );
+    cv::Sobel( octaveImages[sobelCnt]( roi ), dyRoi, CV_16SC1, 0, 1, 3 );
+  }
+}
+
 /* utility function for conversion of an LBD descriptor to its binary representation */
 unsigned char BinaryDescriptor::binaryConversion( float* f1, float* f2 )
 {
@@ -631,11 +685,12 @@ void BinaryDescriptor::computeImpl( const Mat& imageSrc, std::vector<KeyLine>& k
   
   //std::cout<< "octaveIndex: " << octaveIndex << std::endl; 
 
+  /* only the octaves and regions covered by the input lines are needed */
   if( !useDetectionData )
-    bd->computeSobel( image, octaveIndex + 1 );
+    bd->computeSobelForLines( image, keylines, octaveIndex + 1 );
 
   if(bSetGaussianPyramid)
-    assert( (octaveIndex + 1 ) == params.numOfOctave_ );
+    assert( (octaveIndex + 1 ) <= params.numOfOctave_ );
   
   /* create a ScaleLines object */
   OctaveSingleLine fictiousOSL;
@@ -1485,7 +1540,6 @@ void BinaryDescriptor::setGaussianPyramid(const std::vector<cv::Mat>& pyrs, int
     if ((borderX > 0) || (borderY > 0))
     {
         octaveImages.resize(pyrs.size());
-        images_sizes.resize(pyrs.size());
         
         for (int i = 0; i < numOctaves; i++)
         {
@@ -1507,6 +1561,7 @@ void BinaryDescriptor::setGaussianPyramid(const std::vector<cv::Mat>& pyrs, int
         octaveImages = pyrs; // N.B.: memory sharing when copying element images 
     }
     
+    images_sizes.clear();
     for (int i = 0; i < params.numOfOctave_; i++)
     {    
         images_sizes.push_back( octaveImages[i].size() );
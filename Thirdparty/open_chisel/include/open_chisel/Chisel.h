@@ -31,6 +31,9 @@
 #include <open_chisel/geometry/Frustum.h>
 #include <open_chisel/pointcloud/PointCloud.h>
 
+#include <numeric>
+#include <algorithm>
+
 namespace chisel
 {
 
@@ -85,48 +88,11 @@ namespace chisel
                     ChunkIDList chunksIntersecting;
                     chunkManager.GetChunkIDsIntersecting(frustum, &chunksIntersecting);
 
-                    std::mutex mutex;
-                    ChunkIDList garbageChunks;
-                    for(const ChunkID& chunkID : chunksIntersecting)
-                    //parallel_for(chunksIntersecting.begin(), chunksIntersecting.end(), [&](const ChunkID& chunkID)
+                    IntegrateChunksParallel(chunksIntersecting, [&](Chunk* chunk)
                     {
-                        bool chunkNew = false;
-
-                        mutex.lock();
-                        if (!chunkManager.HasChunk(chunkID))
-                        {
-                           chunkNew = true;
-                           chunkManager.CreateChunk(chunkID);
-                        }
-
-                        ChunkPtr chunk = chunkManager.GetChunk(chunkID);
-                        mutex.unlock();
-
-                        bool needsUpdate = integrator.Integrate(depthImage, camera, extrinsic, chunk.get());
-
-                        mutex.lock();
-                        if (needsUpdate)
-                        {
-                            for (int dx = -1; dx <= 1; dx++)
-                            {
-                                for (int dy = -1; dy <= 1; dy++)
-                                {
-                                    for (int dz = -1; dz <= 1; dz++)
-                                    {
-                                        meshesToUpdate[chunkID + ChunkID(dx, dy, dz)] = true;
-                                    }
-                                }
-                            }
-                        }
-                        else if(chunkNew)
-                        {
-                            garbageChunks.push_back(chunkID);
-                        }
-                        mutex.unlock();
-                    }
-                    //);
+                        return integrator.Integrate(depthImage, camera, extrinsic, chunk);
+                    });
                     printf("CHISEL: Done with scan\n");
-                    GarbageCollect(garbageChunks);
                     //chunkManager.PrintMemoryStatistics();
             }
 
@@ -145,51 +111,10 @@ namespace chisel
                     ChunkIDList chunksIntersecting;
                     chunkManager.GetChunkIDsIntersecting(frustum, &chunksIntersecting);
 
-                    std::mutex mutex;
-                    ChunkIDList garbageChunks;
-                    for ( const ChunkID& chunkID : chunksIntersecting)
-                    //parallel_for(chunksIntersecting.begin(), chunksIntersecting.end(), [&](const ChunkID& chunkID)
+                    IntegrateChunksParallel(chunksIntersecting, [&](Chunk* chunk)
                     {
-
-                        mutex.lock();
-                        bool chunkNew = false;
-                        if (!chunkManager.HasChunk(chunkID))
-                        {
-                           chunkNew = true;
-                           chunkManager.CreateChunk(chunkID);
-                        }
-
-                        ChunkPtr chunk = chunkManager.GetChunk(chunkID);
-                        mutex.unlock();
-
-
-                        bool needsUpdate = integrator.IntegrateColor(depthImage, depthCamera, depthExtrinsic, colorImage, colorCamera, colorExtrinsic, chunk.get());
-
-                        mutex.lock();
-                        if (needsUpdate)
-                        {
-                            for (int dx = -1; dx <= 1; dx++)
-                            {
-                                for (int dy = -1; dy <= 1; dy++)
-                                {
-                                    for (int dz = -1; dz <= 1; dz++)
-                                    {
-                                        meshesToUpdate[chunkID + ChunkID(dx, dy, dz)] = true;
-                                    }
-                                }
-                            }
-                        }
-                        else if(chunkNew)
-                        {
-                            garbageChunks.push_back(chunkID);
-                        }
-                        mutex.unlock();
-                    }
-                    //,
-                    //2 // num threads
-                    //);
-
-                    GarbageCollect(garbageChunks);
+                        return integrator.IntegrateColor(depthImage, depthCamera, depthExtrinsic, colorImage, colorCamera, colorExtrinsic, chunk);
+                    });
                     //chunkManager.PrintMemoryStatistics();
             }
             
@@ -209,51 +134,10 @@ namespace chisel
                     ChunkIDList chunksIntersecting;
                     chunkManager.GetChunkIDsIntersecting(frustum, &chunksIntersecting);
 
-                    std::mutex mutex;
-                    ChunkIDList garbageChunks;
-                    for ( const ChunkID& chunkID : chunksIntersecting)
-                    //parallel_for(chunksIntersecting.begin(), chunksIntersecting.end(), [&](const ChunkID& chunkID)
+                    IntegrateChunksParallel(chunksIntersecting, [&](Chunk* chunk)
                     {
-
-                        //mutex.lock();
-                        bool chunkNew = false;
-                        if (!chunkManager.HasChunk(chunkID))
-                        {
-                           chunkNew = true;
-                           chunkManager.CreateChunk(chunkID);
-                        }
-
-                        ChunkPtr chunk = chunkManager.GetChunk(chunkID);
-                        //mutex.unlock();
-
-
-                        bool needsUpdate = integrator.IntegrateColorWithOneCameraModelBGR(depthImage, depthCamera, depthExtrinsic, colorImage, colorCamera, colorExtrinsic, chunk.get());
-
-                        //mutex.lock();
-                        if (needsUpdate)
-                        {
-                            for (int dx = -1; dx <= 1; dx++)
-                            {
-                                for (int dy = -1; dy <= 1; dy++)
-                                {
-                                    for (int dz = -1; dz <= 1; dz++)
-                                    {
-                                        meshesToUpdate[chunkID + ChunkID(dx, dy, dz)] = true;
-                                    }
-                                }
-                            }
-                        }
-                        else if(chunkNew)
-                        {
-                            garbageChunks.push_back(chunkID);
-                        }
-                        //mutex.unlock();
-                    }
-                    //,
-                    //2 // num threads
-                    //);
-
-                    GarbageCollect(garbageChunks);
+                        return integrator.IntegrateColorWithOneCameraModelBGR(depthImage, depthCamera, depthExtrinsic, colorImage, colorCamera, colorExtrinsic, chunk);
+                    });
                     //chunkManager.PrintMemoryStatistics();
             }
             
@@ -333,10 +217,72 @@ namespace chisel
             void Reset();
 
             const ChunkSet& GetMeshesToUpdate() const { return meshesToUpdate; }
+            const ChunkSet& GetUpdatedMeshes() const { return updatedMeshes; } // meshes recomputed (or deformed) by the last UpdateMeshes()
+
+            inline int GetNumThreads() const { return numThreads; }
+            inline void SetNumThreads(int n) { numThreads = std::max(n, 1); }
 
         protected:
+
+            // Integrates the chunks in parallel: the missing chunks are created in advance, so that the workers never
+            // modify the chunk map and each worker only writes the voxels of its own chunk.
+            // integrateChunk(Chunk*) returns true if the chunk has been updated.
+            template <class IntegrateChunkFunction> void IntegrateChunksParallel(const ChunkIDList& chunkIDs, IntegrateChunkFunction&& integrateChunk)
+            {
+                    const size_t numChunks = chunkIDs.size();
+                    std::vector<Chunk*> chunks(numChunks);
+                    std::vector<uint8_t> chunksNew(numChunks, 0);
+                    std::vector<uint8_t> chunksUpdated(numChunks, 0);
+                    for (size_t i = 0; i < numChunks; i++)
+                    {
+                        ChunkMap::iterator itc = chunkManager.FindChunk(chunkIDs[i]);
+                        if (itc != chunkManager.ChunksEnd())
+                        {
+                            chunks[i] = itc->second.get();
+                        }
+                        else
+                        {
+                            chunks[i] = chunkManager.CreateChunk2(chunkIDs[i]).get();
+                            chunksNew[i] = 1;
+                        }
+                    }
+
+                    std::vector<size_t> indices(numChunks);
+                    std::iota(indices.begin(), indices.end(), 0);
+                    parallel_for(indices.begin(), indices.end(), [&](const size_t& i)
+                    {
+                        chunksUpdated[i] = integrateChunk(chunks[i]) ? 1 : 0;
+                    },
+                    numThreads, kMinChunksPerThread);
+
+                    ChunkIDList garbageChunks;
+                    for (size_t i = 0; i < numChunks; i++)
+                    {
+                        if (chunksUpdated[i])
+                        {
+                            MarkMeshesToUpdate(*chunks[i]);
+                        }
+                        else if (chunksNew[i])
+                        {
+                            garbageChunks.push_back(chunkIDs[i]);
+                        }
+                    }
+                    GarbageCollect(garbageChunks);
+            }
+
+            // Marks the meshes depending on the changed voxels of the chunk: its own mesh and the ones of the neighbor chunks
+            // whose marching cubes and SDF gradients reach the changed voxels (all the 26 neighbors if no changed voxel was recorded).
+            void MarkMeshesToUpdate(Chunk& chunk);
+
+        protected:
+            static const int kMinChunksPerThread = 4;
+            static const int kMeshBorderVoxels = 2; // voxels of a chunk read by the meshes of the neighbor chunks, on each side
+
             ChunkManager chunkManager;
             ChunkSet meshesToUpdate;
+            ChunkSet updatedMeshes;
+            ChunkSet deformedMeshes; // meshes whose vertices were transformed in place by Deform() (not recomputed)
+            int numThreads = 8;
 
     };
     typedef std::shared_ptr<Chisel> ChiselPtr;
@@ -145,6 +145,20 @@ namespace chisel
             VoxelID GetLocalVoxelIDFromGlobal(const Point3& worldPoint) const;
             Point3 GetLocalCoordsFromGlobal(const Point3& worldPoint) const;
 
+            // bounding box of the voxels changed by the integrations since the last reset (used for selecting the meshes to update)
+            inline void MarkVoxelChanged(const VoxelID& voxelID)
+            {
+                const int yz = voxelID / numVoxels(0);
+                const Point3 coords(voxelID - yz * numVoxels(0), yz % numVoxels(1), yz / numVoxels(1));
+                changedVoxelsMin = changedVoxelsMin.cwiseMin(coords);
+                changedVoxelsMax = changedVoxelsMax.cwiseMax(coords);
+            }
+
+            inline bool HasChangedVoxels() const { return changedVoxelsMin(0) <= changedVoxelsMax(0); }
+            inline const Point3& GetChangedVoxelsMin() const { return changedVoxelsMin; }
+            inline const Point3& GetChangedVoxelsMax() const { return changedVoxelsMax; }
+            void ResetChangedVoxels();
+
         protected:
             ChunkID ID;
             Eigen::Vector3i numVoxels;
@@ -158,6 +172,8 @@ namespace chisel
             Vec3 origin;
             Point3 originPoint3; 
 
+            Point3 changedVoxelsMin, changedVoxelsMax;
+
     };
 
     typedef std::shared_ptr<Chunk> ChunkPtr;
@@ -242,7 +242,7 @@ namespace chisel
 
             void RecomputeMesh(const ChunkID& chunkID, std::mutex& mutex);
             void RecomputeMeshes(const ChunkSet& chunks);
-            void RecomputeMeshesParallel(const ChunkSet& chunks);            
+            void RecomputeMeshesParallel(const ChunkSet& chunks, const int numThreads = 8);            
             void ComputeNormalsFromGradients(Mesh* mesh);
 
             inline const Eigen::Vector3i& GetChunkSize() const { return chunkSize; }
@@ -260,6 +260,8 @@ namespace chisel
             void Deform(MapKfidRt& deformationMap, ChunkSet& meshesToUpdate);               
             
         protected:
+
+            static const int kMinMeshesPerThread = 4;
             
             ChunkMap chunks;   // chunkID -> corresponding chunk
             MeshMap allMeshes; // chunkID -> corresponding mesh           
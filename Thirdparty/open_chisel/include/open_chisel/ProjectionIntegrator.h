@@ -92,6 +92,7 @@ public:
                 DistVoxel& voxel = chunk->GetDistVoxelMutable(i);
                 voxel.Integrate(surfaceDist, 1.0f);
                 updated = true;
+                chunk->MarkVoxelChanged(i);
             }
             else if (enableVoxelCarving && surfaceDist > truncation + carvingDist)
             {
@@ -100,6 +101,7 @@ public:
                 {
                     voxel.Carve();
                     updated = true;
+                    chunk->MarkVoxelChanged(i);
                 }
             }
 
@@ -167,6 +169,7 @@ public:
                 voxel.Integrate(surfaceDist, weighter->GetWeight(surfaceDist, truncation));
 
                 updated = true;
+                chunk->MarkVoxelChanged(i);
             }
             else if (enableVoxelCarving && surfaceDist > truncation + carvingDist)
             {
@@ -175,6 +178,7 @@ public:
                 {
                     voxel.Carve();
                     updated = true;
+                    chunk->MarkVoxelChanged(i);
                 }
             }
 
@@ -249,6 +253,7 @@ public:
                 voxel.Integrate(surfaceDist, weighter->GetWeight(surfaceDist, truncation));
 
                 updated = true;
+                chunk->MarkVoxelChanged(i);
             }
             else if (enableVoxelCarving && surfaceDist > truncation + carvingDist)
             {
@@ -258,6 +263,7 @@ public:
                     //voxel.Carve();
                     voxel.Reset();
                     updated = true;
+                    chunk->MarkVoxelChanged(i);
                 }
             }
 
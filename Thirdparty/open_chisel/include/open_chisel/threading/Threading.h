@@ -37,7 +37,7 @@ namespace chisel
         std::vector<std::thread> threads;
         threads.reserve(nthreads);
         Iterator it = first;
-        for (; it < last - group; it = std::min(it + group, last))
+        for (; last - it > group; it += group)
         {
             threads.push_back(std::thread([=,&f](){std::for_each(it, std::min(it+group, last), f);}));
         }
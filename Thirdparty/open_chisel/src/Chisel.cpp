@@ -52,6 +52,8 @@ void Chisel::Reset()
 {
     chunkManager.Reset();
     meshesToUpdate.clear();
+    updatedMeshes.clear();
+    deformedMeshes.clear();
 }
 
 void Chisel::UpdateMeshes()
@@ -59,9 +61,49 @@ void Chisel::UpdateMeshes()
 #if 0    
     chunkManager.RecomputeMeshes(meshesToUpdate);
 #else    
-    chunkManager.RecomputeMeshesParallel(meshesToUpdate);    
+    chunkManager.RecomputeMeshesParallel(meshesToUpdate, numThreads);    
 #endif    
-    meshesToUpdate.clear();
+    // keep track of the recomputed and deformed meshes (e.g. for the incremental export of the meshes)
+    updatedMeshes.clear();
+    updatedMeshes.swap(meshesToUpdate);
+    for (const auto& deformedMesh : deformedMeshes)
+    {
+        updatedMeshes[deformedMesh.first] = true;
+    }
+    deformedMeshes.clear();
+}
+
+void Chisel::MarkMeshesToUpdate(Chunk& chunk)
+{
+    const ChunkID& chunkID = chunk.GetID();
+
+    ChunkID minOffset(-1, -1, -1);
+    ChunkID maxOffset(1, 1, 1);
+    if (chunk.HasChangedVoxels())
+    {
+        // the mesh of the lower neighbor reads the first voxels of the chunk (marching cubes and SDF gradients),
+        // the mesh of the upper neighbor reads its last voxels (SDF gradients)
+        const Point3& changedMin = chunk.GetChangedVoxelsMin();
+        const Point3& changedMax = chunk.GetChangedVoxelsMax();
+        const Eigen::Vector3i& numVoxels = chunk.GetNumVoxels();
+        for (int i = 0; i < 3; i++)
+        {
+            minOffset(i) = (changedMin(i) < kMeshBorderVoxels) ? -1 : 0;
+            maxOffset(i) = (changedMax(i) >= numVoxels(i) - kMeshBorderVoxels) ? 1 : 0;
+        }
+        chunk.ResetChangedVoxels();
+    }
+
+    for (int dx = minOffset(0); dx <= maxOffset(0); dx++)
+    {
+        for (int dy = minOffset(1); dy <= maxOffset(1); dy++)
+        {
+            for (int dz = minOffset(2); dz <= maxOffset(2); dz++)
+            {
+                meshesToUpdate[chunkID + ChunkID(dx, dy, dz)] = true;
+            }
+        }
+    }
 }
 
 void Chisel::GarbageCollect(const ChunkIDList& chunks)
@@ -535,6 +577,7 @@ template <class DataType> void Chisel::IntegratePointCloudWidthDepth(const Proje
                 //voxel.Integrate((uint8_t) (color.x() * 255.0f), (uint8_t) (color.y() * 255.0f), (uint8_t) (color.z() * 255.0f), 1); // added for color integration 
                 colorVoxel.IntegrateSimple((uint8_t) (color.x() * 255.0f), (uint8_t) (color.y() * 255.0f), (uint8_t) (color.z() * 255.0f), 1); // added for color integration 
                 updatedChunks[chunk->GetID()] = true;
+                chunk->MarkVoxelChanged(id);
             }
 #if 0            
             else if (!wasNew && carving && u > truncation + carvingDist)
@@ -555,15 +598,10 @@ template <class DataType> void Chisel::IntegratePointCloudWidthDepth(const Proje
 #if 1        
         if (updatedChunk.second)
         {
-            for (int dx = -1; dx <= 1; dx++)
+            ChunkMap::iterator itc = chunkManager.FindChunk(updatedChunk.first);
+            if (itc != chunkManager.ChunksEnd())
             {
-                for (int dy = -1; dy <= 1; dy++)
-                {
-                    for (int dz = -1; dz <= 1; dz++)
-                    {
-                        meshesToUpdate[updatedChunk.first + ChunkID(dx, dy, dz)] = true;
-                    }
-                }
+                MarkMeshesToUpdate(*itc->second);
             }
         }
 #else
@@ -588,6 +626,12 @@ template <class DataType> void Chisel::IntegratePointCloudWidthDepth(const Proje
 void Chisel::Deform(MapKfidRt& deformationMap)   
 {
     chunkManager.Deform(deformationMap, meshesToUpdate);
+
+    // the meshes left after the deformation had their vertices transformed in place
+    for (const auto& mesh : chunkManager.GetAllMeshes())
+    {
+        deformedMeshes[mesh.first] = true;
+    }
 }
 
 
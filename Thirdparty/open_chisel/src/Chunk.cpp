@@ -25,7 +25,7 @@ namespace chisel
 {
 
     Chunk::Chunk() :
-            voxelResolutionMeters(0)
+            voxelResolutionMeters(0), changedVoxelsMin(0, 0, 0), changedVoxelsMax(-1, -1, -1)
     {
         // TODO Auto-generated constructor stub
 
@@ -48,6 +48,8 @@ namespace chisel
         origin = Vec3(numVoxels(0) * ID(0) * voxelResolutionMeters, numVoxels(1) * ID(1) * voxelResolutionMeters, numVoxels(2) * ID(2) * voxelResolutionMeters);
         
         originPoint3 = Point3(ID.x() * numVoxels.x(), ID.y() * numVoxels.y(), ID.z() * numVoxels.z());
+
+        ResetChangedVoxels();
     }
 
     Chunk::~Chunk()
@@ -55,6 +57,12 @@ namespace chisel
 
     }
 
+    void Chunk::ResetChangedVoxels()
+    {
+        changedVoxelsMin = numVoxels;
+        changedVoxelsMax = Point3(-1, -1, -1);
+    }
+
     void Chunk::AllocateDistVoxels()
     {
         const int totalNum = GetTotalNumVoxels();
@@ -199,7 +199,7 @@ namespace chisel
         
     }
     
-    void ChunkManager::RecomputeMeshesParallel(const ChunkSet& chunkMeshes)
+    void ChunkManager::RecomputeMeshesParallel(const ChunkSet& chunkMeshes, const int numThreads)
     {
         if (chunkMeshes.empty())
         {
@@ -217,7 +217,9 @@ namespace chisel
         parallel_for(vChuncks.begin(), vChuncks.end(), [this, &mutex](const ChunkID& chunk)
         {
             this->RecomputeMesh(chunk, mutex);
-        });        
+        },
+        numThreads, kMinMeshesPerThread); // N.B. with the default threshold (1000 items per thread) the meshes of a keyframe were recomputed serially 
+
         
     }
 
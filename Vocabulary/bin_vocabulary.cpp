@@ -22,6 +22,13 @@ void load_as_binary(PLVS2::ORBVocabulary* voc, const std::string infile) {
   printf("Loading fom binary: %.2fs\n", (double)(clock() - tStart)/CLOCKS_PER_SEC);
 }
 
+bool load_as_flat(PLVS2::ORBVocabulary* voc, const std::string infile) {
+  clock_t tStart = clock();
+  bool res = voc->loadFromFlatFile(infile);
+  printf("Loading fom flat (mapped): %.2fs\n", (double)(clock() - tStart)/CLOCKS_PER_SEC);
+  return res;
+}
+
 void save_as_xml(PLVS2::ORBVocabulary* voc, const std::string outfile) {
   clock_t tStart = clock();
   voc->save(outfile);
@@ -40,6 +47,13 @@ void save_as_binary(PLVS2::ORBVocabulary* voc, const std::string outfile) {
   printf("Saving as binary: %.2fs\n", (double)(clock() - tStart)/CLOCKS_PER_SEC);
 }
 
+bool save_as_flat(PLVS2::ORBVocabulary* voc, const std::string outfile) {
+  clock_t tStart = clock();
+  bool res = voc->saveToFlatFile(outfile);
+  printf("Saving as flat: %.2fs\n", (double)(clock() - tStart)/CLOCKS_PER_SEC);
+  return res;
+}
+
 
 int main(int argc, char **argv) {
   cout << "BoW load/save benchmark" << endl;
@@ -48,6 +62,18 @@ int main(int argc, char **argv) {
   load_as_text(voc, "ORBvoc.txt");
   save_as_binary(voc, "ORBvoc.bin");
 
+  // the flat file is mapped read-only by System (preferred to the binary one)
+  if(!save_as_flat(voc, "ORBvoc.flat")) {
+    cerr << "Cannot save ORBvoc.flat" << endl;
+    return 1;
+  }
+  PLVS2::ORBVocabulary* vocFlat = new PLVS2::ORBVocabulary();
+  if(!load_as_flat(vocFlat, "ORBvoc.flat") || vocFlat->getDigest() != voc->getDigest()) {
+    cerr << "ORBvoc.flat does not match ORBvoc.txt" << endl;
+    return 1;
+  }
+  cout << "vocabulary digest: " << voc->getDigest() << endl;
+
   return 0;
 }
 
@@ -19,8 +19,8 @@ if [ ! -f ORBvoc.txt ]; then
 	tar -xf ORBvoc.txt.tar.gz
 fi	
 
-if [ ! -f ORBvoc.bin ] && [ -f bin_vocabulary ]; then
-	echo "Converting vocabulary to binary version"
+if { [ ! -f ORBvoc.bin ] || [ ! -f ORBvoc.flat ]; } && [ -f bin_vocabulary ]; then
+	echo "Converting vocabulary to binary and flat (mapped) versions"
 	./bin_vocabulary
 fi
 
@@ -0,0 +1,208 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BA_SOLVER_H
+#define BA_SOLVER_H
+
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+#include <Eigen/Cholesky>
+#include <Eigen/SparseCore>
+#include <Eigen/SparseCholesky>
+
+#ifdef USE_G2O_NEW
+#include "Thirdparty/g2o_new/install/include/g2o/core/sparse_optimizer.h"
+#else
+#include "Thirdparty/g2o/g2o/core/sparse_optimizer.h"
+#endif
+
+
+namespace PLVS2
+{
+
+/// Levenberg-Marquardt solver for the bundle adjustment graphs of PLVS with an explicit Schur complement over the landmarks.
+/// With lines, g2o needs g2o::BlockSolverX since the landmarks mix 3-DoF points (g2o::VertexSBAPointXYZ) and 6-DoF
+/// lines (g2o::VertexSBALine, the two endpoints). Here each landmark type has its own fixed-size blocks:
+/// 6x6 pose blocks, 3x3/6x6 point/line blocks and 6x3/6x6 pose-landmark blocks, stored contiguously per type.
+/// The reduced camera system is built in parallel: each landmark owns its blocks and its Schur terms, each pose owns
+/// its row of the reduced system (accumulated in ascending landmark order), so the result does not depend on the
+/// number of threads. The reduced system is solved with a dense Cholesky factorization for small windows and with a
+/// sparse LDLT factorization (pattern analyzed once in Init()) otherwise.
+/// The solver works on a graph built for g2o (the edges compute their errors and Jacobians) and reproduces the
+/// iterations of g2o::OptimizationAlgorithmLevenberg (damping strategy, step acceptance and stop criteria).
+/// Supported edges: point (mono/stereo/rgbd/right camera) and line (mono/stereo) observations between a landmark
+/// (vertex 0) and a g2o::VertexSE3Expmap (vertex 1), and line priors. Init() fails on any other graph.
+class BASolver
+{
+public:
+
+    struct Params
+    {
+        int numThreads = 1;
+        double lambdaInit = 0;               // 0: tau * max diagonal element of the Hessian (as g2o)
+        double tau = 1e-5;
+        int maxTrialsAfterFailure = 10;
+        int maxDenseNumPoses = 40;           // the reduced camera system is solved with a dense factorization up to this number of poses
+    };
+
+public:
+
+    BASolver() = default;
+
+    void SetParams(const Params& params) { params_ = params; }
+    const Params& GetParams() const { return params_; }
+
+    /// Set up the blocks for the active vertices and edges of optimizer (to be called after initializeOptimization()).
+    /// Return false if the graph contains vertices or edges that are not supported: the g2o algorithm must be used.
+    bool Init(g2o::SparseOptimizer* optimizer);
+
+    /// Run numIterations Levenberg-Marquardt iterations (stopped by the force-stop flag of the optimizer).
+    /// The errors of the active edges are up to date with the final estimates. The post-iteration actions of the optimizer
+    /// are called after each iteration. Return the number of iterations.
+    int Optimize(const int numIterations);
+
+    double InitialChi2() const { return initialChi2_; }
+    double FinalChi2() const { return finalChi2_; }
+    double FinalLambda() const { return finalLambda_; }  // damping of the last iteration
+
+    int NumPoses() const { return numPoses_; }
+    int NumPoints() const { return points_.Size(); }
+    int NumLines() const { return lines_.Size(); }
+
+protected:
+
+    typedef Eigen::Matrix<double,6,6> Matrix6d;
+    typedef Eigen::Matrix<double,6,1> Vector6d;
+
+    enum EdgeKind
+    {
+        kEdgePointMono = 0,   // 2D error (also the observations of the right camera)
+        kEdgePointStereo,     // 3D error (stereo and rgbd)
+        kEdgeLineMono,        // 2D error
+        kEdgeLineStereo,      // 4D error
+        kEdgeLinePrior        // unary 6D error on a line
+    };
+
+    struct EdgeInfo
+    {
+        g2o::OptimizableGraph::Edge* edge;
+        EdgeKind kind;
+        int pose;             // -1 if fixed
+        int landmark;         // -1 if fixed
+        int pair;             // pose-landmark block, -1 if one of the two is fixed
+    };
+
+    /// Blocks of the landmarks with dimension L (points or lines)
+    template<int L>
+    struct LandmarkBlocks
+    {
+        typedef Eigen::Matrix<double,L,L> MatrixL;
+        typedef Eigen::Matrix<double,L,1> VectorL;
+        typedef Eigen::Matrix<double,6,L> Matrix6L;
+
+        std::vector<g2o::OptimizableGraph::Vertex*> vertices;
+        std::vector<MatrixL, Eigen::aligned_allocator<MatrixL> > H, Hinv;
+        std::vector<VectorL, Eigen::aligned_allocator<VectorL> > b, Hinvb, dx;
+
+        std::vector<int> edgeStart, edges;     // CSR: edges of each landmark
+        std::vector<int> pairStart;            // the pairs of a landmark are contiguous: [pairStart[l], pairStart[l+1])
+        std::vector<int> pairPose;             // pose of each pair
+        std::vector<int> pairLandmark;         // landmark of each pair
+        std::vector<Matrix6L, Eigen::aligned_allocator<Matrix6L> > W;   // pose-landmark blocks
+        std::vector<Matrix6L, Eigen::aligned_allocator<Matrix6L> > Y;   // W * Hinv
+        std::vector<Matrix6d, Eigen::aligned_allocator<Matrix6d> > V;   // pose block terms of each pair
+        std::vector<Vector6d, Eigen::aligned_allocator<Vector6d> > g;   // pose gradient terms of each pair
+
+        std::vector<int> posePairStart, posePairs;  // CSR: pairs of each pose (ascending landmark order)
+
+        struct SchurTerm { int p, q, block; };       // S_block -= Y_p * W_q^T
+        std::vector<int> schurStart;                // CSR: terms of each row of the reduced camera system (ascending landmark order)
+        std::vector<SchurTerm> schurTerms;
+
+        int Size() const { return (int)vertices.size(); }
+    };
+
+protected:
+
+    /// Accumulate the Hessian blocks and the gradient of the current linearization
+    void BuildSystem();
+
+    /// Solve the damped system. Return false if the factorization failed.
+    bool Solve(const double lambda);
+
+    template<int L> void BuildLandmarkBlocks(LandmarkBlocks<L>& lm);
+    template<int L> void AccumulatePosePairs(const LandmarkBlocks<L>& lm, const int pose);
+    template<int L> void EliminateLandmarks(LandmarkBlocks<L>& lm, const double lambda);
+    template<int L> void ReduceLandmarks(const LandmarkBlocks<L>& lm, const int pose);
+    template<int L> void BackSubstitute(LandmarkBlocks<L>& lm);
+    template<int L> void SetupPairs(LandmarkBlocks<L>& lm, std::vector<std::vector<int> >& rowPattern);
+    template<int L> void SetupSchurTerms(LandmarkBlocks<L>& lm);
+
+    void AccumulateLandmarkEdge(const EdgeInfo& info, const double w, LandmarkBlocks<3>& lm, const int l);
+    void AccumulateLandmarkEdge(const EdgeInfo& info, const double w, LandmarkBlocks<6>& lm, const int l);
+    void AccumulatePoseEdge(const EdgeInfo& info, const double w, Matrix6d& H, Vector6d& b);
+
+    /// Apply the increments to the estimates of the free vertices
+    void Update();
+
+    /// Sum of dx*(lambda*dx + b) (the predicted cost reduction of g2o::OptimizationAlgorithmLevenberg)
+    double ComputeScale(const double lambda) const;
+
+    double MaxDiagonal() const;
+
+protected:
+
+    Params params_;
+
+    g2o::SparseOptimizer* optimizer_ = nullptr;
+
+    std::vector<EdgeInfo> edges_;
+    std::vector<double> edgeWeights_;               // robust kernel weights of the current linearization
+
+    // poses
+    int numPoses_ = 0;
+    std::vector<g2o::OptimizableGraph::Vertex*> poseVertices_;
+    std::vector<Matrix6d, Eigen::aligned_allocator<Matrix6d> > Hpp_;
+    std::vector<Vector6d, Eigen::aligned_allocator<Vector6d> > bp_;
+    std::vector<int> poseEdgeStart_, poseEdges_;   // CSR: edges of each pose with a fixed landmark (the others are accumulated per pair)
+
+    LandmarkBlocks<3> points_;
+    LandmarkBlocks<6> lines_;
+
+    // reduced camera system: upper block triangle stored by rows
+    std::vector<int> reducedRowStart_, reducedCols_;
+    std::vector<Matrix6d, Eigen::aligned_allocator<Matrix6d> > S_;
+    Eigen::VectorXd rhs_, dxPoses_;
+
+    bool bDense_ = true;
+    Eigen::MatrixXd denseS_;                        // lower triangle
+    Eigen::LLT<Eigen::MatrixXd, Eigen::Lower> denseSolver_;
+    Eigen::SparseMatrix<double> sparseS_;           // lower triangle: the columns of pose i are the transposed row i of S_
+    Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>, Eigen::Lower> sparseSolver_;
+
+    double initialChi2_ = 0;
+    double finalChi2_ = 0;
+    double finalLambda_ = 0;
+};
+
+} // namespace PLVS2
+
+#endif // BA_SOLVER_H
@@ -0,0 +1,132 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DEPTH_CLOUD_KERNEL_H
+#define DEPTH_CLOUD_KERNEL_H
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <opencv2/core/core.hpp>
+
+
+namespace PLVS2
+{
+
+class TaskPool;
+
+/// Back-projection of a (downsampled) depth image and computation of the point normals and of the segmentation
+/// measures (min fi and max delta over the neighborhood of each point).
+/// The kernel works on image-structured SoA buffers with a border of one invalid cell: the neighbors of a point are
+/// read at fixed offsets from its cell (no index lists) and each row is processed with AVX2 (x86) or NEON (ARM), the
+/// implementation being selected at runtime; a scalar fallback is always available and all the implementations produce
+/// the same values. Rows are processed in parallel bands when a TaskPool is given.
+/// A kernel is built for a camera (resolution, calibration and downsampling step) and it is not modified by Compute(),
+/// which can be called concurrently with different outputs.
+class DepthCloudKernel
+{
+public:
+
+    enum SimdType {kScalar=0, kAVX2=1, kNEON=2};
+
+    static const int kRowsPerTask = 8; // downsampled rows processed by each task
+
+    /// Neighborhood of a cell: offsets (delta row, delta column) in [-1,1], normals are computed with the pairs
+    /// (k, k+diNormal) for k = iStartNormal, iStartNormal+diNormal, ...
+    struct Neighborhood
+    {
+        int size;
+        const int* dm;
+        const int* dn;
+        int iStartNormal;
+        int diNormal;
+    };
+
+    /// Output of Compute(): padded SoA buffers (use Cell() to index them) and the index of each point in the cloud
+    struct Output
+    {
+        int rows = 0, cols = 0;  // downsampled grid
+        int stride = 0;          // padded row length
+
+        std::vector<float> x, y, z;       // camera frame coordinates (z = 0 for invalid points)
+        std::vector<float> nx, ny, nz;    // normals (zero for invalid points or when not computed)
+        std::vector<float> fi, delta;     // segmentation measures (only if computed)
+
+        std::vector<int> rowStart;        // index of the first point of each row, rowStart[rows] = number of points
+        std::vector<int> pointIdx;        // index of the point of each cell (rows x cols, -1 for invalid points)
+
+        inline int Cell(const int md, const int nd) const { return (md + 1)*stride + nd + 1; }
+        inline int NumPoints() const { return rowStart.empty() ? 0 : rowStart[rows]; }
+    };
+
+public:
+
+    DepthCloudKernel(const int depthRows, const int depthCols, const int downsampleStep,
+                     const cv::Mat& K, const cv::Mat& distCoef, const Neighborhood& neighborhood);
+
+    /// Whether the kernel was built for this depth resolution, downsampling step and calibration
+    bool Matches(const int depthRows, const int depthCols, const int downsampleStep, const cv::Mat& K, const cv::Mat& distCoef) const;
+
+    /// Back-project the depth image (CV_32F) keeping the points with depth in (minDepth, maxDepth); normals and
+    /// segmentation measures are computed on demand (the latter require the former)
+    void Compute(const cv::Mat& depth, const float minDepth, const float maxDepth, const bool bNormals, const bool bSegmentation,
+                 TaskPool* pPool, Output& out) const;
+
+    int Rows() const { return rows_; }   // downsampled rows
+    int Cols() const { return cols_; }   // downsampled columns
+    int NumCells() const { return rows_*cols_; }
+    int DownsampleStep() const { return step_; }
+
+    void SetSimdType(SimdType type);
+    SimdType GetSimdType() const { return simdType_; }
+
+    /// Best implementation supported by the running CPU
+    static SimdType GetBestSimdType();
+    static std::string GetSimdTypeName(SimdType type);
+
+    /// Run func(rowBegin, rowEnd) on bands of kRowsPerTask rows (in the pool tasks if pPool is not NULL)
+    static void ForEachRowBand(TaskPool* pPool, const int numRows, const std::function<void(int,int)>& func);
+
+protected:
+
+    void ComputePointsRow(const cv::Mat& depth, const int md, const float minDepth, const float maxDepth, Output& out, int& numPoints) const;
+    void ComputeNormalsRow(const int md, Output& out) const;
+    void ComputeSegmentationRow(const int md, Output& out) const;
+
+protected:
+
+    int depthRows_, depthCols_;
+    int step_;
+    int rows_, cols_;
+    int stride_; // padded row length of the output buffers
+    cv::Mat K_, distCoef_;
+
+    // (undistorted) grid points back-projected on the plane z=1 (rows_ x cols_)
+    std::vector<float> gridX_, gridY_;
+
+    // neighborhood as offsets in the padded buffers
+    std::vector<int> neighborOffsets_;
+    std::vector<std::pair<int,int> > normalPairs_;
+
+    SimdType simdType_;
+};
+
+} // namespace PLVS2
+
+#endif // DEPTH_CLOUD_KERNEL_H
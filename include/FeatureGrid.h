@@ -0,0 +1,139 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FEATURE_GRID_H
+#define FEATURE_GRID_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include <boost/serialization/vector.hpp>
+#include <boost/serialization/split_member.hpp>
+#include <boost/serialization/level.hpp>
+#include <boost/serialization/tracking.hpp>
+
+
+namespace PLVS2
+{
+
+/// Grid of feature indices stored in compressed sparse row (CSR) format: the indices of all the cells are in a single
+/// array and cell c spans [offsets[c], offsets[c+1]). Cells are stored column by column (cell (ix,iy) has index
+/// ix*rows+iy), so the cells (ix,iyMin..iyMax) of a column are a single contiguous range.
+/// Within a cell, indices keep the order in which features were assigned (increasing index).
+class FeatureGrid
+{
+public:
+
+    /// Read-only view of a range of indices
+    class Span
+    {
+    public:
+        Span(const uint32_t* begin = nullptr, const uint32_t* end = nullptr): begin_(begin), end_(end) {}
+
+        const uint32_t* begin() const { return begin_; }
+        const uint32_t* end() const { return end_; }
+        size_t size() const { return end_ - begin_; }
+        bool empty() const { return begin_ == end_; }
+        uint32_t operator[](size_t i) const { return begin_[i]; }
+
+    private:
+        const uint32_t* begin_;
+        const uint32_t* end_;
+    };
+
+public:
+
+    FeatureGrid() = default;
+    FeatureGrid(int cols, int rows) { Reset(cols, rows); }
+
+    /// Set the grid size and remove all the indices
+    void Reset(int cols, int rows);
+
+    /// Fill the grid: vCells[i] is the cell index (see CellIndex()) of feature i, or -1 if the feature is out of the grid
+    void Build(int cols, int rows, const std::vector<int>& vCells);
+
+    int Cols() const { return cols_; }
+    int Rows() const { return rows_; }
+
+    /// True if the grid has no cells (it has not been allocated)
+    bool IsEmpty() const { return offsets_.empty(); }
+
+    int CellIndex(int ix, int iy) const { return ix*rows_ + iy; }
+
+    Span Cell(int ix, int iy) const
+    {
+        const int c = CellIndex(ix, iy);
+        return Span(indices_.data() + offsets_[c], indices_.data() + offsets_[c+1]);
+    }
+
+    /// Indices of the cells (ix,iyMin), ..., (ix,iyMax)
+    Span Column(int ix, int iyMin, int iyMax) const
+    {
+        return Span(indices_.data() + offsets_[CellIndex(ix, iyMin)], indices_.data() + offsets_[CellIndex(ix, iyMax)+1]);
+    }
+
+private:
+
+    friend class boost::serialization::access;
+
+    // saved as the former nested vectors [cols][rows][indices] so that old and new maps can be exchanged
+    template<class Archive>
+    void save(Archive& ar, const unsigned int version) const
+    {
+        std::vector<std::vector<std::vector<size_t> > > grid(IsEmpty() ? 0 : cols_);
+        for(int ix=0; ix<(int)grid.size(); ix++)
+        {
+            grid[ix].resize(rows_);
+            for(int iy=0; iy<rows_; iy++)
+            {
+                const Span cell = Cell(ix, iy);
+                grid[ix][iy].assign(cell.begin(), cell.end());
+            }
+        }
+        ar & grid;
+    }
+
+    template<class Archive>
+    void load(Archive& ar, const unsigned int version)
+    {
+        std::vector<std::vector<std::vector<size_t> > > grid;
+        ar & grid;
+        FromNestedVectors(grid);
+    }
+
+    BOOST_SERIALIZATION_SPLIT_MEMBER()
+
+    void FromNestedVectors(const std::vector<std::vector<std::vector<size_t> > >& grid);
+
+private:
+
+    int cols_ = 0;
+    int rows_ = 0;
+    std::vector<uint32_t> offsets_; // cols*rows + 1 (empty if the grid is not allocated)
+    std::vector<uint32_t> indices_;
+};
+
+} // namespace PLVS2
+
+// no class header (version, tracking) in the archives: a grid is written exactly as the former nested vectors
+BOOST_CLASS_IMPLEMENTATION(PLVS2::FeatureGrid, boost::serialization::object_serializable)
+BOOST_CLASS_TRACKING(PLVS2::FeatureGrid, boost::serialization::track_never)
+
+#endif // FEATURE_GRID_H
@@ -56,6 +56,7 @@
 #include "LineExtractor.h"
 #include "Geom2DUtils.h"
 #include "Pointers.h"
+#include "FeatureGrid.h"
 
 #include <mutex>
 #include <opencv2/core/mat.hpp>
@@ -79,6 +80,7 @@ class ConstraintPoseImu;
 class GeometricCamera;
 class ORBextractor;
 class LineExtractor; 
+class TaskPool;
 
 class Frame
 {
@@ -172,12 +174,16 @@ public:
     bool PosLineInGrid(const cv::line_descriptor_c::KeyLine &kl, int &posX, int &posY);
 
     std::vector<size_t> GetFeaturesInArea(const float &x, const float  &y, const float  &r, const int minLevel=-1, const int maxLevel=kMaxInt, const bool bRight = false) const;
-
+    // Same as above but the indices are written in vIndices (cleared first): reuse the same vector across calls to avoid allocations
+    void GetFeaturesInArea(const float &x, const float  &y, const float  &r, const int minLevel, const int maxLevel, const bool bRight, std::vector<size_t>& vIndices) const;
     
     std::vector<size_t> GetLineFeaturesInArea(const float &xs, const float  &ys, const float &xe, const float  &ye, 
                                               const float& dtheta = kDeltaTheta, const float& dd = kDeltaD, const int minLevel=-1, const int maxLevel=kMaxInt) const;
     std::vector<size_t> GetLineFeaturesInArea(const Line2DRepresentation& lineRepresentation, 
                                               const float& dtheta = kDeltaTheta, const float& dd = kDeltaD, const int minLevel=-1, const int maxLevel=kMaxInt) const;
+    // Same as above but the indices are written in vIndices (cleared first): reuse the same vector across calls to avoid allocations
+    void GetLineFeaturesInArea(const Line2DRepresentation& lineRepresentation, const float& dtheta, const float& dd, 
+                               const int minLevel, const int maxLevel, std::vector<size_t>& vIndices) const;
     
     void GetLineFeaturesInArea(const float thetaMin, const float thetaMax, const float dMin, const float dMax, const bool bCheckLevels, const int minLevel, const int maxLevel, vector<size_t>& vIndices) const;
     
@@ -342,7 +348,7 @@ public:
     // Keypoints are assigned to cells in a grid to reduce matching complexity when projecting MapPoints.
     static float mfGridElementWidthInv;
     static float mfGridElementHeightInv;
-    std::vector<std::size_t> mGrid[FRAME_GRID_COLS][FRAME_GRID_ROWS];
+    FeatureGrid mGrid; // FRAME_GRID_COLS x FRAME_GRID_ROWS
 
     /// < Key Lines 
         
@@ -379,7 +385,7 @@ public:
     // Keylines are assigned to cells in a grid to reduce matching complexity when projecting MapPoints.
     static float mfLineGridElementThetaInv;
     static float mfLineGridElementDInv;
-    std::vector<std::size_t> mLineGrid[LINE_D_GRID_COLS][LINE_THETA_GRID_ROWS];
+    FeatureGrid mLineGrid; // LINE_D_GRID_COLS x LINE_THETA_GRID_ROWS
     
     /// < Other data
 
@@ -432,6 +438,9 @@ public:
     static bool mbInitialComputations;
 
     static bool mbUseFovCentersKfGenCriterion;        
+
+    // Persistent worker pool (owned by Tracking) used for feature extraction; if NULL, temporary threads are spawned
+    static TaskPool* spExtractionPool;
     
     float mMedianDepth;   
 
@@ -513,7 +522,7 @@ public:
     std::vector<Eigen::Vector3f> mvStereo3Dpoints;
 
     //Grid for the right image
-    std::vector<std::size_t> mGridRight[FRAME_GRID_COLS][FRAME_GRID_ROWS];
+    FeatureGrid mGridRight; // FRAME_GRID_COLS x FRAME_GRID_ROWS
 
     Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeStamp, 
           std::shared_ptr<LineExtractor>& lineExtractorLeft, std::shared_ptr<LineExtractor>& lineExtractorRight, 
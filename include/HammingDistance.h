@@ -0,0 +1,128 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HAMMING_DISTANCE_H
+#define HAMMING_DISTANCE_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <climits>
+#include <opencv2/core/core.hpp>
+
+#ifdef __POPCNT__
+#include <immintrin.h>
+#endif
+
+
+namespace PLVS2
+{
+
+/// Hamming distances between 256-bit binary descriptors (ORB and LBD), one descriptor per row of a CV_8U matrix.
+/// Besides the single pair distance, it provides batch versions (one query vs many train descriptors, and many-vs-many
+/// with best/second-best tracking) that work on the contiguous descriptor rows and use AVX-512 VPOPCNTDQ, AVX2 or NEON
+/// when available (selected at runtime). All the implementations return the same distances.
+class HammingDistance
+{
+public:
+
+    enum SimdType {kScalar=0, kAVX2=1, kAVX512=2, kNEON=3};
+
+    static const int kDescriptorSize = 32; // bytes
+    static const int kMaxDistance = 256;
+
+public:
+
+    /// Distance between two 32-byte descriptors
+    static inline int Distance(const uchar* a, const uchar* b)
+    {
+        const uint64_t *pa = reinterpret_cast<const uint64_t*>(a);
+        const uint64_t *pb = reinterpret_cast<const uint64_t*>(b);
+
+        uint64_t dist=0;
+        for(int i=0; i<4; i++, pa++, pb++)
+        {
+#ifdef __POPCNT__
+            dist += _mm_popcnt_u64(*pa ^ *pb); // count number of 1 over XOR
+#else
+            // http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
+            using T = uint64_t;
+            uint64_t v = *pa ^ *pb;
+            v = v - ((v >> 1) & (T)~(T)0/3);
+            v = (v & (T)~(T)0/15*3) + ((v >> 2) & (T)~(T)0/15*3);
+            v = (v + (v >> 4)) & (T)~(T)0/255*15;
+            dist += (T)(v * ((T)~(T)0/255)) >> (sizeof(T) - 1) * CHAR_BIT;
+#endif
+        }
+        return (int)dist;
+    }
+
+    static inline int Distance(const cv::Mat &a, const cv::Mat &b)
+    {
+        return Distance(a.ptr(), b.ptr());
+    }
+
+    /// Distances between the query and all the rows of train
+    static void ComputeDistances(const cv::Mat& query, const cv::Mat& train, std::vector<int>& dists);
+
+    /// Distances between the query and the rows (indices[i] + rowOffset) of train
+    template<typename IndexT>
+    static void ComputeDistances(const cv::Mat& query, const cv::Mat& train, const std::vector<IndexT>& indices, std::vector<int>& dists, const int rowOffset = 0)
+    {
+        std::vector<const uchar*>& vRows = GetRowBuffer();
+        vRows.resize(indices.size());
+        for(size_t i=0; i<indices.size(); i++)
+            vRows[i] = train.ptr((int)indices[i] + rowOffset);
+
+        dists.resize(indices.size());
+        if(!indices.empty())
+            ComputeDistances(query.ptr(), vRows.data(), (int)vRows.size(), dists.data());
+    }
+
+    /// Distances between the query and the input descriptors
+    static void ComputeDistances(const uchar* query, const uchar* const* train, const int numTrain, int* dists);
+
+    /// For each query row (with a non-zero queryMask entry if the mask is not empty) find the best and second best train rows.
+    /// bestIdx[i] is -1 if the query was masked out; secondIdx[i] is -1 if train has a single row.
+    static void MatchBestTwo(const cv::Mat& queries, const cv::Mat& train, const cv::Mat& queryMask,
+                             std::vector<int>& bestIdx, std::vector<int>& bestDist,
+                             std::vector<int>& secondIdx, std::vector<int>& secondDist);
+
+public:
+
+    static void SetSimdType(SimdType type);
+    static SimdType GetSimdType() { return sSimdType; }
+
+    /// Best implementation supported by the running CPU
+    static SimdType GetBestSimdType();
+    static std::string GetSimdTypeName(SimdType type);
+
+protected:
+
+    /// Thread-local buffer of row pointers used by the gather version of ComputeDistances()
+    static std::vector<const uchar*>& GetRowBuffer();
+
+protected:
+
+    static SimdType sSimdType;
+};
+
+} // namespace PLVS2
+
+#endif // HAMMING_DISTANCE_H
@@ -189,6 +189,27 @@ class Preintegrated
         ar & mvMeasurements;
     }
 
+public:
+    // IMU sample to integrate (acceleration, angular velocity and integration time)
+    struct integrable
+    {
+        template<class Archive>
+        void serialize(Archive & ar, const unsigned int version)
+        {
+            ar & boost::serialization::make_array(a.data(), a.size());
+            ar & boost::serialization::make_array(w.data(), w.size());
+            ar & t;
+        }
+
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+        integrable(){}
+        integrable(const Eigen::Vector3f &a_, const Eigen::Vector3f &w_ , const double &t_):a(a_),w(w_),t(t_){}
+        Eigen::Vector3f a, w;
+        double t;  //NOTE: [Luigi]: changed to double (timestamps should always be represented at least with double) 
+    };
+
+    static const float kMaxFirstOrderGyroBiasUpdate; // max gyro bias update corrected at first order (see ReintegrateIfNeeded())
+
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
     Preintegrated(const Bias &b_, const Calib &calib);
@@ -198,7 +219,11 @@ public:
     void CopyFrom(Preintegrated* pImuPre);
     void Initialize(const Bias &b_);
     void IntegrateNewMeasurement(const Eigen::Vector3f &acceleration, const Eigen::Vector3f &angVel, const double &dt);
+    void IntegrateNewMeasurements(const std::vector<integrable> &vMeasurements);
     void Reintegrate();
+    // Reintegrate only if the gyro bias moved more than maxGyroBiasUpdate from the bias of the integration, otherwise
+    // keep the first-order correction with the bias Jacobians. Returns true if the measurements were reintegrated.
+    bool ReintegrateIfNeeded(const float maxGyroBiasUpdate = kMaxFirstOrderGyroBiasUpdate);
     void MergePrevious(Preintegrated* pPrev);
     void SetNewBias(const Bias &bu_);
     IMU::Bias GetDeltaBias(const Bias &b_);
@@ -249,22 +274,8 @@ private:
     // This is used to compute the updated values of the preintegration
     Eigen::Matrix<float,6,1> db;
 
-    struct integrable
-    {
-        template<class Archive>
-        void serialize(Archive & ar, const unsigned int version)
-        {
-            ar & boost::serialization::make_array(a.data(), a.size());
-            ar & boost::serialization::make_array(w.data(), w.size());
-            ar & t;
-        }
-
-        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-        integrable(){}
-        integrable(const Eigen::Vector3f &a_, const Eigen::Vector3f &w_ , const double &t_):a(a_),w(w_),t(t_){}
-        Eigen::Vector3f a, w;
-        double t;  //NOTE: [Luigi]: changed to double (timestamps should always be represented at least with double) 
-    };
+    // Integrate a block of contiguous measurements with the current bias b
+    void IntegrateMeasurements(const integrable* pMeasurements, const size_t n);
 
     std::vector<integrable> mvMeasurements;
 
@@ -183,12 +183,15 @@ public:
 
     // KeyPoint functions
     std::vector<size_t> GetFeaturesInArea(const float &x, const float  &y, const float  &r, const bool bRight = false) const;
+    // Same as above but the indices are written in vIndices (cleared first): reuse the same vector across calls to avoid allocations
+    void GetFeaturesInArea(const float &x, const float  &y, const float  &r, const bool bRight, std::vector<size_t>& vIndices) const;
     bool UnprojectStereo(int i, Eigen::Vector3f &x3D);
 
     // KeyLine functions
     bool UnprojectStereoLine(const int& i, Eigen::Vector3f& p3DStart, Eigen::Vector3f& p3DEnd);
     std::vector<size_t> GetLineFeaturesInArea(const float &xs, const float &ys, const float &xe, const float &ye, const float& dtheta = kDeltaTheta, const float& dd = kDeltaD) const;
     std::vector<size_t> GetLineFeaturesInArea(const Line2DRepresentation& lineRepresentation, const float& dtheta = kDeltaTheta, const float& dd = kDeltaD) const; 
+    void GetLineFeaturesInArea(const Line2DRepresentation& lineRepresentation, const float& dtheta, const float& dd, std::vector<size_t>& vIndices) const; 
     void GetLineFeaturesInArea(const float thetaMin, const float thetaMax, const float dMin, const float dMax, std::vector<size_t>& vIndices) const;
 
     // Image
@@ -387,6 +390,8 @@ public:
 
     unsigned int mnLBACount = 0;    
 
+    double mTimeQueued = 0; // [ms] LatencyTrace::Now() at the insertion in the LocalMapping/LoopClosing queue (hand-off latency)
+
     // The following variables need to be accessed trough a mutex to be thread safe.
 protected:
     // sophus poses
@@ -430,8 +435,8 @@ protected:
     ORBVocabulary* mpORBvocabulary;
 
     // Grid over the image to speed up feature matching
-    std::vector< std::vector <std::vector<size_t> > > mGrid;
-    std::vector< std::vector <std::vector<size_t> > > mLineGrid;
+    FeatureGrid mGrid;
+    FeatureGrid mLineGrid;
 
     std::map<KeyFramePtr,int> mConnectedKeyFrameWeights;
     std::vector<KeyFramePtr> mvpOrderedConnectedKeyFrames;
@@ -497,8 +502,8 @@ public:
     const int NLeft, NRight;
     const int NlinesLeft, NlinesRight;
 
-    std::vector< std::vector <std::vector<size_t> > > mGridRight;
-    std::vector< std::vector <std::vector<size_t> > > mLineGridRight;
+    FeatureGrid mGridRight;
+    FeatureGrid mLineGridRight;
 
     Sophus::SE3<float> GetRightPose();
     Sophus::SE3<float> GetRightPoseInverse();
@@ -0,0 +1,102 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+#include <mutex>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+
+namespace PLVS2
+{
+
+/// Hand-off latencies of the keyframes along the mapping pipeline: time from the insertion of a keyframe in the queue 
+/// of a thread to the moment that thread picks it up (Tracking -> LocalMapping -> LoopClosing, Tracking -> PointCloudMapping). 
+class LatencyTrace
+{
+public:
+
+    enum Stage { kLocalMapping=0, kLoopClosing, kPointCloudMapping, kPointCloudIntegration, kNumStages };
+
+public:
+
+    static LatencyTrace& GetInstance()
+    {
+        static LatencyTrace instance;
+        return instance;
+    }
+
+    // [ms] time of the steady clock 
+    static double Now()
+    {
+        return std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void Add(const Stage stage, const double latencyMs)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        Stats& stats = stats_[stage];
+        stats.count++;
+        stats.sum += latencyMs;
+        stats.sumSquares += latencyMs*latencyMs;
+        stats.max = std::max(stats.max, latencyMs);
+    }
+
+    void Print(std::ostream& out)
+    {
+        static const char* names[kNumStages] = {"Tracking -> LocalMapping", "LocalMapping -> LoopClosing", 
+                                                "Tracking -> PointCloudMapping", "Tracking -> PointCloudMapping integration"};
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        out << std::endl << "Keyframe hand-off latency [ms] (mean, std, max, #KFs)" << std::endl;
+        for(int i=0; i<kNumStages; i++)
+        {
+            const Stats& stats = stats_[i];
+            if(stats.count == 0) continue;
+            const double mean = stats.sum/stats.count;
+            const double deviation = sqrt(std::max(0., stats.sumSquares/stats.count - mean*mean));
+            out << " - " << names[i] << ": " << std::fixed << std::setprecision(3) << mean << ", " << deviation << ", " << stats.max 
+                << ", " << stats.count << std::defaultfloat << std::endl;
+        }
+    }
+
+private:
+
+    struct Stats
+    {
+        size_t count = 0;
+        double sum = 0;
+        double sumSquares = 0;
+        double max = 0;
+    };
+
+    LatencyTrace() {}
+
+    std::mutex mutex_;
+    Stats stats_[kNumStages];
+};
+
+} // namespace PLVS2
+
+#endif // LATENCY_TRACE_H
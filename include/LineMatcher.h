@@ -30,21 +30,14 @@
 #include "KeyFrame.h"
 #include "MapLine.h"
 #include "LineProjection.h"
+#include "LocalMapProjector.h"
 #include "Pointers.h"
 
-namespace cv
-{
-namespace line_descriptor_c
-{
-class BinaryDescriptorMatcher;
-}
-}
-
-
 namespace PLVS2
 {
 
-   
+// N.B.: the search methods query the line grids through the GetLineFeaturesInArea() variants filling a caller-owned
+// index buffer; each method declares its buffer once and reuses it across all its queries.
 class LineMatcher
 {
     static const float kDescTh;    // parameter to avoid outliers in line matching
@@ -77,6 +70,9 @@ public:
     // Used to track the local map (Tracking)
     int SearchByKnn(Frame &F, const std::vector<MapLinePtr> &vpMapLines);
     int SearchByProjection(Frame &F, const std::vector<MapLinePtr> &vpMapLines, const bool bLargerSearch=false);
+    // Same as above but the projections are read from the side tables filled by LocalMapProjector
+    int SearchByProjection(Frame &F, const std::vector<MapLinePtr> &vpMapLines, const std::vector<uint8_t> &vbInView, 
+                           const std::vector<MapLineProjection> &vProjections, const bool bLargerSearch=false);
     
     // Project MapLines seen in KeyFrame into the Frame and search matches.
     // Used in relocalisation (Tracking) [not used at the moment]
@@ -110,11 +106,14 @@ protected:
 
     void LineDescriptorMAD(const std::vector<std::vector<cv::DMatch> >& matches, double &sigma_mad);
     void LineDescriptorMAD12(const std::vector<std::vector<cv::DMatch> >&matches, double &sigma12_mad);
+
+    // Match a map line projected in F. Returns true if a new match is found
+    bool MatchProjectedLine(Frame &F, const MapLinePtr& pML, const MapLineProjection& proj, const float thChiSquareLineMonoProj, const float thChiSquareSegSeg,
+                            std::vector<size_t> &vIndices, std::vector<int> &vDistances);
         
 protected:    
     
     //std::shared_ptr<cv::BFMatcher> mpBfm;
-    cv::Ptr<cv::line_descriptor_c::BinaryDescriptorMatcher> mBdm; 
     
     float mfNNratio;
     bool mbCheckOrientation;    
@@ -0,0 +1,106 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LOCAL_MAP_PROJECTOR_H
+#define LOCAL_MAP_PROJECTOR_H
+
+#include <vector>
+#include <cstdint>
+
+#include "Pointers.h"
+
+
+namespace PLVS2
+{
+
+class Frame;
+
+/// Projection of a local map point in a frame (same data as the MapPoint tracking fields filled by Frame::isInFrustum())
+struct MapPointProjection
+{
+    float u, v;      // projection
+    float uR;        // virtual right projection
+    float depth;     // distance from the camera center
+    float viewCos;   // cosine of the viewing angle
+    int level;       // predicted scale level
+};
+
+/// Projection of a local map line in a frame (same data as the MapLine tracking fields filled by Frame::isInFrustum())
+struct MapLineProjection
+{
+    float uS, vS;    // start point projection
+    float uE, vE;    // end point projection
+    float depthS;    // start point depth
+    float depthE;    // end point depth
+    float viewCos;   // cosine of the viewing angle (middle point)
+    int level;       // predicted scale level
+};
+
+/// Frustum culling of the local map in the current frame.
+/// The positions, normals and scale invariance distances of the local map points and lines are copied in flat arrays
+/// (structure of arrays) once per local map update, so that the culling does not lock the map features and its first
+/// stage (transformation, projection and range checks) is a branch-free loop that the compiler vectorizes.
+/// The features that pass it are then checked with the exact tests of Frame::isInFrustum().
+/// Results are written in per-frame side tables (indexed as the local map vectors) instead of the shared map features.
+/// Only the left camera of pinhole (monocular, stereo rectified, RGBD) frames is supported: see IsSupported().
+class LocalMapProjector
+{
+public:
+
+    LocalMapProjector() = default;
+
+    /// Take a snapshot of the local map points
+    void SetMapPoints(const std::vector<MapPointPtr>& vpMapPoints);
+    /// Take a snapshot of the local map lines
+    void SetMapLines(const std::vector<MapLinePtr>& vpMapLines);
+
+    /// Whether the points of frame F can be projected here (otherwise use Frame::isInFrustum())
+    static bool IsSupported(const Frame& F);
+    /// Whether the lines of frame F can be projected here (otherwise use Frame::isInFrustum())
+    static bool IsSupportedLines(const Frame& F);
+
+    /// Project the snapshot points in F: vbInView[i] is set if point i is in the frustum and then vProjections[i] is valid.
+    /// Return the number of points in the frustum.
+    int ProjectMapPoints(const Frame& F, const float viewingCosLimit, std::vector<uint8_t>& vbInView, std::vector<MapPointProjection>& vProjections);
+    /// Project the snapshot lines in F: vbInView[i] is set if line i is in the frustum and then vProjections[i] is valid.
+    /// Return the number of lines in the frustum.
+    int ProjectMapLines(const Frame& F, const float viewingCosLimit, std::vector<uint8_t>& vbInView, std::vector<MapLineProjection>& vProjections);
+
+    size_t NumMapPoints() const { return px_.size(); }
+    size_t NumMapLines() const { return lsx_.size(); }
+
+private:
+
+    // map points
+    std::vector<float> px_, py_, pz_;      // position
+    std::vector<float> pnx_, pny_, pnz_;   // normal
+    std::vector<float> pMinDist_;          // mfMinDistance
+    std::vector<float> pMaxDist_;          // mfMaxDistance
+
+    // map lines
+    std::vector<float> lsx_, lsy_, lsz_;   // start point
+    std::vector<float> lex_, ley_, lez_;   // end point
+    std::vector<float> lmx_, lmy_, lmz_;   // middle point
+    std::vector<float> lnx_, lny_, lnz_;   // normal
+    std::vector<float> lMaxDist_;          // mfMaxDistance
+};
+
+} // namespace PLVS2
+
+#endif // LOCAL_MAP_PROJECTOR_H
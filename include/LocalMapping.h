@@ -46,8 +46,12 @@
 #include "Tracking.h"
 #include "KeyFrameDatabase.h"
 #include "Settings.h"
+#include "WakeUpEvent.h"
 
 #include <mutex>
+#include <memory>
+#include <thread>
+#include <atomic>
 
 
 namespace PLVS2
@@ -60,6 +64,9 @@ class Atlas;
 
 class LocalMapping
 {
+public:
+    static bool skUseAsyncScaleRefinement; // run the scale refinement in a background thread and apply its result when ready 
+
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
     LocalMapping(System* pSys, Atlas* pAtlas, const float bMonocular, bool bInertial, const string &_strSeqName=std::string());
@@ -81,6 +88,7 @@ public:
     bool Stop();
     void Release();
     bool isStopped();
+    void WaitUntilStopped();
     bool stopRequested();
     bool AcceptKeyFrames();
     void SetAcceptKeyFrames(bool flag);
@@ -213,11 +221,24 @@ protected:
     bool mbNotStop;
     std::mutex mMutexStop;
 
+    WakeUpEvent mWakeUpEvent;       // wakes up Run(): new keyframes, stop/release, reset and finish requests, scale refinement done
+    WakeUpEvent mStateChangedEvent; // wakes up the threads waiting for a stop or a reset of Local Mapping
+
     bool mbAcceptKeyFrames;
     std::mutex mMutexAccept;
 
     void InitializeIMU(float priorG = 1e2, float priorA = 1e6, bool bFirst = false);
     void ScaleRefinement();
+    void ApplyScaleRefinement(); // apply the result of the background scale refinement (if ready)
+    void JoinScaleRefinement();  // wait for the background scale refinement and discard its result
+
+    // background scale refinement (see skUseAsyncScaleRefinement)
+    std::unique_ptr<std::thread> mpThreadScaleRefinement;
+    std::atomic<bool> mbScaleRefinementDone;
+    Map* mpScaleRefinementMap;
+    int mnScaleRefinementBigChangeIdx;
+    Eigen::Matrix3d mRwgRefinement;
+    double mScaleRefinement;
 
     bool bInitializing;
 
@@ -49,10 +49,14 @@
 #include "Config.h"
 //#include "KeyFrameDatabase.h"
 #include "Signal.h"
+#include "TaskPool.h"
+#include "WakeUpEvent.h"
 
 #include <boost/algorithm/string.hpp>
 #include <thread>
 #include <mutex>
+#include <memory>
+#include <atomic>
 
 #ifdef USE_G2O_NEW
 #include "Thirdparty/g2o_new/install/include/g2o/types/sim3/types_seven_dof_expmap.h"
@@ -78,6 +82,28 @@ public:
     typedef map<KeyFramePtr,g2o::Sim3,std::less<KeyFramePtr>,
         Eigen::aligned_allocator<std::pair<KeyFramePtr const, g2o::Sim3> > > KeyFrameAndPose;
 
+    /// Progress of an interruptible global BA (see RunGlobalBundleAdjustment()). After each iteration, the visual GBA 
+    /// publishes its estimates in the GBA fields (mTcwGBA, mPosGBA, ...): when a new loop interrupts it, its last 
+    /// published iteration is applied to the map and the next GBA resumes from there.
+    struct GlobalBAProgress
+    {
+        std::mutex mutex;
+        Map* pMap = nullptr;
+        unsigned long nLoopKF = 0;
+        int numPublishedIterations = 0;
+        bool bClosed = false;               // no more publications: the result was applied or discarded 
+        double lambda = 0;                  // LM damping at the end of the GBA (0: g2o default initialization)
+        std::set<KeyFramePtr> sFixedKFs;    // keyframes not affected by the last loop correction (empty: full GBA)
+    };
+
+public:
+
+    static bool skUseIncrementalGBA;           // resume an interrupted GBA from its last iteration and optimize only what a local loop correction moved 
+    static float skMaxAffectedKeyFramesRatio;  // above this ratio of moved keyframes the GBA optimizes the whole map 
+    static int skNumVerificationThreads;       // workers verifying the loop/merge BoW candidates concurrently (0: sequential verification) 
+    static const float kMinGBAKeyFrameCorrection;  // min camera displacement of a keyframe moved by a loop correction, relative to its scene median depth 
+    static const float kMinGBAKeyFrameRotCorrection; // [rad] min rotation of a keyframe moved by a loop correction 
+
 public:
 
     LoopClosing(Atlas* pAtlas, KeyFrameDatabase* pDB, ORBVocabulary* pVoc,const bool bFixScale, const bool bActiveLC);
@@ -95,7 +121,7 @@ public:
     void RequestResetActiveMap(Map* pMap);
 
     // This function will run in a separate thread
-    void RunGlobalBundleAdjustment(Map* pActiveMap, unsigned long nLoopKF);
+    void RunGlobalBundleAdjustment(Map* pActiveMap, unsigned long nLoopKF, std::shared_ptr<GlobalBAProgress> pProgress);
 
     bool isRunningGBA(){
         unique_lock<std::mutex> lock(mMutexGBA);
@@ -124,6 +150,14 @@ public:
     vector<double> vdEstSim3_ms;
     vector<double> vdPRTotal_ms;
 
+    // stages of the verification of each BoW candidate (pushed by the concurrent verifications)
+    vector<double> vdBoWCandMatching_ms;
+    vector<double> vdBoWCandSim3_ms;
+    vector<double> vdBoWCandProjection_ms;
+    vector<double> vdBoWCandOptimization_ms;
+    vector<double> vdBoWCandCovisibility_ms;
+    std::mutex mMutexBoWCandTimes;
+
     vector<double> vdMergeMaps_ms;
     vector<double> vdWeldingBA_ms;
     vector<double> vdMergeOptEss_ms;
@@ -161,10 +195,28 @@ protected:
                                         std::vector<MapPointPtr> &vpMPs, std::vector<MapPointPtr> &vpMatchedMPs,
                                         std::vector<MapLinePtr> &vpMLs, std::vector<MapLinePtr> &vpMatchedMLs,
                                         std::vector<MapObjectPtr> &vpMOs, std::vector<MapObjectPtr> &vpMatchedMOs);
+    // If pbCancel is set while the candidates are being verified, the detection is abandoned (returns false and leaves the outputs untouched)
     bool DetectCommonRegionsFromBoW(std::vector<KeyFramePtr> &vpBowCand, KeyFramePtr &pMatchedKF, KeyFramePtr &pLastCurrentKF, g2o::Sim3 &g2oScw,
                                      int &nNumCoincidences, std::vector<MapPointPtr> &vpMPs, std::vector<MapPointPtr> &vpMatchedMPs,
                                      std::vector<MapLinePtr> &vpMLs, std::vector<MapLinePtr> &vpMatchedMLs,
-                                     std::vector<MapObjectPtr> &vpMOs, std::vector<MapObjectPtr> &vpMatchedMOs);
+                                     std::vector<MapObjectPtr> &vpMOs, std::vector<MapObjectPtr> &vpMatchedMOs,
+                                     const std::atomic<bool>* pbCancel = NULL);
+
+    // Geometric verification of a BoW candidate (see DetectCommonRegionsFromBoW())
+    struct BoWCandidate
+    {
+        KeyFramePtr pMostBoWMatchesKF = NULL;
+        int numProjOptFeatureMatches = 0;   // 0: candidate rejected
+        g2o::Sim3 gScw;
+        std::vector<MapPointPtr> vpMapPoints, vpMatchedMapPoints;
+        std::vector<MapLinePtr> vpMapLines, vpMatchedMapLines;
+        std::vector<MapObjectPtr> vpMapObjects, vpMatchedMapObjects;
+
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    };
+    // BoW matching with the covisibles of pKFi, Sim3 RANSAC, matching by projection and Sim3 optimization (thread-safe)
+    void VerifyBoWCandidate(KeyFramePtr pKFi, const std::set<KeyFramePtr> &spConnectedKeyFrames, const std::atomic<bool>* pbCancel,
+                            BoWCandidate &candidate);
     bool DetectCommonRegionsFromLastKF(KeyFramePtr pCurrentKF, KeyFramePtr pMatchedKF, g2o::Sim3 &gScw, int &nNumProjMatches,
                                      std::vector<MapPointPtr> &vpMPs, std::vector<MapPointPtr> &vpMatchedMPs,
                                      std::vector<MapLinePtr> &vpMLs, std::vector<MapLinePtr> &vpMatchedMLs,
@@ -180,6 +232,15 @@ protected:
 
     void CorrectLoop();
 
+    // Create the progress of a new GBA (it resumes the damping of the previous one)
+    std::shared_ptr<GlobalBAProgress> NewGBAProgress(Map* pMap, const unsigned long nLoopKF);
+    // Apply the last iteration published by the interrupted GBA (Local Mapping must be stopped). Return true if the map was updated.
+    bool ApplyInterruptedGBA(Map* pActiveMap);
+    // Propagate the GBA estimates over the spanning tree and update the map (Local Mapping stopped and map mutex taken)
+    void UpdateMapWithGBA(Map* pActiveMap, const unsigned long nLoopKF);
+    // Keyframes that a loop correction did not affect: they can be fixed in the following GBA (empty for a full GBA)
+    std::set<KeyFramePtr> ComputeGBAFixedKeyFrames(Map* pMap, const KeyFrameAndPose& PosesBeforeCorrection);
+
     void MergeLocal();
     void MergeLocal2();
 
@@ -198,6 +259,9 @@ protected:
     bool mbFinished;
     std::mutex mMutexFinish;
 
+    WakeUpEvent mWakeUpEvent;       // wakes up Run(): new keyframes, reset and finish requests
+    WakeUpEvent mStateChangedEvent; // wakes up the threads waiting for a reset of Loop Closing
+
     Atlas* mpAtlas;
     Tracking* mpTracker;
 
@@ -275,6 +339,10 @@ protected:
     bool mbStopGBA;
     std::mutex mMutexGBA;
     std::thread* mpThreadGBA;
+    std::shared_ptr<GlobalBAProgress> mpGBAProgress;
+
+    // Workers of the concurrent verification of the BoW candidates (see skNumVerificationThreads)
+    std::unique_ptr<TaskPool> mpVerificationPool;
 
     // Fix scale in the stereo/RGB-D case
     bool mbFixScale;
@@ -75,6 +75,8 @@
 #include<Eigen/Dense>
 #include<Eigen/Sparse>
 
+#include <random>
+
 namespace PLVS2{
     class MLPnPsolver {
     public:
@@ -87,6 +89,10 @@ namespace PLVS2{
         void SetRansacParameters(double probability = 0.99, int minInliers = 8, int maxIterations = 300, int minSet = 6, float epsilon = 0.4,
                                  float th2 = 5.991);
 
+        // the minimal sets are drawn from a generator owned by the solver: solvers can run concurrently and,
+        // for a given seed, they draw the same hypotheses
+        void SetRandomSeed(unsigned int seed);
+
         //Find metod is necessary?
 
         bool iterate(int nIterations, bool &bNoMore, vector<bool> &vbInliers, int &nInliers, Eigen::Matrix4f &Tout);
@@ -245,6 +251,9 @@ namespace PLVS2{
         // Indices for random selection [0 .. N-1]
         vector<size_t> mvAllIndices;
 
+        // Generator of the random selections
+        std::mt19937 mRng;
+
         // RANSAC probability
         double mRansacProb;
 
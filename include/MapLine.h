@@ -107,6 +107,9 @@ public:
     float GetMaxDistanceInvariance();
     int PredictScale(const float &currentDist, KeyFramePtr& pKF);
     int PredictScale(const float &currentDist, Frame* pF);    
+
+    // Get end points, normal and max distance (mfMaxDistance) with a single lock
+    void GetProjectionData(Eigen::Vector3f &PosStart, Eigen::Vector3f &PosEnd, Eigen::Vector3f &Normal, float &maxDistance);
     
 public: 
     
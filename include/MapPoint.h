@@ -118,6 +118,9 @@ public:
     float GetMaxDistanceInvariance();
     int PredictScale(const float &currentDist, KeyFramePtr& pKF);
     int PredictScale(const float &currentDist, Frame* pF);
+
+    // Get position, normal and min/max distance (mfMinDistance, mfMaxDistance) with a single lock
+    void GetProjectionData(Eigen::Vector3f &Pos, Eigen::Vector3f &Normal, float &minDistance, float &maxDistance);
     
 public: 
     
@@ -0,0 +1,71 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ORB_DESCRIPTOR_KERNEL_H
+#define ORB_DESCRIPTOR_KERNEL_H
+
+#include <vector>
+#include <string>
+#include <opencv2/core/core.hpp>
+
+
+namespace PLVS2
+{
+
+/// Batch computation of 32-byte rBRIEF descriptors.
+/// The rotated sampling offsets are computed 8/4 at a time and the 256 intensity comparisons are packed into bits with
+/// AVX2 (x86) or NEON (ARM) compare+movemask; the implementation is selected at runtime and a scalar fallback
+/// (the original ORB-SLAM loop) is always available. All the implementations produce the same descriptors.
+class ORBdescriptorKernel
+{
+public:
+
+    enum SimdType {kScalar=0, kAVX2=1, kNEON=2};
+
+    static const int kNumPatternPoints = 512;
+
+public:
+
+    ORBdescriptorKernel(const std::vector<cv::Point>& pattern);
+
+    /// Compute the descriptors (one 32-byte row per keypoint) of the input keypoints;
+    /// img must contain the patch of radius ~19 pixels around each keypoint
+    void Compute(const cv::Mat& img, const std::vector<cv::KeyPoint>& keypoints, cv::Mat& descriptors) const;
+
+    void SetSimdType(SimdType type);
+    SimdType GetSimdType() const { return simdType_; }
+
+    /// Best implementation supported by the running CPU
+    static SimdType GetBestSimdType();
+    static std::string GetSimdTypeName(SimdType type);
+
+protected:
+
+    std::vector<cv::Point> pattern_;
+
+    // pattern coordinates in SoA layout (used by the vectorized kernels)
+    alignas(32) float patternX_[kNumPatternPoints];
+    alignas(32) float patternY_[kNumPatternPoints];
+
+    SimdType simdType_;
+};
+
+} // namespace PLVS2
+
+#endif // ORB_DESCRIPTOR_KERNEL_H
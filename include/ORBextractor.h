@@ -41,6 +41,7 @@
 
 #include <vector>
 #include <list>
+#include <memory>
 #include <opencv2/opencv.hpp>
 
 #ifdef USE_CUDA
@@ -53,6 +54,9 @@
 namespace PLVS2
 {
 
+class TaskPool;
+class ORBdescriptorKernel;
+
 class ExtractorNode
 {
 public:
@@ -78,7 +82,7 @@ public:
     ORBextractor(int nfeatures, float scaleFactor, int nlevels,
                  int iniThFAST, int minThFAST);
 
-    ~ORBextractor(){}
+    ~ORBextractor();
 
     // Compute the ORB features and descriptors on an image.
     // ORB are dispersed on the image using an octree.
@@ -115,6 +119,13 @@ public:
     // for pre-computing Gaussian pyramid 
     void PrecomputeGaussianPyramid(const cv::Mat& image);
 
+    // Set a task pool for splitting FAST detection, octree distribution, orientation and descriptor computation 
+    // into level-by-cell tasks (the extracted keypoints and descriptors are identical to the serial ones); NULL for serial extraction
+    void SetTaskPool(TaskPool* pTaskPool) { mpTaskPool = pTaskPool; }
+
+    // rBRIEF sampling pattern (512 points, 256 pairs)
+    const std::vector<cv::Point>& GetPattern() const { return pattern; }
+
 #ifdef USE_CUDA
     // We assume all frames are of the same dimension
     bool mbImagePyramidAllocated;
@@ -130,6 +141,12 @@ protected:
 
     void ComputePyramid(const cv::Mat& image);
     void ComputeKeyPointsOctTree(std::vector<std::vector<cv::KeyPoint> >& allKeypoints);    
+#ifndef USE_CUDA
+    void ComputeKeyPointsOctTreeLevel(const int level, std::vector<cv::KeyPoint>& keypoints);
+    void DetectFASTCellRow(const int level, const int row, const int nCols, const int wCell, const int hCell, 
+                           const int minBorderX, const int minBorderY, const int maxBorderX, const int maxBorderY, 
+                           std::vector<cv::KeyPoint>& vKeysRow);
+#endif 
     std::vector<cv::KeyPoint> DistributeOctTree(const std::vector<cv::KeyPoint>& vToDistributeKeys, const int &minX,
                                            const int &maxX, const int &minY, const int &maxY, const int &nFeatures, const int &level);
 
@@ -162,6 +179,11 @@ protected:
     
     bool mbPrecomputedGaussianPyramid;
     
+    TaskPool* mpTaskPool; 
+
+#ifndef USE_CUDA
+    std::unique_ptr<ORBdescriptorKernel> mpDescriptorKernel;
+#endif
 };
 
 } // namespace PLVS2
@@ -49,11 +49,14 @@
 #include "KeyFrame.h"
 #include "Frame.h"
 #include "Pointers.h"
+#include "LocalMapProjector.h"
 
 
 namespace PLVS2
 {
 
+    // N.B.: the search methods query the feature grids through the GetFeaturesInArea() variants filling a caller-owned
+    // index buffer; each method declares its buffer once and reuses it across all its queries.
     class ORBmatcher
     {
     public:
@@ -66,6 +69,9 @@ namespace PLVS2
         // Search matches between Frame keypoints and projected MapPoints. Returns number of matches
         // Used to track the local map (Tracking)
         int SearchByProjection(Frame &F, const std::vector<MapPointPtr> &vpMapPoints, const float th=3, const bool bFarPoints = false, const float thFarPoints = 50.0f);
+        // Same as above but the projections are read from the side tables filled by LocalMapProjector (left camera only)
+        int SearchByProjection(Frame &F, const std::vector<MapPointPtr> &vpMapPoints, const std::vector<uint8_t> &vbInView, const std::vector<MapPointProjection> &vProjections,
+                               const float th=3, const bool bFarPoints = false, const float thFarPoints = 50.0f);
 
         // Project MapPoints tracked in last frame into the current frame and search matches.
         // Used to track from previous frame (Tracking)
@@ -121,6 +127,10 @@ namespace PLVS2
 
         float RadiusByViewingCos(const float &viewCos);
 
+        // Match a map point projected in the left image of F. Returns the number of new matches (left and right observations)
+        int MatchProjectedPoint(Frame &F, const MapPointPtr& pMP, const MapPointProjection& proj, const float th, 
+                                std::vector<size_t> &vIndices, std::vector<int> &vDistances);
+
         void ComputeThreeMaxima(std::vector<int>* histo, const int L, int &ind1, int &ind2, int &ind3);
 
         float mfNNratio;
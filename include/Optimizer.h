@@ -90,23 +90,32 @@ public:
     static const float kInvMinLineSegmentLength; 
     
     static float skSigmaZFactor; 
+    static bool skUseFixedSizePoseSolver; 
+    static int skNumOptimizerThreads; 
+    static bool skUseSchurBASolver; 
+    static bool skUsePoseGraphSolver; 
     static float skMuWeightForLine3dDist; 
     static float skSigmaLineError3D;     
     static float skInvSigma2LineError3D;
 
 public:
 
+    // If pProgress is not NULL, the estimates are published in the GBA fields after each iteration and the keyframes 
+    // in pProgress->sFixedKFs are fixed (the features they only observe are not optimized).
     void static BundleAdjustment(const std::vector<KeyFramePtr> &vpKF, const std::vector<MapPointPtr> &vpMPoints,
                                  const std::vector<MapLinePtr> &vpMLines, const std::vector<MapObjectPtr > &vpMObjects, 
                                  int nIterations = 5, bool *pbStopFlag=NULL, const unsigned long nLoopKF=0,
-                                 const bool bRobust = true);
+                                 const bool bRobust = true, LoopClosing::GlobalBAProgress* pProgress = NULL);
     void static GlobalBundleAdjustemnt(Map* pMap, int nIterations=5, bool *pbStopFlag=NULL,
-                                       const unsigned long nLoopKF=0, const bool bRobust = true);
+                                       const unsigned long nLoopKF=0, const bool bRobust = true,
+                                       LoopClosing::GlobalBAProgress* pProgress = NULL);
     void static FullInertialBA(Map *pMap, int its, const bool bFixLocal=false, const unsigned long nLoopKF=0, bool *pbStopFlag=NULL, bool bInit=false, float priorG = 1e2, float priorA=1e6, Eigen::VectorXd *vSingVal = NULL, bool *bHess=NULL);
 
     void static LocalBundleAdjustment(KeyFramePtr pKF, bool *pbStopFlag, Map *pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_MLs, int& num_edges);
 
     int static PoseOptimization(Frame* pFrame);
+    // Same as PoseOptimization() with the fixed-size solver PoseSolver (pinhole camera without a second camera)
+    int static PoseOptimizationFixedSize(Frame* pFrame);
 
     int static PoseInertialOptimizationLastKeyFrame(Frame* pFrame, bool bRecInit = false);
     int static PoseInertialOptimizationLastFrame(Frame *pFrame, bool bRecInit = false);
@@ -155,6 +164,24 @@ public:
     void static InertialOptimization(Map *pMap, Eigen::Vector3d &bg, Eigen::Vector3d &ba, float priorG = 1e2, float priorA = 1e6);
     void static InertialOptimization(Map *pMap, Eigen::Matrix3d &Rwg, double &scale);
 
+    // Copy of the keyframe states read by the gravity and scale optimization below, so that it can run while the mapping 
+    // goes on (the keyframes can be culled and their preintegrations merged meanwhile, see LocalMapping::ScaleRefinement())
+    struct InertialStateSnapshot
+    {
+        struct KeyFrameState
+        {
+            Eigen::Matrix3d Rwb;
+            Eigen::Vector3d twb;
+            Eigen::Vector3d Vw;
+            int prevIdx; // index of the state of mPrevKF (-1 if none)
+            std::shared_ptr<IMU::Preintegrated> pImuPreintegrated; // clone of the preintegration from mPrevKF
+        };
+        std::vector<KeyFrameState> vKFs;
+        Eigen::Vector3d bg, ba; // biases of all the keyframes (fixed)
+    };
+    void static TakeInertialStateSnapshot(Map *pMap, InertialStateSnapshot &snapshot);
+    void static InertialOptimization(const InertialStateSnapshot &snapshot, Eigen::Matrix3d &Rwg, double &scale);
+
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
 };
 
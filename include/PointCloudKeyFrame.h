@@ -152,6 +152,8 @@ public:
     bool bInMap;
     bool bIsValid;
     bool bStereo;
+    
+    unsigned long long int nInsertionTime = 0; // [us] insertion time in PointCloudMapping (for latency stats)
    
 #ifdef USE_LIBELAS    
     static std::shared_ptr<libelas::ElasInterface> pElas;
@@ -162,6 +164,8 @@ public:
 #endif    
     
     static std::shared_ptr<StereoDisparity> pSd;  // for OpenCV (with or without CUDA)  
+    
+    static std::mutex stereoMutex; // the stereo matchers above are shared by the PointCloudMapping preprocessing workers 
         
     std::mutex keyframeMutex;
 };
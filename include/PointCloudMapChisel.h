@@ -22,6 +22,9 @@
 
 #include "PointCloudMap.h" 
 
+#include <unordered_map>
+#include <vector>
+
 
 namespace chisel
 {
@@ -75,6 +78,18 @@ public:
     
     bool LoadMap(const std::string& filename);    
 
+protected:
+
+    // replace in the map cloud the vertices of the meshes recomputed (or deformed) by the last mesh update 
+    void UpdateMeshClouds();
+    
+    // append the vertices of a chunk mesh to the map cloud 
+    void AddChunkPoints(const uint64_t key, const PointCloudT& chunkCloud);
+    // remove the vertices of a chunk mesh from the map cloud (each hole is filled with the last point of the cloud)
+    void RemoveChunkPoints(const uint64_t key);
+    
+    void ClearChunkPoints();
+
 protected:
 
     std::shared_ptr<chisel_server::ChiselServer> pChiselServer_;
@@ -83,6 +98,16 @@ protected:
     //std::unordered_map<uint32_t, typename PointCloudKeyFrameT::Ptr> mapKfidPointCloudKeyFrame_;        
     std::map<uint32_t, typename PointCloudKeyFrameT::Ptr> mapKfidPointCloudKeyFrame_; // ordered map since we use its order in the KF adjustment 
 
+    std::unordered_map<uint64_t, std::vector<size_t>> mapChunkPointIndices_; // packed chunk id -> positions of the chunk mesh vertices in the map cloud 
+    std::vector<uint64_t> pointChunkKeys_; // packed chunk id of each point of the map cloud 
+    std::vector<uint32_t> pointSlots_;     // position of each point of the map cloud in the index list of its chunk 
+
+    // timing stats 
+    double integrationTimeMs_ = 0; 
+    double meshingTimeMs_ = 0; 
+    int numIntegrations_ = 0;
+    int numMeshings_ = 0;
+
 };
 
 
@@ -36,6 +36,7 @@ namespace PLVS2
             kChisel,
             kFastFusion,
             kVoxblox,
+            kVoxelHash,
             kNumPointCloudMapType
         };
         
@@ -0,0 +1,165 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef POINTCLOUD_MAP_VOXELHASH_H
+#define POINTCLOUD_MAP_VOXELHASH_H
+
+#include "PointCloudMap.h"
+
+#include <mutex>
+#include <memory>
+#include <array>
+#include <vector>
+#include <unordered_map>
+
+namespace PLVS2
+{
+
+///	\class PointCloudMapVoxelHash
+///	\author Luigi Freda
+///	\brief Class for merging/managing point clouds by using an incrementally updated hashed voxel map
+///	\note Each inserted point is fused in its voxel: running averages of position, color, normal and depth,
+///       majority vote of keyframe id and label. Voxels are grouped in blocks of kBlockSize^3 voxels stored in a hash table.
+///       An insertion only touches the voxels hit by the new cloud and marks their blocks as dirty; UpdateMap() rewrites the
+///       voxels of the dirty blocks in the exported cloud, where each voxel keeps its own slot. Hence, the cost of an update
+///       does not depend on the map size (as it happens with the voxel grid filter, which re-filters the whole map).
+///	\date
+///	\warning
+template<typename PointT>
+class PointCloudMapVoxelHash : public PointCloudMap<PointT>
+{
+public:
+
+    using PointCloudMap<PointT>::kNormThresholdForEqualMatrices;
+
+    static const int kBlockBits = 3;
+    static const int kBlockSize = 1 << kBlockBits;  // voxels per block side
+    static const int kBlockNumVoxels = kBlockSize*kBlockSize*kBlockSize;
+
+    static const uint32_t kNoKfid;  // kfid of the points inserted without a keyframe
+
+    typedef typename PointCloudMap<PointT>::PointCloudT PointCloudT;
+    typedef PointCloudKeyFrame<PointT> PointCloudKeyFrameT;
+
+public:
+
+    PointCloudMapVoxelHash(Map* pMap, const std::shared_ptr<PointCloudMapParameters>& params);
+
+    void InsertCloud(typename PointCloudT::ConstPtr cloud_world, double x_sensor_origin, double y_sensor_origin, double z_sensor_origin, double max_range);
+
+    void InsertData(typename PointCloudMapInput<PointT>::Ptr pData);
+
+    int UpdateMap();
+    void Clear();
+
+    void OnMapChange();
+
+    bool LoadMap(const std::string& filename);
+
+    size_t GetNumBlocks();
+    size_t GetNumVoxels();
+
+protected:
+
+    struct Voxel
+    {
+        float x, y, z;              // running mean of the position
+        float r, g, b;              // running mean of the color
+        float nx, ny, nz;           // running mean of the normal
+        float depth;                // running mean of the depth
+        uint32_t weight;            // number of fused points
+        uint32_t kfid, kfidVotes;   // majority vote of the keyframe ids
+        uint32_t label, labelVotes; // majority vote of the labels
+        int32_t slot;               // index of the voxel in the exported cloud (-1 if not exported yet)
+    };
+
+    struct Block
+    {
+        Block() { voxelIndex.fill(-1); }
+
+        std::array<int16_t, kBlockNumVoxels> voxelIndex; // position of each voxel in voxels (-1 if empty)
+        std::vector<Voxel> voxels;
+        bool bDirty = false;
+    };
+
+    struct BlockKeyHash
+    {
+        size_t operator()(const uint64_t key) const
+        {
+            // mix the bits of the packed block coordinates
+            uint64_t h = key ^ (key >> 33);
+            h *= 0xff51afd7ed558ccdULL;
+            return h ^ (h >> 33);
+        }
+    };
+
+    typedef std::unordered_map<uint64_t, Block, BlockKeyHash> BlockMap;
+
+protected:
+
+    void Integrate(const PointCloudT& cloud, const uint32_t kfid);
+
+    // fuse the measurement v (with weight v.weight) in its voxel
+    void IntegrateVoxel(const Voxel& v);
+
+    Block& GetBlock(const uint64_t key);
+
+    void ExportVoxel(const Voxel& v, PointT& point) const;
+
+    void ClearVoxels();
+
+    // move the voxels of the keyframes whose pose changed since their integration
+    void DeformMap();
+
+protected:
+
+    float invResolution_;
+    uint32_t minWeight_; // min number of fused points for exporting a voxel
+
+    BlockMap blocks_;
+    std::vector<Block*> dirtyBlocks_;
+    size_t numVoxels_ = 0;
+    size_t numExportedVoxels_ = 0;
+
+    uint64_t lastBlockKey_;
+    Block* pLastBlock_ = nullptr; // cache of the last accessed block
+
+    std::unordered_map<uint32_t, typename PointCloudKeyFrameT::Ptr> mapKfidPointCloudKeyFrame_;
+};
+
+
+
+/// < list here the types you want to use
+
+#if !USE_NORMALS
+
+template class PointCloudMapVoxelHash<pcl::PointXYZRGBA>;
+
+#else
+
+template class PointCloudMapVoxelHash<pcl::PointXYZRGBNormal>;
+template class PointCloudMapVoxelHash<pcl::PointSurfelSegment>;
+
+#endif
+
+} //namespace PLVS2
+
+
+
+#endif // POINTCLOUD_MAP_VOXELHASH_H
@@ -44,6 +44,8 @@ class KeyFrame;
 class Map;
 class Atlas; 
 class LocalMapping; 
+class TaskPool;
+class DepthCloudKernel;
 
 template<typename PointT>
 class PointCloudMap;
@@ -79,8 +81,11 @@ public:
     static const double kMaxDepthDistance; // [m]
     static const double kMinDepthDistance; // [m]
     static const int kNumKeyframesToQueueBeforeProcessing;
+    static const int kNumPreprocessingWorkers;
+    static const int kNumCloudGenerationThreads;
     static const int kMaxNumKeyFramesToInsertInMapInOneStep;
     static const int kTimeoutForWaitingKeyFramesMs; // [ms]    
+    static const int kTimeoutForWaitingLBAMs; // [ms] polling period while preprocessed keyframes are waiting for LBA 
     static const int kMainThreadSleepMs; // [ms]
     static const int kPerKeyFrameProcessSleepMs; // [ms]
 
@@ -150,11 +155,17 @@ protected:
     
     void UpdatePointCloudTimestamp();
 
-    void InitCamGridPoints(KeyFramePtr& kf, cv::Mat& depth);
+    // get the back-projection kernel of the camera of kf (built on the first keyframe of each camera)
+    std::shared_ptr<DepthCloudKernel> GetDepthCloudKernel(KeyFramePtr& kf, const cv::Mat& depth);
 
     //void PrepareNewKeyFramesOld();
+    // move the preprocessed keyframes which have been adjusted by LBA to the keyframes to integrate 
     void PrepareNewKeyFrames();    
     
+    // preprocessing worker: stereo disparity, depth filtering, cloud generation (camera frame), normals and segmentation 
+    void RunPreprocessing();
+    void PreprocessKeyFrame(PointCloudKeyFrame<PointT>::Ptr pcKeyframe);
+    
     bool IntegratePointCloudKeyframe(const std::set<KeyFramePtr>& set_pKFs, PointCloudKeyFrame<PointT>::Ptr pcKeyframe);
 
     static void FilterDepthimage(cv::Mat &image,  const int diamater = 2*3+1, const double sigmaDepth = 0.02, const double sigmaSpace = 5);
@@ -162,8 +173,9 @@ protected:
 protected:
 
     std::shared_ptr<std::thread> viewerThread_;
+    std::vector<std::shared_ptr<std::thread> > preprocessingThreads_;
 
-    bool bShutDown_ = false;
+    std::atomic_bool bShutDown_ {false};
     std::mutex shutDownMutex_;
 
     /// < data to generate point clouds
@@ -184,6 +196,12 @@ protected:
     std::condition_variable keyFramesCond_;
     uint16_t lastKeyframeIndex_ = 0;
     
+    // preprocessed pckeyframes waiting for LBA (sorted by KF id, guarded by keyframesMutex_)
+    std::deque<PointCloudKeyFrame<PointT>::Ptr> pcKeyframesPreprocessed_;    
+    std::condition_variable preprocessingCond_;
+    int numKeyframesInPreprocessing_ = 0;
+    std::atomic_int resetCount_ {0}; // the work started before a reset is discarded 
+    
     int baseKeyframeId_ = -1;
     /* END: to be moved in PointCloudMap */
 
@@ -201,13 +219,15 @@ protected:
     LocalMapping* mpLocalMapping;
     std::shared_ptr<PointCloudAtlas<PointT> >  mpPointCloudAtlas;
 
-    cv::Mat matCamGridPoints_;
-    bool bInitCamGridPoints_;
-    std::vector<std::vector<int> > vCamGridPointsNeighborsIdxs_;
+    std::vector<std::shared_ptr<DepthCloudKernel> > depthCloudKernels_; // one for each camera (resolution and calibration)
+    std::mutex depthCloudKernelsMutex_;
+    std::shared_ptr<TaskPool> pCloudGenerationPool_; // rows of the depth images processed in parallel 
 
     bool bActive_;
     
     size_t numKeyframesToQueueBeforeProcessing_; 
+    int numPreprocessingWorkers_; 
+    int numCloudGenerationThreads_; 
     
     std::vector<Image4Viewer> vecImages_;
     
@@ -45,6 +45,83 @@ inline void updateDepth(const float& depth, PointT& point)
     point.depth = depth; 
 }
 
+template <class PointT, typename std::enable_if<!pcl::traits::has_field<PointT, pcl::fields::depth>::value>::type* = nullptr>
+inline float getDepth(const PointT& point)
+{
+    return 0.f;
+}
+
+template <class PointT, typename std::enable_if<pcl::traits::has_field<PointT, pcl::fields::depth>::value>::type* = nullptr>
+inline float getDepth(const PointT& point)
+{
+    return point.depth;
+}
+
+template <class PointT, typename std::enable_if<!pcl::traits::has_field<PointT, pcl::fields::kfid>::value>::type* = nullptr>
+inline uint32_t getKfid(const PointT& point, const uint32_t& defaultKfid)
+{
+    return defaultKfid;
+}
+
+template <class PointT, typename std::enable_if<pcl::traits::has_field<PointT, pcl::fields::kfid>::value>::type* = nullptr>
+inline uint32_t getKfid(const PointT& point, const uint32_t& defaultKfid)
+{
+    return point.kfid;
+}
+
+template <class PointT, typename std::enable_if<!pcl::traits::has_field<PointT, pcl::fields::normal_x>::value>::type* = nullptr>
+inline void updateNormal(const float& nx, const float& ny, const float& nz, PointT& point)
+{
+
+}
+
+template <class PointT, typename std::enable_if<pcl::traits::has_field<PointT, pcl::fields::normal_x>::value>::type* = nullptr>
+inline void updateNormal(const float& nx, const float& ny, const float& nz, PointT& point)
+{
+    point.normal_x = nx;
+    point.normal_y = ny;
+    point.normal_z = nz;
+}
+
+template <class PointT, typename std::enable_if<!pcl::traits::has_field<PointT, pcl::fields::normal_x>::value>::type* = nullptr>
+inline void getNormal(const PointT& point, float& nx, float& ny, float& nz)
+{
+    nx = ny = nz = 0.f;
+}
+
+template <class PointT, typename std::enable_if<pcl::traits::has_field<PointT, pcl::fields::normal_x>::value>::type* = nullptr>
+inline void getNormal(const PointT& point, float& nx, float& ny, float& nz)
+{
+    nx = point.normal_x;
+    ny = point.normal_y;
+    nz = point.normal_z;
+}
+
+template <class PointT, typename std::enable_if<!pcl::traits::has_field<PointT, pcl::fields::label>::value>::type* = nullptr>
+inline void updateLabel(const uint32_t& label, const uint32_t& confidence, PointT& point)
+{
+
+}
+
+template <class PointT, typename std::enable_if<pcl::traits::has_field<PointT, pcl::fields::label>::value>::type* = nullptr>
+inline void updateLabel(const uint32_t& label, const uint32_t& confidence, PointT& point)
+{
+    point.label = label;
+    point.label_confidence = confidence;
+}
+
+template <class PointT, typename std::enable_if<!pcl::traits::has_field<PointT, pcl::fields::label>::value>::type* = nullptr>
+inline uint32_t getLabel(const PointT& point)
+{
+    return 0;
+}
+
+template <class PointT, typename std::enable_if<pcl::traits::has_field<PointT, pcl::fields::label>::value>::type* = nullptr>
+inline uint32_t getLabel(const PointT& point)
+{
+    return point.label;
+}
+
 template <class PointT, typename std::enable_if<!pcl::traits::has_field<PointT, pcl::fields::normal_x>::value>::type* = nullptr>
 inline void transformPoint(const PointT& mapPointW, const cv::Mat& Rcw, const cv::Mat& tcw, PointT& mapPointC)
 {
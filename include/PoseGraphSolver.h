@@ -0,0 +1,159 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef POSE_GRAPH_SOLVER_H
+#define POSE_GRAPH_SOLVER_H
+
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+#ifdef USE_G2O_NEW
+#include "Thirdparty/g2o_new/install/include/g2o/core/linear_solver.h"
+#include "Thirdparty/g2o_new/install/include/g2o/core/sparse_optimizer.h"
+#else
+#include "Thirdparty/g2o/g2o/core/linear_solver.h"
+#include "Thirdparty/g2o/g2o/core/sparse_optimizer.h"
+#endif
+
+
+namespace PLVS2
+{
+
+/// Symbolic analysis of a pose graph system that is kept across optimizations (see PoseGraphLinearSolver).
+/// The essential graph changes only slightly between two loop closures: the fill-reducing ordering is stored as a
+/// sequence of vertex ids and reused for the next graph, where the vertices that were added are eliminated either
+/// before or after the surviving ones (the placement with the smaller factor is kept).
+/// The ordering is recomputed (AMD on the block pattern) only when too many vertices changed or when the fill-in grew
+/// too much. The pattern of the factor is reused as is when the block pattern of the system did not change.
+class PoseGraphSymbolicCache
+{
+public:
+
+    struct Stats
+    {
+        int numOrderings = 0;   // AMD orderings
+        int numAnalyses = 0;    // symbolic factorizations
+        int numReuses = 0;      // symbolic factorizations reused as is
+    };
+
+    static const float kMaxChangedBlocksRatio;  // max ratio of added+removed vertices for reusing the ordering
+    static const float kMaxFillGrowth;          // max growth of the fill-in (per block) for reusing the ordering
+
+public:
+
+    void Clear();
+
+    /// Set up the symbolic factorization of a system with the given upper block pattern (CSC: block rows r<=c of each
+    /// block column c) where the block i belongs to the vertex with id keys[i]
+    void Analyze(const std::vector<int>& keys, const std::vector<int>& colStart, const std::vector<int>& rows);
+
+    const Stats& GetStats() const { return stats_; }
+
+    int NumBlocks() const { return (int)invPerm_.size(); }
+    int NumFactorBlocks() const { return (int)Lrows_.size(); }  // strictly lower blocks of L
+
+    const std::vector<int>& Perm() const { return perm_; }          // block index -> elimination position
+    const std::vector<int>& InvPerm() const { return invPerm_; }    // elimination position -> block index
+
+    // strictly lower blocks of L (elimination positions): CSC with ascending rows and CSR (column and CSC position)
+    const std::vector<int>& LcolStart() const { return LcolStart_; }
+    const std::vector<int>& Lrows() const { return Lrows_; }
+    const std::vector<int>& LrowStart() const { return LrowStart_; }
+    const std::vector<int>& LrowCols() const { return LrowCols_; }
+    const std::vector<int>& LrowPos() const { return LrowPos_; }
+
+protected:
+
+    void ComputeAMDOrdering();
+    bool ReuseOrdering(const bool bNewFirst, int& numNewBlocks);
+    void ComputeFactorPattern();
+
+protected:
+
+    // system of the current analysis
+    std::vector<int> keys_, colStart_, rows_;
+
+    std::vector<int> orderedKeys_;          // vertex ids in elimination order
+    int numBlocksAtOrdering_ = 0;
+    int numFactorBlocksAtOrdering_ = 0;
+
+    std::vector<int> perm_, invPerm_;
+    std::vector<int> LcolStart_, Lrows_;
+    std::vector<int> LrowStart_, LrowCols_, LrowPos_;
+
+    Stats stats_;
+};
+
+
+/// Sparse Cholesky solver (LL^T) for the pose graphs of the essential graph optimizations, plugged into
+/// g2o::BlockSolver as its linear solver. The factorization works on DxD blocks (one per pose): each block column of
+/// L is a supernode updated with fixed-size dense products. The symbolic analysis comes from a PoseGraphSymbolicCache
+/// that survives the optimizer (SetBlockKeys() must be called after initializeOptimization() to reuse it across graphs).
+template<int D>
+class PoseGraphLinearSolver : public g2o::LinearSolver<Eigen::Matrix<double,D,D> >
+{
+public:
+
+    typedef Eigen::Matrix<double,D,D> MatrixD;
+    typedef Eigen::Matrix<double,D,1> VectorD;
+
+public:
+
+    explicit PoseGraphLinearSolver(PoseGraphSymbolicCache* pCache) : pCache_(pCache) {}
+
+    virtual bool init();
+
+    virtual bool solve(const g2o::SparseBlockMatrix<MatrixD>& A, double* x, double* b);
+
+    /// Use the ids of the active vertices of optimizer as the keys of the blocks of the system
+    /// (if not set, the block indices are used and the cached ordering is meaningful only for the same graph)
+    void SetBlockKeys(const g2o::SparseOptimizer& optimizer);
+
+protected:
+
+    void SetupStructure(const g2o::SparseBlockMatrix<MatrixD>& A);
+
+    bool Factorize();
+
+protected:
+
+    struct Gather
+    {
+        int block;                  // strictly lower block of L
+        const MatrixD* pSource;     // block of A
+        bool bTranspose;
+    };
+
+    PoseGraphSymbolicCache* pCache_;
+    bool bInit_ = true;
+    std::vector<int> keys_;
+
+    std::vector<const MatrixD*> diagSources_;           // diagonal block of A of each elimination position
+    std::vector<int> gatherStart_;                      // CSR: blocks of A of each column of L
+    std::vector<Gather> gathers_;
+    std::vector<MatrixD, Eigen::aligned_allocator<MatrixD> > Ldiag_, L_;
+    std::vector<int> scatter_;
+    std::vector<VectorD, Eigen::aligned_allocator<VectorD> > y_;
+};
+
+} // namespace PLVS2
+
+#endif // POSE_GRAPH_SOLVER_H
@@ -0,0 +1,168 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef POSE_SOLVER_H
+#define POSE_SOLVER_H
+
+#include <vector>
+#include <cstdint>
+
+#include <Eigen/Core>
+
+#include "Thirdparty/Sophus/sophus/se3.hpp"
+
+
+namespace PLVS2
+{
+
+/// Pose-only optimization with a fixed-size 6x6 solver.
+/// It solves the same problem as the g2o graph built in Optimizer::PoseOptimization() for a pinhole camera
+/// without a second camera (mono points, stereo points, mono lines and stereo lines with Huber kernels) and
+/// reproduces its schedule: numRounds rounds of Levenberg-Marquardt iterations (same damping strategy as
+/// g2o::OptimizationAlgorithmLevenberg), each one restarting from the input pose, with the observations
+/// reclassified as inliers/outliers after each round, outliers excluded from the next round and robust kernels
+/// dropped after round roundRobustKernelOff.
+/// The observations are stored in flat arrays (structure of arrays) and the normal equations are accumulated
+/// directly in a 6x6 matrix: no graph, no edge/kernel allocations.
+class PoseSolver
+{
+public:
+
+    static const int kNumRounds = 4;
+
+    struct Params
+    {
+        float chi2Mono[kNumRounds]       = {5.991, 5.991, 5.991, 5.991}; // chi-square 2 DOFs
+        float chi2Stereo[kNumRounds]     = {7.815, 7.815, 7.815, 7.815}; // chi-square 3 DOFs
+        float chi2LineMono[kNumRounds]   = {5.991, 5.991, 5.991, 5.991}; // chi-square 2 DOFs
+        float chi2LineStereo[kNumRounds] = {9.49, 9.49, 9.49, 9.49};     // chi-square 4 DOFs
+        int its[kNumRounds] = {10, 10, 10, 10};
+
+        float deltaMono = sqrt(5.991);       // Huber thresholds
+        float deltaStereo = sqrt(7.815);
+        float deltaLineMono = sqrt(5.991);
+        float deltaLineStereo = sqrt(9.49);
+
+        int roundRobustKernelOff = 2;        // robust kernels are removed after this round
+        int minNumObservations = 10;         // stop after the first round with less observations
+    };
+
+public:
+
+    PoseSolver() = default;
+
+    void SetParams(const Params& params) { params_ = params; }
+    const Params& GetParams() const { return params_; }
+
+    /// Remove all the observations and set the camera intrinsics
+    void Reset(float fx, float fy, float cx, float cy, float bf);
+
+    /// Monocular point observation (u,v)
+    void AddMonoPoint(const Eigen::Vector3f& Xw, float u, float v, float invSigma2);
+    /// Stereo point observation (u,v,uR)
+    void AddStereoPoint(const Eigen::Vector3f& Xw, float u, float v, float uR, float invSigma2);
+    /// Monocular line observation: l = [nx,ny,-d] is the detected line with [nx,ny] a unit normal
+    void AddMonoLine(const Eigen::Vector3f& XSw, const Eigen::Vector3f& XEw, const Eigen::Vector3d& l, float invSigma2);
+    /// Stereo line observation: XSc and XEc are the back-projected endpoints in the camera frame
+    void AddStereoLine(const Eigen::Vector3f& XSw, const Eigen::Vector3f& XEw, const Eigen::Vector3d& l,
+                       const Eigen::Vector3d& XSc, const Eigen::Vector3d& XEc, float invSigma2, float invSigma2PointLineDistance);
+
+    size_t NumMonoPoints() const { return mpU_.size(); }
+    size_t NumStereoPoints() const { return spU_.size(); }
+    size_t NumMonoLines() const { return mlL1_.size(); }
+    size_t NumStereoLines() const { return slL1_.size(); }
+    size_t NumObservations() const { return NumMonoPoints() + NumStereoPoints() + NumMonoLines() + NumStereoLines(); }
+
+    /// Optimize Tcw (in/out). The outlier flags are then available below.
+    void Optimize(Sophus::SE3f& Tcw);
+
+    const std::vector<uint8_t>& MonoPointOutliers() const { return mpOutlier_; }
+    const std::vector<uint8_t>& StereoPointOutliers() const { return spOutlier_; }
+    const std::vector<uint8_t>& MonoLineOutliers() const { return mlOutlier_; }
+    const std::vector<uint8_t>& StereoLineOutliers() const { return slOutlier_; }
+
+    int NumPointOutliers() const { return nPointOutliers_; }
+    int NumLineOutliers() const { return nLineOutliers_; }
+
+protected:
+
+    typedef Eigen::Matrix<double,6,6> Matrix6d;
+    typedef Eigen::Matrix<double,6,1> Vector6d;
+
+    enum EvalMode
+    {
+        kEvalActive = 0,      // inliers: chi2 at T, robust cost and (optionally) normal equations
+        kEvalInactive         // outliers: chi2 at T only
+    };
+
+    /// Evaluate the observations at T. If H and g are not null, accumulate the normal equations H*dx = -g.
+    /// Return the (robust) cost of the evaluated observations.
+    double Evaluate(const Sophus::SE3d& T, const EvalMode mode, const bool bRobust, Matrix6d* H, Vector6d* g);
+
+    /// Levenberg-Marquardt iterations on the active observations starting from T
+    void Minimize(Sophus::SE3d& T, const int numIterations, const bool bRobust);
+
+    /// Swap the back-projected endpoints of the stereo lines whose direction is opposite to the map line in T
+    void CheckStereoLineEndpoints(const Sophus::SE3d& T);
+
+protected:
+
+    Params params_;
+
+    double fx_ = 0, fy_ = 0, cx_ = 0, cy_ = 0, bf_ = 0;
+
+    // mono points
+    std::vector<double> mpX_, mpY_, mpZ_;
+    std::vector<double> mpU_, mpV_;
+    std::vector<double> mpInfo_;
+    std::vector<double> mpChi2_;
+    std::vector<uint8_t> mpOutlier_;
+
+    // stereo points
+    std::vector<double> spX_, spY_, spZ_;
+    std::vector<double> spU_, spV_, spUR_;
+    std::vector<double> spInfo_;
+    std::vector<double> spChi2_;
+    std::vector<uint8_t> spOutlier_;
+
+    // mono lines
+    std::vector<double> mlSX_, mlSY_, mlSZ_;
+    std::vector<double> mlEX_, mlEY_, mlEZ_;
+    std::vector<double> mlL1_, mlL2_, mlL3_;
+    std::vector<double> mlInfo_;
+    std::vector<double> mlChi2_;
+    std::vector<uint8_t> mlOutlier_;
+
+    // stereo lines
+    std::vector<double> slSX_, slSY_, slSZ_;
+    std::vector<double> slEX_, slEY_, slEZ_;
+    std::vector<double> slL1_, slL2_, slL3_;
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > slBS_, slBE_; // back-projected endpoints (camera frame)
+    std::vector<double> slLengthInv_;
+    std::vector<double> slInfo2D_, slInfo3D_;
+    std::vector<double> slChi2_;
+    std::vector<uint8_t> slOutlier_;
+
+    int nPointOutliers_ = 0;
+    int nLineOutliers_ = 0;
+};
+
+} // namespace PLVS2
+
+#endif // POSE_SOLVER_H
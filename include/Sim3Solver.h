@@ -42,6 +42,7 @@
 
 #include <opencv2/opencv.hpp>
 #include <vector>
+#include <random>
 
 #include "KeyFrame.h"
 
@@ -59,6 +60,10 @@ public:
 
     void SetRansacParameters(double probability = 0.99, int minInliers = 6 , int maxIterations = 300);
 
+    // the minimal sets are drawn from a generator owned by the solver: solvers can run concurrently and,
+    // for a given seed, they draw the same hypotheses
+    void SetRandomSeed(unsigned int seed);
+
     Eigen::Matrix4f find(std::vector<bool> &vbInliers12, int &nInliers);
 
     Eigen::Matrix4f iterate(int nIterations, bool &bNoMore, std::vector<bool> &vbInliers, int &nInliers);
@@ -125,6 +130,9 @@ protected:
     // Indices for random selection
     std::vector<size_t> mvAllIndices;
 
+    // Generator of the random selections
+    std::mt19937 mRng;
+
     // Projections
     std::vector<Eigen::Vector2f> mvP1im1;
     std::vector<Eigen::Vector2f> mvP2im2;
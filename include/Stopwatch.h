@@ -41,6 +41,7 @@
 #include <string>
 #include <iostream>
 #include <map>
+#include <mutex>
 
 
 //#define DISABLE_STOPWATCH // uncomment to disable 
@@ -94,6 +95,25 @@
     } \
     while(false)
 
+// timing of an expression which can run concurrently on many threads (tick/tock share the start time of a name)
+#define STOPWATCHTYPE(name, expression, type) \
+    do \
+    { \
+        const unsigned long long int startTime = Stopwatch::getInstance##type().getCurrentSystemTime(); \
+        expression \
+        const unsigned long long int endTime = Stopwatch::getInstance##type().getCurrentSystemTime(); \
+        Stopwatch::getInstance##type().addStopwatchTiming(name, endTime - startTime); \
+    } \
+    while(false)
+
+// a value which is not a timing (e.g. a queue depth)
+#define COUNTERTYPE(name,value,type) \
+    do \
+    { \
+        Stopwatch::getInstance##type().setCounter(name, value); \
+    } \
+    while(false)
+
 // specific tick-tock for each thread of interest
 
 
@@ -109,6 +129,11 @@
 
 #define SENDALL(type) ((void)0)
 
+#define STOPWATCHTYPE(name, expression, type) \
+    expression
+
+#define COUNTERTYPE(name,value,type) ((void)0)
+
 #endif
 
 // create one StopWatch instance for each useful thread 
@@ -120,6 +145,8 @@
 #define TICKCLOUD(name) TICKTYPE(name,Cloud)
 #define TOCKCLOUD(name) TOCKTYPE(name,Cloud)
 #define SENDALLCLOUD SENDALL(Cloud)
+#define STOPWATCHCLOUD(name, expression) STOPWATCHTYPE(name, expression, Cloud)
+#define COUNTERCLOUD(name,value) COUNTERTYPE(name,value,Cloud)
 
 #define TICKLIBELAS(name) TICKTYPE(name,Libelas)
 #define TOCKLIBELAS(name) TOCKTYPE(name,Libelas)
@@ -150,6 +177,7 @@ class Stopwatch
         
         void addStopwatchTiming(std::string name, unsigned long long int duration)
         {
+            std::unique_lock<std::mutex> lock(mutex);
             if(duration > 0)
             {
                 timings[name] = (float)(duration) / 1000.0f;
@@ -166,23 +194,41 @@ class Stopwatch
             return timings;
         }
 
+        const std::map<std::string, float> & getCounters()
+        {
+            return counters;
+        }
+
+        void setCounter(std::string name, float value)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            counters[name] = value;
+        }
+
         void printAll()
         {
+            std::unique_lock<std::mutex> lock(mutex);
             for(std::map<std::string, float>::const_iterator it = timings.begin(); it != timings.end(); it++)
             {
                 std::cout << it->first << ": " << it->second  << "ms" << std::endl;
             }
+            for(std::map<std::string, float>::const_iterator it = counters.begin(); it != counters.end(); it++)
+            {
+                std::cout << it->first << ": " << it->second << std::endl;
+            }
 
             std::cout << std::endl;
         }
 
         void pulse(std::string name)
         {
+            std::unique_lock<std::mutex> lock(mutex);
             timings[name] = 1;
         }
 
         void sendAll()
         {
+            std::unique_lock<std::mutex> lock(mutex);
             gettimeofday(&clock, 0);
 
             if((currentSend = (clock.tv_sec * 1000000 + clock.tv_usec)) - lastSend > SEND_INTERVAL_MS)
@@ -208,11 +254,13 @@ class Stopwatch
 
         void tick(std::string name, unsigned long long int start)
         {
+            std::unique_lock<std::mutex> lock(mutex);
         	tickTimings[name] = start;
         }
 
         void tock(std::string name, unsigned long long int end)
         {
+            std::unique_lock<std::mutex> lock(mutex);
         	float duration = (float)(end - tickTimings[name]) / 1000.0f;
 
             if(duration > 0)
@@ -242,6 +290,7 @@ class Stopwatch
             close(sockfd);
         }
 
+        // the counters are sent along with the timings
         unsigned char * serialiseTimings(int & packetSize)
         {
             packetSize = sizeof(int) + sizeof(unsigned long long int);
@@ -250,6 +299,10 @@ class Stopwatch
             {
                 packetSize += it->first.length() + 1 + sizeof(float);
             }
+            for(std::map<std::string, float>::const_iterator it = counters.begin(); it != counters.end(); it++)
+            {
+                packetSize += it->first.length() + 1 + sizeof(float);
+            }
 
             int * dataPacket = (int *)calloc(packetSize, sizeof(unsigned char));
 
@@ -259,12 +312,15 @@ class Stopwatch
 
             float * valuePointer = (float *)&((unsigned long long int *)&dataPacket[1])[1];
 
-            for(std::map<std::string, float>::const_iterator it = timings.begin(); it != timings.end(); it++)
+            for(const std::map<std::string, float>* pValues : {&timings, &counters})
             {
-                memcpy(valuePointer, it->first.c_str(), it->first.length() + 1);
-                valuePointer = (float *)((unsigned char *)valuePointer +
-                  it->first.length() + 1);
-                *valuePointer++ = it->second;
+                for(std::map<std::string, float>::const_iterator it = pValues->begin(); it != pValues->end(); it++)
+                {
+                    memcpy(valuePointer, it->first.c_str(), it->first.length() + 1);
+                    valuePointer = (float *)((unsigned char *)valuePointer +
+                      it->first.length() + 1);
+                    *valuePointer++ = it->second;
+                }
             }
 
             return (unsigned char *)dataPacket;
@@ -275,8 +331,10 @@ class Stopwatch
         unsigned long long int signature;
         int sockfd;
         struct sockaddr_in servaddr;
-        std::map<std::string, float> timings;
+        std::map<std::string, float> timings;  // [ms]
+        std::map<std::string, float> counters; // values which are not timings (see COUNTERTYPE)
         std::map<std::string, unsigned long long int> tickTimings;
+        std::mutex mutex; // the Cloud instance is shared by the point cloud mapping threads
 };
 
 #endif /* STOPWATCH_H_ */
@@ -261,6 +261,7 @@ public:
 private:
 
     std::string CalculateCheckSum(std::string filename, int type);
+    std::string GetVocabularyDigest(int type);
 
     // Input sensor
     eSensor mSensor;
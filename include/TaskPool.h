@@ -0,0 +1,119 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+
+namespace PLVS2
+{
+
+/// A long-lived pool of worker threads.
+/// Workers are created once (and optionally pinned to consecutive cores) and then reused for every submitted job,
+/// so that per-frame tasks do not pay thread creation/destruction and can find warm caches.
+/// Each worker owns the scratch buffers of the jobs it executes (see GetScratch()).
+class TaskPool
+{
+public:
+
+    typedef std::function<void()> Task;
+
+    /// Group of tasks whose completion can be awaited with Wait()
+    class TaskGroup
+    {
+    public:
+        TaskGroup(TaskPool* pPool): pPool_(pPool), numPending_(0) {}
+        ~TaskGroup() { Wait(); }
+
+        /// Submit a task to the pool. If the pool is NULL or has no workers, the task is run immediately in the calling thread.
+        void Run(Task&& task);
+
+        /// Wait for all the submitted tasks. The calling thread helps executing pending tasks while waiting.
+        void Wait();
+
+    protected:
+        friend class TaskPool;
+        void NotifyDone();
+
+    protected:
+        TaskPool* pPool_;
+        std::atomic<int> numPending_;
+        std::mutex mutex_;
+        std::condition_variable cond_;
+    };
+
+public:
+
+    /// numThreads: number of workers; firstCore: if >=0 worker i is pinned to core (firstCore+i) modulo the number of available cores
+    TaskPool(int numThreads, int firstCore = -1);
+    ~TaskPool();
+
+    int GetNumThreads() const { return (int)workers_.size(); }
+
+    /// Index of the calling worker in [0, GetNumThreads()), -1 if the calling thread is not a worker of any pool
+    static int GetWorkerId();
+
+    /// Scratch object of type T of the calling worker (of the calling thread if it is not a pool worker). Workers live as long 
+    /// as the pool, so the capacity of its buffers is reused by all the following jobs; its content is not preserved among 
+    /// different jobs. It must not be held across a TaskGroup::Wait(), which can run other jobs in the calling thread. 
+    template<typename T>
+    static T& GetScratch()
+    {
+        static thread_local T scratch;
+        return scratch;
+    }
+
+protected:
+
+    void Push(Task&& task, TaskGroup* pGroup);
+
+    /// Pop and execute one pending task if any; returns false if the queue was empty
+    bool RunPendingTask();
+
+    void WorkerLoop(int workerId);
+
+    void PinToCore(std::thread& thread, int core);
+
+protected:
+
+    struct Job
+    {
+        Task task;
+        TaskGroup* pGroup;
+    };
+
+    std::vector<std::thread> workers_;
+
+    std::deque<Job> jobs_;
+    std::mutex jobsMutex_;
+    std::condition_variable jobsCond_;
+    bool bStop_;
+};
+
+} // namespace PLVS2
+
+#endif // TASK_POOL_H
@@ -63,6 +63,8 @@
 
 #include "GeometricCamera.h"
 #include "PointCloudMapping.h"
+#include "TaskPool.h"
+#include "LocalMapProjector.h"
 
 #include <mutex>
 #include <unordered_set>
@@ -96,6 +98,7 @@ public:
     static float skLineStereoMaxDist; 
     static float skMaxDistFovCenters; 
     static bool skUsePyramidPrecomputation; 
+    static bool skUseBatchFrustumCulling; 
 
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -331,6 +334,9 @@ protected:
     //LSD
     bool mbLineTrackerOn = false;  // is line tracking active 
     std::shared_ptr<LineExtractor> mpLineExtractorLeft, mpLineExtractorRight; 
+
+    // Persistent worker pool used by Frame for feature extraction
+    std::shared_ptr<TaskPool> mpExtractionPool;
     
     //Object Tracking
     bool mbObjectTrackerOn = false;
@@ -349,6 +355,13 @@ protected:
     std::vector<MapPointPtr> mvpLocalMapPoints;
     std::vector<MapLinePtr> mvpLocalMapLines;
     std::vector<MapObjectPtr > mvpLocalMapObjects;
+
+    // Batched frustum culling of the local map (snapshot taken in UpdateLocalMap()) and its per-frame side tables
+    LocalMapProjector mLocalMapProjector;
+    std::vector<uint8_t> mvbLocalMapPointsInView;
+    std::vector<MapPointProjection> mvLocalMapPointsProjections;
+    std::vector<uint8_t> mvbLocalMapLinesInView;
+    std::vector<MapLineProjection> mvLocalMapLinesProjections;
     
     // System
     System* mpSystem;
@@ -27,6 +27,7 @@
 #include <string> 
 #include <vector>
 #include <algorithm>
+#include <cstdint>
 
 #include <opencv2/core.hpp>
 
@@ -213,6 +214,20 @@ public:
     {
         return x*x;
     }
+
+    // pack the integer coordinates of a grid cell in a hash key: 21 bits for each coordinate (two's complement)
+    static uint64_t PackGridKey(const int x, const int y, const int z)
+    {
+        return ((uint64_t)(x & 0x1FFFFF) << 42) | ((uint64_t)(y & 0x1FFFFF) << 21) | (uint64_t)(z & 0x1FFFFF);
+    }
+
+    // inverse of PackGridKey() (sign extension of the 21-bit fields)
+    static void UnpackGridKey(const uint64_t key, int& x, int& y, int& z)
+    {
+        x = (int)((int64_t)(key << 1) >> 43);
+        y = (int)((int64_t)(key << 22) >> 43);
+        z = (int)((int64_t)(key << 43) >> 43);
+    }
     
         
     static float SigmaZ(const float& z)
@@ -0,0 +1,80 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef WAKE_UP_EVENT_H
+#define WAKE_UP_EVENT_H
+
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+
+namespace PLVS2
+{
+
+/// Wake-up of a thread waiting for some state change of another thread (new keyframes, stop/release, reset and finish requests).
+/// The producer changes its state (under its own lock) and then calls Notify(). 
+/// A notification is never lost: it stays pending until a WaitFor() consumes it. 
+class WakeUpEvent
+{
+public:
+
+    static constexpr int kMaxWaitMs = 50; // [ms] fallback timeout for the state changes which are not notified 
+
+public:
+
+    void Notify()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            bNotified_ = true;
+        }
+        cond_.notify_all();
+    }
+
+    /// Wait for a notification (consuming it) or the timeout. Returns false on timeout.
+    bool WaitFor(const int timeoutMs = kMaxWaitMs)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        const bool bNotified = cond_.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]{ return bNotified_; });
+        bNotified_ = false;
+        return bNotified;
+    }
+
+    /// Wait until pred() is true (re-checked at each notification or after the fallback timeout). pred() is evaluated 
+    /// with the lock of the event held: the state it reads must be changed before calling Notify() (and Notify() must 
+    /// not be called while holding a lock taken by pred()).
+    template<typename Predicate>
+    void WaitUntil(Predicate pred)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while(!pred())
+            cond_.wait_for(lock, std::chrono::milliseconds(kMaxWaitMs));
+    }
+
+private:
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool bNotified_ = false;
+};
+
+} // namespace PLVS2
+
+#endif // WAKE_UP_EVENT_H
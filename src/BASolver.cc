@@ -0,0 +1,717 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "BASolver.h"
+
+#ifndef USE_G2O_NEW // the solver relies on g2o::SparseOptimizer::linearizeActiveEdges() of the vendored g2o
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include <Eigen/Cholesky>
+
+#include "Thirdparty/g2o/g2o/core/base_binary_edge.h"
+#include "Thirdparty/g2o/g2o/core/base_unary_edge.h"
+#include "Thirdparty/g2o/g2o/core/robust_kernel.h"
+#include "Thirdparty/g2o/g2o/types/types_sba.h"
+#include "Thirdparty/g2o/g2o/types/types_six_dof_expmap.h"
+
+#include "g2o/types_sba_line.h"
+
+
+namespace PLVS2
+{
+
+// The base classes of the supported edges (vertex 0: landmark, vertex 1: pose)
+typedef g2o::BaseBinaryEdge<2, Eigen::Vector2d, g2o::VertexSBAPointXYZ, g2o::VertexSE3Expmap> EdgePointMonoBase;   // EdgeSE3ProjectXYZ, EdgeSE3ProjectXYZToBody
+typedef g2o::BaseBinaryEdge<3, Eigen::Vector3d, g2o::VertexSBAPointXYZ, g2o::VertexSE3Expmap> EdgePointStereoBase; // EdgeStereoSE3ProjectXYZ, EdgeRgbdSE3ProjectXYZ
+typedef g2o::BaseBinaryEdge<2, Eigen::Vector3d, g2o::VertexSBALine, g2o::VertexSE3Expmap> EdgeLineMonoBase;        // EdgeSE3ProjectLine
+typedef g2o::BaseBinaryEdge<4, Eigen::Vector3d, g2o::VertexSBALine, g2o::VertexSE3Expmap> EdgeLineStereoBase;      // EdgeSE3ProjectStereoLine
+typedef g2o::BaseUnaryEdge<6, g2o::Vector6d, g2o::VertexSBALine> EdgeLinePriorBase;                               // EdgeLinePrior
+
+static const int kMinParallelSize = 50; // below this size a loop is run in the calling thread
+
+enum VertexSlotType { kSlotPose = 0, kSlotPoint, kSlotLine };
+
+// Weight of the information matrix with a robust kernel (as g2o::BaseEdge::robustInformation())
+static inline double RobustWeight(const g2o::OptimizableGraph::Edge* e)
+{
+    const g2o::RobustKernel* rk = e->robustKernel();
+    if(!rk)
+        return 1.;
+    Eigen::Vector3d rho;
+    rk->robustify(e->chi2(), rho);
+    return rho[1];
+}
+
+// H += Jl^T*W*Jl, b -= Jl^T*W*e and Wpl += Jp^T*W*Jl (landmark Jacobian Jl, pose Jacobian Jp, information W weighted by w)
+template<class EdgeT, int L>
+static inline void AccumulateLandmarkTerms(const EdgeT* e, const double w, Eigen::Matrix<double,L,L>& H, Eigen::Matrix<double,L,1>& b,
+                                           Eigen::Matrix<double,6,L>* pW, Eigen::Matrix<double,6,6>* pV, Eigen::Matrix<double,6,1>* pg)
+{
+    const typename EdgeT::InformationType omega = w * e->information();
+    const Eigen::Matrix<double,L,EdgeT::Dimension> JltO = e->jacobianOplusXi().transpose() * omega;
+    H.noalias() += JltO * e->jacobianOplusXi();
+    b.noalias() -= JltO * e->error();
+    if(pW)
+    {
+        // the pose terms are accumulated here as well, while the Jacobians are in cache
+        const Eigen::Matrix<double,6,EdgeT::Dimension> JptO = e->jacobianOplusXj().transpose() * omega;
+        pW->noalias() += JptO * e->jacobianOplusXi();
+        pV->noalias() += JptO * e->jacobianOplusXj();
+        pg->noalias() -= JptO * e->error();
+    }
+}
+
+template<class EdgeT>
+static inline void AccumulateLinePriorTerms(const EdgeT* e, const double w, Eigen::Matrix<double,6,6>& H, Eigen::Matrix<double,6,1>& b)
+{
+    const typename EdgeT::InformationType omega = w * e->information();
+    const Eigen::Matrix<double,6,EdgeT::Dimension> JtO = e->jacobianOplusXi().transpose() * omega;
+    H.noalias() += JtO * e->jacobianOplusXi();
+    b.noalias() -= JtO * e->error();
+}
+
+// H += Jp^T*W*Jp, b -= Jp^T*W*e
+template<class EdgeT>
+static inline void AccumulatePoseTerms(const EdgeT* e, const double w, Eigen::Matrix<double,6,6>& H, Eigen::Matrix<double,6,1>& b)
+{
+    const typename EdgeT::InformationType omega = w * e->information();
+    const Eigen::Matrix<double,6,EdgeT::Dimension> JptO = e->jacobianOplusXj().transpose() * omega;
+    H.noalias() += JptO * e->jacobianOplusXj();
+    b.noalias() -= JptO * e->error();
+}
+
+
+bool BASolver::Init(g2o::SparseOptimizer* optimizer)
+{
+    optimizer_ = optimizer;
+    edges_.clear();
+    numPoses_ = 0;
+    poseVertices_.clear();
+    points_ = LandmarkBlocks<3>();
+    lines_ = LandmarkBlocks<6>();
+
+    // free vertices (the fixed ones have no Hessian index)
+    const g2o::SparseOptimizer::VertexContainer& indexMapping = optimizer->indexMapping();
+    std::vector<int> slot(indexMapping.size(), -1);
+    std::vector<uint8_t> slotType(indexMapping.size(), kSlotPose);
+    for(size_t k=0; k<indexMapping.size(); k++)
+    {
+        g2o::OptimizableGraph::Vertex* v = indexMapping[k];
+        if(!v->marginalized())
+        {
+            if(v->dimension() != 6)
+                return false;
+            slot[k] = numPoses_++;
+            slotType[k] = kSlotPose;
+            poseVertices_.push_back(v);
+        }
+        else if(v->dimension() == 3)
+        {
+            slot[k] = points_.Size();
+            slotType[k] = kSlotPoint;
+            points_.vertices.push_back(v);
+        }
+        else if(v->dimension() == 6)
+        {
+            slot[k] = lines_.Size();
+            slotType[k] = kSlotLine;
+            lines_.vertices.push_back(v);
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    // returns the slot of a vertex (-1 if fixed) and false if the vertex is free with a different type
+    auto getSlot = [&](g2o::HyperGraph::Vertex* hv, const VertexSlotType type, int& index) -> bool
+    {
+        const int hessianIndex = static_cast<g2o::OptimizableGraph::Vertex*>(hv)->hessianIndex();
+        index = hessianIndex < 0 ? -1 : slot[hessianIndex];
+        return hessianIndex < 0 || slotType[hessianIndex] == type;
+    };
+
+    const g2o::SparseOptimizer::EdgeContainer& activeEdges = optimizer->activeEdges();
+    edges_.reserve(activeEdges.size());
+    for(size_t k=0; k<activeEdges.size(); k++)
+    {
+        g2o::OptimizableGraph::Edge* e = activeEdges[k];
+        EdgeInfo info{e, kEdgePointMono, -1, -1, -1};
+        VertexSlotType landmarkType = kSlotPoint;
+        if(dynamic_cast<EdgePointMonoBase*>(e))
+            info.kind = kEdgePointMono;
+        else if(dynamic_cast<EdgePointStereoBase*>(e))
+            info.kind = kEdgePointStereo;
+        else if(dynamic_cast<EdgeLineMonoBase*>(e))
+            info.kind = kEdgeLineMono;
+        else if(dynamic_cast<EdgeLineStereoBase*>(e))
+            info.kind = kEdgeLineStereo;
+        else if(dynamic_cast<EdgeLinePriorBase*>(e))
+            info.kind = kEdgeLinePrior;
+        else
+            return false;
+        if(info.kind >= kEdgeLineMono)
+            landmarkType = kSlotLine;
+
+        if(!getSlot(e->vertex(0), landmarkType, info.landmark))
+            return false;
+        if(info.kind != kEdgeLinePrior && !getSlot(e->vertex(1), kSlotPose, info.pose))
+            return false;
+
+        if(info.landmark >= 0 || info.pose >= 0)
+            edges_.push_back(info);
+    }
+
+    // edges of each landmark and of each pose
+    auto buildCSR = [&](const int size, std::vector<int>& start, std::vector<int>& items, const bool bPoses, const VertexSlotType type)
+    {
+        start.assign(size+1, 0);
+        for(const EdgeInfo& info : edges_)
+        {
+            const int index = bPoses ? (info.pair < 0 ? info.pose : -1) : info.landmark;
+            const bool bLine = info.kind >= kEdgeLineMono;
+            if(index >= 0 && (bPoses || bLine == (type == kSlotLine)))
+                start[index+1]++;
+        }
+        for(int i=0; i<size; i++)
+            start[i+1] += start[i];
+        items.resize(start[size]);
+        std::vector<int> pos(start.begin(), start.end()-1);
+        for(size_t k=0; k<edges_.size(); k++)
+        {
+            const EdgeInfo& info = edges_[k];
+            const int index = bPoses ? (info.pair < 0 ? info.pose : -1) : info.landmark;
+            const bool bLine = info.kind >= kEdgeLineMono;
+            if(index >= 0 && (bPoses || bLine == (type == kSlotLine)))
+                items[pos[index]++] = k;
+        }
+    };
+    buildCSR(points_.Size(), points_.edgeStart, points_.edges, false, kSlotPoint);
+    buildCSR(lines_.Size(), lines_.edgeStart, lines_.edges, false, kSlotLine);
+
+    // pose-landmark blocks and block pattern of the reduced camera system
+    std::vector<std::vector<int> > rowPattern(numPoses_);
+    SetupPairs(points_, rowPattern);
+    SetupPairs(lines_, rowPattern);
+    buildCSR(numPoses_, poseEdgeStart_, poseEdges_, true, kSlotPose);
+
+    reducedRowStart_.assign(numPoses_+1, 0);
+    reducedCols_.clear();
+    for(int i=0; i<numPoses_; i++)
+    {
+        std::vector<int>& row = rowPattern[i];
+        row.push_back(i);
+        std::sort(row.begin(), row.end());
+        row.erase(std::unique(row.begin(), row.end()), row.end());
+        reducedCols_.insert(reducedCols_.end(), row.begin(), row.end());
+        reducedRowStart_[i+1] = reducedCols_.size();
+    }
+    S_.resize(reducedCols_.size());
+    SetupSchurTerms(points_);
+    SetupSchurTerms(lines_);
+    edgeWeights_.resize(edges_.size());
+
+    Hpp_.resize(numPoses_);
+    bp_.resize(numPoses_);
+    rhs_.resize(6*numPoses_);
+    dxPoses_.resize(6*numPoses_);
+
+    bDense_ = numPoses_ <= params_.maxDenseNumPoses;
+    if(bDense_)
+    {
+        denseS_.setZero(6*numPoses_, 6*numPoses_); // the blocks outside the pattern are never written
+    }
+    else
+    {
+        // lower triangle: the entries of column 6i+a are the diagonal block rows a..5 and then the blocks (i,j) with j>i
+        std::vector<Eigen::Triplet<double> > triplets;
+        triplets.reserve(36*reducedCols_.size());
+        for(int i=0; i<numPoses_; i++)
+        {
+            for(int a=0; a<6; a++)
+            {
+                for(int k=reducedRowStart_[i]; k<reducedRowStart_[i+1]; k++)
+                {
+                    const int j = reducedCols_[k];
+                    for(int b=(j==i ? a : 0); b<6; b++)
+                        triplets.push_back(Eigen::Triplet<double>(6*j+b, 6*i+a, 0.));
+                }
+            }
+        }
+        sparseS_.resize(6*numPoses_, 6*numPoses_);
+        sparseS_.setFromTriplets(triplets.begin(), triplets.end());
+        sparseS_.makeCompressed();
+        sparseSolver_.analyzePattern(sparseS_);
+    }
+
+    return true;
+}
+
+template<int L>
+void BASolver::SetupPairs(LandmarkBlocks<L>& lm, std::vector<std::vector<int> >& rowPattern)
+{
+    const int numLandmarks = lm.Size();
+    lm.pairStart.assign(numLandmarks+1, 0);
+    lm.pairPose.clear();
+    lm.pairLandmark.clear();
+    for(int l=0; l<numLandmarks; l++)
+    {
+        const int start = lm.pairPose.size();
+        for(int k=lm.edgeStart[l]; k<lm.edgeStart[l+1]; k++)
+        {
+            EdgeInfo& info = edges_[lm.edges[k]];
+            if(info.pose < 0)
+                continue;
+            int pair = start;
+            while(pair < (int)lm.pairPose.size() && lm.pairPose[pair] != info.pose)
+                pair++;
+            if(pair == (int)lm.pairPose.size())
+            {
+                lm.pairPose.push_back(info.pose);
+                lm.pairLandmark.push_back(l);
+            }
+            info.pair = pair;
+        }
+        lm.pairStart[l+1] = lm.pairPose.size();
+
+        for(int p=start; p<lm.pairStart[l+1]; p++)
+            for(int q=start; q<lm.pairStart[l+1]; q++)
+                if(lm.pairPose[p] < lm.pairPose[q])
+                    rowPattern[lm.pairPose[p]].push_back(lm.pairPose[q]);
+    }
+
+    const int numPairs = lm.pairPose.size();
+    lm.W.resize(numPairs);
+    lm.Y.resize(numPairs);
+    lm.V.resize(numPairs);
+    lm.g.resize(numPairs);
+    lm.H.resize(numLandmarks);
+    lm.Hinv.resize(numLandmarks);
+    lm.b.resize(numLandmarks);
+    lm.Hinvb.resize(numLandmarks);
+    lm.dx.resize(numLandmarks);
+
+    // pairs of each pose in ascending landmark order
+    lm.posePairStart.assign(numPoses_+1, 0);
+    for(int p=0; p<numPairs; p++)
+        lm.posePairStart[lm.pairPose[p]+1]++;
+    for(int i=0; i<numPoses_; i++)
+        lm.posePairStart[i+1] += lm.posePairStart[i];
+    lm.posePairs.resize(numPairs);
+    std::vector<int> pos(lm.posePairStart.begin(), lm.posePairStart.end()-1);
+    for(int p=0; p<numPairs; p++)
+        lm.posePairs[pos[lm.pairPose[p]]++] = p;
+}
+
+template<int L>
+void BASolver::SetupSchurTerms(LandmarkBlocks<L>& lm)
+{
+    lm.schurStart.assign(numPoses_+1, 0);
+    lm.schurTerms.clear();
+    std::vector<int> colBlock(numPoses_, -1);
+    for(int i=0; i<numPoses_; i++)
+    {
+        for(int k=reducedRowStart_[i]; k<reducedRowStart_[i+1]; k++)
+            colBlock[reducedCols_[k]] = k;
+        for(int k=lm.posePairStart[i]; k<lm.posePairStart[i+1]; k++)
+        {
+            const int p = lm.posePairs[k];
+            const int l = lm.pairLandmark[p];
+            for(int q=lm.pairStart[l]; q<lm.pairStart[l+1]; q++)
+            {
+                const int j = lm.pairPose[q];
+                if(j >= i)
+                    lm.schurTerms.push_back(typename LandmarkBlocks<L>::SchurTerm{p, q, colBlock[j]});
+            }
+        }
+        lm.schurStart[i+1] = lm.schurTerms.size();
+    }
+}
+
+void BASolver::AccumulateLandmarkEdge(const EdgeInfo& info, const double w, LandmarkBlocks<3>& lm, const int l)
+{
+    Eigen::Matrix<double,6,3>* pW = info.pair >= 0 ? &lm.W[info.pair] : nullptr;
+    Matrix6d* pV = info.pair >= 0 ? &lm.V[info.pair] : nullptr;
+    Vector6d* pg = info.pair >= 0 ? &lm.g[info.pair] : nullptr;
+    switch(info.kind)
+    {
+    case kEdgePointMono:
+        AccumulateLandmarkTerms(static_cast<const EdgePointMonoBase*>(info.edge), w, lm.H[l], lm.b[l], pW, pV, pg);
+        break;
+    case kEdgePointStereo:
+        AccumulateLandmarkTerms(static_cast<const EdgePointStereoBase*>(info.edge), w, lm.H[l], lm.b[l], pW, pV, pg);
+        break;
+    default:
+        break;
+    }
+}
+
+void BASolver::AccumulateLandmarkEdge(const EdgeInfo& info, const double w, LandmarkBlocks<6>& lm, const int l)
+{
+    Eigen::Matrix<double,6,6>* pW = info.pair >= 0 ? &lm.W[info.pair] : nullptr;
+    Matrix6d* pV = info.pair >= 0 ? &lm.V[info.pair] : nullptr;
+    Vector6d* pg = info.pair >= 0 ? &lm.g[info.pair] : nullptr;
+    switch(info.kind)
+    {
+    case kEdgeLineMono:
+        AccumulateLandmarkTerms(static_cast<const EdgeLineMonoBase*>(info.edge), w, lm.H[l], lm.b[l], pW, pV, pg);
+        break;
+    case kEdgeLineStereo:
+        AccumulateLandmarkTerms(static_cast<const EdgeLineStereoBase*>(info.edge), w, lm.H[l], lm.b[l], pW, pV, pg);
+        break;
+    case kEdgeLinePrior:
+        AccumulateLinePriorTerms(static_cast<const EdgeLinePriorBase*>(info.edge), w, lm.H[l], lm.b[l]);
+        break;
+    default:
+        break;
+    }
+}
+
+void BASolver::AccumulatePoseEdge(const EdgeInfo& info, const double w, Matrix6d& H, Vector6d& b)
+{
+    switch(info.kind)
+    {
+    case kEdgePointMono:
+        AccumulatePoseTerms(static_cast<const EdgePointMonoBase*>(info.edge), w, H, b);
+        break;
+    case kEdgePointStereo:
+        AccumulatePoseTerms(static_cast<const EdgePointStereoBase*>(info.edge), w, H, b);
+        break;
+    case kEdgeLineMono:
+        AccumulatePoseTerms(static_cast<const EdgeLineMonoBase*>(info.edge), w, H, b);
+        break;
+    case kEdgeLineStereo:
+        AccumulatePoseTerms(static_cast<const EdgeLineStereoBase*>(info.edge), w, H, b);
+        break;
+    default:
+        break;
+    }
+}
+
+template<int L>
+void BASolver::BuildLandmarkBlocks(LandmarkBlocks<L>& lm)
+{
+    // each landmark owns its diagonal block, its gradient and its pose-landmark blocks
+    const int numLandmarks = lm.Size();
+#   pragma omp parallel for default(shared) schedule(static) num_threads(params_.numThreads) if(params_.numThreads > 1 && numLandmarks > kMinParallelSize)
+    for(int l=0; l<numLandmarks; l++)
+    {
+        lm.H[l].setZero();
+        lm.b[l].setZero();
+        for(int p=lm.pairStart[l]; p<lm.pairStart[l+1]; p++)
+        {
+            lm.W[p].setZero();
+            lm.V[p].setZero();
+            lm.g[p].setZero();
+        }
+        for(int k=lm.edgeStart[l]; k<lm.edgeStart[l+1]; k++)
+            AccumulateLandmarkEdge(edges_[lm.edges[k]], edgeWeights_[lm.edges[k]], lm, l);
+    }
+}
+
+void BASolver::BuildSystem()
+{
+    optimizer_->linearizeActiveEdges(); // the Jacobians of each edge are kept in its own workspace
+
+    const int numEdges = edges_.size();
+#   pragma omp parallel for default(shared) schedule(static) num_threads(params_.numThreads) if(params_.numThreads > 1 && numEdges > kMinParallelSize)
+    for(int k=0; k<numEdges; k++)
+        edgeWeights_[k] = RobustWeight(edges_[k].edge);
+
+    BuildLandmarkBlocks(points_);
+    BuildLandmarkBlocks(lines_);
+
+#   pragma omp parallel for default(shared) schedule(static) num_threads(params_.numThreads) if(params_.numThreads > 1 && numPoses_ > kMinParallelSize)
+    for(int i=0; i<numPoses_; i++)
+    {
+        Hpp_[i].setZero();
+        bp_[i].setZero();
+        AccumulatePosePairs(points_, i);
+        AccumulatePosePairs(lines_, i);
+        for(int k=poseEdgeStart_[i]; k<poseEdgeStart_[i+1]; k++)
+            AccumulatePoseEdge(edges_[poseEdges_[k]], edgeWeights_[poseEdges_[k]], Hpp_[i], bp_[i]);
+    }
+}
+
+template<int L>
+void BASolver::AccumulatePosePairs(const LandmarkBlocks<L>& lm, const int i)
+{
+    for(int k=lm.posePairStart[i]; k<lm.posePairStart[i+1]; k++)
+    {
+        const int p = lm.posePairs[k];
+        Hpp_[i] += lm.V[p];
+        bp_[i] += lm.g[p];
+    }
+}
+
+template<int L>
+void BASolver::EliminateLandmarks(LandmarkBlocks<L>& lm, const double lambda)
+{
+    typedef typename LandmarkBlocks<L>::MatrixL MatrixL;
+    const int numLandmarks = lm.Size();
+#   pragma omp parallel for default(shared) schedule(static) num_threads(params_.numThreads) if(params_.numThreads > 1 && numLandmarks > kMinParallelSize)
+    for(int l=0; l<numLandmarks; l++)
+    {
+        const MatrixL Hd = lm.H[l] + lambda * MatrixL::Identity();
+        lm.Hinv[l] = Hd.inverse();
+        lm.Hinvb[l].noalias() = lm.Hinv[l] * lm.b[l];
+        for(int p=lm.pairStart[l]; p<lm.pairStart[l+1]; p++)
+            lm.Y[p].noalias() = lm.W[p] * lm.Hinv[l];
+    }
+}
+
+template<int L>
+void BASolver::ReduceLandmarks(const LandmarkBlocks<L>& lm, const int i)
+{
+    // S_ij -= sum_l Y_il * W_jl^T (j>=i), rhs_i -= sum_l Y_il * b_l
+    Eigen::VectorBlock<Eigen::VectorXd,6> rhs = rhs_.segment<6>(6*i);
+    for(int k=lm.posePairStart[i]; k<lm.posePairStart[i+1]; k++)
+    {
+        const int p = lm.posePairs[k];
+        rhs.noalias() -= lm.Y[p] * lm.b[lm.pairLandmark[p]];
+    }
+    for(int k=lm.schurStart[i]; k<lm.schurStart[i+1]; k++)
+    {
+        const typename LandmarkBlocks<L>::SchurTerm& term = lm.schurTerms[k];
+        S_[term.block].noalias() -= lm.Y[term.p] * lm.W[term.q].transpose();
+    }
+}
+
+template<int L>
+void BASolver::BackSubstitute(LandmarkBlocks<L>& lm)
+{
+    // dx_l = Hinv_l * (b_l - sum_i W_il^T * dx_i)
+    const int numLandmarks = lm.Size();
+#   pragma omp parallel for default(shared) schedule(static) num_threads(params_.numThreads) if(params_.numThreads > 1 && numLandmarks > kMinParallelSize)
+    for(int l=0; l<numLandmarks; l++)
+    {
+        lm.dx[l] = lm.Hinvb[l];
+        for(int p=lm.pairStart[l]; p<lm.pairStart[l+1]; p++)
+            lm.dx[l].noalias() -= lm.Y[p].transpose() * dxPoses_.segment<6>(6*lm.pairPose[p]);
+    }
+}
+
+bool BASolver::Solve(const double lambda)
+{
+    EliminateLandmarks(points_, lambda);
+    EliminateLandmarks(lines_, lambda);
+
+    if(numPoses_ > 0)
+    {
+        // each pose owns its row of the reduced camera system
+#       pragma omp parallel for default(shared) schedule(dynamic,4) num_threads(params_.numThreads) if(params_.numThreads > 1 && numPoses_ > 1)
+        for(int i=0; i<numPoses_; i++)
+        {
+            const int rowStart = reducedRowStart_[i];
+            const int rowEnd = reducedRowStart_[i+1];
+            for(int k=rowStart; k<rowEnd; k++)
+                S_[k].setZero();
+            S_[rowStart] = Hpp_[i] + lambda * Matrix6d::Identity(); // the diagonal block is the first one of the row
+            rhs_.segment<6>(6*i) = bp_[i];
+
+            ReduceLandmarks(points_, i);
+            ReduceLandmarks(lines_, i);
+
+            // write the transposed row into the lower triangle of the columns of pose i
+            if(bDense_)
+            {
+                for(int k=rowStart; k<rowEnd; k++)
+                    denseS_.block<6,6>(6*reducedCols_[k], 6*i) = S_[k].transpose();
+            }
+            else
+            {
+                double* values = sparseS_.valuePtr();
+                const int* outer = sparseS_.outerIndexPtr();
+                for(int a=0; a<6; a++)
+                {
+                    double* column = values + outer[6*i+a];
+                    const Matrix6d& Sii = S_[rowStart];
+                    for(int b=a; b<6; b++)
+                        *column++ = Sii(a,b);
+                    for(int k=rowStart+1; k<rowEnd; k++)
+                    {
+                        const Matrix6d& Sij = S_[k];
+                        for(int b=0; b<6; b++)
+                            *column++ = Sij(a,b);
+                    }
+                }
+            }
+        }
+
+        if(bDense_)
+        {
+            denseSolver_.compute(denseS_);
+            if(denseSolver_.info() != Eigen::Success)
+                return false;
+            dxPoses_ = denseSolver_.solve(rhs_);
+        }
+        else
+        {
+            sparseSolver_.factorize(sparseS_);
+            if(sparseSolver_.info() != Eigen::Success)
+                return false;
+            dxPoses_ = sparseSolver_.solve(rhs_);
+        }
+    }
+
+    BackSubstitute(points_);
+    BackSubstitute(lines_);
+    return true;
+}
+
+void BASolver::Update()
+{
+    for(int i=0; i<numPoses_; i++)
+        poseVertices_[i]->oplus(dxPoses_.data() + 6*i);
+    for(int l=0; l<points_.Size(); l++)
+        points_.vertices[l]->oplus(points_.dx[l].data());
+    for(int l=0; l<lines_.Size(); l++)
+        lines_.vertices[l]->oplus(lines_.dx[l].data());
+}
+
+double BASolver::ComputeScale(const double lambda) const
+{
+    double scale = 0.;
+    for(int i=0; i<numPoses_; i++)
+    {
+        const Vector6d dx = dxPoses_.segment<6>(6*i);
+        scale += dx.dot(lambda*dx + bp_[i]);
+    }
+    for(int l=0; l<points_.Size(); l++)
+        scale += points_.dx[l].dot(lambda*points_.dx[l] + points_.b[l]);
+    for(int l=0; l<lines_.Size(); l++)
+        scale += lines_.dx[l].dot(lambda*lines_.dx[l] + lines_.b[l]);
+    return scale;
+}
+
+double BASolver::MaxDiagonal() const
+{
+    double maxDiagonal = 0.;
+    for(int i=0; i<numPoses_; i++)
+        maxDiagonal = std::max(maxDiagonal, Hpp_[i].diagonal().cwiseAbs().maxCoeff());
+    for(int l=0; l<points_.Size(); l++)
+        maxDiagonal = std::max(maxDiagonal, points_.H[l].diagonal().cwiseAbs().maxCoeff());
+    for(int l=0; l<lines_.Size(); l++)
+        maxDiagonal = std::max(maxDiagonal, lines_.H[l].diagonal().cwiseAbs().maxCoeff());
+    return maxDiagonal;
+}
+
+int BASolver::Optimize(const int numIterations)
+{
+    optimizer_->computeActiveErrors();
+    double currentChi = optimizer_->activeRobustChi2();
+    initialChi2_ = finalChi2_ = currentChi;
+    if(numPoses_ == 0 && points_.Size() == 0 && lines_.Size() == 0)
+        return 0;
+
+    // same iterations as g2o::OptimizationAlgorithmLevenberg::solve()
+    double lambda = 0.;
+    double ni = 2.;
+    int nBad = 0;
+    bool bErrorsUpToDate = true;
+    int it = 0;
+    for(; it<numIterations && !optimizer_->terminate(); it++)
+    {
+        if(!bErrorsUpToDate)
+        {
+            optimizer_->computeActiveErrors(); // the estimates were restored after a rejected step
+            bErrorsUpToDate = true;
+        }
+        const double iniChi = currentChi;
+
+        BuildSystem();
+
+        if(it == 0)
+        {
+            lambda = params_.lambdaInit > 0 ? params_.lambdaInit : params_.tau * MaxDiagonal();
+            ni = 2.;
+        }
+
+        double rho = 0;
+        int numTrials = 0;
+        do
+        {
+            optimizer_->push();
+
+            const bool bOk = Solve(lambda);
+            double tempChi = std::numeric_limits<double>::max();
+            if(bOk)
+            {
+                Update();
+                optimizer_->computeActiveErrors();
+                tempChi = optimizer_->activeRobustChi2();
+                rho = (currentChi - tempChi) / (ComputeScale(lambda) + 1e-3);
+            }
+            else
+            {
+                rho = -1.; // the estimates were not changed
+            }
+
+            if(rho > 0 && std::isfinite(tempChi)) // good step
+            {
+                const double alpha = std::min(1. - pow((2*rho-1), 3), 2./3.);
+                lambda *= std::max(1./3., alpha);
+                ni = 2.;
+                currentChi = tempChi;
+                optimizer_->discardTop();
+                bErrorsUpToDate = true;
+            }
+            else
+            {
+                lambda *= ni;
+                ni *= 2.;
+                optimizer_->pop();
+                bErrorsUpToDate = !bOk;
+            }
+            numTrials++;
+        } while(rho < 0 && numTrials < params_.maxTrialsAfterFailure && !optimizer_->terminate());
+
+        optimizer_->postIteration(it); // post-iteration actions of the graph (as g2o::SparseOptimizer::optimize())
+
+        if(numTrials == params_.maxTrialsAfterFailure || rho == 0)
+        {
+            it++;
+            break;
+        }
+
+        // stop criterion of the vendored g2o
+        if((iniChi - currentChi)*1e3 < iniChi)
+            nBad++;
+        else
+            nBad = 0;
+        if(nBad >= 3)
+        {
+            it++;
+            break;
+        }
+    }
+
+    if(!bErrorsUpToDate)
+        optimizer_->computeActiveErrors();
+    finalChi2_ = currentChi;
+    finalLambda_ = lambda;
+    return it;
+}
+
+} // namespace PLVS2
+
+#endif // USE_G2O_NEW
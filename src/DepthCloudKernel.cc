@@ -0,0 +1,644 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "DepthCloudKernel.h"
+#include "TaskPool.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <iostream>
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DEPTH_KERNEL_X86 1
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DEPTH_KERNEL_NEON 1
+#endif
+
+
+namespace PLVS2
+{
+
+// all the implementations must round exactly in the same way (mul and add, no fused multiply-add)
+#if defined(__clang__)
+#define DEPTH_KERNEL_NO_FP_CONTRACT _Pragma("clang fp contract(off)")
+#define DEPTH_KERNEL_NO_FP_CONTRACT_ATTRIBUTE
+#elif defined(__GNUC__)
+#define DEPTH_KERNEL_NO_FP_CONTRACT
+#define DEPTH_KERNEL_NO_FP_CONTRACT_ATTRIBUTE __attribute__((optimize("fp-contract=off")))
+#else
+#define DEPTH_KERNEL_NO_FP_CONTRACT
+#define DEPTH_KERNEL_NO_FP_CONTRACT_ATTRIBUTE
+#endif
+
+// depth noise model of Utils::SigmaZ(): sigma(z) = 0.0012 + 0.0019*(z-0.4)^2
+static const float kSigmaZa = 0.001504f;
+static const float kSigmaZb = 0.00152f;
+static const float kSigmaZc = 0.0019f;
+static const float kSigmaZmin = kSigmaZa - kSigmaZb*0.5f + kSigmaZc*0.5f*0.5f; // sigma(zMin) with zMin = 0.5 [m]
+
+static const float kMaxFi = std::numeric_limits<float>::max();
+
+
+/// < scalar implementation (also used for the tails of the rows)
+
+DEPTH_KERNEL_NO_FP_CONTRACT_ATTRIBUTE
+static int computePointsScalar(const float* gx, const float* gy, const float minDepth, const float maxDepth,
+                               float* x, float* y, float* z, const int nBegin, const int nEnd)
+{
+    DEPTH_KERNEL_NO_FP_CONTRACT
+    int numPoints = 0;
+    for(int n = nBegin; n < nEnd; n++)
+    {
+        const float d = z[n];
+        const bool bValid = (d > minDepth) && (d < maxDepth);
+        const float zn = bValid ? d : 0.f;
+        x[n] = gx[n]*zn;
+        y[n] = gy[n]*zn;
+        z[n] = zn;
+        numPoints += bValid;
+    }
+    return numPoints;
+}
+
+DEPTH_KERNEL_NO_FP_CONTRACT_ATTRIBUTE
+static void computeNormalsScalar(const float* x, const float* y, const float* z, float* nx, float* ny, float* nz,
+                                 const std::pair<int,int>* pairs, const int numPairs, const int cBegin, const int cEnd)
+{
+    DEPTH_KERNEL_NO_FP_CONTRACT
+    for(int c = cBegin; c < cEnd; c++)
+    {
+        const float xc = x[c], yc = y[c], zc = z[c];
+        float sx = 0.f, sy = 0.f, sz = 0.f;
+        for(int k = 0; k < numPairs; k++)
+        {
+            const int c1 = c + pairs[k].first;
+            const int c2 = c + pairs[k].second;
+            const bool bValid = (z[c1] > 0.f) && (z[c2] > 0.f);
+            const float v1x = x[c1] - xc, v1y = y[c1] - yc, v1z = z[c1] - zc;
+            const float v2x = x[c2] - xc, v2y = y[c2] - yc, v2z = z[c2] - zc;
+            // area weighting (the norm of the cross product is 2*SpannedArea)
+            sx += bValid ? (v1y*v2z - v1z*v2y) : 0.f;
+            sy += bValid ? (v1z*v2x - v1x*v2z) : 0.f;
+            sz += bValid ? (v1x*v2y - v1y*v2x) : 0.f;
+        }
+        const float squaredNorm = sx*sx + sy*sy + sz*sz;
+        const bool bValid = (zc > 0.f) && (squaredNorm > 0.f);
+        const float norm = std::sqrt(squaredNorm);
+        nx[c] = bValid ? sx/norm : 0.f;
+        ny[c] = bValid ? sy/norm : 0.f;
+        nz[c] = bValid ? sz/norm : 0.f;
+    }
+}
+
+DEPTH_KERNEL_NO_FP_CONTRACT_ATTRIBUTE
+static void computeSegmentationScalar(const float* x, const float* y, const float* z, const float* nx, const float* ny, const float* nz,
+                                      float* fi, float* delta, const int* offsets, const int numOffsets, const int cBegin, const int cEnd)
+{
+    DEPTH_KERNEL_NO_FP_CONTRACT
+    for(int c = cBegin; c < cEnd; c++)
+    {
+        const float xc = x[c], yc = y[c], zc = z[c];
+        const float nxc = nx[c], nyc = ny[c], nzc = nz[c];
+        const float weight = kSigmaZmin/(kSigmaZa - kSigmaZb*zc + kSigmaZc*zc*zc);
+        float minFi = kMaxFi;
+        float maxDelta = 0.f;
+        for(int k = 0; k < numOffsets; k++)
+        {
+            const int c1 = c + offsets[k];
+            const bool bValid = z[c1] > 0.f;
+            const float dx = x[c1] - xc, dy = y[c1] - yc, dz = z[c1] - zc;
+            // fi is the cosine between the normals where the neighbor is in front of the tangent plane (convexity)
+            const float dotNormal = dx*nxc + dy*nyc + dz*nzc;
+            const float cosNormals = nx[c1]*nxc + ny[c1]*nyc + nz[c1]*nzc;
+            const float fik = (dotNormal >= 0.f) ? cosNormals : 1.f;
+            minFi = (bValid && (fik < minFi)) ? fik : minFi;
+            float deltak = std::sqrt(dx*dx + dy*dy + dz*dz)*weight;
+            deltak = (deltak < 1.f) ? deltak : 1.f;
+            maxDelta = (bValid && (deltak > maxDelta)) ? deltak : maxDelta;
+        }
+        const bool bValid = zc > 0.f;
+        fi[c] = bValid ? minFi : 0.f;
+        delta[c] = bValid ? maxDelta : 0.f;
+    }
+}
+
+
+#if DEPTH_KERNEL_X86
+
+__attribute__((target("avx2"))) DEPTH_KERNEL_NO_FP_CONTRACT_ATTRIBUTE
+static int computePointsAVX2(const float* gx, const float* gy, const float minDepth, const float maxDepth,
+                             float* x, float* y, float* z, const int nBegin, const int nEnd)
+{
+    DEPTH_KERNEL_NO_FP_CONTRACT
+    const __m256 vMin = _mm256_set1_ps(minDepth);
+    const __m256 vMax = _mm256_set1_ps(maxDepth);
+    int numPoints = 0;
+    int n = nBegin;
+    for(; n + 8 <= nEnd; n += 8)
+    {
+        const __m256 d = _mm256_loadu_ps(z + n);
+        const __m256 valid = _mm256_and_ps(_mm256_cmp_ps(d, vMin, _CMP_GT_OQ), _mm256_cmp_ps(d, vMax, _CMP_LT_OQ));
+        const __m256 zn = _mm256_and_ps(valid, d);
+        _mm256_storeu_ps(x + n, _mm256_mul_ps(_mm256_loadu_ps(gx + n), zn));
+        _mm256_storeu_ps(y + n, _mm256_mul_ps(_mm256_loadu_ps(gy + n), zn));
+        _mm256_storeu_ps(z + n, zn);
+        numPoints += __builtin_popcount(_mm256_movemask_ps(valid));
+    }
+    return numPoints + computePointsScalar(gx, gy, minDepth, maxDepth, x, y, z, n, nEnd);
+}
+
+__attribute__((target("avx2"))) DEPTH_KERNEL_NO_FP_CONTRACT_ATTRIBUTE
+static void computeNormalsAVX2(const float* x, const float* y, const float* z, float* nx, float* ny, float* nz,
+                               const std::pair<int,int>* pairs, const int numPairs, const int cBegin, const int cEnd)
+{
+    DEPTH_KERNEL_NO_FP_CONTRACT
+    const __m256 zero = _mm256_setzero_ps();
+    int c = cBegin;
+    for(; c + 8 <= cEnd; c += 8)
+    {
+        const __m256 xc = _mm256_loadu_ps(x + c), yc = _mm256_loadu_ps(y + c), zc = _mm256_loadu_ps(z + c);
+        __m256 sx = zero, sy = zero, sz = zero;
+        for(int k = 0; k < numPairs; k++)
+        {
+            const int c1 = c + pairs[k].first;
+            const int c2 = c + pairs[k].second;
+            const __m256 z1 = _mm256_loadu_ps(z + c1), z2 = _mm256_loadu_ps(z + c2);
+            const __m256 valid = _mm256_and_ps(_mm256_cmp_ps(z1, zero, _CMP_GT_OQ), _mm256_cmp_ps(z2, zero, _CMP_GT_OQ));
+            const __m256 v1x = _mm256_sub_ps(_mm256_loadu_ps(x + c1), xc);
+            const __m256 v1y = _mm256_sub_ps(_mm256_loadu_ps(y + c1), yc);
+            const __m256 v1z = _mm256_sub_ps(z1, zc);
+            const __m256 v2x = _mm256_sub_ps(_mm256_loadu_ps(x + c2), xc);
+            const __m256 v2y = _mm256_sub_ps(_mm256_loadu_ps(y + c2), yc);
+            const __m256 v2z = _mm256_sub_ps(z2, zc);
+            sx = _mm256_add_ps(sx, _mm256_and_ps(valid, _mm256_sub_ps(_mm256_mul_ps(v1y, v2z), _mm256_mul_ps(v1z, v2y))));
+            sy = _mm256_add_ps(sy, _mm256_and_ps(valid, _mm256_sub_ps(_mm256_mul_ps(v1z, v2x), _mm256_mul_ps(v1x, v2z))));
+            sz = _mm256_add_ps(sz, _mm256_and_ps(valid, _mm256_sub_ps(_mm256_mul_ps(v1x, v2y), _mm256_mul_ps(v1y, v2x))));
+        }
+        const __m256 squaredNorm = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, sx), _mm256_mul_ps(sy, sy)), _mm256_mul_ps(sz, sz));
+        const __m256 valid = _mm256_and_ps(_mm256_cmp_ps(zc, zero, _CMP_GT_OQ), _mm256_cmp_ps(squaredNorm, zero, _CMP_GT_OQ));
+        const __m256 norm = _mm256_sqrt_ps(squaredNorm);
+        _mm256_storeu_ps(nx + c, _mm256_and_ps(valid, _mm256_div_ps(sx, norm)));
+        _mm256_storeu_ps(ny + c, _mm256_and_ps(valid, _mm256_div_ps(sy, norm)));
+        _mm256_storeu_ps(nz + c, _mm256_and_ps(valid, _mm256_div_ps(sz, norm)));
+    }
+    computeNormalsScalar(x, y, z, nx, ny, nz, pairs, numPairs, c, cEnd);
+}
+
+__attribute__((target("avx2"))) DEPTH_KERNEL_NO_FP_CONTRACT_ATTRIBUTE
+static void computeSegmentationAVX2(const float* x, const float* y, const float* z, const float* nx, const float* ny, const float* nz,
+                                    float* fi, float* delta, const int* offsets, const int numOffsets, const int cBegin, const int cEnd)
+{
+    DEPTH_KERNEL_NO_FP_CONTRACT
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 sigmaZa = _mm256_set1_ps(kSigmaZa);
+    const __m256 sigmaZb = _mm256_set1_ps(kSigmaZb);
+    const __m256 sigmaZc = _mm256_set1_ps(kSigmaZc);
+    const __m256 sigmaZmin = _mm256_set1_ps(kSigmaZmin);
+    const __m256 maxFi = _mm256_set1_ps(kMaxFi);
+    int c = cBegin;
+    for(; c + 8 <= cEnd; c += 8)
+    {
+        const __m256 xc = _mm256_loadu_ps(x + c), yc = _mm256_loadu_ps(y + c), zc = _mm256_loadu_ps(z + c);
+        const __m256 nxc = _mm256_loadu_ps(nx + c), nyc = _mm256_loadu_ps(ny + c), nzc = _mm256_loadu_ps(nz + c);
+        const __m256 sigmaZ = _mm256_add_ps(_mm256_sub_ps(sigmaZa, _mm256_mul_ps(sigmaZb, zc)), _mm256_mul_ps(_mm256_mul_ps(sigmaZc, zc), zc));
+        const __m256 weight = _mm256_div_ps(sigmaZmin, sigmaZ);
+        __m256 minFi = maxFi;
+        __m256 maxDelta = zero;
+        for(int k = 0; k < numOffsets; k++)
+        {
+            const int c1 = c + offsets[k];
+            const __m256 z1 = _mm256_loadu_ps(z + c1);
+            const __m256 valid = _mm256_cmp_ps(z1, zero, _CMP_GT_OQ);
+            const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + c1), xc);
+            const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + c1), yc);
+            const __m256 dz = _mm256_sub_ps(z1, zc);
+            const __m256 dotNormal = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, nxc), _mm256_mul_ps(dy, nyc)), _mm256_mul_ps(dz, nzc));
+            const __m256 cosNormals = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(nx + c1), nxc), _mm256_mul_ps(_mm256_loadu_ps(ny + c1), nyc)),
+                                                    _mm256_mul_ps(_mm256_loadu_ps(nz + c1), nzc));
+            const __m256 fik = _mm256_blendv_ps(one, cosNormals, _mm256_cmp_ps(dotNormal, zero, _CMP_GE_OQ));
+            minFi = _mm256_blendv_ps(minFi, fik, _mm256_and_ps(valid, _mm256_cmp_ps(fik, minFi, _CMP_LT_OQ)));
+            const __m256 squaredNorm = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+            __m256 deltak = _mm256_mul_ps(_mm256_sqrt_ps(squaredNorm), weight);
+            deltak = _mm256_blendv_ps(one, deltak, _mm256_cmp_ps(deltak, one, _CMP_LT_OQ));
+            maxDelta = _mm256_blendv_ps(maxDelta, deltak, _mm256_and_ps(valid, _mm256_cmp_ps(deltak, maxDelta, _CMP_GT_OQ)));
+        }
+        const __m256 valid = _mm256_cmp_ps(zc, zero, _CMP_GT_OQ);
+        _mm256_storeu_ps(fi + c, _mm256_and_ps(valid, minFi));
+        _mm256_storeu_ps(delta + c, _mm256_and_ps(valid, maxDelta));
+    }
+    computeSegmentationScalar(x, y, z, nx, ny, nz, fi, delta, offsets, numOffsets, c, cEnd);
+}
+
+#endif // DEPTH_KERNEL_X86
+
+
+#if DEPTH_KERNEL_NEON
+
+DEPTH_KERNEL_NO_FP_CONTRACT_ATTRIBUTE
+static int computePointsNEON(const float* gx, const float* gy, const float minDepth, const float maxDepth,
+                             float* x, float* y, float* z, const int nBegin, const int nEnd)
+{
+    DEPTH_KERNEL_NO_FP_CONTRACT
+    const float32x4_t vMin = vdupq_n_f32(minDepth);
+    const float32x4_t vMax = vdupq_n_f32(maxDepth);
+    uint32x4_t counts = vdupq_n_u32(0);
+    int n = nBegin;
+    for(; n + 4 <= nEnd; n += 4)
+    {
+        const float32x4_t d = vld1q_f32(z + n);
+        const uint32x4_t valid = vandq_u32(vcgtq_f32(d, vMin), vcltq_f32(d, vMax));
+        const float32x4_t zn = vreinterpretq_f32_u32(vandq_u32(valid, vreinterpretq_u32_f32(d)));
+        vst1q_f32(x + n, vmulq_f32(vld1q_f32(gx + n), zn));
+        vst1q_f32(y + n, vmulq_f32(vld1q_f32(gy + n), zn));
+        vst1q_f32(z + n, zn);
+        counts = vaddq_u32(counts, vshrq_n_u32(valid, 31));
+    }
+    return (int)vaddvq_u32(counts) + computePointsScalar(gx, gy, minDepth, maxDepth, x, y, z, n, nEnd);
+}
+
+static inline float32x4_t maskNEON(const uint32x4_t mask, const float32x4_t v)
+{
+    return vreinterpretq_f32_u32(vandq_u32(mask, vreinterpretq_u32_f32(v)));
+}
+
+DEPTH_KERNEL_NO_FP_CONTRACT_ATTRIBUTE
+static void computeNormalsNEON(const float* x, const float* y, const float* z, float* nx, float* ny, float* nz,
+                               const std::pair<int,int>* pairs, const int numPairs, const int cBegin, const int cEnd)
+{
+    DEPTH_KERNEL_NO_FP_CONTRACT
+    const float32x4_t zero = vdupq_n_f32(0.f);
+    int c = cBegin;
+    for(; c + 4 <= cEnd; c += 4)
+    {
+        const float32x4_t xc = vld1q_f32(x + c), yc = vld1q_f32(y + c), zc = vld1q_f32(z + c);
+        float32x4_t sx = zero, sy = zero, sz = zero;
+        for(int k = 0; k < numPairs; k++)
+        {
+            const int c1 = c + pairs[k].first;
+            const int c2 = c + pairs[k].second;
+            const float32x4_t z1 = vld1q_f32(z + c1), z2 = vld1q_f32(z + c2);
+            const uint32x4_t valid = vandq_u32(vcgtq_f32(z1, zero), vcgtq_f32(z2, zero));
+            const float32x4_t v1x = vsubq_f32(vld1q_f32(x + c1), xc);
+            const float32x4_t v1y = vsubq_f32(vld1q_f32(y + c1), yc);
+            const float32x4_t v1z = vsubq_f32(z1, zc);
+            const float32x4_t v2x = vsubq_f32(vld1q_f32(x + c2), xc);
+            const float32x4_t v2y = vsubq_f32(vld1q_f32(y + c2), yc);
+            const float32x4_t v2z = vsubq_f32(z2, zc);
+            sx = vaddq_f32(sx, maskNEON(valid, vsubq_f32(vmulq_f32(v1y, v2z), vmulq_f32(v1z, v2y))));
+            sy = vaddq_f32(sy, maskNEON(valid, vsubq_f32(vmulq_f32(v1z, v2x), vmulq_f32(v1x, v2z))));
+            sz = vaddq_f32(sz, maskNEON(valid, vsubq_f32(vmulq_f32(v1x, v2y), vmulq_f32(v1y, v2x))));
+        }
+        const float32x4_t squaredNorm = vaddq_f32(vaddq_f32(vmulq_f32(sx, sx), vmulq_f32(sy, sy)), vmulq_f32(sz, sz));
+        const uint32x4_t valid = vandq_u32(vcgtq_f32(zc, zero), vcgtq_f32(squaredNorm, zero));
+        const float32x4_t norm = vsqrtq_f32(squaredNorm);
+        vst1q_f32(nx + c, maskNEON(valid, vdivq_f32(sx, norm)));
+        vst1q_f32(ny + c, maskNEON(valid, vdivq_f32(sy, norm)));
+        vst1q_f32(nz + c, maskNEON(valid, vdivq_f32(sz, norm)));
+    }
+    computeNormalsScalar(x, y, z, nx, ny, nz, pairs, numPairs, c, cEnd);
+}
+
+DEPTH_KERNEL_NO_FP_CONTRACT_ATTRIBUTE
+static void computeSegmentationNEON(const float* x, const float* y, const float* z, const float* nx, const float* ny, const float* nz,
+                                    float* fi, float* delta, const int* offsets, const int numOffsets, const int cBegin, const int cEnd)
+{
+    DEPTH_KERNEL_NO_FP_CONTRACT
+    const float32x4_t zero = vdupq_n_f32(0.f);
+    const float32x4_t one = vdupq_n_f32(1.f);
+    const float32x4_t sigmaZa = vdupq_n_f32(kSigmaZa);
+    const float32x4_t sigmaZb = vdupq_n_f32(kSigmaZb);
+    const float32x4_t sigmaZc = vdupq_n_f32(kSigmaZc);
+    const float32x4_t sigmaZmin = vdupq_n_f32(kSigmaZmin);
+    const float32x4_t maxFi = vdupq_n_f32(kMaxFi);
+    int c = cBegin;
+    for(; c + 4 <= cEnd; c += 4)
+    {
+        const float32x4_t xc = vld1q_f32(x + c), yc = vld1q_f32(y + c), zc = vld1q_f32(z + c);
+        const float32x4_t nxc = vld1q_f32(nx + c), nyc = vld1q_f32(ny + c), nzc = vld1q_f32(nz + c);
+        const float32x4_t sigmaZ = vaddq_f32(vsubq_f32(sigmaZa, vmulq_f32(sigmaZb, zc)), vmulq_f32(vmulq_f32(sigmaZc, zc), zc));
+        const float32x4_t weight = vdivq_f32(sigmaZmin, sigmaZ);
+        float32x4_t minFi = maxFi;
+        float32x4_t maxDelta = zero;
+        for(int k = 0; k < numOffsets; k++)
+        {
+            const int c1 = c + offsets[k];
+            const float32x4_t z1 = vld1q_f32(z + c1);
+            const uint32x4_t valid = vcgtq_f32(z1, zero);
+            const float32x4_t dx = vsubq_f32(vld1q_f32(x + c1), xc);
+            const float32x4_t dy = vsubq_f32(vld1q_f32(y + c1), yc);
+            const float32x4_t dz = vsubq_f32(z1, zc);
+            const float32x4_t dotNormal = vaddq_f32(vaddq_f32(vmulq_f32(dx, nxc), vmulq_f32(dy, nyc)), vmulq_f32(dz, nzc));
+            const float32x4_t cosNormals = vaddq_f32(vaddq_f32(vmulq_f32(vld1q_f32(nx + c1), nxc), vmulq_f32(vld1q_f32(ny + c1), nyc)),
+                                                     vmulq_f32(vld1q_f32(nz + c1), nzc));
+            const float32x4_t fik = vbslq_f32(vcgeq_f32(dotNormal, zero), cosNormals, one);
+            minFi = vbslq_f32(vandq_u32(valid, vcltq_f32(fik, minFi)), fik, minFi);
+            const float32x4_t squaredNorm = vaddq_f32(vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dy, dy)), vmulq_f32(dz, dz));
+            float32x4_t deltak = vmulq_f32(vsqrtq_f32(squaredNorm), weight);
+            deltak = vbslq_f32(vcltq_f32(deltak, one), deltak, one);
+            maxDelta = vbslq_f32(vandq_u32(valid, vcgtq_f32(deltak, maxDelta)), deltak, maxDelta);
+        }
+        const uint32x4_t valid = vcgtq_f32(zc, zero);
+        vst1q_f32(fi + c, maskNEON(valid, minFi));
+        vst1q_f32(delta + c, maskNEON(valid, maxDelta));
+    }
+    computeSegmentationScalar(x, y, z, nx, ny, nz, fi, delta, offsets, numOffsets, c, cEnd);
+}
+
+#endif // DEPTH_KERNEL_NEON
+
+
+static bool isSameMat(const cv::Mat& a, const cv::Mat& b)
+{
+    if(a.size() != b.size() || a.type() != b.type()) return false;
+    return a.empty() || (cv::norm(a, b, cv::NORM_INF) == 0);
+}
+
+
+DepthCloudKernel::DepthCloudKernel(const int depthRows, const int depthCols, const int downsampleStep,
+                                   const cv::Mat& K, const cv::Mat& distCoef, const Neighborhood& neighborhood):
+    depthRows_(depthRows), depthCols_(depthCols), step_(std::max(1, downsampleStep)), K_(K.clone()), distCoef_(distCoef.clone())
+{
+    rows_ = (depthRows_ + step_ - 1)/step_;
+    cols_ = (depthCols_ + step_ - 1)/step_;
+    stride_ = ((cols_ + 2 + 7)/8)*8;
+
+    // generate the grid points on the image plane
+    cv::Mat gridPoints(rows_*cols_, 2, CV_32F);
+    int ii = 0;
+    for (int m = 0; m < depthRows_; m += step_)
+    {
+        for (int n = 0; n < depthCols_; n += step_, ii++)
+        {
+            gridPoints.at<float>(ii, 0) = n; // x
+            gridPoints.at<float>(ii, 1) = m; // y
+        }
+    }
+
+    // undistort grid points: these are used for backprojections while 'distorted'(original) coordinates are used to read color and registered depth
+    if (!distCoef_.empty() && distCoef_.at<float>(0) != 0.0)
+    {
+        std::cout << "DepthCloudKernel - undistorting grid points" << std::endl;
+        gridPoints = gridPoints.reshape(2);
+        cv::undistortPoints(gridPoints, gridPoints, K_, distCoef_, cv::Mat(), K_);
+        gridPoints = gridPoints.reshape(1);
+    }
+
+    // back project the points on the camera plane z=1
+    const float fx = K_.at<float>(0,0);
+    const float fy = K_.at<float>(1,1);
+    const float cx = K_.at<float>(0,2);
+    const float cy = K_.at<float>(1,2);
+    gridX_.resize(rows_*cols_);
+    gridY_.resize(rows_*cols_);
+    for (int i = 0; i < rows_*cols_; i++)
+    {
+        gridX_[i] = (gridPoints.at<float>(i, 0) - cx) / fx;
+        gridY_[i] = (gridPoints.at<float>(i, 1) - cy) / fy;
+    }
+
+    // neighbors as offsets in the padded buffers
+    neighborOffsets_.resize(neighborhood.size);
+    for (int k = 0; k < neighborhood.size; k++)
+    {
+        if (std::abs(neighborhood.dm[k]) > 1 || std::abs(neighborhood.dn[k]) > 1)
+        {
+            std::cerr << "DepthCloudKernel::DepthCloudKernel() - neighborhood deltas must be in [-1,1]" << std::endl;
+        }
+        const int dm = std::max(-1, std::min(1, neighborhood.dm[k]));
+        const int dn = std::max(-1, std::min(1, neighborhood.dn[k]));
+        neighborOffsets_[k] = dm*stride_ + dn;
+    }
+    for (int k = neighborhood.iStartNormal; k < neighborhood.size; k += neighborhood.diNormal)
+    {
+        normalPairs_.push_back(std::make_pair(neighborOffsets_[k], neighborOffsets_[(k + neighborhood.diNormal) % neighborhood.size]));
+    }
+
+    simdType_ = GetBestSimdType();
+}
+
+bool DepthCloudKernel::Matches(const int depthRows, const int depthCols, const int downsampleStep, const cv::Mat& K, const cv::Mat& distCoef) const
+{
+    return (depthRows == depthRows_) && (depthCols == depthCols_) && (std::max(1, downsampleStep) == step_) &&
+            isSameMat(K, K_) && isSameMat(distCoef, distCoef_);
+}
+
+DepthCloudKernel::SimdType DepthCloudKernel::GetBestSimdType()
+{
+#if DEPTH_KERNEL_X86
+    if(__builtin_cpu_supports("avx2"))
+        return kAVX2;
+#endif
+#if DEPTH_KERNEL_NEON
+    return kNEON;
+#endif
+    return kScalar;
+}
+
+std::string DepthCloudKernel::GetSimdTypeName(SimdType type)
+{
+    switch(type)
+    {
+        case kAVX2: return "AVX2";
+        case kNEON: return "NEON";
+        default:    return "scalar";
+    }
+}
+
+void DepthCloudKernel::SetSimdType(SimdType type)
+{
+    // fall back to the scalar implementation if the requested one is not supported
+    const SimdType best = GetBestSimdType();
+    simdType_ = (type == kScalar || type == best) ? type : kScalar;
+}
+
+void DepthCloudKernel::ForEachRowBand(TaskPool* pPool, const int numRows, const std::function<void(int,int)>& func)
+{
+    if(!pPool)
+    {
+        func(0, numRows);
+        return;
+    }
+
+    TaskPool::TaskGroup rowTasks(pPool);
+    for(int r = 0; r < numRows; r += kRowsPerTask)
+    {
+        const int rEnd = std::min(numRows, r + kRowsPerTask);
+        rowTasks.Run([&func, r, rEnd]{ func(r, rEnd); });
+    }
+    rowTasks.Wait();
+}
+
+void DepthCloudKernel::Compute(const cv::Mat& depth, const float minDepth, const float maxDepth, const bool bNormals, const bool bSegmentation,
+                               TaskPool* pPool, Output& out) const
+{
+    out.rows = rows_;
+    out.cols = cols_;
+    out.stride = stride_;
+
+    // the padding cells stay at zero (invalid points)
+    const size_t size = (rows_ + 2)*stride_;
+    out.x.assign(size, 0.f);
+    out.y.assign(size, 0.f);
+    out.z.assign(size, 0.f);
+    if(bNormals)
+    {
+        out.nx.assign(size, 0.f);
+        out.ny.assign(size, 0.f);
+        out.nz.assign(size, 0.f);
+    }
+    if(bNormals && bSegmentation)
+    {
+        out.fi.assign(size, 0.f);
+        out.delta.assign(size, 0.f);
+    }
+    out.rowStart.assign(rows_ + 1, 0);
+    out.pointIdx.resize(rows_*cols_);
+
+    /// < back-project the points
+    std::vector<int> rowNumPoints(rows_, 0);
+    ForEachRowBand(pPool, rows_, [&](const int rBegin, const int rEnd)
+    {
+        for(int md = rBegin; md < rEnd; md++)
+            ComputePointsRow(depth, md, minDepth, maxDepth, out, rowNumPoints[md]);
+    });
+
+    for(int md = 0; md < rows_; md++)
+        out.rowStart[md + 1] = out.rowStart[md] + rowNumPoints[md];
+
+    /// < index the points (in row-major order) and compute the normals (all the rows must be back-projected)
+    ForEachRowBand(pPool, rows_, [&](const int rBegin, const int rEnd)
+    {
+        for(int md = rBegin; md < rEnd; md++)
+        {
+            const float* zRow = &out.z[out.Cell(md, 0)];
+            int* pointIdxRow = &out.pointIdx[md*cols_];
+            int idx = out.rowStart[md];
+            for(int nd = 0; nd < cols_; nd++)
+                pointIdxRow[nd] = (zRow[nd] > 0.f) ? idx++ : -1;
+
+            if(bNormals)
+                ComputeNormalsRow(md, out);
+        }
+    });
+
+    /// < compute the segmentation measures (all the normals must be computed)
+    if(bNormals && bSegmentation)
+    {
+        ForEachRowBand(pPool, rows_, [&](const int rBegin, const int rEnd)
+        {
+            for(int md = rBegin; md < rEnd; md++)
+                ComputeSegmentationRow(md, out);
+        });
+    }
+}
+
+void DepthCloudKernel::ComputePointsRow(const cv::Mat& depth, const int md, const float minDepth, const float maxDepth, Output& out, int& numPoints) const
+{
+    const int c0 = out.Cell(md, 0);
+    float* x = &out.x[c0];
+    float* y = &out.y[c0];
+    float* z = &out.z[c0];
+    const float* gx = &gridX_[md*cols_];
+    const float* gy = &gridY_[md*cols_];
+
+    // gather the downsampled depths (they are then replaced in place by the z coordinates)
+    const float* depthRow = depth.ptr<float>(md*step_);
+    for(int nd = 0; nd < cols_; nd++)
+        z[nd] = depthRow[nd*step_];
+
+    switch(simdType_)
+    {
+#if DEPTH_KERNEL_X86
+    case kAVX2:
+        numPoints = computePointsAVX2(gx, gy, minDepth, maxDepth, x, y, z, 0, cols_);
+        break;
+#endif
+#if DEPTH_KERNEL_NEON
+    case kNEON:
+        numPoints = computePointsNEON(gx, gy, minDepth, maxDepth, x, y, z, 0, cols_);
+        break;
+#endif
+    default:
+        numPoints = computePointsScalar(gx, gy, minDepth, maxDepth, x, y, z, 0, cols_);
+        break;
+    }
+}
+
+void DepthCloudKernel::ComputeNormalsRow(const int md, Output& out) const
+{
+    const int c0 = out.Cell(md, 0);
+    const int numPairs = (int)normalPairs_.size();
+
+    switch(simdType_)
+    {
+#if DEPTH_KERNEL_X86
+    case kAVX2:
+        computeNormalsAVX2(out.x.data(), out.y.data(), out.z.data(), out.nx.data(), out.ny.data(), out.nz.data(),
+                           normalPairs_.data(), numPairs, c0, c0 + cols_);
+        break;
+#endif
+#if DEPTH_KERNEL_NEON
+    case kNEON:
+        computeNormalsNEON(out.x.data(), out.y.data(), out.z.data(), out.nx.data(), out.ny.data(), out.nz.data(),
+                           normalPairs_.data(), numPairs, c0, c0 + cols_);
+        break;
+#endif
+    default:
+        computeNormalsScalar(out.x.data(), out.y.data(), out.z.data(), out.nx.data(), out.ny.data(), out.nz.data(),
+                             normalPairs_.data(), numPairs, c0, c0 + cols_);
+        break;
+    }
+}
+
+void DepthCloudKernel::ComputeSegmentationRow(const int md, Output& out) const
+{
+    const int c0 = out.Cell(md, 0);
+    const int numOffsets = (int)neighborOffsets_.size();
+
+    switch(simdType_)
+    {
+#if DEPTH_KERNEL_X86
+    case kAVX2:
+        computeSegmentationAVX2(out.x.data(), out.y.data(), out.z.data(), out.nx.data(), out.ny.data(), out.nz.data(),
+                                out.fi.data(), out.delta.data(), neighborOffsets_.data(), numOffsets, c0, c0 + cols_);
+        break;
+#endif
+#if DEPTH_KERNEL_NEON
+    case kNEON:
+        computeSegmentationNEON(out.x.data(), out.y.data(), out.z.data(), out.nx.data(), out.ny.data(), out.nz.data(),
+                                out.fi.data(), out.delta.data(), neighborOffsets_.data(), numOffsets, c0, c0 + cols_);
+        break;
+#endif
+    default:
+        computeSegmentationScalar(out.x.data(), out.y.data(), out.z.data(), out.nx.data(), out.ny.data(), out.nz.data(),
+                                  out.fi.data(), out.delta.data(), neighborOffsets_.data(), numOffsets, c0, c0 + cols_);
+        break;
+    }
+}
+
+} // namespace PLVS2
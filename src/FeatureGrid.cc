@@ -0,0 +1,83 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "FeatureGrid.h"
+
+
+namespace PLVS2
+{
+
+void FeatureGrid::Reset(int cols, int rows)
+{
+    cols_ = cols;
+    rows_ = rows;
+    offsets_.assign(cols*rows + 1, 0);
+    indices_.clear();
+}
+
+void FeatureGrid::Build(int cols, int rows, const std::vector<int>& vCells)
+{
+    cols_ = cols;
+    rows_ = rows;
+    const int nCells = cols*rows;
+
+    // counting sort of the features by cell: count, prefix sum, fill (increasing feature index within each cell)
+    offsets_.assign(nCells + 1, 0);
+    for(const int c : vCells)
+    {
+        if(c >= 0) offsets_[c+1]++;
+    }
+    for(int c=0; c<nCells; c++)
+        offsets_[c+1] += offsets_[c];
+
+    indices_.resize(offsets_[nCells]);
+    std::vector<uint32_t> vFill(offsets_.begin(), offsets_.end()-1);
+    for(size_t i=0; i<vCells.size(); i++)
+    {
+        const int c = vCells[i];
+        if(c >= 0) indices_[vFill[c]++] = (uint32_t)i;
+    }
+}
+
+void FeatureGrid::FromNestedVectors(const std::vector<std::vector<std::vector<size_t> > >& grid)
+{
+    if(grid.empty())
+    {
+        cols_ = rows_ = 0;
+        offsets_.clear();
+        indices_.clear();
+        return;
+    }
+
+    cols_ = grid.size();
+    rows_ = grid[0].size();
+    offsets_.assign(cols_*rows_ + 1, 0);
+    indices_.clear();
+    for(int ix=0; ix<cols_; ix++)
+    {
+        for(int iy=0; iy<rows_; iy++)
+        {
+            if(iy < (int)grid[ix].size())
+                indices_.insert(indices_.end(), grid[ix][iy].begin(), grid[ix][iy].end());
+            offsets_[CellIndex(ix, iy)+1] = indices_.size();
+        }
+    }
+}
+
+} // namespace PLVS2
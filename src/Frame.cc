@@ -54,6 +54,7 @@
 #include "Stopwatch.h"
 #include "Utils.h"
 #include "Geom2DUtils.h"
+#include "TaskPool.h"
 
 #include <thread>
 #include <include/CameraModels/Pinhole.h>
@@ -82,6 +83,7 @@ namespace PLVS2
 long unsigned int Frame::nNextId=0;
 bool Frame::mbInitialComputations=true;
 bool Frame::mbUseFovCentersKfGenCriterion = false;   
+TaskPool* Frame::spExtractionPool = NULL;
 float Frame::cx, Frame::cy, Frame::fx, Frame::fy, Frame::invfx, Frame::invfy;
 float Frame::mnMinX, Frame::mnMinY, Frame::mnMaxX, Frame::mnMaxY;
 float Frame::mfGridElementWidthInv, Frame::mfGridElementHeightInv;
@@ -162,20 +164,13 @@ Frame::Frame(const Frame &frame)
      mMedianDepth(frame.mMedianDepth),
      mbHasPose(false), mbHasVelocity(false)
 {
-    for(int i=0;i<FRAME_GRID_COLS;i++)
-        for(int j=0; j<FRAME_GRID_ROWS; j++){
-            mGrid[i][j]=frame.mGrid[i][j];
-            if(frame.Nleft > 0){
-                mGridRight[i][j] = frame.mGridRight[i][j];
-            }
-        }
+    // the grids are flat arrays: a copy is a few allocations instead of one per cell
+    mGrid = frame.mGrid;
+    if(frame.Nleft > 0)
+        mGridRight = frame.mGridRight;
 
     if(frame.mpLineExtractorLeft)
-    {
-        for(int i=0;i<LINE_D_GRID_COLS;i++)
-            for(int j=0; j<LINE_THETA_GRID_ROWS; j++)
-                mLineGrid[i][j]=frame.mLineGrid[i][j];
-    }
+        mLineGrid = frame.mLineGrid;
 
     if(frame.mbHasPose)
         SetPose(frame.GetPose());
@@ -277,7 +272,44 @@ Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeSt
 #ifdef REGISTER_TIMES
     std::chrono::steady_clock::time_point time_StartExtORB = std::chrono::steady_clock::now();
 #endif
-    if(mpLineExtractorLeft)
+    
+    TICKTRACK("ExtractFeatures");
+    
+    if(spExtractionPool)
+    {
+        // use the persistent worker pool (no thread creation/destruction per frame)
+        if(mpLineExtractorLeft)
+        {
+#ifndef USE_CUDA          
+            if( Tracking::skUsePyramidPrecomputation )
+            {
+                // pre-compute Gaussian pyramid to be used for the extraction of both keypoints and keylines        
+                TaskPool::TaskGroup pyramidTasks(spExtractionPool);
+                pyramidTasks.Run([&]{ PrecomputeGaussianPyramid(0,imLeft); });
+                pyramidTasks.Run([&]{ PrecomputeGaussianPyramid(1,imRight); });
+                pyramidTasks.Wait();
+            }
+#else 
+            if( Tracking::skUsePyramidPrecomputation )
+            {
+                std::cout << IoColor::Yellow() << "Can't use pyramid precomputation when CUDA is active!" << std::endl;         
+            }
+#endif 
+        }
+        
+        TaskPool::TaskGroup extractionTasks(spExtractionPool);
+        // ORB extraction
+        extractionTasks.Run([&]{ ExtractORB(0,imLeft,0,0); });
+        extractionTasks.Run([&]{ ExtractORB(1,imRight,0,0); });
+        if(mpLineExtractorLeft)
+        {
+            // Line extraction
+            extractionTasks.Run([&]{ ExtractLSD(0,imLeft); });
+            extractionTasks.Run([&]{ ExtractLSD(1,imRight); });
+        }
+        extractionTasks.Wait();
+    }
+    else if(mpLineExtractorLeft)
     {            
 #ifndef USE_CUDA          
         if( Tracking::skUsePyramidPrecomputation )
@@ -315,6 +347,9 @@ Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeSt
         threadLeft.join();
         threadRight.join();        
     } 
+    
+    TOCKTRACK("ExtractFeatures");
+    
 #ifdef REGISTER_TIMES
     std::chrono::steady_clock::time_point time_EndExtORB = std::chrono::steady_clock::now();
 
@@ -481,7 +516,19 @@ Frame::Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const double &timeSt
     
 #if USE_PARALLEL_POINTS_LINES_EXTRACTION    
            
-    if(mpLineExtractorLeft)
+    if(mpLineExtractorLeft && spExtractionPool)
+    { 
+        // use the persistent worker pool: keylines are extracted by a worker while keypoints are extracted in this thread 
+        TaskPool::TaskGroup extractionTasks(spExtractionPool);
+        TICKTRACK("ExtractKeyLines-");          
+        extractionTasks.Run([&]{ ExtractLSD(0,imGray); });
+        TICKTRACK("ExtractKeyPoints*");                  
+        ExtractORB(0,imGray,0,0);
+        TOCKTRACK("ExtractKeyPoints*");           
+        extractionTasks.Wait();
+        TOCKTRACK("ExtractKeyLines-");           
+    }
+    else if(mpLineExtractorLeft)
     { 
         TICKTRACK("ExtractKeyPoints*");                  
         std::thread threadPoints(&Frame::ExtractORB,this,0,imGray,0,0);  
@@ -695,20 +742,10 @@ Frame::Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* extra
 
 void Frame::AssignFeaturesToGrid()
 {
-    // Fill matrix with points
-    const int nCells = FRAME_GRID_COLS*FRAME_GRID_ROWS;
-
-    int nReserve = 0.5f*N/(nCells);
-
-    for(unsigned int i=0; i<FRAME_GRID_COLS;i++)
-        for (unsigned int j=0; j<FRAME_GRID_ROWS;j++){
-            mGrid[i][j].reserve(nReserve);
-            if(Nleft != -1){
-                mGridRight[i][j].reserve(nReserve);
-            }
-        }
-
-
+    // Fill matrix with points: compute the cell of each keypoint and then build the grids in one pass
+    const int nLeft = (Nleft == -1) ? N : Nleft;
+    std::vector<int> vCells(nLeft, -1);
+    std::vector<int> vCellsRight((Nleft == -1) ? 0 : N - Nleft, -1);
 
     for(int i=0;i<N;i++)
     {
@@ -718,20 +755,21 @@ void Frame::AssignFeaturesToGrid()
 
         int nGridPosX, nGridPosY;
         if(PosInGrid(kp,nGridPosX,nGridPosY)){
+            const int cell = nGridPosX*FRAME_GRID_ROWS + nGridPosY;
             if(Nleft == -1 || i < Nleft)
-                mGrid[nGridPosX][nGridPosY].push_back(i);
+                vCells[i] = cell;
             else
-                mGridRight[nGridPosX][nGridPosY].push_back(i - Nleft);
+                vCellsRight[i - Nleft] = cell;
         }
     }
 
+    mGrid.Build(FRAME_GRID_COLS, FRAME_GRID_ROWS, vCells);
+    if(Nleft != -1)
+        mGridRight.Build(FRAME_GRID_COLS, FRAME_GRID_ROWS, vCellsRight);
+
     if(mpLineExtractorLeft)
     {
-        int nReserve = 0.5f*Nlines/(LINE_D_GRID_COLS*LINE_THETA_GRID_ROWS);
-        for(unsigned int i=0; i<LINE_D_GRID_COLS;i++)
-            for (unsigned int j=0; j<LINE_THETA_GRID_ROWS;j++)
-                mLineGrid[i][j].reserve(nReserve);
-
+        std::vector<int> vLineCells(Nlines, -1);
         for(int i=0;i<Nlines;i++)
         {
             const cv::line_descriptor_c::KeyLine& kl = mvKeyLinesUn[i];
@@ -739,9 +777,10 @@ void Frame::AssignFeaturesToGrid()
             int nGridPosX, nGridPosY;
             if(PosLineInGrid(kl,nGridPosX,nGridPosY))
             {
-                mLineGrid[nGridPosX][nGridPosY].push_back(i);
+                vLineCells[i] = nGridPosX*LINE_THETA_GRID_ROWS + nGridPosY;
             }
         }
+        mLineGrid.Build(LINE_D_GRID_COLS, LINE_THETA_GRID_ROWS, vLineCells);
     
 #if LOG_ASSIGN_FEATURES
         logger << "================================================================" << std::endl;
@@ -749,7 +788,7 @@ void Frame::AssignFeaturesToGrid()
         for(int nGridPosX=0; nGridPosX < LINE_D_GRID_COLS; nGridPosX++)
         for(int nGridPosY=0; nGridPosY < LINE_THETA_GRID_ROWS; nGridPosY++)
         {
-            std::vector<std::size_t>& vec = mLineGrid[nGridPosX][nGridPosY];
+            const FeatureGrid::Span vec = mLineGrid.Cell(nGridPosX,nGridPosY);
             for(int kk=0; kk<vec.size(); kk++)
             {
                 const cv::line_descriptor_c::KeyLine& kl = mvKeyLinesUn[vec[kk]];
@@ -1177,12 +1216,16 @@ Eigen::Vector3f Frame::inRefCoordinates(Eigen::Vector3f pCw)
 }
 
 
-// TODO: Luigi optimization 
-// bring (!bRight) ? mGrid[ix][iy] : mGridRight[ix][iy]; outside the loop!
 vector<size_t> Frame::GetFeaturesInArea(const float &x, const float  &y, const float  &r, const int minLevel, const int maxLevel, const bool bRight) const
 {
     vector<size_t> vIndices;
-    vIndices.reserve(N);
+    GetFeaturesInArea(x, y, r, minLevel, maxLevel, bRight, vIndices);
+    return vIndices;
+}
+
+void Frame::GetFeaturesInArea(const float &x, const float  &y, const float  &r, const int minLevel, const int maxLevel, const bool bRight, vector<size_t>& vIndices) const
+{
+    vIndices.clear();
 
     float factorX = r;
     float factorY = r;
@@ -1190,61 +1233,60 @@ vector<size_t> Frame::GetFeaturesInArea(const float &x, const float  &y, const f
     const int nMinCellX = max(0,(int)floor((x-mnMinX-factorX)*mfGridElementWidthInv));
     if(nMinCellX>=FRAME_GRID_COLS)
     {
-        return vIndices;
+        return;
     }
 
     const int nMaxCellX = min((int)FRAME_GRID_COLS-1,(int)ceil((x-mnMinX+factorX)*mfGridElementWidthInv));
     if(nMaxCellX<0)
     {
-        return vIndices;
+        return;
     }
 
     const int nMinCellY = max(0,(int)floor((y-mnMinY-factorY)*mfGridElementHeightInv));
     if(nMinCellY>=FRAME_GRID_ROWS)
     {
-        return vIndices;
+        return;
     }
 
     const int nMaxCellY = min((int)FRAME_GRID_ROWS-1,(int)ceil((y-mnMinY+factorY)*mfGridElementHeightInv));
     if(nMaxCellY<0)
     {
-        return vIndices;
+        return;
     }
 
     const bool bCheckLevels = (minLevel>0) || (maxLevel>=0);
 
+    const FeatureGrid& grid = (!bRight) ? mGrid : mGridRight;
+    if(grid.IsEmpty())
+        return;
+    const std::vector<cv::KeyPoint>& vKeys = (Nleft == -1) ? mvKeysUn
+                                                           : (!bRight) ? mvKeys
+                                                                       : mvKeysRight;
+
     for(int ix = nMinCellX; ix<=nMaxCellX; ix++)
     {
-        for(int iy = nMinCellY; iy<=nMaxCellY; iy++)
-        {
-            const vector<size_t>& vCell = (!bRight) ? mGrid[ix][iy] : mGridRight[ix][iy];
-            if(vCell.empty())
-                continue;
+        // the cells (ix,nMinCellY..nMaxCellY) are contiguous in the grid
+        const FeatureGrid::Span vCells = grid.Column(ix, nMinCellY, nMaxCellY);
 
-            for(size_t j=0, jend=vCell.size(); j<jend; j++)
+        for(const uint32_t idx : vCells)
+        {
+            const cv::KeyPoint &kpUn = vKeys[idx];
+            if(bCheckLevels)
             {
-                const cv::KeyPoint &kpUn = (Nleft == -1) ? mvKeysUn[vCell[j]]
-                                                         : (!bRight) ? mvKeys[vCell[j]]
-                                                                     : mvKeysRight[vCell[j]];
-                if(bCheckLevels)
-                {
-                    if(kpUn.octave<minLevel)
+                if(kpUn.octave<minLevel)
+                    continue;
+                //if(maxLevel>=0)
+                    if(kpUn.octave>maxLevel)
                         continue;
-                    //if(maxLevel>=0)
-                        if(kpUn.octave>maxLevel)
-                            continue;
-                }
+            }
 
-                const float distx = kpUn.pt.x-x;
-                const float disty = kpUn.pt.y-y;
+            const float distx = kpUn.pt.x-x;
+            const float disty = kpUn.pt.y-y;
 
-                if(fabs(distx)<factorX && fabs(disty)<factorY)
-                    vIndices.push_back(vCell[j]);
-            }
+            if(fabs(distx)<factorX && fabs(disty)<factorY)
+                vIndices.push_back(idx);
         }
     }
-
-    return vIndices;
 }
 
 bool Frame::PosInGrid(const cv::KeyPoint &kp, int &posX, int &posY)
@@ -1272,7 +1314,14 @@ vector<size_t> Frame::GetLineFeaturesInArea(const Line2DRepresentation& lineRepr
                                             const float& dtheta, const float& dd, const int minLevel, const int maxLevel) const
 {       
     vector<size_t> vIndices;
-    vIndices.reserve(Nlines);
+    GetLineFeaturesInArea(lineRepresentation, dtheta, dd, minLevel, maxLevel, vIndices);
+    return vIndices;
+}
+
+void Frame::GetLineFeaturesInArea(const Line2DRepresentation& lineRepresentation, const float& dtheta, const float& dd, 
+                                  const int minLevel, const int maxLevel, vector<size_t>& vIndices) const
+{       
+    vIndices.clear();
   
     const bool bCheckLevels = (minLevel>0) || (maxLevel<kMaxInt);   
             
@@ -1283,15 +1332,13 @@ vector<size_t> Frame::GetLineFeaturesInArea(const Line2DRepresentation& lineRepr
     {
         std::cout << "Frame::GetLineFeaturesInArea() - ERROR - you are searching over the full theta interval!" << std::endl; 
         quick_exit(-1);
-        return vIndices; 
+        return; 
     }      
     
     const float dMin = lineRepresentation.d - dd;
     const float dMax = lineRepresentation.d + dd;    
     
     GetLineFeaturesInArea(thetaMin, thetaMax, dMin, dMax, bCheckLevels, minLevel, maxLevel, vIndices);
-
-    return vIndices;
 }
 
 void Frame::GetLineFeaturesInArea(const float thetaMin, const float thetaMax, const float dMin, const float dMax, const bool bCheckLevels, const int minLevel, const int maxLevel, vector<size_t>& vIndices) const
@@ -1376,40 +1423,39 @@ void Frame::GetLineFeaturesInArea(const float thetaMin, const float thetaMax, co
         return; 
     }
         
+    if(mLineGrid.IsEmpty())
+        return;
+
     for(int ix = nMinCellDCol; ix<=nMaxCellDCol; ix++)
     {
-        for(int iy = nMinCellThetaRow; iy<=nMaxCellThetaRow; iy++)
-        {
-            //const int iyW = Utils::Modulus(iy,LINE_THETA_GRID_ROWS);
-            const int iyW = iy;
-            const vector<size_t>& vCell = mLineGrid[ix][iyW];
-            if(vCell.empty())
-                continue;
+        // the cells (ix,nMinCellThetaRow..nMaxCellThetaRow) are contiguous in the grid
+        const FeatureGrid::Span vCells = mLineGrid.Column(ix, nMinCellThetaRow, nMaxCellThetaRow);
+        if(vCells.empty())
+            continue;
 
 #if 0            
-            vIndices.insert(vIndices.end(),vCell.begin(),vCell.end());
+        vIndices.insert(vIndices.end(),vCells.begin(),vCells.end());
 #else
-            for(size_t j=0, jend=vCell.size(); j<jend; j++)
+        for(const uint32_t idx : vCells)
+        {
+            const cv::line_descriptor_c::KeyLine &klUn = mvKeyLinesUn[idx];
+            if(bCheckLevels)
             {
-                const cv::line_descriptor_c::KeyLine &klUn = mvKeyLinesUn[vCell[j]];
-                if(bCheckLevels)
-                {
-                    if(klUn.octave<minLevel)
-                        continue;
-                    if(klUn.octave>maxLevel)
-                        continue;
-                }
+                if(klUn.octave<minLevel)
+                    continue;
+                if(klUn.octave>maxLevel)
+                    continue;
+            }
 
-                //const float distx = kpUn.pt.x-x;
-                //const float disty = kpUn.pt.y-y;
+            //const float distx = kpUn.pt.x-x;
+            //const float disty = kpUn.pt.y-y;
 
-                //if(fabs(distx)<r && fabs(disty)<r)
-                //    vIndices.push_back(vCell[j]);
-                
-                vIndices.push_back(vCell[j]);                
-            }     
+            //if(fabs(distx)<r && fabs(disty)<r)
+            //    vIndices.push_back(idx);
+            
+            vIndices.push_back(idx);                
+        }     
 #endif            
-        }
     }
 }
 
@@ -1438,8 +1484,8 @@ void Frame::ComputeBoW()
 {
     if(mBowVec.empty())
     {
-        vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mDescriptors);
-        mpORBvocabulary->transform(vCurrentDesc,mBowVec,mFeatVec,4);
+        // the descriptor rows are transformed in place (and in parallel)
+        mpORBvocabulary->transform(mDescriptors,mBowVec,mFeatVec,4);
     }
 }
 
@@ -2585,10 +2631,22 @@ Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeSt
 #ifdef REGISTER_TIMES
     std::chrono::steady_clock::time_point time_StartExtORB = std::chrono::steady_clock::now();
 #endif
-    thread threadLeft(&Frame::ExtractORB,this,0,imLeft,static_cast<KannalaBrandt8*>(mpCamera)->mvLappingArea[0],static_cast<KannalaBrandt8*>(mpCamera)->mvLappingArea[1]);
-    thread threadRight(&Frame::ExtractORB,this,1,imRight,static_cast<KannalaBrandt8*>(mpCamera2)->mvLappingArea[0],static_cast<KannalaBrandt8*>(mpCamera2)->mvLappingArea[1]);
-    threadLeft.join();
-    threadRight.join();
+    TICKTRACK("ExtractFeatures");
+    if(spExtractionPool)
+    {
+        TaskPool::TaskGroup extractionTasks(spExtractionPool);
+        extractionTasks.Run([&]{ ExtractORB(0,imLeft,static_cast<KannalaBrandt8*>(mpCamera)->mvLappingArea[0],static_cast<KannalaBrandt8*>(mpCamera)->mvLappingArea[1]); });
+        extractionTasks.Run([&]{ ExtractORB(1,imRight,static_cast<KannalaBrandt8*>(mpCamera2)->mvLappingArea[0],static_cast<KannalaBrandt8*>(mpCamera2)->mvLappingArea[1]); });
+        extractionTasks.Wait();
+    }
+    else
+    {
+        thread threadLeft(&Frame::ExtractORB,this,0,imLeft,static_cast<KannalaBrandt8*>(mpCamera)->mvLappingArea[0],static_cast<KannalaBrandt8*>(mpCamera)->mvLappingArea[1]);
+        thread threadRight(&Frame::ExtractORB,this,1,imRight,static_cast<KannalaBrandt8*>(mpCamera2)->mvLappingArea[0],static_cast<KannalaBrandt8*>(mpCamera2)->mvLappingArea[1]);
+        threadLeft.join();
+        threadRight.join();
+    }
+    TOCKTRACK("ExtractFeatures");
 #ifdef REGISTER_TIMES
     std::chrono::steady_clock::time_point time_EndExtORB = std::chrono::steady_clock::now();
 
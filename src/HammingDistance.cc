@@ -0,0 +1,260 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "HammingDistance.h"
+
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAMMING_X86 1
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HAMMING_NEON 1
+#endif
+
+
+namespace PLVS2
+{
+
+HammingDistance::SimdType HammingDistance::sSimdType = HammingDistance::GetBestSimdType();
+
+
+static void computeDistancesScalar(const uchar* query, const uchar* const* train, const int numTrain, int* dists)
+{
+    for(int i=0; i<numTrain; i++)
+        dists[i] = HammingDistance::Distance(query, train[i]);
+}
+
+
+#if HAMMING_X86
+
+// popcount of each 64-bit lane by means of a nibble lookup table (Mula's algorithm)
+__attribute__((target("avx2")))
+static inline __m256i popcount256AVX2(const __m256i v)
+{
+    const __m256i lut = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+                                         0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+    const __m256i lowMask = _mm256_set1_epi8(0x0f);
+    const __m256i lo = _mm256_and_si256(v, lowMask);
+    const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), lowMask);
+    const __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo), _mm256_shuffle_epi8(lut, hi));
+    return _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+}
+
+// reduce the 64-bit lane counts of 4 descriptors into 4 distances
+__attribute__((target("avx2")))
+static inline void reduce4AVX2(const __m256i a, const __m256i b, const __m256i c, const __m256i d, int* dists)
+{
+    const __m256i ab = _mm256_add_epi64(_mm256_unpacklo_epi64(a, b), _mm256_unpackhi_epi64(a, b)); // a01 b01 a23 b23
+    const __m256i cd = _mm256_add_epi64(_mm256_unpacklo_epi64(c, d), _mm256_unpackhi_epi64(c, d)); // c01 d01 c23 d23
+    const __m256i sum = _mm256_add_epi64(_mm256_permute2x128_si256(ab, cd, 0x20), _mm256_permute2x128_si256(ab, cd, 0x31));
+    const __m256i packed = _mm256_permutevar8x32_epi32(sum, _mm256_setr_epi32(0,2,4,6,0,2,4,6));
+    _mm_storeu_si128((__m128i*)dists, _mm256_castsi256_si128(packed));
+}
+
+__attribute__((target("avx2")))
+static void computeDistancesAVX2(const uchar* query, const uchar* const* train, const int numTrain, int* dists)
+{
+    const __m256i q = _mm256_loadu_si256((const __m256i*)query);
+
+    int i = 0;
+    for(; i+4 <= numTrain; i+=4)
+    {
+        const __m256i a = popcount256AVX2(_mm256_xor_si256(q, _mm256_loadu_si256((const __m256i*)train[i])));
+        const __m256i b = popcount256AVX2(_mm256_xor_si256(q, _mm256_loadu_si256((const __m256i*)train[i+1])));
+        const __m256i c = popcount256AVX2(_mm256_xor_si256(q, _mm256_loadu_si256((const __m256i*)train[i+2])));
+        const __m256i d = popcount256AVX2(_mm256_xor_si256(q, _mm256_loadu_si256((const __m256i*)train[i+3])));
+        reduce4AVX2(a, b, c, d, dists + i);
+    }
+    for(; i < numTrain; i++)
+        dists[i] = HammingDistance::Distance(query, train[i]);
+}
+
+// native 64-bit popcount on 256-bit vectors (AVX-512 VPOPCNTDQ + VL)
+__attribute__((target("avx2,avx512f,avx512vl,avx512vpopcntdq")))
+static void computeDistancesAVX512(const uchar* query, const uchar* const* train, const int numTrain, int* dists)
+{
+    const __m256i q = _mm256_loadu_si256((const __m256i*)query);
+
+    int i = 0;
+    for(; i+4 <= numTrain; i+=4)
+    {
+        const __m256i a = _mm256_popcnt_epi64(_mm256_xor_si256(q, _mm256_loadu_si256((const __m256i*)train[i])));
+        const __m256i b = _mm256_popcnt_epi64(_mm256_xor_si256(q, _mm256_loadu_si256((const __m256i*)train[i+1])));
+        const __m256i c = _mm256_popcnt_epi64(_mm256_xor_si256(q, _mm256_loadu_si256((const __m256i*)train[i+2])));
+        const __m256i d = _mm256_popcnt_epi64(_mm256_xor_si256(q, _mm256_loadu_si256((const __m256i*)train[i+3])));
+        reduce4AVX2(a, b, c, d, dists + i);
+    }
+    for(; i < numTrain; i++)
+        dists[i] = HammingDistance::Distance(query, train[i]);
+}
+
+#endif // HAMMING_X86
+
+
+#if HAMMING_NEON
+
+static void computeDistancesNEON(const uchar* query, const uchar* const* train, const int numTrain, int* dists)
+{
+    const uint8x16_t q0 = vld1q_u8(query);
+    const uint8x16_t q1 = vld1q_u8(query + 16);
+
+    for(int i = 0; i < numTrain; i++)
+    {
+        const uint8x16_t x0 = veorq_u8(q0, vld1q_u8(train[i]));
+        const uint8x16_t x1 = veorq_u8(q1, vld1q_u8(train[i] + 16));
+        dists[i] = vaddlvq_u8(vaddq_u8(vcntq_u8(x0), vcntq_u8(x1)));
+    }
+}
+
+#endif // HAMMING_NEON
+
+
+HammingDistance::SimdType HammingDistance::GetBestSimdType()
+{
+#if HAMMING_X86
+    __builtin_cpu_init(); // N.B.: this is also called during static initialization
+    if(__builtin_cpu_supports("avx512vpopcntdq") && __builtin_cpu_supports("avx512vl"))
+        return kAVX512;
+    if(__builtin_cpu_supports("avx2"))
+        return kAVX2;
+#endif
+#if HAMMING_NEON
+    return kNEON;
+#endif
+    return kScalar;
+}
+
+std::string HammingDistance::GetSimdTypeName(SimdType type)
+{
+    switch(type)
+    {
+        case kAVX2:   return "AVX2";
+        case kAVX512: return "AVX512-VPOPCNTDQ";
+        case kNEON:   return "NEON";
+        default:      return "scalar";
+    }
+}
+
+void HammingDistance::SetSimdType(SimdType type)
+{
+    // fall back to the scalar implementation if the requested one is not supported
+    const SimdType best = GetBestSimdType();
+    const bool bSupported = (type == kScalar) || (type == best) || (type == kAVX2 && best == kAVX512);
+    sSimdType = bSupported ? type : kScalar;
+}
+
+std::vector<const uchar*>& HammingDistance::GetRowBuffer()
+{
+    static thread_local std::vector<const uchar*> vRows;
+    return vRows;
+}
+
+void HammingDistance::ComputeDistances(const uchar* query, const uchar* const* train, const int numTrain, int* dists)
+{
+    switch(sSimdType)
+    {
+#if HAMMING_X86
+    case kAVX512:
+        computeDistancesAVX512(query, train, numTrain, dists);
+        break;
+    case kAVX2:
+        computeDistancesAVX2(query, train, numTrain, dists);
+        break;
+#endif
+#if HAMMING_NEON
+    case kNEON:
+        computeDistancesNEON(query, train, numTrain, dists);
+        break;
+#endif
+    default:
+        computeDistancesScalar(query, train, numTrain, dists);
+        break;
+    }
+}
+
+void HammingDistance::ComputeDistances(const cv::Mat& query, const cv::Mat& train, std::vector<int>& dists)
+{
+    std::vector<const uchar*>& vRows = GetRowBuffer();
+    vRows.resize(train.rows);
+    for(int i=0; i<train.rows; i++)
+        vRows[i] = train.ptr(i);
+
+    dists.resize(train.rows);
+    if(train.rows > 0)
+        ComputeDistances(query.ptr(), vRows.data(), train.rows, dists.data());
+}
+
+void HammingDistance::MatchBestTwo(const cv::Mat& queries, const cv::Mat& train, const cv::Mat& queryMask,
+                                   std::vector<int>& bestIdx, std::vector<int>& bestDist,
+                                   std::vector<int>& secondIdx, std::vector<int>& secondDist)
+{
+    const int numQueries = queries.rows;
+    bestIdx.assign(numQueries, -1);
+    bestDist.assign(numQueries, kMaxDistance+1);
+    secondIdx.assign(numQueries, -1);
+    secondDist.assign(numQueries, kMaxDistance+1);
+
+    if(train.rows == 0)
+        return;
+
+    if(!queryMask.empty() && (int)queryMask.total() != numQueries)
+    {
+        std::cerr << "HammingDistance::MatchBestTwo() - query mask should have " << numQueries << " elements" << std::endl;
+        return;
+    }
+
+    std::vector<const uchar*> vRows(train.rows);
+    for(int j=0; j<train.rows; j++)
+        vRows[j] = train.ptr(j);
+
+    std::vector<int> vDists(train.rows);
+
+    for(int i=0; i<numQueries; i++)
+    {
+        if(!queryMask.empty() && queryMask.at<uchar>(i) == 0)
+            continue;
+
+        ComputeDistances(queries.ptr(i), vRows.data(), train.rows, vDists.data());
+
+        int best = kMaxDistance+1, second = kMaxDistance+1;
+        int bestJ = -1, secondJ = -1;
+        for(int j=0; j<train.rows; j++)
+        {
+            const int dist = vDists[j];
+            if(dist < best)
+            {
+                second = best; secondJ = bestJ;
+                best = dist; bestJ = j;
+            }
+            else if(dist < second)
+            {
+                second = dist; secondJ = j;
+            }
+        }
+
+        bestIdx[i] = bestJ; bestDist[i] = best;
+        secondIdx[i] = secondJ; secondDist[i] = second;
+    }
+}
+
+} // namespace PLVS2
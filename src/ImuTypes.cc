@@ -51,6 +51,8 @@ namespace IMU
 
 const float eps = 1e-4;
 
+const float Preintegrated::kMaxFirstOrderGyroBiasUpdate = 0.01;
+
 Eigen::Matrix3f NormalizeRotation(const Eigen::Matrix3f &R){
     Eigen::JacobiSVD<Eigen::Matrix3f> svd(R, Eigen::ComputeFullU | Eigen::ComputeFullV);
     return svd.matrixU() * svd.matrixV().transpose();
@@ -213,68 +215,117 @@ void Preintegrated::Reintegrate()
     std::unique_lock<std::mutex> lock(mMutex);
     const std::vector<integrable> aux = mvMeasurements;
     Initialize(bu);
-    for(size_t i=0;i<aux.size();i++)
-        IntegrateNewMeasurement(aux[i].a,aux[i].w,aux[i].t);
+    IntegrateMeasurements(aux.data(),aux.size());
+}
+
+bool Preintegrated::ReintegrateIfNeeded(const float maxGyroBiasUpdate)
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if(db.head(3).norm() <= maxGyroBiasUpdate)
+            return false;
+    }
+    Reintegrate();
+    return true;
 }
 
 void Preintegrated::IntegrateNewMeasurement(const Eigen::Vector3f &acceleration, const Eigen::Vector3f &angVel, const double &dt)
 {
-    mvMeasurements.push_back(integrable(acceleration,angVel,dt));
+    const integrable measurement(acceleration,angVel,dt);
+    IntegrateMeasurements(&measurement,1);
+}
+
+void Preintegrated::IntegrateNewMeasurements(const std::vector<integrable> &vMeasurements)
+{
+    IntegrateMeasurements(vMeasurements.data(),vMeasurements.size());
+}
+
+void Preintegrated::IntegrateMeasurements(const integrable* pMeasurements, const size_t n)
+{
+    if(n==0)
+        return;
 
     // Position is updated firstly, as it depends on previously computed velocity and rotation.
     // Velocity is updated secondly, as it depends on previously computed rotation.
     // Rotation is the last to be updated.
 
-    //Matrices to compute covariance
-    Eigen::Matrix<float,9,9> A;
-    A.setIdentity();
-    Eigen::Matrix<float,9,6> B;
-    B.setZero();
-
-    Eigen::Vector3f acc, accW;
-    acc << acceleration(0)-b.bax, acceleration(1)-b.bay, acceleration(2)-b.baz;
-    accW << angVel(0)-b.bwx, angVel(1)-b.bwy, angVel(2)-b.bwz;
-
-    avgA = (dT*avgA + dR*acc*dt)/(dT+dt);
-    avgW = (dT*avgW + accW*dt)/(dT+dt);
+    mvMeasurements.insert(mvMeasurements.end(), pMeasurements, pMeasurements+n);
 
-    // Update delta position dP and velocity dV (rely on no-updated delta rotation)
-    dP = dP + dV*dt + 0.5f*dR*acc*dt*dt;
-    dV = dV + dR*acc*dt;
+    const Eigen::Vector3f ba(b.bax, b.bay, b.baz);
+    const Eigen::Vector3f bg(b.bwx, b.bwy, b.bwz);
+    const Eigen::DiagonalMatrix<float,3> Ng(Nga.diagonal().head<3>());
+    const Eigen::DiagonalMatrix<float,3> Na(Nga.diagonal().tail<3>());
 
-    // Compute velocity and position parts of matrices A and B (rely on non-updated delta rotation)
-    Eigen::Matrix<float,3,3> Wacc = Sophus::SO3f::hat(acc);
+    // The covariance of (rotation, velocity, position) is propagated by 3x3 blocks: the transition matrix A has only
+    // 3 non trivial blocks and the noise only hits the rotation and the (velocity, position) blocks.
+    // The bias random walk block is never correlated with them.
+    Eigen::Matrix3f CRR = C.block<3,3>(0,0), CRV = C.block<3,3>(0,3), CRP = C.block<3,3>(0,6);
+    Eigen::Matrix3f CVV = C.block<3,3>(3,3), CVP = C.block<3,3>(3,6), CPP = C.block<3,3>(6,6);
 
-    A.block<3,3>(3,0) = -dR*dt*Wacc;
-    A.block<3,3>(6,0) = -0.5f*dR*dt*dt*Wacc;
-    A.block<3,3>(6,3) = Eigen::DiagonalMatrix<float,3>(dt, dt, dt);
-    B.block<3,3>(3,3) = dR*dt;
-    B.block<3,3>(6,3) = 0.5f*dR*dt*dt;
+    Eigen::Vector3f sumA = Eigen::Vector3f::Zero(), sumW = Eigen::Vector3f::Zero();
+    double sumDt = 0;
 
+    for(size_t i=0; i<n; i++)
+    {
+        const float dt = pMeasurements[i].t;
+        const Eigen::Vector3f acc = pMeasurements[i].a - ba;
+
+        // Update delta position dP and velocity dV (rely on no-updated delta rotation)
+        const Eigen::Matrix3f dRdt = dR*dt;
+        const Eigen::Vector3f dVi = dRdt*acc;
+        sumA += dVi;
+        sumW += (pMeasurements[i].w - bg)*dt;
+        dP += dV*dt + 0.5f*dt*dVi;
+        dV += dVi;
+
+        // velocity and position blocks of A (rely on non-updated delta rotation)
+        const Eigen::Matrix3f AVR = -dRdt*Sophus::SO3f::hat(acc);
+        const Eigen::Matrix3f APR = 0.5f*dt*AVR;
+
+        // Update position and velocity jacobians wrt bias correction
+        JPa += JVa*dt - 0.5f*dt*dRdt;
+        JPg += JVg*dt + APR*JRg;
+        JVa -= dRdt;
+        JVg += AVR*JRg;
+
+        // Update delta rotation (re-orthonormalized through a unit quaternion, cheaper than the SVD of NormalizeRotation())
+        IntegratedRotation dRi(pMeasurements[i].w,b,dt);
+        dR = Eigen::Quaternionf(dR*dRi.deltaR).normalized().toRotationMatrix();
+        const Eigen::Matrix3f ARR = dRi.deltaR.transpose();
+        const Eigen::Matrix3f BR = dRi.rightJ*dt;
+
+        // Update covariance C = A*C*A^T + B*Nga*B^T: rows of A*C first, then the upper blocks of the product by A^T
+        const Eigen::Matrix3f XRR = ARR*CRR, XRV = ARR*CRV, XRP = ARR*CRP;
+        const Eigen::Matrix3f XVR = AVR*CRR + CRV.transpose(), XVV = AVR*CRV + CVV, XVP = AVR*CRP + CVP;
+        const Eigen::Matrix3f XPR = APR*CRR + dt*CRV.transpose() + CRP.transpose();
+        const Eigen::Matrix3f XPV = APR*CRV + dt*CVV + CVP.transpose();
+        const Eigen::Matrix3f XPP = APR*CRP + dt*CVP + CPP;
+
+        const Eigen::Matrix3f QVV = dRdt*Na*dRdt.transpose();
+
+        CRR = XRR*ARR.transpose() + BR*Ng*BR.transpose();
+        CRV = XRR*AVR.transpose() + XRV;
+        CRP = XRR*APR.transpose() + dt*XRV + XRP;
+        CVV = XVR*AVR.transpose() + XVV + QVV;
+        CVP = XVR*APR.transpose() + dt*XVV + XVP + (0.5f*dt)*QVV;
+        CPP = XPR*APR.transpose() + dt*XPV + XPP + (0.25f*dt*dt)*QVV;
+
+        // Update rotation jacobian wrt bias correction
+        JRg = ARR*JRg - BR;
+
+        sumDt += pMeasurements[i].t;
+    }
 
-    // Update position and velocity jacobians wrt bias correction
-    JPa = JPa + JVa*dt -0.5f*dR*dt*dt;
-    JPg = JPg + JVg*dt -0.5f*dR*dt*dt*Wacc*JRg;
-    JVa = JVa - dR*dt;
-    JVg = JVg - dR*dt*Wacc*JRg;
-
-    // Update delta rotation
-    IntegratedRotation dRi(angVel,b,dt);
-    dR = NormalizeRotation(dR*dRi.deltaR);
-
-    // Compute rotation parts of matrices A and B
-    A.block<3,3>(0,0) = dRi.deltaR.transpose();
-    B.block<3,3>(0,0) = dRi.rightJ*dt;
-
-    // Update covariance
-    C.block<9,9>(0,0) = A * C.block<9,9>(0,0) * A.transpose() + B*Nga*B.transpose();
-    C.block<6,6>(9,9) += NgaWalk;
+    C.block<3,3>(0,0) = CRR; C.block<3,3>(0,3) = CRV; C.block<3,3>(0,6) = CRP;
+    C.block<3,3>(3,0) = CRV.transpose(); C.block<3,3>(3,3) = CVV; C.block<3,3>(3,6) = CVP;
+    C.block<3,3>(6,0) = CRP.transpose(); C.block<3,3>(6,3) = CVP.transpose(); C.block<3,3>(6,6) = CPP;
+    C.block<6,6>(9,9).diagonal() += float(n)*NgaWalk.diagonal();
 
-    // Update rotation jacobian wrt bias correction
-    JRg = dRi.deltaR.transpose()*JRg - dRi.rightJ*dt;
+    avgA = (dT*avgA + sumA)/(dT+sumDt);
+    avgW = (dT*avgW + sumW)/(dT+sumDt);
 
     // Total integrated time
-    dT += dt;
+    dT += sumDt;
 }
 
 void Preintegrated::MergePrevious(Preintegrated* pPrev)
@@ -296,10 +347,8 @@ void Preintegrated::MergePrevious(Preintegrated* pPrev)
     const std::vector<integrable> aux2 = mvMeasurements;
 
     Initialize(bav);
-    for(size_t i=0;i<aux1.size();i++)
-        IntegrateNewMeasurement(aux1[i].a,aux1[i].w,aux1[i].t);
-    for(size_t i=0;i<aux2.size();i++)
-        IntegrateNewMeasurement(aux2[i].a,aux2[i].w,aux2[i].t);
+    IntegrateMeasurements(aux1.data(),aux1.size());
+    IntegrateMeasurements(aux2.data(),aux2.size());
 
 }
 
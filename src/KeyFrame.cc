@@ -170,30 +170,11 @@ KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB):
     mnId=nNextId++;
     mbFixed = (mnId==pMap->GetInitKFid()); // this check is used in the Optimizer 
 
-    mGrid.resize(mnGridCols);
-    if(F.Nleft != -1)  mGridRight.resize(mnGridCols);
-    for(int i=0; i<mnGridCols;i++)
-    {
-        mGrid[i].resize(mnGridRows);
-        if(F.Nleft != -1) mGridRight[i].resize(mnGridRows);
-        for(int j=0; j<mnGridRows; j++){
-            mGrid[i][j] = F.mGrid[i][j];
-            if(F.Nleft != -1){
-                mGridRight[i][j] = F.mGridRight[i][j];
-            }
-        }
-    }
+    mGrid = F.mGrid;
+    if(F.Nleft != -1) mGridRight = F.mGridRight;
 
     if(F.mpLineExtractorLeft)
-    {
-        mLineGrid.resize(mnLineDGridCols);
-        for(int i=0; i<mnLineDGridCols;i++)
-        {
-            mLineGrid[i].resize(mnLineThetaGridRows);
-            for(int j=0; j<mnLineThetaGridRows; j++)
-                mLineGrid[i][j] = F.mLineGrid[i][j];
-        }
-    }
+        mLineGrid = F.mLineGrid;
 
 
     if(!F.HasVelocity()) {
@@ -223,10 +204,9 @@ void KeyFrame::ComputeBoW()
 {
     if(mBowVec.empty() || mFeatVec.empty())
     {
-        vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mDescriptors);
         // Feature vector associate features with nodes in the 4th level (from leaves up)
         // We assume the vocabulary tree has 6 levels, change the 4 otherwise
-        mpORBvocabulary->transform(vCurrentDesc,mBowVec,mFeatVec,4);
+        mpORBvocabulary->transform(mDescriptors,mBowVec,mFeatVec,4);
     }
 }
 
@@ -1142,47 +1122,53 @@ void KeyFrame::EraseConnection(const KeyFramePtr& pKF)
 vector<size_t> KeyFrame::GetFeaturesInArea(const float &x, const float &y, const float &r, const bool bRight) const
 {
     vector<size_t> vIndices;
-    vIndices.reserve(N);
+    GetFeaturesInArea(x, y, r, bRight, vIndices);
+    return vIndices;
+}
+
+void KeyFrame::GetFeaturesInArea(const float &x, const float &y, const float &r, const bool bRight, vector<size_t>& vIndices) const
+{
+    vIndices.clear();
 
     float factorX = r;
     float factorY = r;
 
     const int nMinCellX = max(0,(int)floor((x-mnMinX-factorX)*mfGridElementWidthInv));
     if(nMinCellX>=mnGridCols)
-        return vIndices;
+        return;
 
     const int nMaxCellX = min((int)mnGridCols-1,(int)ceil((x-mnMinX+factorX)*mfGridElementWidthInv));
     if(nMaxCellX<0)
-        return vIndices;
+        return;
 
     const int nMinCellY = max(0,(int)floor((y-mnMinY-factorY)*mfGridElementHeightInv));
     if(nMinCellY>=mnGridRows)
-        return vIndices;
+        return;
 
     const int nMaxCellY = min((int)mnGridRows-1,(int)ceil((y-mnMinY+factorY)*mfGridElementHeightInv));
     if(nMaxCellY<0)
-        return vIndices;
+        return;
+
+    const FeatureGrid& grid = (!bRight) ? mGrid : mGridRight;
+    if(grid.IsEmpty())
+        return;
+    const std::vector<cv::KeyPoint>& vKeys = (NLeft == -1) ? mvKeysUn
+                                                           : (!bRight) ? mvKeys
+                                                                       : mvKeysRight;
 
     for(int ix = nMinCellX; ix<=nMaxCellX; ix++)
     {
-        for(int iy = nMinCellY; iy<=nMaxCellY; iy++)
+        // the cells (ix,nMinCellY..nMaxCellY) are contiguous in the grid
+        for(const uint32_t idx : grid.Column(ix, nMinCellY, nMaxCellY))
         {
-            const vector<size_t>& vCell = (!bRight) ? mGrid[ix][iy] : mGridRight[ix][iy];
-            for(size_t j=0, jend=vCell.size(); j<jend; j++)
-            {
-                const cv::KeyPoint &kpUn = (NLeft == -1) ? mvKeysUn[vCell[j]]
-                                                         : (!bRight) ? mvKeys[vCell[j]]
-                                                                     : mvKeysRight[vCell[j]];
-                const float distx = kpUn.pt.x-x;
-                const float disty = kpUn.pt.y-y;
-
-                if(fabs(distx)<r && fabs(disty)<r)
-                    vIndices.push_back(vCell[j]);
-            }
+            const cv::KeyPoint &kpUn = vKeys[idx];
+            const float distx = kpUn.pt.x-x;
+            const float disty = kpUn.pt.y-y;
+
+            if(fabs(distx)<r && fabs(disty)<r)
+                vIndices.push_back(idx);
         }
     }
-
-    return vIndices;
 }
 
 
@@ -1248,7 +1234,13 @@ vector<size_t> KeyFrame::GetLineFeaturesInArea(const float &xs, const float  &ys
 vector<size_t> KeyFrame::GetLineFeaturesInArea(const Line2DRepresentation& lineRepresentation, const float& dtheta, const float& dd) const
 {       
     vector<size_t> vIndices;
-    vIndices.reserve(Nlines);
+    GetLineFeaturesInArea(lineRepresentation, dtheta, dd, vIndices);
+    return vIndices;
+}
+
+void KeyFrame::GetLineFeaturesInArea(const Line2DRepresentation& lineRepresentation, const float& dtheta, const float& dd, vector<size_t>& vIndices) const
+{       
+    vIndices.clear();
             
     const float thetaMin = lineRepresentation.theta - dtheta;
     const float thetaMax = lineRepresentation.theta + dtheta;
@@ -1257,15 +1249,13 @@ vector<size_t> KeyFrame::GetLineFeaturesInArea(const Line2DRepresentation& lineR
     {
         std::cout << "KeyFrame::GetLineFeaturesInArea() - ERROR - you are searching over the full theta interval!" << std::endl; 
         quick_exit(-1);
-        return vIndices; 
+        return; 
     }      
     
     const float dMin = lineRepresentation.d - dd;
     const float dMax = lineRepresentation.d + dd;    
     
     GetLineFeaturesInArea(thetaMin, thetaMax, dMin, dMax, vIndices);
-
-    return vIndices;
 }
 
 void KeyFrame::GetLineFeaturesInArea(const float thetaMin, const float thetaMax, const float dMin, const float dMax, vector<size_t>& vIndices) const
@@ -1338,18 +1328,14 @@ void KeyFrame::GetLineFeaturesInArea(const float thetaMin, const float thetaMax,
         return; 
     }
         
+    if(mLineGrid.IsEmpty())
+        return;
+
     for(int ix = nMinCellDCol; ix<=nMaxCellDCol; ix++)
     {
-        for(int iy = nMinCellThetaRow; iy<=nMaxCellThetaRow; iy++)
-        {
-            //const int iyW = Utils::Modulus(iy,LINE_THETA_GRID_ROWS); 
-            const int iyW = iy;
-            const vector<size_t>& vCell = mLineGrid[ix][iyW];
-            if(vCell.empty())
-                continue;
-
-            vIndices.insert(vIndices.end(),vCell.begin(),vCell.end()); 
-        }
+        // the cells (ix,nMinCellThetaRow..nMaxCellThetaRow) are contiguous in the grid
+        const FeatureGrid::Span vCells = mLineGrid.Column(ix, nMinCellThetaRow, nMaxCellThetaRow);
+        vIndices.insert(vIndices.end(),vCells.begin(),vCells.end()); 
     }
 }
 
@@ -1484,6 +1470,9 @@ float KeyFrame::ComputeSceneMedianDepth(const int q)
         }
     }    
 
+    if(vDepths.empty())
+        return -1.0;
+
     sort(vDepths.begin(),vDepths.end());
 
     return vDepths[(vDepths.size()-1)/q];
@@ -2245,21 +2234,13 @@ void KeyFrame::serialize(Archive& ar, const unsigned int version)
     ar & mbHasVelocity;    
     
     // allocate line grid in case the loaded map did not manage lines 
-    if( mLineGrid.empty() )
+    if( mLineGrid.IsEmpty() )
     {
-        mLineGrid.resize(mnLineDGridCols);
-        for(int i=0; i<mnLineDGridCols;i++)
-        {
-            mLineGrid[i].resize(mnLineThetaGridRows);
-        }    
+        mLineGrid.Reset(mnLineDGridCols, mnLineThetaGridRows);
     }    
-    if( mLineGridRight.empty() )
+    if( mLineGridRight.IsEmpty() )
     {
-        mLineGridRight.resize(mnLineDGridCols);
-        for(int i=0; i<mnLineDGridCols;i++)
-        {
-            mLineGridRight[i].resize(mnLineThetaGridRows);
-        }    
+        mLineGridRight.Reset(mnLineDGridCols, mnLineThetaGridRows);
     }       
 }
 template void KeyFrame::serialize(boost::archive::binary_iarchive &, const unsigned int);
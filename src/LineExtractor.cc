@@ -224,8 +224,8 @@ void LineExtractor::detectLineFeatures(const cv::Mat& img, std::vector<cv::line_
     // filter lines
     if (lines.size() > mnLinefeatures && mnLinefeatures != 0)
     {
-        // sort lines by their response
-        sort(lines.begin(), lines.end(), sort_lines_by_response());
+        // sort lines by their response (only the retained ones need to be sorted)
+        std::partial_sort(lines.begin(), lines.begin() + mnLinefeatures, lines.end(), sort_lines_by_response());
         //sort( lines.begin(), lines.end(), sort_lines_by_length() );
         lines.resize(mnLinefeatures);
         // reassign index
@@ -268,6 +268,8 @@ void LineExtractor::detectLineFeatures(const cv::Mat& img, std::vector<cv::line_
         return; 
     }
     
+    // N.B.: the LBD descriptors are computed only for the retained lines; with the LSD extractor, the image gradients are 
+    // computed only on the octaves and regions covered by their support regions (on the pyramid set by SetGaussianPyramid() if any)
     if(skUseLsdExtractor)   
     {
         // N.B.: can't reuse detection data since we used the LSD extractor 
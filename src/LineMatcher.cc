@@ -24,6 +24,7 @@
 #include <line_descriptor/descriptor_custom.hpp>
 
 #include "LineMatcher.h"
+#include "HammingDistance.h"
 #include "MapLine.h"
 #include "Geom2DUtils.h"
 #include "Logger.h"
@@ -138,8 +139,6 @@ void ComputeThreeMaxima(T* histo, const int L, int &ind1, int &ind2, int &ind3)
 LineMatcher::LineMatcher(float nnratio, bool crossCheck, bool checkOrientation):mfNNratio(nnratio),mbCheckOrientation(checkOrientation)
 {
     //mpBfm = std::make_shared<cv::BFMatcher>(cv::NORM_HAMMING, crossCheck); // cross-check
-    
-    mBdm = cv::line_descriptor_c::BinaryDescriptorMatcher::createBinaryDescriptorMatcher();
 }
 
 
@@ -738,6 +737,8 @@ int LineMatcher::SearchForTriangulation(KeyFramePtr& pKF1, KeyFramePtr& pKF2, ve
 int LineMatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame, const bool bLargerSearch, const bool bMono)
 {
     int nmatches = 0;
+    std::vector<int> vDistances;
+    std::vector<size_t> vIndices2; // candidate keylines
 
     const float thChiSquareLineMonoProj = bLargerSearch ? kChiSquareLineMonoProjLarger : kChiSquareLineMonoProj; 
     const float thChiSquareSegSeg = bLargerSearch ? kChiSquareSegSegLarger : kChiSquareSegSeg;
@@ -810,7 +811,6 @@ int LineMatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
             //    // Search in a window. Size depends on scale
             //    float radius = th*CurrentFrame.mvScaleFactors[nLastOctave];
 
-                vector<size_t> vIndices2;
                 Geom2DUtils::GetLine2dRepresentation(proj.uS, proj.vS, proj.uE, proj.vE, projLineRepresentation);  
              
             //    if(bForward)
@@ -820,17 +820,17 @@ int LineMatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
             //    else
             //        vIndices2 = CurrentFrame.GetFeaturesInArea(u,v, radius, nLastOctave-1, nLastOctave+1);
 #if 0                
-                vIndices2 = CurrentFrame.GetLineFeaturesInArea(projLineRepresentation);                 
+                CurrentFrame.GetLineFeaturesInArea(projLineRepresentation, Frame::kDeltaTheta, Frame::kDeltaD, -1, Frame::kMaxInt, vIndices2);                 
 #else
                 const float scale = CurrentFrame.mvLineScaleFactors[nLastOctave];
                 const float deltaTheta = Frame::kDeltaTheta*scale;
                 const float deltaD = Frame::kDeltaD*scale;
                 if(bForward) 
-                    vIndices2 = CurrentFrame.GetLineFeaturesInArea(projLineRepresentation, deltaTheta, deltaD, nLastOctave);                
+                    CurrentFrame.GetLineFeaturesInArea(projLineRepresentation, deltaTheta, deltaD, nLastOctave, Frame::kMaxInt, vIndices2);                
                 else if(bBackward)
-                    vIndices2 = CurrentFrame.GetLineFeaturesInArea(projLineRepresentation, deltaTheta, deltaD, 0, nLastOctave);                   
+                    CurrentFrame.GetLineFeaturesInArea(projLineRepresentation, deltaTheta, deltaD, 0, nLastOctave, vIndices2);                   
                 else
-                    vIndices2 = CurrentFrame.GetLineFeaturesInArea(projLineRepresentation, deltaTheta, deltaD, nLastOctave-1, nLastOctave+1);                  
+                    CurrentFrame.GetLineFeaturesInArea(projLineRepresentation, deltaTheta, deltaD, nLastOctave-1, nLastOctave+1, vIndices2);                  
 #endif   
               
                 
@@ -857,6 +857,7 @@ int LineMatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
                 int bestIdx  = -1;
                 int bestDist2 = 256;
 
+                HammingDistance::ComputeDistances(dML, CurrentFrame.mLineDescriptors, vIndices2, vDistances);
                 for(vector<size_t>::const_iterator vit=vIndices2.begin(), vend=vIndices2.end(); vit!=vend; vit++)
                 {
                     const size_t i2 = *vit;
@@ -933,9 +934,7 @@ int LineMatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
                         }                
                     }  
 #endif  
-                    const cv::Mat &d = CurrentFrame.mLineDescriptors.row(i2); 
-
-                    const int dist = DescriptorDistance(dML,d);
+                    const int dist = vDistances[vit-vIndices2.begin()];
 
                     
                     if(dist<bestDist)
@@ -1068,13 +1067,11 @@ int LineMatcher::SearchByProjection(Frame &F, const std::vector<MapLinePtr> &vpM
     const float thChiSquareSegSeg = bLargerSearch ? kChiSquareSegSegLarger : kChiSquareSegSeg;
 
     int nmatches=0;
+    std::vector<int> vDistances;
+    std::vector<size_t> vIndices; // candidate keylines
 
 //    const bool bFactor = th!=1.0;
 
-    LineProjection proj;
-    Line2DRepresentation projLineRepresentation;
-    Line2DRepresentation projRightLineRepresentation;
-    
     for(size_t iML=0,iMLEnd=vpMapLines.size(); iML<iMLEnd; iML++)
     {
         MapLinePtr pML = vpMapLines[iML];
@@ -1084,154 +1081,207 @@ int LineMatcher::SearchByProjection(Frame &F, const std::vector<MapLinePtr> &vpM
         if(pML->isBad())
             continue;
 
-        const int &nPredictedLevel = pML->mnTrackScaleLevel;
-//
-//        // The size of the window will depend on the viewing direction
-//        float r = RadiusByViewingCos(pML->mTrackViewCos);
-//
-//        if(bFactor)
-//            r*=th;
+        MapLineProjection proj;
+        proj.uS = pML->mTrackProjStartX;
+        proj.vS = pML->mTrackProjStartY;
+        proj.uE = pML->mTrackProjEndX;
+        proj.vE = pML->mTrackProjEndY;
+        proj.depthS = pML->mTrackStartDepth;
+        proj.depthE = pML->mTrackEndDepth;
+        proj.viewCos = pML->mTrackViewCos;
+        proj.level = pML->mnTrackScaleLevel;
+
+        if(MatchProjectedLine(F, pML, proj, thChiSquareLineMonoProj, thChiSquareSegSeg, vIndices, vDistances))
+            nmatches++;
+    }
 
-        //const vector<size_t> vIndices = F.GetFeaturesInArea(pML->mTrackProjX,pML->mTrackProjY,r*F.mvScaleFactors[nPredictedLevel],nPredictedLevel-1,nPredictedLevel);
-        
-        Geom2DUtils::GetLine2dRepresentation(pML->mTrackProjStartX, pML->mTrackProjStartY, pML->mTrackProjEndX, pML->mTrackProjEndY, projLineRepresentation); 
-        
-        //const vector<size_t> vIndices = F.GetLineFeaturesInArea(projLineRepresentation);
-        const float scale = F.mvLineScaleFactors[nPredictedLevel];
-        const float deltaTheta = Frame::kDeltaTheta*scale;
-        const float deltaD = Frame::kDeltaD*scale;        
-        const vector<size_t> vIndices = F.GetLineFeaturesInArea(projLineRepresentation, deltaTheta, deltaD, nPredictedLevel-1,nPredictedLevel);
+#if VERBOSE    
+    std::cout << "LineMatcher::MatchByProjection() F-Map - matched " << nmatches << " lines" << std::endl;
+#endif
+    
+    return nmatches;
+}
 
-        if(vIndices.empty())
+
+// used by Tracking::SearchLocalLines() with LocalMapProjector
+int LineMatcher::SearchByProjection(Frame &F, const std::vector<MapLinePtr> &vpMapLines, const std::vector<uint8_t> &vbInView, 
+                                    const std::vector<MapLineProjection> &vProjections, const bool bLargerSearch)
+{
+    const float thChiSquareLineMonoProj = bLargerSearch ? kChiSquareLineMonoProjLarger : kChiSquareLineMonoProj; 
+    const float thChiSquareSegSeg = bLargerSearch ? kChiSquareSegSegLarger : kChiSquareSegSeg;
+
+    int nmatches=0;
+    std::vector<int> vDistances;
+    std::vector<size_t> vIndices; // candidate keylines
+
+    for(size_t iML=0,iMLEnd=vpMapLines.size(); iML<iMLEnd; iML++)
+    {
+        if(!vbInView[iML])
             continue;
 
-        const cv::Mat MPdescriptor = pML->GetDescriptor();
+        MapLinePtr pML = vpMapLines[iML];
+        if(pML->isBad())
+            continue;
 
-        int bestDist  = 256;
-        int bestLevel= -1;
-        int bestDist2 = 256;
-        int bestLevel2 = -1;
-        int bestIdx = -1;
+        if(MatchProjectedLine(F, pML, vProjections[iML], thChiSquareLineMonoProj, thChiSquareSegSeg, vIndices, vDistances))
+            nmatches++;
+    }
 
-        // Get best and second matches with near keylines
-        for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)   
-        {
-            const size_t idx = *vit;
+#if VERBOSE    
+    std::cout << "LineMatcher::MatchByProjection() F-Map - matched " << nmatches << " lines" << std::endl;
+#endif
+    
+    return nmatches;
+}
 
-            if(F.mvpMapLines[idx])
-                if(F.mvpMapLines[idx]->Observations()>0)
-                    continue;
+bool LineMatcher::MatchProjectedLine(Frame &F, const MapLinePtr& pML, const MapLineProjection& proj, const float thChiSquareLineMonoProj, const float thChiSquareSegSeg,
+                                     std::vector<size_t> &vIndices, std::vector<int> &vDistances)
+{
+    Line2DRepresentation projLineRepresentation;
+    Line2DRepresentation projRightLineRepresentation;
+
+    const int &nPredictedLevel = proj.level;
+//
+//        // The size of the window will depend on the viewing direction
+//        float r = RadiusByViewingCos(proj.viewCos);
+//
+//        if(bFactor)
+//            r*=th;
+
+    //const vector<size_t> vIndices = F.GetFeaturesInArea(pML->mTrackProjX,pML->mTrackProjY,r*F.mvScaleFactors[nPredictedLevel],nPredictedLevel-1,nPredictedLevel);
+    
+    Geom2DUtils::GetLine2dRepresentation(proj.uS, proj.vS, proj.uE, proj.vE, projLineRepresentation); 
+    
+    //const vector<size_t> vIndices = F.GetLineFeaturesInArea(projLineRepresentation);
+    const float scale = F.mvLineScaleFactors[nPredictedLevel];
+    const float deltaTheta = Frame::kDeltaTheta*scale;
+    const float deltaD = Frame::kDeltaD*scale;        
+    F.GetLineFeaturesInArea(projLineRepresentation, deltaTheta, deltaD, nPredictedLevel-1,nPredictedLevel, vIndices);
+
+    if(vIndices.empty())
+        return false;
+
+    const cv::Mat MPdescriptor = pML->GetDescriptor();
+
+    int bestDist  = 256;
+    int bestLevel= -1;
+    int bestDist2 = 256;
+    int bestLevel2 = -1;
+    int bestIdx = -1;
+
+    // Get best and second matches with near keylines
+    HammingDistance::ComputeDistances(MPdescriptor, F.mLineDescriptors, vIndices, vDistances);
+    for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)   
+    {
+        const size_t idx = *vit;
+
+        if(F.mvpMapLines[idx])
+            if(F.mvpMapLines[idx]->Observations()>0)
+                continue;
 
 //            if(F.mvuRight[idx]>0)
 //            {
-//                const float er = fabs(pML->mTrackProjStartXR-F.mvuRight[idx]);
+//                const float er = fabs(proj.uSR-F.mvuRight[idx]);
 //                if(er>r*F.mvScaleFactors[nPredictedLevel])
 //                    continue;
 //            }
 
-            const cv::line_descriptor_c::KeyLine& kl = F.mvKeyLinesUn[idx];
-            //const int &klLevel= kl.octave;
-            
+        const cv::line_descriptor_c::KeyLine& kl = F.mvKeyLinesUn[idx];
+        //const int &klLevel= kl.octave;
+        
 #if USE_DISTSEGMENT2SEGMENT_FOR_MATCHING             
-            // dist segment-segment 
-            const float distSegSeg = Geom2DUtils::distSegment2Segment(Eigen::Vector2f(pML->mTrackProjStartX, pML->mTrackProjStartY), 
-                                                                        Eigen::Vector2f(pML->mTrackProjEndX, pML->mTrackProjEndY),
-                                                                        Eigen::Vector2f(kl.startPointX, kl.startPointY),
-                                                                        Eigen::Vector2f(kl.endPointX, kl.endPointY));
+        // dist segment-segment 
+        const float distSegSeg = Geom2DUtils::distSegment2Segment(Eigen::Vector2f(proj.uS, proj.vS), 
+                                                                    Eigen::Vector2f(proj.uE, proj.vE),
+                                                                    Eigen::Vector2f(kl.startPointX, kl.startPointY),
+                                                                    Eigen::Vector2f(kl.endPointX, kl.endPointY));
 
-            if(distSegSeg*distSegSeg*(F.mvLineInvLevelSigma2[nPredictedLevel])>thChiSquareSegSeg) 
-            {
-                continue;
-            }
+        if(distSegSeg*distSegSeg*(F.mvLineInvLevelSigma2[nPredictedLevel])>thChiSquareSegSeg) 
+        {
+            continue;
+        }
 #else 
-            // distance point-line + point-line
-            // line representation [l1,l2,l3]=[nx,ny,-d] with [nx,ny] defining a unit normal
-            // constraint: 0 = l1*u1 + l2*v1 + l3  
-            const float distS = projLineRepresentation.nx*kl.startPointX + projLineRepresentation.ny*kl.startPointY - projLineRepresentation.d;
-            const float distE = projLineRepresentation.nx*kl.endPointX + projLineRepresentation.ny*kl.endPointY - projLineRepresentation.d;
-            const float err2 = distS*distS + distE*distE; 
-
-            if(err2*(F.mvLineInvLevelSigma2[nPredictedLevel])>thChiSquareLineMonoProj)  
-            {
-                continue;
-            }    
+        // distance point-line + point-line
+        // line representation [l1,l2,l3]=[nx,ny,-d] with [nx,ny] defining a unit normal
+        // constraint: 0 = l1*u1 + l2*v1 + l3  
+        const float distS = projLineRepresentation.nx*kl.startPointX + projLineRepresentation.ny*kl.startPointY - projLineRepresentation.d;
+        const float distE = projLineRepresentation.nx*kl.endPointX + projLineRepresentation.ny*kl.endPointY - projLineRepresentation.d;
+        const float err2 = distS*distS + distE*distE; 
+
+        if(err2*(F.mvLineInvLevelSigma2[nPredictedLevel])>thChiSquareLineMonoProj)  
+        {
+            continue;
+        }    
 #endif 
 
 
 #if USE_STEREO_PROJECTION_CHECK
-            if(F.mvuRightLineStart[idx]>=0 && F.mvuRightLineEnd[idx]>=0)
-            {
-                // we assume left and right images are rectified 
+        if(F.mvuRightLineStart[idx]>=0 && F.mvuRightLineEnd[idx]>=0)
+        {
+            // we assume left and right images are rectified 
 
-                // get right projection of pML 
-                const float proj_uSr = pML->mTrackProjStartX - F.mbf/pML->mTrackStartDepth;
-                const float proj_vSr = pML->mTrackProjStartY; 
+            // get right projection of pML 
+            const float proj_uSr = proj.uS - F.mbf/proj.depthS;
+            const float proj_vSr = proj.vS; 
 
-                const float proj_uEr = pML->mTrackProjEndX - F.mbf/pML->mTrackEndDepth;
-                const float proj_vEr = pML->mTrackProjEndY;  
+            const float proj_uEr = proj.uE - F.mbf/proj.depthE;
+            const float proj_vEr = proj.vE;  
 
-                Geom2DUtils::GetLine2dRepresentation(proj_uSr, proj_vSr, proj_uEr, proj_vEr, projRightLineRepresentation);  
+            Geom2DUtils::GetLine2dRepresentation(proj_uSr, proj_vSr, proj_uEr, proj_vEr, projRightLineRepresentation);  
 
-                // get current frame line end-points on right image
-                const float uSr = F.mvuRightLineStart[idx];
-                const float vSr = kl.startPointY;   
+            // get current frame line end-points on right image
+            const float uSr = F.mvuRightLineStart[idx];
+            const float vSr = kl.startPointY;   
 
-                const float uEr = F.mvuRightLineEnd[idx];
-                const float vEr = kl.endPointY;                                                       
+            const float uEr = F.mvuRightLineEnd[idx];
+            const float vEr = kl.endPointY;                                                       
 
-                // distance point-line + point-line on right line
-                // line representation [l1,l2,l3]=[nx,ny,-d] with [nx,ny] defining a unit normal
-                // constraint: 0 = l1*u1 + l2*v1 + l3  
-                const float distSr = projRightLineRepresentation.nx*uSr + projRightLineRepresentation.ny*vSr - projRightLineRepresentation.d;
-                const float distEr = projRightLineRepresentation.nx*uEr + projRightLineRepresentation.ny*vEr - projRightLineRepresentation.d;
-                const float err2r = distSr*distSr + distEr*distEr; 
+            // distance point-line + point-line on right line
+            // line representation [l1,l2,l3]=[nx,ny,-d] with [nx,ny] defining a unit normal
+            // constraint: 0 = l1*u1 + l2*v1 + l3  
+            const float distSr = projRightLineRepresentation.nx*uSr + projRightLineRepresentation.ny*vSr - projRightLineRepresentation.d;
+            const float distEr = projRightLineRepresentation.nx*uEr + projRightLineRepresentation.ny*vEr - projRightLineRepresentation.d;
+            const float err2r = distSr*distSr + distEr*distEr; 
 
-                if(err2r*(F.mvLineInvLevelSigma2[nPredictedLevel])>thChiSquareLineMonoProj)  
-                {
-                    continue;
-                }                
-            }  
+            if(err2r*(F.mvLineInvLevelSigma2[nPredictedLevel])>thChiSquareLineMonoProj)  
+            {
+                continue;
+            }                
+        }  
 #endif  
-                    
-            const cv::Mat &d = F.mLineDescriptors.row(idx);
-
-            const int dist = DescriptorDistance(MPdescriptor,d);
+                
+        const int dist = vDistances[vit-vIndices.begin()];
 
-            if(dist<bestDist)
-            {
-                bestDist2=bestDist;
-                bestDist=dist;
-                bestLevel2 = bestLevel;
-                bestLevel = F.mvKeyLinesUn[idx].octave;
-                bestIdx=idx;
-            }
-            else if(dist<bestDist2)
-            {
-                bestLevel2 = F.mvKeyLinesUn[idx].octave;
-                bestDist2=dist;
-            }
+        if(dist<bestDist)
+        {
+            bestDist2=bestDist;
+            bestDist=dist;
+            bestLevel2 = bestLevel;
+            bestLevel = F.mvKeyLinesUn[idx].octave;
+            bestIdx=idx;
         }
-
-        // Apply ratio to second match (only if best and second are in the same scale level)
-        if( (bestDist<=TH_HIGH) && (bestIdx>=0) )
+        else if(dist<bestDist2)
         {
-            if(bestLevel==bestLevel2 && bestDist>mfNNratio*bestDist2)
-                continue;
-            //if(bestDist>mfNNratio*bestDist2)
-            //    continue;            
-
-            //std::cout << "match distance H: " << bestDist << std::endl; 
-            
-            F.mvpMapLines[bestIdx]=pML;
-            nmatches++;
+            bestLevel2 = F.mvKeyLinesUn[idx].octave;
+            bestDist2=dist;
         }
     }
 
-#if VERBOSE    
-    std::cout << "LineMatcher::MatchByProjection() F-Map - matched " << nmatches << " lines" << std::endl;
-#endif
-    
-    return nmatches;
+    // Apply ratio to second match (only if best and second are in the same scale level)
+    if( (bestDist<=TH_HIGH) && (bestIdx>=0) )
+    {
+        if(bestLevel==bestLevel2 && bestDist>mfNNratio*bestDist2)
+            return false;
+        //if(bestDist>mfNNratio*bestDist2)
+        //    continue;            
+
+        //std::cout << "match distance H: " << bestDist << std::endl; 
+        
+        F.mvpMapLines[bestIdx]=pML;
+        return true;
+    }
+
+    return false;
 }
 
 
@@ -1242,6 +1292,8 @@ int LineMatcher::SearchByProjection(Frame &F, const std::vector<MapLinePtr> &vpM
 int LineMatcher::SearchByProjection(Frame &CurrentFrame, KeyFramePtr& pKF, const set<MapLinePtr> &sAlreadyFound, const bool bLargerSearch, const int& descriptorDist)
 {
     int nmatches = 0;
+    std::vector<int> vDistances;
+    std::vector<size_t> vIndices2; // candidate keylines
 
     //const cv::Mat Rcw = CurrentFrame.mTcw.rowRange(0,3).colRange(0,3);
     //const cv::Mat tcw = CurrentFrame.mTcw.rowRange(0,3).col(3);
@@ -1314,7 +1366,7 @@ int LineMatcher::SearchByProjection(Frame &CurrentFrame, KeyFramePtr& pKF, const
                 const float scale = CurrentFrame.mvLineScaleFactors[nPredictedLevel];
                 const float deltaTheta = Frame::kDeltaTheta*scale;
                 const float deltaD = Frame::kDeltaD*scale;                
-                const vector<size_t> vIndices2 = CurrentFrame.GetLineFeaturesInArea(projLineRepresentation, deltaTheta, deltaD, nPredictedLevel-1,nPredictedLevel);                
+                CurrentFrame.GetLineFeaturesInArea(projLineRepresentation, deltaTheta, deltaD, nPredictedLevel-1,nPredictedLevel, vIndices2);                
 
                 //const vector<size_t> vIndices2 = CurrentFrame.GetFeaturesInArea(u, v, radius, nPredictedLevel-1, nPredictedLevel+1);
 
@@ -1327,15 +1379,14 @@ int LineMatcher::SearchByProjection(Frame &CurrentFrame, KeyFramePtr& pKF, const
                 int bestIdx   = -1;
                 int bestDist2 = 256;
 
+                HammingDistance::ComputeDistances(dML, CurrentFrame.mLineDescriptors, vIndices2, vDistances);
                 for(vector<size_t>::const_iterator vit=vIndices2.begin(); vit!=vIndices2.end(); vit++)
                 {
                     const size_t i2 = *vit;
                     if(CurrentFrame.mvpMapLines[i2])
                         continue;
 
-                    const cv::Mat &d = CurrentFrame.mLineDescriptors.row(i2);
-
-                    const int dist = DescriptorDistance(dML,d);
+                    const int dist = vDistances[vit-vIndices2.begin()];
 
 //                    if(dist<bestDist)
 //                    { 
@@ -1439,6 +1490,8 @@ int LineMatcher::SearchByProjection(KeyFramePtr& pKF, const Sophus::Sim3f& Scw,
     spAlreadyFound.erase(static_cast<MapLinePtr>(NULL));
 
     int nmatches=0;
+    std::vector<int> vDistances;
+    std::vector<size_t> vIndices; // candidate keylines
 
     LineProjection proj;
     Line2DRepresentation projLineRepresentation;
@@ -1501,7 +1554,7 @@ int LineMatcher::SearchByProjection(KeyFramePtr& pKF, const Sophus::Sim3f& Scw,
         const float scale = pKF->mvLineScaleFactors[nPredictedLevel];
         const float deltaTheta = Frame::kDeltaTheta*scale;
         const float deltaD = th * Frame::kDeltaD*scale; // increase just the distance            
-        const vector<size_t> vIndices = pKF->GetLineFeaturesInArea(projLineRepresentation, deltaTheta, deltaD);    
+        pKF->GetLineFeaturesInArea(projLineRepresentation, deltaTheta, deltaD, vIndices);    
                         
     //    // Search in a radius
     //    const float radius = th*pKF->mvScaleFactors[nPredictedLevel];
@@ -1517,6 +1570,7 @@ int LineMatcher::SearchByProjection(KeyFramePtr& pKF, const Sophus::Sim3f& Scw,
         int bestIdx   = -1;
         int bestDist2 = 256;
         
+        HammingDistance::ComputeDistances(dML, pKF->mLineDescriptors, vIndices, vDistances);
         for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
         {
             const size_t idx = *vit;
@@ -1528,9 +1582,7 @@ int LineMatcher::SearchByProjection(KeyFramePtr& pKF, const Sophus::Sim3f& Scw,
             if(klLevel<nPredictedLevel-1 || klLevel>nPredictedLevel)
                 continue;
 
-            const cv::Mat &dKF = pKF->mLineDescriptors.row(idx);
-
-            const int dist = DescriptorDistance(dML,dKF);
+            const int dist = vDistances[vit-vIndices.begin()];
  
 //            if(dist<bestDist)
 //            {
@@ -1599,6 +1651,8 @@ int LineMatcher::SearchByProjection(KeyFramePtr& pKF, const Sophus::Sim3f& Scw,
     spAlreadyFound.erase(static_cast<MapLinePtr>(NULL));
 
     int nmatches=0;
+    std::vector<int> vDistances;
+    std::vector<size_t> vIndices; // candidate keylines
     LineProjection proj;
     Line2DRepresentation projLineRepresentation;
     
@@ -1665,7 +1719,7 @@ int LineMatcher::SearchByProjection(KeyFramePtr& pKF, const Sophus::Sim3f& Scw,
         const float scale = pKF->mvLineScaleFactors[nPredictedLevel];
         const float deltaTheta = Frame::kDeltaTheta*scale;
         const float deltaD = th * Frame::kDeltaD*scale;  //only increase the distance 
-        const vector<size_t> vIndices = pKF->GetLineFeaturesInArea(projLineRepresentation, deltaTheta, deltaD);            
+        pKF->GetLineFeaturesInArea(projLineRepresentation, deltaTheta, deltaD, vIndices);            
 
         if(vIndices.empty())
             continue;
@@ -1675,6 +1729,7 @@ int LineMatcher::SearchByProjection(KeyFramePtr& pKF, const Sophus::Sim3f& Scw,
 
         int bestDist = 256;
         int bestIdx = -1;
+        HammingDistance::ComputeDistances(dML, pKF->mLineDescriptors, vIndices, vDistances);
         for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
         {
             const size_t idx = *vit;
@@ -1686,9 +1741,7 @@ int LineMatcher::SearchByProjection(KeyFramePtr& pKF, const Sophus::Sim3f& Scw,
             if(klLevel<nPredictedLevel-1 || klLevel>nPredictedLevel)
                 continue;
 
-            const cv::Mat &dKF = pKF->mLineDescriptors.row(idx);            
-
-            const int dist = DescriptorDistance(dML,dKF);
+            const int dist = vDistances[vit-vIndices.begin()];
 
             if(dist<bestDist)
             {
@@ -1727,6 +1780,8 @@ int LineMatcher::Fuse(KeyFramePtr& pKF, const vector<MapLinePtr> &vpMapLines, co
     Eigen::Vector3f Ow = pKF->GetCameraCenter();
 
     int nFused=0;
+    std::vector<int> vDistances;
+    std::vector<size_t> vIndices; // candidate keylines
 
     const int nMLs = vpMapLines.size();
 
@@ -1800,7 +1855,7 @@ int LineMatcher::Fuse(KeyFramePtr& pKF, const vector<MapLinePtr> &vpMapLines, co
         const float scale = pKF->mvLineScaleFactors[nPredictedLevel];
         const float deltaTheta = Frame::kDeltaTheta*scale;     
         const float deltaD = th * Frame::kDeltaD*scale; // increase just the distance               
-        const vector<size_t>& vIndices = pKF->GetLineFeaturesInArea(projLineRepresentation,deltaTheta,deltaD);  
+        pKF->GetLineFeaturesInArea(projLineRepresentation,deltaTheta,deltaD,vIndices);  
         
         if(vIndices.empty())
             continue;
@@ -1813,6 +1868,7 @@ int LineMatcher::Fuse(KeyFramePtr& pKF, const vector<MapLinePtr> &vpMapLines, co
         int bestIdx   = -1;
         int bestDist2 = 256; // second to best 
         
+        HammingDistance::ComputeDistances(dML, pKF->mLineDescriptors, vIndices, vDistances);
         for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
         {
             const size_t idx = *vit;
@@ -1916,9 +1972,7 @@ int LineMatcher::Fuse(KeyFramePtr& pKF, const vector<MapLinePtr> &vpMapLines, co
             }  
 #endif  
 
-            const cv::Mat &dKF = pKF->mLineDescriptors.row(idx);
-
-            const int dist = DescriptorDistance(dML,dKF);
+            const int dist = vDistances[vit-vIndices.begin()];
 
         //    if(dist<bestDist)
         //    {
@@ -2008,6 +2062,8 @@ int LineMatcher::Fuse(KeyFramePtr& pKF, const Sophus::Sim3f& Scw, const std::vec
     const set<MapLinePtr> spAlreadyFound = pKF->GetMapLines();
 
     int nFused=0;
+    std::vector<int> vDistances;
+    std::vector<size_t> vIndices; // candidate keylines
 
     const int nLines = vpLines.size();
     
@@ -2089,7 +2145,7 @@ int LineMatcher::Fuse(KeyFramePtr& pKF, const Sophus::Sim3f& Scw, const std::vec
         const float scale = pKF->mvLineScaleFactors[nPredictedLevel];
         const float deltaTheta = Frame::kDeltaTheta*scale;
         const float deltaD = th * Frame::kDeltaD*scale; // increase just the distance              
-        const vector<size_t>& vIndices = pKF->GetLineFeaturesInArea(projLineRepresentation,deltaTheta,deltaD);  
+        pKF->GetLineFeaturesInArea(projLineRepresentation,deltaTheta,deltaD,vIndices);  
         
 
         if(vIndices.empty())
@@ -2103,6 +2159,7 @@ int LineMatcher::Fuse(KeyFramePtr& pKF, const Sophus::Sim3f& Scw, const std::vec
         int bestIdx   = -1;
         int bestDist2 = INT_MAX;
         
+        HammingDistance::ComputeDistances(dML, pKF->mLineDescriptors, vIndices, vDistances);
         for(vector<size_t>::const_iterator vit=vIndices.begin(); vit!=vIndices.end(); vit++)
         {
             const size_t idx = *vit;
@@ -2175,9 +2232,7 @@ int LineMatcher::Fuse(KeyFramePtr& pKF, const Sophus::Sim3f& Scw, const std::vec
             }  
 #endif  
 
-            const cv::Mat &dKF = pKF->mLineDescriptors.row(idx);
-
-            int dist = DescriptorDistance(dML,dKF);
+            int dist = vDistances[vit-vIndices.begin()];
 
         //    if(dist<bestDist)
         //    {
@@ -2241,7 +2296,23 @@ int LineMatcher::ComputeDescriptorMatches(const cv::Mat& ldesc_q/*query*/, const
 {
     //mpBfm->knnMatch(ldesc_q/*query*/, ldesc_t/*train*/, lmatches, 2, queryMask, true/*compact result*/);
     
-    mBdm->knnMatch(ldesc_q/*query*/, ldesc_t/*train*/, lmatches, 2 /*k*/, queryMask, true/*compact result*/);
+    // brute-force 2-NN search with the batch Hamming distance (same output of knnMatch() with compact result)
+    std::vector<int> vBestIdx, vBestDist, vSecondIdx, vSecondDist; 
+    HammingDistance::MatchBestTwo(ldesc_q, ldesc_t, queryMask, vBestIdx, vBestDist, vSecondIdx, vSecondDist);
+    
+    lmatches.clear();
+    lmatches.reserve(ldesc_q.rows);
+    for(int iq=0; iq<ldesc_q.rows; iq++)
+    {
+        if(vBestIdx[iq] < 0) continue; // masked out query 
+        
+        std::vector<cv::DMatch> lmatchesi; 
+        lmatchesi.reserve(2);
+        lmatchesi.push_back(cv::DMatch(iq, vBestIdx[iq], 0 /*imgIdx*/, (float)vBestDist[iq]));
+        if(vSecondIdx[iq] >= 0)
+            lmatchesi.push_back(cv::DMatch(iq, vSecondIdx[iq], 0 /*imgIdx*/, (float)vSecondDist[iq]));
+        lmatches.push_back(std::move(lmatchesi));
+    }
     
     vValidMatch = std::vector<bool>(lmatches.size(),false);
             
@@ -2323,67 +2394,11 @@ void LineMatcher::LineDescriptorMAD12(const std::vector<std::vector<cv::DMatch>
     sigma12_mad = 1.4826 * matches_12[int(matches_12.size() / 2)][0].distance;
 }
 
-#if 0 
-
-// Bit set count operation from
-// http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
+// Bit set count operation (see HammingDistance)
     int LineMatcher::DescriptorDistance(const cv::Mat &a, const cv::Mat &b)
     {
-        const uint32_t *pa = a.ptr<uint32_t>();
-        const uint32_t *pb = b.ptr<uint32_t>();
-
-        int dist=0;      
-
-        for(int i=0; i<8; i++, pa++, pb++)
-        {
-//#include <immintrin.h>             
-#ifdef __POPCNT__    
-            // SIMD optimization by using 32-size instruction
-            dist += _mm_popcnt_u32(*pa ^ *pb); // count number of 1 over XOR
-#else                  
-            unsigned int v = *pa ^ *pb;
-            v = v - ((v >> 1) & 0x55555555);
-            v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
-            dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
-#endif             
-        }
-        return dist;
+        return HammingDistance::Distance(a.ptr(), b.ptr());
     }
 
-#else 
-
-// Bit set count operation from
-// http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
-    int LineMatcher::DescriptorDistance(const cv::Mat &a, const cv::Mat &b)
-    {
-        const uint64_t *pa = a.ptr<uint64_t>();
-        const uint64_t *pb = b.ptr<uint64_t>();
-
-        uint64_t dist=0;      
-
-        for(int i=0; i<4; i++, pa++, pb++)
-        {
-//#include <immintrin.h>             
-#ifdef __POPCNT__    
-            // SIMD optimization by using 64-size instruction
-            dist += _mm_popcnt_u64(*pa ^ *pb); // count number of 1 over XOR
-#else             
-            using T = uint64_t;   
-            uint64_t v = *pa ^ *pb;
-            // v = v - ((v >> 1) & 0x55555555);
-            // v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
-            // dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
-
-            v = v - ((v >> 1) & (T)~(T)0/3);                           // temp
-            v = (v & (T)~(T)0/15*3) + ((v >> 2) & (T)~(T)0/15*3);      // temp
-            v = (v + (v >> 4)) & (T)~(T)0/255*15;                      // temp
-            dist += (T)(v * ((T)~(T)0/255)) >> (sizeof(T) - 1) * CHAR_BIT; // count            
-#endif             
-        }
-        return dist;
-    }    
-    
-#endif 
-
 } //namespace PLVS2
 
@@ -0,0 +1,311 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "LocalMapProjector.h"
+
+#include <cmath>
+
+#include "Frame.h"
+#include "MapPoint.h"
+#include "MapLine.h"
+#include "GeometricCamera.h"
+
+
+namespace PLVS2
+{
+
+namespace
+{
+
+// relative tolerance of the first culling stage (it must accept a superset of the features accepted by the exact tests)
+const float kRelTol = 1e-4f;
+// pixel tolerance of the first culling stage on the image bounds
+const float kPixelTol = 1.0f;
+
+/// Parameters of the first culling stage
+struct CullingParams
+{
+    float R[9];          // Rcw (row-major)
+    float t[3];          // tcw
+    float O[3];          // camera center
+    float fx, fy, cx, cy;
+    float minX, maxX, minY, maxY;
+    float cosLimit;
+};
+
+void SetCullingParams(const Frame& F, const float viewingCosLimit, CullingParams& params)
+{
+    const Eigen::Matrix3f Rcw = F.GetRcw();
+    const Eigen::Vector3f tcw = F.GetPose().translation();
+    const Eigen::Vector3f Ow = F.GetOw();
+    for(int r=0; r<3; r++)
+    {
+        for(int c=0; c<3; c++)
+            params.R[3*r+c] = Rcw(r,c);
+        params.t[r] = tcw(r);
+        params.O[r] = Ow(r);
+    }
+    params.fx = Frame::fx; params.fy = Frame::fy;
+    params.cx = Frame::cx; params.cy = Frame::cy;
+    params.minX = Frame::mnMinX - kPixelTol; params.maxX = Frame::mnMaxX + kPixelTol;
+    params.minY = Frame::mnMinY - kPixelTol; params.maxY = Frame::mnMaxY + kPixelTol;
+    params.cosLimit = viewingCosLimit;
+}
+
+/// First culling stage on flat arrays: positive depth and image bounds of the projection of (x,y,z), scale invariance
+/// region [minDistScale*minDist, maxDistScale*maxDist] and viewing angle.
+/// Distances and cosines are compared squared (no square roots) with a small tolerance: the loop is branch-free and
+/// the compiler vectorizes it.
+void CullKernel(const CullingParams& p,
+                const float* __restrict x, const float* __restrict y, const float* __restrict z,
+                const float* __restrict nx, const float* __restrict ny, const float* __restrict nz,
+                const float* __restrict minDist, const float* __restrict maxDist,
+                const float minDistScale, const float maxDistScale,
+                const size_t n, uint8_t* __restrict mask)
+{
+    const float cosLimit2 = p.cosLimit*p.cosLimit;
+    const bool bPositiveCosLimit = p.cosLimit >= 0.f;
+    const bool bNegativeCosLimit = !bPositiveCosLimit;
+    for(size_t i=0; i<n; i++)
+    {
+        const float xc = p.R[0]*x[i] + p.R[1]*y[i] + p.R[2]*z[i] + p.t[0];
+        const float yc = p.R[3]*x[i] + p.R[4]*y[i] + p.R[5]*z[i] + p.t[1];
+        const float zc = p.R[6]*x[i] + p.R[7]*y[i] + p.R[8]*z[i] + p.t[2];
+        const float invz = 1.0f/zc;
+        const float u = p.fx*xc*invz + p.cx;
+        const float v = p.fy*yc*invz + p.cy;
+
+        const float pox = x[i] - p.O[0];
+        const float poy = y[i] - p.O[1];
+        const float poz = z[i] - p.O[2];
+        const float dist2 = pox*pox + poy*poy + poz*poz;
+        const float dMin = minDistScale*minDist[i];
+        const float dMax = maxDistScale*maxDist[i];
+
+        // viewCos = dot/dist >= cosLimit
+        const float dot = pox*nx[i] + poy*ny[i] + poz*nz[i];
+        const float dot2 = dot*dot;
+        const bool bCos = (bPositiveCosLimit & (dot >= 0.f) & (dot2 >= cosLimit2*dist2*(1.f-kRelTol))) |
+                          (bNegativeCosLimit & ((dot >= 0.f) | (dot2 <= cosLimit2*dist2*(1.f+kRelTol))));
+
+        mask[i] = (zc >= 0.f) & (u >= p.minX) & (u <= p.maxX) & (v >= p.minY) & (v <= p.maxY) &
+                  (dist2 >= dMin*dMin*(1.f-kRelTol)) & (dist2 <= dMax*dMax*(1.f+kRelTol)) & bCos;
+    }
+}
+
+} // namespace
+
+
+void LocalMapProjector::SetMapPoints(const std::vector<MapPointPtr>& vpMapPoints)
+{
+    const size_t n = vpMapPoints.size();
+    px_.resize(n); py_.resize(n); pz_.resize(n);
+    pnx_.resize(n); pny_.resize(n); pnz_.resize(n);
+    pMinDist_.resize(n); pMaxDist_.resize(n);
+
+    Eigen::Vector3f P, Pn;
+    for(size_t i=0; i<n; i++)
+    {
+        vpMapPoints[i]->GetProjectionData(P, Pn, pMinDist_[i], pMaxDist_[i]);
+        px_[i] = P(0); py_[i] = P(1); pz_[i] = P(2);
+        pnx_[i] = Pn(0); pny_[i] = Pn(1); pnz_[i] = Pn(2);
+    }
+}
+
+void LocalMapProjector::SetMapLines(const std::vector<MapLinePtr>& vpMapLines)
+{
+    const size_t n = vpMapLines.size();
+    lsx_.resize(n); lsy_.resize(n); lsz_.resize(n);
+    lex_.resize(n); ley_.resize(n); lez_.resize(n);
+    lmx_.resize(n); lmy_.resize(n); lmz_.resize(n);
+    lnx_.resize(n); lny_.resize(n); lnz_.resize(n);
+    lMaxDist_.resize(n);
+
+    Eigen::Vector3f PS, PE, Pn;
+    for(size_t i=0; i<n; i++)
+    {
+        vpMapLines[i]->GetProjectionData(PS, PE, Pn, lMaxDist_[i]);
+        lsx_[i] = PS(0); lsy_[i] = PS(1); lsz_[i] = PS(2);
+        lex_[i] = PE(0); ley_[i] = PE(1); lez_[i] = PE(2);
+        lmx_[i] = 0.5f*(PS(0)+PE(0)); lmy_[i] = 0.5f*(PS(1)+PE(1)); lmz_[i] = 0.5f*(PS(2)+PE(2));
+        lnx_[i] = Pn(0); lny_[i] = Pn(1); lnz_[i] = Pn(2);
+    }
+}
+
+bool LocalMapProjector::IsSupported(const Frame& F)
+{
+    return F.Nleft == -1 && F.mpCamera && F.mpCamera->GetType() == GeometricCamera::CAM_PINHOLE;
+}
+
+bool LocalMapProjector::IsSupportedLines(const Frame& F)
+{
+    // Frame::isInFrustum() projects the lines with the pinhole model in this case
+    return F.NlinesLeft == -1;
+}
+
+int LocalMapProjector::ProjectMapPoints(const Frame& F, const float viewingCosLimit, std::vector<uint8_t>& vbInView, std::vector<MapPointProjection>& vProjections)
+{
+    const size_t n = px_.size();
+    vbInView.resize(n);
+    vProjections.resize(n);
+
+    CullingParams params;
+    SetCullingParams(F, viewingCosLimit, params);
+    CullKernel(params, px_.data(), py_.data(), pz_.data(), pnx_.data(), pny_.data(), pnz_.data(), pMinDist_.data(), pMaxDist_.data(),
+               0.8f, 1.2f, n, vbInView.data());
+
+    // exact tests (as in Frame::isInFrustum()) and tracking data of the points that passed the first stage
+    const Eigen::Matrix3f Rcw = F.GetRcw();
+    const Eigen::Vector3f tcw = F.GetPose().translation();
+    const Eigen::Vector3f Ow = F.GetOw();
+
+    int nInView = 0;
+    for(size_t i=0; i<n; i++)
+    {
+        if(!vbInView[i])
+            continue;
+        vbInView[i] = 0;
+
+        const Eigen::Vector3f P(px_[i], py_[i], pz_[i]);
+        const Eigen::Vector3f Pc = Rcw * P + tcw;
+        const float Pc_dist = Pc.norm();
+
+        const float &PcZ = Pc(2);
+        const float invz = 1.0f/PcZ;
+        if(PcZ<0.0f)
+            continue;
+
+        const float u = Frame::fx * Pc(0) / PcZ + Frame::cx;
+        const float v = Frame::fy * Pc(1) / PcZ + Frame::cy;
+        if(u<Frame::mnMinX || u>Frame::mnMaxX)
+            continue;
+        if(v<Frame::mnMinY || v>Frame::mnMaxY)
+            continue;
+
+        const Eigen::Vector3f PO = P - Ow;
+        const float dist = PO.norm();
+        if(dist<0.8f*pMinDist_[i] || dist>1.2f*pMaxDist_[i])
+            continue;
+
+        const Eigen::Vector3f Pn(pnx_[i], pny_[i], pnz_[i]);
+        const float viewCos = PO.dot(Pn)/dist;
+        if(viewCos<viewingCosLimit)
+            continue;
+
+        // predict scale in the image (as in MapPoint::PredictScale())
+        int nScale = ceil(log(pMaxDist_[i]/dist)/F.mfLogScaleFactor);
+        if(nScale<0)
+            nScale = 0;
+        else if(nScale>=F.mnScaleLevels)
+            nScale = F.mnScaleLevels-1;
+
+        MapPointProjection& proj = vProjections[i];
+        proj.u = u;
+        proj.v = v;
+        proj.uR = u - F.mbf*invz;
+        proj.depth = Pc_dist;
+        proj.viewCos = viewCos;
+        proj.level = nScale;
+
+        vbInView[i] = 1;
+        nInView++;
+    }
+    return nInView;
+}
+
+int LocalMapProjector::ProjectMapLines(const Frame& F, const float viewingCosLimit, std::vector<uint8_t>& vbInView, std::vector<MapLineProjection>& vProjections)
+{
+    const size_t n = lsx_.size();
+    vbInView.resize(n);
+    vProjections.resize(n);
+
+    CullingParams params;
+    SetCullingParams(F, viewingCosLimit, params);
+    // the first stage checks the middle points; the scale invariance region of a line is [0.8, 1.2]*mfMaxDistance (see MapLine::GetMinDistanceInvariance())
+    CullKernel(params, lmx_.data(), lmy_.data(), lmz_.data(), lnx_.data(), lny_.data(), lnz_.data(), lMaxDist_.data(), lMaxDist_.data(),
+               0.8f, 1.2f, n, vbInView.data());
+
+    // exact tests (as in Frame::isInFrustum()) and tracking data of the lines that passed the first stage
+    const Eigen::Matrix3f Rcw = F.GetRcw();
+    const Eigen::Vector3f tcw = F.GetPose().translation();
+    const Eigen::Vector3f Ow = F.GetOw();
+
+    int nInView = 0;
+    for(size_t i=0; i<n; i++)
+    {
+        if(!vbInView[i])
+            continue;
+        vbInView[i] = 0;
+
+        const Eigen::Vector3f p3DStart(lsx_[i], lsy_[i], lsz_[i]);
+        const Eigen::Vector3f p3DEnd(lex_[i], ley_[i], lez_[i]);
+        const Eigen::Vector3f p3DMiddle = 0.5*(p3DStart+p3DEnd);
+
+        const Eigen::Vector3f p3DMc = Rcw*p3DMiddle+tcw;
+        const float &pMcZ = p3DMc(2);
+        if(pMcZ<0.0f)
+            continue;
+
+        const float invMz = 1.0f/pMcZ;
+        const float u = Frame::fx*p3DMc(0)*invMz+Frame::cx;
+        const float v = Frame::fy*p3DMc(1)*invMz+Frame::cy;
+        if(u<Frame::mnMinX || u>Frame::mnMaxX)
+            continue;
+        if(v<Frame::mnMinY || v>Frame::mnMaxY)
+            continue;
+
+        const Eigen::Vector3f PO = p3DMiddle-Ow;
+        const float dist = PO.norm();
+        if(dist<0.8f*lMaxDist_[i] || dist>1.2f*lMaxDist_[i])
+            continue;
+
+        const Eigen::Vector3f Pn(lnx_[i], lny_[i], lnz_[i]);
+        const float viewCos = PO.dot(Pn)/dist;
+        if(viewCos<viewingCosLimit)
+            continue;
+
+        const Eigen::Vector3f p3DSc = Rcw*p3DStart+tcw;
+        const Eigen::Vector3f p3DEc = Rcw*p3DEnd+tcw;
+        const float invSz = 1.0f/p3DSc(2);
+        const float invEz = 1.0f/p3DEc(2);
+
+        // predict scale in the image (as in MapLine::PredictScale())
+        int nScale = ceil(log(lMaxDist_[i]/dist)/F.mfLineLogScaleFactor);
+        if(nScale<0)
+            nScale = 0;
+        else if(nScale>=F.mnLineScaleLevels)
+            nScale = F.mnLineScaleLevels-1;
+
+        MapLineProjection& proj = vProjections[i];
+        proj.uS = Frame::fx*p3DSc(0)*invSz+Frame::cx;
+        proj.vS = Frame::fy*p3DSc(1)*invSz+Frame::cy;
+        proj.depthS = p3DSc(2);
+        proj.uE = Frame::fx*p3DEc(0)*invEz+Frame::cx;
+        proj.vE = Frame::fy*p3DEc(1)*invEz+Frame::cy;
+        proj.depthE = p3DEc(2);
+        proj.viewCos = viewCos;
+        proj.level = nScale;
+
+        vbInView[i] = 1;
+        nInView++;
+    }
+    return nInView;
+}
+
+} // namespace PLVS2
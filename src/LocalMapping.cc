@@ -47,6 +47,7 @@
 #include "MapObject.h"
 #include "LineMatcher.h"
 #include "Utils.h"
+#include "LatencyTrace.h"
 
 #include<mutex>
 #include<chrono>
@@ -58,11 +59,15 @@
 namespace PLVS2
 {
 
+bool LocalMapping::skUseAsyncScaleRefinement = true; 
+
 LocalMapping::LocalMapping(System* pSys, Atlas *pAtlas, const float bMonocular, bool bInertial, const string &_strSeqName):
     mpSystem(pSys), mbMonocular(bMonocular), mbInertial(bInertial), mbResetRequested(false), mbResetRequestedActiveMap(false), mbFinishRequested(false), mbFinished(true), mpAtlas(pAtlas), bInitializing(false),
     mbAbortBA(false), mbStopped(false), mbStopRequested(false), mbNotStop(false), mbAcceptKeyFrames(true),
     mIdxInit(0), mScale(1.0), mInitSect(0), mbNotBA1(true), mbNotBA2(true), 
-    mIdxIteration(0), infoInertial(Eigen::MatrixXd::Zero(9,9))
+    mIdxIteration(0), infoInertial(Eigen::MatrixXd::Zero(9,9)),
+    mbScaleRefinementDone(false), mpScaleRefinementMap(NULL), mnScaleRefinementBigChangeIdx(0),
+    mRwgRefinement(Eigen::Matrix3d::Identity()), mScaleRefinement(1.0)
 {
     mnMatchesInliers = 0;
 
@@ -100,8 +105,10 @@ void LocalMapping::Run()
         SetAcceptKeyFrames(false);
 
         // Check if there are keyframes in the queue
+        bool bProcessedKeyFrame = false;
         if(CheckNewKeyFrames() && !mbBadImu)
         {
+            bProcessedKeyFrame = true;
 #ifdef REGISTER_TIMES
             double timeLBA_ms = 0;
             double timeKFCulling_ms = 0;
@@ -300,12 +307,16 @@ void LocalMapping::Run()
             // Safe area to stop
             while(isStopped() && !CheckFinish())
             {
-                usleep(3000);
+                mWakeUpEvent.WaitFor();
             }
             if(CheckFinish())
                 break;
         }
 
+        // Apply the result of the background scale refinement when no keyframe is waiting in the queue
+        if(!CheckNewKeyFrames())
+            ApplyScaleRefinement();
+
         ResetIfRequested();
 
         // Tracking will see that Local Mapping is free
@@ -314,17 +325,26 @@ void LocalMapping::Run()
         if(CheckFinish())
             break;
 
-        usleep(3000);
+        // Sleep until a new keyframe or a request comes in (queued keyframes are not processed with a bad IMU: 
+        // wait for the reset instead of spinning)
+        if(!bProcessedKeyFrame || !CheckNewKeyFrames())
+            mWakeUpEvent.WaitFor();
     }
 
+    JoinScaleRefinement();
+
     SetFinish();
 }
 
 void LocalMapping::InsertKeyFrame(KeyFramePtr pKF)
 {
-    unique_lock<mutex> lock(mMutexNewKFs);
-    mlNewKeyFrames.push_back(pKF);
-    mbAbortBA=true;
+    {
+        unique_lock<mutex> lock(mMutexNewKFs);
+        pKF->mTimeQueued = LatencyTrace::Now();
+        mlNewKeyFrames.push_back(pKF);
+        mbAbortBA=true;
+    }
+    mWakeUpEvent.Notify();
 }
 
 
@@ -348,6 +368,7 @@ void LocalMapping::ProcessNewKeyFrame()
         mpCurrentKeyFrame = mlNewKeyFrames.front();
         mlNewKeyFrames.pop_front();
     }
+    LatencyTrace::GetInstance().Add(LatencyTrace::kLocalMapping, LatencyTrace::Now() - mpCurrentKeyFrame->mTimeQueued);
 
     // Compute Bags of Words structures
     mpCurrentKeyFrame->ComputeBoW();
@@ -1559,23 +1580,27 @@ void LocalMapping::ComputeF12_(KeyFramePtr& pKF1, KeyFramePtr& pKF2, cv::Matx33f
 
 void LocalMapping::RequestStop()
 {
-    unique_lock<mutex> lock(mMutexStop);
-    mbStopRequested = true;
-    unique_lock<mutex> lock2(mMutexNewKFs);
-    mbAbortBA = true;
+    {
+        unique_lock<mutex> lock(mMutexStop);
+        mbStopRequested = true;
+        unique_lock<mutex> lock2(mMutexNewKFs);
+        mbAbortBA = true;
+    }
+    mWakeUpEvent.Notify();
 }
 
 bool LocalMapping::Stop()
 {
-    unique_lock<mutex> lock(mMutexStop);
-    if(mbStopRequested && !mbNotStop)
     {
+        unique_lock<mutex> lock(mMutexStop);
+        if(!mbStopRequested || mbNotStop)
+            return false;
+
         mbStopped = true;
         cout << "Local Mapping STOP" << endl;
-        return true;
     }
-
-    return false;
+    mStateChangedEvent.Notify();
+    return true;
 }
 
 bool LocalMapping::isStopped()
@@ -1584,6 +1609,11 @@ bool LocalMapping::isStopped()
     return mbStopped;
 }
 
+void LocalMapping::WaitUntilStopped()
+{
+    mStateChangedEvent.WaitUntil([this]{ return isStopped(); });
+}
+
 bool LocalMapping::stopRequested()
 {
     unique_lock<mutex> lock(mMutexStop);
@@ -1592,18 +1622,21 @@ bool LocalMapping::stopRequested()
 
 void LocalMapping::Release()
 {
-    unique_lock<mutex> lock(mMutexStop);
-    unique_lock<mutex> lock2(mMutexFinish);
-    if(mbFinished)
-        return;
-    mbStopped = false;
-    mbStopRequested = false;
-    for(list<KeyFramePtr>::iterator lit = mlNewKeyFrames.begin(), lend=mlNewKeyFrames.end(); lit!=lend; lit++)
     {
-        //delete *lit;
-        DeletePtr(*lit);
+        unique_lock<mutex> lock(mMutexStop);
+        unique_lock<mutex> lock2(mMutexFinish);
+        if(mbFinished)
+            return;
+        mbStopped = false;
+        mbStopRequested = false;
+        for(list<KeyFramePtr>::iterator lit = mlNewKeyFrames.begin(), lend=mlNewKeyFrames.end(); lit!=lend; lit++)
+        {
+            //delete *lit;
+            DeletePtr(*lit);
+        }
+        mlNewKeyFrames.clear();
     }
-    mlNewKeyFrames.clear();
+    mWakeUpEvent.Notify();
 
     cout << "Local Mapping RELEASE" << endl;
 }
@@ -1622,12 +1655,16 @@ void LocalMapping::SetAcceptKeyFrames(bool flag)
 
 bool LocalMapping::SetNotStop(bool flag)
 {
-    unique_lock<mutex> lock(mMutexStop);
+    {
+        unique_lock<mutex> lock(mMutexStop);
 
-    if(flag && mbStopped)
-        return false;
+        if(flag && mbStopped)
+            return false;
 
-    mbNotStop = flag;
+        mbNotStop = flag;
+    }
+    if(!flag)
+        mWakeUpEvent.Notify(); // a pending stop request can now be served
 
     return true;
 }
@@ -1917,17 +1954,10 @@ void LocalMapping::RequestReset()
         cout << "LM: Map reset recieved" << endl;
         mbResetRequested = true;
     }
+    mWakeUpEvent.Notify();
     cout << "LM: Map reset, waiting..." << endl;
 
-    while(1)
-    {
-        {
-            unique_lock<mutex> lock2(mMutexReset);
-            if(!mbResetRequested)
-                break;
-        }
-        usleep(3000);
-    }
+    mStateChangedEvent.WaitUntil([this]{ unique_lock<mutex> lock2(mMutexReset); return !mbResetRequested; });
     cout << "LM: Map reset, Done!!!" << endl;
 }
 
@@ -1939,17 +1969,10 @@ void LocalMapping::RequestResetActiveMap(Map* pMap)
         mbResetRequestedActiveMap = true;
         mpMapToReset = pMap;
     }
+    mWakeUpEvent.Notify();
     cout << "LM: Active map reset, waiting..." << endl;
 
-    while(1)
-    {
-        {
-            unique_lock<mutex> lock2(mMutexReset);
-            if(!mbResetRequestedActiveMap)
-                break;
-        }
-        usleep(3000);
-    }
+    mStateChangedEvent.WaitUntil([this]{ unique_lock<mutex> lock2(mMutexReset); return !mbResetRequestedActiveMap; });
     cout << "LM: Active map reset, Done!!!" << endl;
 }
 
@@ -1958,6 +1981,9 @@ void LocalMapping::ResetIfRequested()
     bool executed_reset = false;
     {
         unique_lock<mutex> lock(mMutexReset);
+        if(mbResetRequested || mbResetRequestedActiveMap)
+            JoinScaleRefinement();
+
         if(mbResetRequested)
         {
             executed_reset = true;
@@ -1999,14 +2025,20 @@ void LocalMapping::ResetIfRequested()
         }
     }
     if(executed_reset)
+    {
+        mStateChangedEvent.Notify();
         cout << "LM: Reset free the mutex" << endl;
+    }
 
 }
 
 void LocalMapping::RequestFinish()
 {
-    unique_lock<mutex> lock(mMutexFinish);
-    mbFinishRequested = true;
+    {
+        unique_lock<mutex> lock(mMutexFinish);
+        mbFinishRequested = true;
+    }
+    mWakeUpEvent.Notify();
 }
 
 bool LocalMapping::CheckFinish()
@@ -2017,10 +2049,13 @@ bool LocalMapping::CheckFinish()
 
 void LocalMapping::SetFinish()
 {
-    unique_lock<mutex> lock(mMutexFinish);
-    mbFinished = true;    
-    unique_lock<mutex> lock2(mMutexStop);
-    mbStopped = true;
+    {
+        unique_lock<mutex> lock(mMutexFinish);
+        mbFinished = true;    
+        unique_lock<mutex> lock2(mMutexStop);
+        mbStopped = true;
+    }
+    mStateChangedEvent.Notify();
 }
 
 bool LocalMapping::isFinished()
@@ -2385,6 +2420,34 @@ void LocalMapping::ScaleRefinement()
     if (mbResetRequested)
         return;
 
+    if(skUseAsyncScaleRefinement)
+    {
+        // The optimization only estimates gravity direction and scale on a copy of the keyframe states (poses, velocities, 
+        // biases and cloned preintegrations) taken here: it runs in background while mapping goes on (culling keyframes and 
+        // merging their preintegrations), and ApplyScaleRefinement() rescales the map when it is done
+        if(mpThreadScaleRefinement)
+            return; // the previous refinement is still running
+
+        Map* pMap = mpAtlas->GetCurrentMap();
+        std::shared_ptr<Optimizer::InertialStateSnapshot> pSnapshot = std::make_shared<Optimizer::InertialStateSnapshot>();
+        {
+            unique_lock<mutex> lock(pMap->mMutexMapUpdate);
+            Optimizer::TakeInertialStateSnapshot(pMap, *pSnapshot);
+        }
+        mpScaleRefinementMap = pMap;
+        mnScaleRefinementBigChangeIdx = pMap->GetLastBigChangeIdx();
+        mbScaleRefinementDone = false;
+        mpThreadScaleRefinement.reset(new std::thread([this, pSnapshot]()
+        {
+            mRwgRefinement = Eigen::Matrix3d::Identity();
+            mScaleRefinement = 1.0;
+            Optimizer::InertialOptimization(*pSnapshot, mRwgRefinement, mScaleRefinement);
+            mbScaleRefinementDone = true;
+            mWakeUpEvent.Notify();
+        }));
+        return;
+    }
+
     // Retrieve all keyframes in temporal order
     list<KeyFramePtr> lpKF;
     KeyFramePtr pKF = mpCurrentKeyFrame;
@@ -2446,6 +2509,61 @@ void LocalMapping::ScaleRefinement()
     return;
 }
 
+void LocalMapping::ApplyScaleRefinement()
+{
+    if(!mpThreadScaleRefinement || !mbScaleRefinementDone)
+        return;
+
+    mpThreadScaleRefinement->join();
+    mpThreadScaleRefinement.reset();
+
+    // Discard the solution if the map was switched or corrected (loop closure, merge) while optimizing
+    Map* pMap = mpAtlas->GetCurrentMap();
+    if(pMap!=mpScaleRefinementMap || pMap->GetLastBigChangeIdx()!=mnScaleRefinementBigChangeIdx)
+    {
+        Verbose::PrintMess("Scale refinement discarded: the map changed", Verbose::VERBOSITY_NORMAL);
+        return;
+    }
+
+    if (mScaleRefinement<1e-1) // 1e-1
+    {
+        cout << "scale too small" << endl;
+        return;
+    }
+
+    mRwg = mRwgRefinement;
+    mScale = mScaleRefinement;
+
+    unique_lock<mutex> lock(pMap->mMutexMapUpdate);
+    if ((fabs(mScale-1.f)>0.002)||!mbMonocular)
+    {
+        Sophus::SE3f Tgw(mRwg.cast<float>().transpose(),Eigen::Vector3f::Zero());
+        pMap->ApplyScaledRotation(Tgw,mScale,true);
+        mpTracker->UpdateFrameIMU(mScale,mpCurrentKeyFrame->GetImuBias(),mpCurrentKeyFrame);
+
+        // The keyframes still in the queue are not in the map and were not transformed
+        unique_lock<mutex> lockNewKFs(mMutexNewKFs);
+        for(list<KeyFramePtr>::iterator lit = mlNewKeyFrames.begin(), lend=mlNewKeyFrames.end(); lit!=lend; lit++)
+        {
+            (*lit)->SetBadFlag();
+            delete *lit;
+        }
+        mlNewKeyFrames.clear();
+    }
+
+    // To perform pose-inertial opt w.r.t. last keyframe
+    pMap->IncreaseChangeIndex();
+}
+
+void LocalMapping::JoinScaleRefinement()
+{
+    if(!mpThreadScaleRefinement)
+        return;
+
+    mpThreadScaleRefinement->join();
+    mpThreadScaleRefinement.reset();
+}
+
 
 
 bool LocalMapping::IsInitializing()
@@ -49,6 +49,7 @@
 
 #include "LineMatcher.h"
 #include "MapObject.h"
+#include "LatencyTrace.h"
 
 #include<mutex>
 #include<thread>
@@ -63,6 +64,12 @@
 namespace PLVS2
 {
 
+bool LoopClosing::skUseIncrementalGBA = true; 
+float LoopClosing::skMaxAffectedKeyFramesRatio = 0.5; 
+int LoopClosing::skNumVerificationThreads = 4; 
+const float LoopClosing::kMinGBAKeyFrameCorrection = 0.005; // 0.5% of the scene median depth (scale independent, e.g. 1 cm at 2 m)
+const float LoopClosing::kMinGBAKeyFrameRotCorrection = 0.5*M_PI/180.0; // [rad] 
+
 LoopClosing::LoopClosing(Atlas *pAtlas, KeyFrameDatabase *pDB, ORBVocabulary *pVoc, const bool bFixScale, const bool bActiveLC):
     mbResetRequested(false), mbResetActiveMapRequested(false), mbFinishRequested(false), mbFinished(true), mpAtlas(pAtlas),
     mpKeyFrameDB(pDB), mpORBVocabulary(pVoc), mpMatchedKF(NULL), mLastLoopKFid(0), mbRunningGBA(false), mbFinishedGBA(true),
@@ -72,12 +79,21 @@ LoopClosing::LoopClosing(Atlas *pAtlas, KeyFrameDatabase *pDB, ORBVocabulary *pV
     mnCovisibilityConsistencyTh = 3;
     mpLastCurrentKF = static_cast<KeyFramePtr>(NULL);
 
+    if(skNumVerificationThreads > 0)
+        mpVerificationPool.reset(new TaskPool(skNumVerificationThreads));
+
 #ifdef REGISTER_TIMES
 
     vdDataQuery_ms.clear();
     vdEstSim3_ms.clear();
     vdPRTotal_ms.clear();
 
+    vdBoWCandMatching_ms.clear();
+    vdBoWCandSim3_ms.clear();
+    vdBoWCandProjection_ms.clear();
+    vdBoWCandOptimization_ms.clear();
+    vdBoWCandCovisibility_ms.clear();
+
     vdMergeMaps_ms.clear();
     vdWeldingBA_ms.clear();
     vdMergeOptEss_ms.clear();
@@ -355,7 +371,9 @@ void LoopClosing::Run()
             break;
         }
 
-        usleep(5000);
+        // Sleep until a new keyframe or a request comes in 
+        if(!CheckNewKeyFrames())
+            mWakeUpEvent.WaitFor();
     }
 
     SetFinish();
@@ -363,9 +381,14 @@ void LoopClosing::Run()
 
 void LoopClosing::InsertKeyFrame(KeyFramePtr& pKF)
 {
-    unique_lock<mutex> lock(mMutexLoopQueue);
-    if(pKF->mnId!=0)
+    if(pKF->mnId==0)
+        return;
+    {
+        unique_lock<mutex> lock(mMutexLoopQueue);
+        pKF->mTimeQueued = LatencyTrace::Now();
         mlpLoopKeyFrameQueue.push_back(pKF);
+    }
+    mWakeUpEvent.Notify();
 }
 
 bool LoopClosing::CheckNewKeyFrames()
@@ -391,6 +414,7 @@ bool LoopClosing::NewDetectCommonRegions()
 
         mpLastMap = mpCurrentKF->GetMap();
     }
+    LatencyTrace::GetInstance().Add(LatencyTrace::kLoopClosing, LatencyTrace::Now() - mpCurrentKF->mTimeQueued);
 
     {
         unique_lock< mutex > lock(mpAtlas->mMutexLoopClosing);
@@ -583,19 +607,34 @@ bool LoopClosing::NewDetectCommonRegions()
         std::chrono::steady_clock::time_point time_StartEstSim3_2 = std::chrono::steady_clock::now();
 #endif
     // Check the BoW candidates if the geometric candidate list is empty
-    //Loop candidates
-    if(!bLoopDetectedInKF && !vpLoopBowCand.empty())
+    // Loop and merge candidates are verified concurrently: a confirmed merge cancels the loop detection, since the merge
+    // has the precedence and the loop detection is then reset in Run()
+    std::atomic<bool> bCancelLoopDetection(false);
     {
-        mbLoopDetected = DetectCommonRegionsFromBoW(vpLoopBowCand, mpLoopMatchedKF, mpLoopLastCurrentKF, mg2oLoopSlw, mnLoopNumCoincidences, mvpLoopMPs, mvpLoopMatchedMPs,
-                                                                                                                                             mvpLoopMLs, mvpLoopMatchedMLs,
-                                                                                                                                             mvpLoopMOs, mvpLoopMatchedMOs);
-    }
-    // Merge candidates
-    if(!bMergeDetectedInKF && !vpMergeBowCand.empty())
-    {
-        mbMergeDetected = DetectCommonRegionsFromBoW(vpMergeBowCand, mpMergeMatchedKF, mpMergeLastCurrentKF, mg2oMergeSlw, mnMergeNumCoincidences, mvpMergeMPs, mvpMergeMatchedMPs,
-                                                                                                                                                   mvpMergeMLs, mvpMergeMatchedMLs,
-                                                                                                                                                   mvpMergeMOs, mvpMergeMatchedMOs);
+        TaskPool::TaskGroup detections(mpVerificationPool.get());
+        //Loop candidates
+        if(!bLoopDetectedInKF && !vpLoopBowCand.empty())
+        {
+            detections.Run([&]()
+            {
+                mbLoopDetected = DetectCommonRegionsFromBoW(vpLoopBowCand, mpLoopMatchedKF, mpLoopLastCurrentKF, mg2oLoopSlw, mnLoopNumCoincidences, mvpLoopMPs, mvpLoopMatchedMPs,
+                                                                                                                                                     mvpLoopMLs, mvpLoopMatchedMLs,
+                                                                                                                                                     mvpLoopMOs, mvpLoopMatchedMOs,
+                                                                                                                                                     &bCancelLoopDetection);
+            });
+        }
+        // Merge candidates
+        if(!bMergeDetectedInKF && !vpMergeBowCand.empty())
+        {
+            detections.Run([&]()
+            {
+                mbMergeDetected = DetectCommonRegionsFromBoW(vpMergeBowCand, mpMergeMatchedKF, mpMergeLastCurrentKF, mg2oMergeSlw, mnMergeNumCoincidences, mvpMergeMPs, mvpMergeMatchedMPs,
+                                                                                                                                                           mvpMergeMLs, mvpMergeMatchedMLs,
+                                                                                                                                                           mvpMergeMOs, mvpMergeMatchedMOs);
+                if(mbMergeDetected)
+                    bCancelLoopDetection = true;
+            });
+        }
     }
 
 #ifdef REGISTER_TIMES
@@ -670,23 +709,26 @@ bool LoopClosing::DetectAndReffineSim3FromLastKF(KeyFramePtr pCurrentKF, KeyFram
     return false;
 }
 
-bool LoopClosing::DetectCommonRegionsFromBoW(std::vector<KeyFramePtr> &vpBowCand, KeyFramePtr &pMatchedKF2, KeyFramePtr &pLastCurrentKF, g2o::Sim3 &g2oScw,
-                                             int &nNumCoincidences, std::vector<MapPointPtr> &vpMPs, std::vector<MapPointPtr> &vpMatchedMPs,
-                                             std::vector<MapLinePtr> &vpMLs, std::vector<MapLinePtr> &vpMatchedMLs,
-                                             std::vector<MapObjectPtr> &vpMOs, std::vector<MapObjectPtr> &vpMatchedMOs)
+void LoopClosing::VerifyBoWCandidate(KeyFramePtr pKFi, const std::set<KeyFramePtr> &spConnectedKeyFrames, const std::atomic<bool>* pbCancel,
+                                     BoWCandidate &candidate)
 {
-    /// < TODO: add line matching here and use it in the Sim3Solver  ?  
-    
     int nBoWMatches = 20;
     int nBoWInliers = 15;
     int nSim3Inliers = 20;
     int nProjMatches = 50;
     int nProjOptMatches = 80;
 
-    set<KeyFramePtr> spConnectedKeyFrames = mpCurrentKF->GetConnectedKeyFrames();
-
     int nNumCovisibles = 10;
 
+    candidate.numProjOptFeatureMatches = 0;
+
+    if(!pKFi || pKFi->isBad())
+        return;
+
+#ifdef REGISTER_TIMES
+    std::chrono::steady_clock::time_point time_StartStage = std::chrono::steady_clock::now();
+#endif
+
     ORBmatcher matcherBoW(0.9, true);
     ORBmatcher matcher(0.75, true);
 
@@ -696,420 +738,410 @@ bool LoopClosing::DetectCommonRegionsFromBoW(std::vector<KeyFramePtr> &vpBowCand
         pLineMatcher.reset( new LineMatcher(0.75) );
     }
 
-    // Varibles to select the best numbe
-    KeyFramePtr pBestMatchedKF;
-    int nBestMatchesReproj = 0;
-    int nBestNumCoindicendes = 0;
-    g2o::Sim3 g2oBestScw;
-    
-    std::vector<MapPointPtr> vpBestMapPoints;
-    std::vector<MapPointPtr> vpBestMatchedMapPoints;
-    
-    std::vector<MapLinePtr> vpBestMapLines;    
-    std::vector<MapLinePtr> vpBestMatchedMapLines;    
-    
-    std::vector<MapObjectPtr> vpBestMapObjects;    
-    std::vector<MapObjectPtr> vpBestMatchedMapObjects;        
+    // std::cout << "KF candidate: " << pKFi->mnId << std::endl;
+    // Current KF against KF with covisibles version
+    std::vector<KeyFramePtr> vpCovKFi = pKFi->GetBestCovisibilityKeyFrames(nNumCovisibles);
+    if(vpCovKFi.empty())
+    {
+        std::cout << "Covisible list empty" << std::endl;
+        vpCovKFi.push_back(pKFi);
+    }
+    else
+    {
+        vpCovKFi.push_back(vpCovKFi[0]);
+        vpCovKFi[0] = pKFi;
+    }
 
-    int numCandidates = vpBowCand.size();
-    vector<int> vnStage(numCandidates, 0);
-    vector<int> vnMatchesStage(numCandidates, 0);
 
-    int index = 0;
-    //Verbose::PrintMess("BoW candidates: There are " + to_string(vpBowCand.size()) + " possible candidates ", Verbose::VERBOSITY_DEBUG);
-    for(KeyFramePtr pKFi : vpBowCand)
+    bool bAbortByNearKF = false;
+    for(int j=0; j<vpCovKFi.size(); ++j)
     {
-        if(!pKFi || pKFi->isBad())
-            continue;
-
-        // std::cout << "KF candidate: " << pKFi->mnId << std::endl;
-        // Current KF against KF with covisibles version
-        std::vector<KeyFramePtr> vpCovKFi = pKFi->GetBestCovisibilityKeyFrames(nNumCovisibles);
-        if(vpCovKFi.empty())
+        if(spConnectedKeyFrames.find(vpCovKFi[j]) != spConnectedKeyFrames.end())
         {
-            std::cout << "Covisible list empty" << std::endl;
-            vpCovKFi.push_back(pKFi);
+            bAbortByNearKF = true;
+            break;
         }
-        else
+    }
+    if(bAbortByNearKF)
+    {
+        //std::cout << "Check BoW aborted because is close to the matched one " << std::endl;
+        return;
+    }
+    //std::cout << "Check BoW continue because is far to the matched one " << std::endl;
+
+
+    std::vector<std::vector<MapPointPtr> > vvpMatchedMPs;
+    vvpMatchedMPs.resize(vpCovKFi.size());
+    std::set<MapPointPtr> spMatchedMPi;
+    int numBoWMatches = 0;
+
+    KeyFramePtr pMostBoWMatchesKF = pKFi;
+    int nMostBoWNumMatches = 0;
+
+    std::vector<MapPointPtr> vpMatchedPoints = std::vector<MapPointPtr>(mpCurrentKF->GetMapPointMatches().size(), static_cast<MapPointPtr>(NULL));
+    std::vector<KeyFramePtr> vpKeyFrameMatchedMP = std::vector<KeyFramePtr>(mpCurrentKF->GetMapPointMatches().size(), static_cast<KeyFramePtr>(NULL));
+
+    int nIndexMostBoWMatchesKF=0;
+    for(int j=0; j<vpCovKFi.size(); ++j)
+    {
+        if(!vpCovKFi[j] || vpCovKFi[j]->isBad())
+            continue;
+
+        int num = matcherBoW.SearchByBoW(mpCurrentKF, vpCovKFi[j], vvpMatchedMPs[j]);
+        if (num > nMostBoWNumMatches)
         {
-            vpCovKFi.push_back(vpCovKFi[0]);
-            vpCovKFi[0] = pKFi;
+            nMostBoWNumMatches = num;
+            nIndexMostBoWMatchesKF = j;
         }
+    }
 
-
-        bool bAbortByNearKF = false;
-        for(int j=0; j<vpCovKFi.size(); ++j)
+    for(int j=0; j<vpCovKFi.size(); ++j)
+    {
+        for(int k=0; k < vvpMatchedMPs[j].size(); ++k)
         {
-            if(spConnectedKeyFrames.find(vpCovKFi[j]) != spConnectedKeyFrames.end())
+            MapPointPtr pMPi_j = vvpMatchedMPs[j][k];
+            if(!pMPi_j || pMPi_j->isBad())
+                continue;
+
+            if(spMatchedMPi.find(pMPi_j) == spMatchedMPi.end())
             {
-                bAbortByNearKF = true;
-                break;
+                spMatchedMPi.insert(pMPi_j);
+                numBoWMatches++;
+
+                vpMatchedPoints[k]= pMPi_j;
+                vpKeyFrameMatchedMP[k] = vpCovKFi[j];
             }
         }
-        if(bAbortByNearKF)
-        {
-            //std::cout << "Check BoW aborted because is close to the matched one " << std::endl;
-            continue;
-        }
-        //std::cout << "Check BoW continue because is far to the matched one " << std::endl;
+    }
+
+#ifdef REGISTER_TIMES
+    std::chrono::steady_clock::time_point time_EndMatching = std::chrono::steady_clock::now();
+    {
+        unique_lock<mutex> lock(mMutexBoWCandTimes);
+        vdBoWCandMatching_ms.push_back(std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndMatching - time_StartStage).count());
+    }
+    time_StartStage = time_EndMatching;
+#endif
+
+    //pMostBoWMatchesKF = vpCovKFi[pMostBoWMatchesKF];
+
+    if(numBoWMatches < nBoWMatches || (pbCancel && *pbCancel)) // TODO pick a good threshold
+        return;
+
+    // Geometric validation
+    bool bFixedScale = mbFixScale;
+    if(mpTracker->mSensor==System::IMU_MONOCULAR && !mpCurrentKF->GetMap()->GetIniertialBA2())
+        bFixedScale=false;
+
+    Sim3Solver solver = Sim3Solver(mpCurrentKF, pMostBoWMatchesKF, vpMatchedPoints, bFixedScale, vpKeyFrameMatchedMP);
+    solver.SetRansacParameters(0.99, nBoWInliers, 300); // at least 15 inliers
+    solver.SetRandomSeed(pKFi->mnId); // hypotheses independent of the scheduling of the verifications
+
+    bool bNoMore = false;
+    vector<bool> vbInliers;
+    int nInliers;
+    bool bConverge = false;
+    Eigen::Matrix4f mTcm;
+    while(!bConverge && !bNoMore)
+    {
+        if(pbCancel && *pbCancel)
+            return;
+        mTcm = solver.iterate(20,bNoMore, vbInliers, nInliers, bConverge);
+        //Verbose::PrintMess("BoW guess: Solver achieve " + to_string(nInliers) + " geometrical inliers among " + to_string(nBoWInliers) + " BoW matches", Verbose::VERBOSITY_DEBUG);
+    }
+
+#ifdef REGISTER_TIMES
+    std::chrono::steady_clock::time_point time_EndSim3 = std::chrono::steady_clock::now();
+    {
+        unique_lock<mutex> lock(mMutexBoWCandTimes);
+        vdBoWCandSim3_ms.push_back(std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndSim3 - time_StartStage).count());
+    }
+    time_StartStage = time_EndSim3;
+#endif
+
+    if(!bConverge)
+        return;
 
+    //std::cout << "Check BoW: SolverSim3 converged" << std::endl;
 
-        std::vector<std::vector<MapPointPtr> > vvpMatchedMPs;
-        vvpMatchedMPs.resize(vpCovKFi.size());
-        std::set<MapPointPtr> spMatchedMPi;
-        int numBoWMatches = 0;
+    //Verbose::PrintMess("BoW guess: Convergende with " + to_string(nInliers) + " geometrical inliers among " + to_string(nBoWInliers) + " BoW matches", Verbose::VERBOSITY_DEBUG);
+    // Match by reprojection
+    vpCovKFi.clear();
+    vpCovKFi = pMostBoWMatchesKF->GetBestCovisibilityKeyFrames(nNumCovisibles);
+    vpCovKFi.push_back(pMostBoWMatchesKF);
+    set<KeyFramePtr> spCheckKFs(vpCovKFi.begin(), vpCovKFi.end());
 
-        KeyFramePtr pMostBoWMatchesKF = pKFi;
-        int nMostBoWNumMatches = 0;
+    //std::cout << "There are " << vpCovKFi.size() <<" near KFs" << std::endl;
 
-        std::vector<MapPointPtr> vpMatchedPoints = std::vector<MapPointPtr>(mpCurrentKF->GetMapPointMatches().size(), static_cast<MapPointPtr>(NULL));
-        std::vector<KeyFramePtr> vpKeyFrameMatchedMP = std::vector<KeyFramePtr>(mpCurrentKF->GetMapPointMatches().size(), static_cast<KeyFramePtr>(NULL));
+    set<MapPointPtr> spMapPoints;
+    vector<MapPointPtr> vpMapPoints;
+    
+    set<MapLinePtr> spMapLines;
+    vector<MapLinePtr> vpMapLines;
 
-        int nIndexMostBoWMatchesKF=0;
-        for(int j=0; j<vpCovKFi.size(); ++j)
+    set<MapObjectPtr> spMapObjects;
+    vector<MapObjectPtr> vpMapObjects;                
+    
+    vector<KeyFramePtr> vpKeyFrames;
+    unordered_set<KeyFramePtr> spKeyFrames;  // Luigi's change: added set in order to avoid pushing many instances of the same KF when considering points, lines, etc
+    for(KeyFramePtr pCovKFi : vpCovKFi)
+    {
+        for(MapPointPtr pCovMPij : pCovKFi->GetMapPointMatches())
         {
-            if(!vpCovKFi[j] || vpCovKFi[j]->isBad())
+            if(!pCovMPij || pCovMPij->isBad())
                 continue;
 
-            int num = matcherBoW.SearchByBoW(mpCurrentKF, vpCovKFi[j], vvpMatchedMPs[j]);
-            if (num > nMostBoWNumMatches)
+            if(spMapPoints.find(pCovMPij) == spMapPoints.end())
             {
-                nMostBoWNumMatches = num;
-                nIndexMostBoWMatchesKF = j;
+                spMapPoints.insert(pCovMPij);
+                vpMapPoints.push_back(pCovMPij);
+                //vpKeyFrames.push_back(pCovKFi); // Luigi's change 
+                spKeyFrames.insert(pCovKFi);
             }
         }
 
-        for(int j=0; j<vpCovKFi.size(); ++j)
+        if(mpTracker->IsLineTracking())
         {
-            for(int k=0; k < vvpMatchedMPs[j].size(); ++k)
+            for(MapLinePtr pCovMLij : pCovKFi->GetMapLineMatches())
             {
-                MapPointPtr pMPi_j = vvpMatchedMPs[j][k];
-                if(!pMPi_j || pMPi_j->isBad())
+                if(!pCovMLij || pCovMLij->isBad())
                     continue;
 
-                if(spMatchedMPi.find(pMPi_j) == spMatchedMPi.end())
+                if(spMapLines.find(pCovMLij) == spMapLines.end())
                 {
-                    spMatchedMPi.insert(pMPi_j);
-                    numBoWMatches++;
-
-                    vpMatchedPoints[k]= pMPi_j;
-                    vpKeyFrameMatchedMP[k] = vpCovKFi[j];
+                    spMapLines.insert(pCovMLij);
+                    vpMapLines.push_back(pCovMLij);
+                    //vpKeyFrames.push_back(pCovKFi); // Luigi's change 
+                    spKeyFrames.insert(pCovKFi);
                 }
-            }
+            }                        
         }
-
-        //pMostBoWMatchesKF = vpCovKFi[pMostBoWMatchesKF];
-
-        if(numBoWMatches >= nBoWMatches) // TODO pick a good threshold
+        
+        if(mpTracker->IsObjectTracking())
         {
-            // Geometric validation
-            bool bFixedScale = mbFixScale;
-            if(mpTracker->mSensor==System::IMU_MONOCULAR && !mpCurrentKF->GetMap()->GetIniertialBA2())
-                bFixedScale=false;
-
-            Sim3Solver solver = Sim3Solver(mpCurrentKF, pMostBoWMatchesKF, vpMatchedPoints, bFixedScale, vpKeyFrameMatchedMP);
-            solver.SetRansacParameters(0.99, nBoWInliers, 300); // at least 15 inliers
-
-            bool bNoMore = false;
-            vector<bool> vbInliers;
-            int nInliers;
-            bool bConverge = false;
-            Eigen::Matrix4f mTcm;
-            while(!bConverge && !bNoMore)
-            {
-                mTcm = solver.iterate(20,bNoMore, vbInliers, nInliers, bConverge);
-                //Verbose::PrintMess("BoW guess: Solver achieve " + to_string(nInliers) + " geometrical inliers among " + to_string(nBoWInliers) + " BoW matches", Verbose::VERBOSITY_DEBUG);
-            }
-
-            if(bConverge)
+            for(MapObjectPtr pCovMOij : pCovKFi->GetMapObjectMatches())
             {
-                //std::cout << "Check BoW: SolverSim3 converged" << std::endl;
-
-                //Verbose::PrintMess("BoW guess: Convergende with " + to_string(nInliers) + " geometrical inliers among " + to_string(nBoWInliers) + " BoW matches", Verbose::VERBOSITY_DEBUG);
-                // Match by reprojection
-                vpCovKFi.clear();
-                vpCovKFi = pMostBoWMatchesKF->GetBestCovisibilityKeyFrames(nNumCovisibles);
-                vpCovKFi.push_back(pMostBoWMatchesKF);
-                set<KeyFramePtr> spCheckKFs(vpCovKFi.begin(), vpCovKFi.end());
-
-                //std::cout << "There are " << vpCovKFi.size() <<" near KFs" << std::endl;
-
-                set<MapPointPtr> spMapPoints;
-                vector<MapPointPtr> vpMapPoints;
-                
-                set<MapLinePtr> spMapLines;
-                vector<MapLinePtr> vpMapLines;
+                if(!pCovMOij || pCovMOij->isBad())
+                    continue;
 
-                set<MapObjectPtr> spMapObjects;
-                vector<MapObjectPtr> vpMapObjects;                
-                
-                vector<KeyFramePtr> vpKeyFrames;
-                unordered_set<KeyFramePtr> spKeyFrames;  // Luigi's change: added set in order to avoid pushing many instances of the same KF when considering points, lines, etc
-                for(KeyFramePtr pCovKFi : vpCovKFi)
+                if(spMapObjects.find(pCovMOij) == spMapObjects.end())
                 {
-                    for(MapPointPtr pCovMPij : pCovKFi->GetMapPointMatches())
-                    {
-                        if(!pCovMPij || pCovMPij->isBad())
-                            continue;
-
-                        if(spMapPoints.find(pCovMPij) == spMapPoints.end())
-                        {
-                            spMapPoints.insert(pCovMPij);
-                            vpMapPoints.push_back(pCovMPij);
-                            //vpKeyFrames.push_back(pCovKFi); // Luigi's change 
-                            spKeyFrames.insert(pCovKFi);
-                        }
-                    }
-
-                    if(mpTracker->IsLineTracking())
-                    {
-                        for(MapLinePtr pCovMLij : pCovKFi->GetMapLineMatches())
-                        {
-                            if(!pCovMLij || pCovMLij->isBad())
-                                continue;
-
-			                if(spMapLines.find(pCovMLij) == spMapLines.end())
-                            {
-                                spMapLines.insert(pCovMLij);
-                                vpMapLines.push_back(pCovMLij);
-                                //vpKeyFrames.push_back(pCovKFi); // Luigi's change 
-                                spKeyFrames.insert(pCovKFi);
-                            }
-                        }                        
-                    }
-                    
-                    if(mpTracker->IsObjectTracking())
-                    {
-                        for(MapObjectPtr pCovMOij : pCovKFi->GetMapObjectMatches())
-                        {
-                            if(!pCovMOij || pCovMOij->isBad())
-                                continue;
-
-			                if(spMapObjects.find(pCovMOij) == spMapObjects.end())
-                            {
-                                spMapObjects.insert(pCovMOij);
-                                vpMapObjects.push_back(pCovMOij);
-                                //vpKeyFrames.push_back(pCovKFi); // Luigi's change 
-                                spKeyFrames.insert(pCovKFi);
-                            }
-                        }                        
-                    }                    
-     
+                    spMapObjects.insert(pCovMOij);
+                    vpMapObjects.push_back(pCovMOij);
+                    //vpKeyFrames.push_back(pCovKFi); // Luigi's change 
+                    spKeyFrames.insert(pCovKFi);
                 }
-                vpKeyFrames = vector<KeyFramePtr>(spKeyFrames.begin(),spKeyFrames.end()); // Luigi's change 
+            }                        
+        }                    
+
+    }
+    vpKeyFrames = vector<KeyFramePtr>(spKeyFrames.begin(),spKeyFrames.end()); // Luigi's change 
 
-                //std::cout << "There are " << vpKeyFrames.size() <<" KFs which view all the mappoints" << std::endl;
+    //std::cout << "There are " << vpKeyFrames.size() <<" KFs which view all the mappoints" << std::endl;
 
-                g2o::Sim3 gScm(solver.GetEstimatedRotation().cast<double>(),solver.GetEstimatedTranslation().cast<double>(), (double) solver.GetEstimatedScale());
-                g2o::Sim3 gSmw(pMostBoWMatchesKF->GetRotation().cast<double>(),pMostBoWMatchesKF->GetTranslation().cast<double>(),1.0);
-                g2o::Sim3 gScw = gScm*gSmw; // Similarity matrix of current from the world position
-                Sophus::Sim3f mScw = Converter::toSophus(gScw);
+    g2o::Sim3 gScm(solver.GetEstimatedRotation().cast<double>(),solver.GetEstimatedTranslation().cast<double>(), (double) solver.GetEstimatedScale());
+    g2o::Sim3 gSmw(pMostBoWMatchesKF->GetRotation().cast<double>(),pMostBoWMatchesKF->GetTranslation().cast<double>(),1.0);
+    g2o::Sim3 gScw = gScm*gSmw; // Similarity matrix of current from the world position
+    Sophus::Sim3f mScw = Converter::toSophus(gScw);
 
-                vector<MapPointPtr> vpMatchedMP;
-                vpMatchedMP.resize(mpCurrentKF->GetMapPointMatches().size(), static_cast<MapPointPtr>(NULL));
-                vector<KeyFramePtr> vpMatchedKF;
-                vpMatchedKF.resize(mpCurrentKF->GetMapPointMatches().size(), static_cast<KeyFramePtr>(NULL));
-                int numProjPointMatches = matcher.SearchByProjection(mpCurrentKF, mScw, vpMapPoints, vpKeyFrames, vpMatchedMP, vpMatchedKF, 8, 1.5);
-                //cout <<"BoW: " << numProjMatches << " matches between " << vpMapPoints.size() << " points with coarse Sim3" << endl;
+    vector<MapPointPtr> vpMatchedMP;
+    vpMatchedMP.resize(mpCurrentKF->GetMapPointMatches().size(), static_cast<MapPointPtr>(NULL));
+    vector<KeyFramePtr> vpMatchedKF;
+    vpMatchedKF.resize(mpCurrentKF->GetMapPointMatches().size(), static_cast<KeyFramePtr>(NULL));
+    int numProjPointMatches = matcher.SearchByProjection(mpCurrentKF, mScw, vpMapPoints, vpKeyFrames, vpMatchedMP, vpMatchedKF, 8, 1.5);
+    //cout <<"BoW: " << numProjMatches << " matches between " << vpMapPoints.size() << " points with coarse Sim3" << endl;
 
-                int numProjLineMatches = 0; 
-                vector<MapLinePtr> vpMatchedML;    
-                vector<KeyFramePtr> vpMatchedLinesKF;
+    int numProjLineMatches = 0; 
+    vector<MapLinePtr> vpMatchedML;    
+    vector<KeyFramePtr> vpMatchedLinesKF;
 #if USE_LINES_FOR_VOTING_LOOP_CLOSURE                
-                if(mpTracker->IsLineTracking())
-                {
-                    vpMatchedML.resize(mpCurrentKF->GetMapLineMatches().size(), static_cast<MapLinePtr>(NULL));                                        
-                    vpMatchedLinesKF.resize(mpCurrentKF->GetMapLineMatches().size(), static_cast<KeyFramePtr>(NULL));
-                    numProjLineMatches = pLineMatcher->SearchByProjection(mpCurrentKF, mScw, vpMapLines, vpKeyFrames, vpMatchedML, vpMatchedLinesKF, 8, 1.5);
-                }
+    if(mpTracker->IsLineTracking())
+    {
+        vpMatchedML.resize(mpCurrentKF->GetMapLineMatches().size(), static_cast<MapLinePtr>(NULL));                                        
+        vpMatchedLinesKF.resize(mpCurrentKF->GetMapLineMatches().size(), static_cast<KeyFramePtr>(NULL));
+        numProjLineMatches = pLineMatcher->SearchByProjection(mpCurrentKF, mScw, vpMapLines, vpKeyFrames, vpMatchedML, vpMatchedLinesKF, 8, 1.5);
+    }
 #endif    
-                int numProjObjectMatches = 0; 
-                vector<MapObjectPtr> vpMatchedMO;    
-                vector<KeyFramePtr> vpMatchedObjectsKF;
+    vector<MapObjectPtr> vpMatchedMO;    
 #if USE_OBJECTS_FOR_VOTING_LOOP_CLOSURE                
-                if(mpTracker->IsObjectTracking())
-                {
-                    /// < TODO: Luigi add objects matching 
-                }
+    if(mpTracker->IsObjectTracking())
+    {
+        /// < TODO: Luigi add objects matching 
+    }
 #endif                   
-                int numProjFeatureMatches = (numProjPointMatches + Tracking::sknLineTrackWeigth*numProjLineMatches);
-                        
-                if(numProjFeatureMatches >= nProjMatches)
-                {
-                    // Optimize Sim3 transformation with every matches
-                    Eigen::Matrix<double, 7, 7> mHessian7x7;
+    int numProjFeatureMatches = (numProjPointMatches + Tracking::sknLineTrackWeigth*numProjLineMatches);
 
-                    bool bFixedScale = mbFixScale;
-                    if(mpTracker->mSensor==System::IMU_MONOCULAR && !mpCurrentKF->GetMap()->GetIniertialBA2())
-                        bFixedScale=false;
+#ifdef REGISTER_TIMES
+    std::chrono::steady_clock::time_point time_EndProjection = std::chrono::steady_clock::now();
+    {
+        unique_lock<mutex> lock(mMutexBoWCandTimes);
+        vdBoWCandProjection_ms.push_back(std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndProjection - time_StartStage).count());
+    }
+    time_StartStage = time_EndProjection;
+#endif
+            
+    if(numProjFeatureMatches < nProjMatches || (pbCancel && *pbCancel))
+        return;
 
-                    int numOptMatches = Optimizer::OptimizeSim3(mpCurrentKF, pKFi, vpMatchedMP, gScm, 10, mbFixScale, mHessian7x7, true);
+    // Optimize Sim3 transformation with every matches
+    Eigen::Matrix<double, 7, 7> mHessian7x7;
 
-                    if(numOptMatches >= nSim3Inliers)
-                    {
-                        g2o::Sim3 gSmw(pMostBoWMatchesKF->GetRotation().cast<double>(),pMostBoWMatchesKF->GetTranslation().cast<double>(),1.0);
-                        g2o::Sim3 gScw = gScm*gSmw; // Similarity matrix of current from the world position
-                        Sophus::Sim3f mScw = Converter::toSophus(gScw);
+    int numOptMatches = Optimizer::OptimizeSim3(mpCurrentKF, pKFi, vpMatchedMP, gScm, 10, mbFixScale, mHessian7x7, true);
 
-                        vector<MapPointPtr> vpMatchedMP;
-                        vpMatchedMP.resize(mpCurrentKF->GetMapPointMatches().size(), static_cast<MapPointPtr>(NULL));
-                        int numProjOptPointMatches = matcher.SearchByProjection(mpCurrentKF, mScw, vpMapPoints, vpMatchedMP, 5, 1.0);
+    if(numOptMatches >= nSim3Inliers)
+    {
+        g2o::Sim3 gSmw(pMostBoWMatchesKF->GetRotation().cast<double>(),pMostBoWMatchesKF->GetTranslation().cast<double>(),1.0);
+        g2o::Sim3 gScw = gScm*gSmw; // Similarity matrix of current from the world position
+        Sophus::Sim3f mScw = Converter::toSophus(gScw);
+
+        vector<MapPointPtr> vpMatchedMP;
+        vpMatchedMP.resize(mpCurrentKF->GetMapPointMatches().size(), static_cast<MapPointPtr>(NULL));
+        int numProjOptPointMatches = matcher.SearchByProjection(mpCurrentKF, mScw, vpMapPoints, vpMatchedMP, 5, 1.0);
 
-                        vector<MapLinePtr> vpMatchedML;
-                        int numProjOptLineMatches = 0; 
+        vector<MapLinePtr> vpMatchedML;
+        int numProjOptLineMatches = 0; 
 #if USE_LINES_FOR_VOTING_LOOP_CLOSURE                              
-                        if(mpTracker->IsLineTracking())
-			{
-                            vpMatchedML.resize(mpCurrentKF->GetMapLineMatches().size(), static_cast<MapLinePtr>(NULL));
-                            LineMatcher lineMatcher(0.9);
-                            numProjOptLineMatches = lineMatcher.SearchByProjection(mpCurrentKF, mScw, vpMapLines, vpMatchedML, 5, 1.0);
-                        }
+        if(mpTracker->IsLineTracking())
+        {
+            vpMatchedML.resize(mpCurrentKF->GetMapLineMatches().size(), static_cast<MapLinePtr>(NULL));
+            LineMatcher lineMatcher(0.9);
+            numProjOptLineMatches = lineMatcher.SearchByProjection(mpCurrentKF, mScw, vpMapLines, vpMatchedML, 5, 1.0);
+        }
 #endif                      
 #if USE_OBJECTS_FOR_VOTING_LOOP_CLOSURE                
-                        if(mpTracker->IsObjectTracking())
-                        {
-                            /// < TODO: Luigi add objects matching 
-                        }
+        if(mpTracker->IsObjectTracking())
+        {
+            /// < TODO: Luigi add objects matching 
+        }
 #endif                            
-                        int numProjOptFeatureMatches = (numProjOptPointMatches + Tracking::sknLineTrackWeigth*numProjOptLineMatches);
-                        
-                        if( numProjOptFeatureMatches >= nProjOptMatches)
-                        {
-#if 0
-			    // TODO: Luigi: check this, it seems useless
-                            int max_x = -1, min_x = 1000000;
-                            int max_y = -1, min_y = 1000000;
-                            for(MapPointPtr pMPi : vpMatchedMP)
-                            {
-                                if(!pMPi || pMPi->isBad())
-                                {
-                                    continue;
-                                }
+        int numProjOptFeatureMatches = (numProjOptPointMatches + Tracking::sknLineTrackWeigth*numProjOptLineMatches);
+        
+        if( numProjOptFeatureMatches >= nProjOptMatches)
+        {
+            candidate.pMostBoWMatchesKF = pMostBoWMatchesKF;
+            candidate.numProjOptFeatureMatches = numProjOptFeatureMatches;
+            candidate.gScw = gScw;
 
-                                tuple<size_t,size_t> indexes = pMPi->GetIndexInKeyFrame(pKFi);
-                                int index = get<0>(indexes);
-                                if(index >= 0)
-                                {
-                                    int coord_x = pKFi->mvKeysUn[index].pt.x;
-                                    if(coord_x < min_x)
-                                    {
-                                        min_x = coord_x;
-                                    }
-                                    if(coord_x > max_x)
-                                    {
-                                        max_x = coord_x;
-                                    }
-                                    int coord_y = pKFi->mvKeysUn[index].pt.y;
-                                    if(coord_y < min_y)
-                                    {
-                                        min_y = coord_y;
-                                    }
-                                    if(coord_y > max_y)
-                                    {
-                                        max_y = coord_y;
-                                    }
-                                }
-                            }
-#endif 
-                            int nNumKFs = 0;
-                            //vpMatchedMPs = vpMatchedMP;
-                            //vpMPs = vpMapPoints;
-                            // Check the Sim3 transformation with the current KeyFrame covisibles
-                            vector<KeyFramePtr> vpCurrentCovKFs = mpCurrentKF->GetBestCovisibilityKeyFrames(nNumCovisibles);
-
-                            int j = 0;
-                            while(nNumKFs < 3 && j<vpCurrentCovKFs.size())
-                            {
-                                KeyFramePtr pKFj = vpCurrentCovKFs[j];
-                                Sophus::SE3d mTjc = (pKFj->GetPose() * mpCurrentKF->GetPoseInverse()).cast<double>();
-                                g2o::Sim3 gSjc(mTjc.unit_quaternion(),mTjc.translation(),1.0);
-                                g2o::Sim3 gSjw = gSjc * gScw;
-                                int numProjMatches_j = 0;
-                                vector<MapPointPtr> vpMatchedMPs_j;
-                                vector<MapLinePtr> vpMatchedMLs_j;
-                                vector<MapObjectPtr> vpMatchedMOs_j;
-                                bool bValid = DetectCommonRegionsFromLastKF(pKFj,pMostBoWMatchesKF, gSjw,numProjMatches_j, vpMapPoints, vpMatchedMPs_j,
-                                                                                                                           vpMapLines, vpMatchedMLs_j,
-                                                                                                                           vpMapObjects, vpMatchedMOs_j);
-
-                                if(bValid)
-                                {
-                                    Sophus::SE3f Tc_w = mpCurrentKF->GetPose();
-                                    Sophus::SE3f Tw_cj = pKFj->GetPoseInverse();
-                                    Sophus::SE3f Tc_cj = Tc_w * Tw_cj;
-                                    Eigen::Vector3f vector_dist = Tc_cj.translation();
-                                    nNumKFs++;
-                                }
-                                j++;
-                            }
+            candidate.vpMapPoints.swap(vpMapPoints);
+            candidate.vpMatchedMapPoints.swap(vpMatchedMP);
 
-                            if(nNumKFs < 3)
-                            {
-                                vnStage[index] = 8;
-                                vnMatchesStage[index] = nNumKFs;
-                            }
+            candidate.vpMapLines.swap(vpMapLines);
+            candidate.vpMatchedMapLines.swap(vpMatchedML);
 
-                            if(nBestMatchesReproj < numProjOptFeatureMatches)
-                            {
-                                nBestMatchesReproj = numProjOptFeatureMatches;
-                                nBestNumCoindicendes = nNumKFs;
-                                pBestMatchedKF = pMostBoWMatchesKF;
-                                g2oBestScw = gScw;
-                                
-                                vpBestMapPoints = vpMapPoints;
-                                vpBestMatchedMapPoints = vpMatchedMP;
-                                
-                                vpBestMapLines = vpMapLines;
-                                vpBestMatchedMapLines = vpMatchedML;      
-                                
-                                vpBestMapObjects = vpMapObjects;
-                                vpBestMatchedMapObjects = vpMatchedMO;                                  
-                            }
-                        }
-                    }
-                }
-            }
-            /*else
-            {
-                Verbose::PrintMess("BoW candidate: it don't match with the current one", Verbose::VERBOSITY_DEBUG);
-            }*/
+            candidate.vpMapObjects.swap(vpMapObjects);
+            candidate.vpMatchedMapObjects.swap(vpMatchedMO);
         }
-        index++;
     }
 
-    if(nBestMatchesReproj > 0)
+#ifdef REGISTER_TIMES
+    std::chrono::steady_clock::time_point time_EndOptimization = std::chrono::steady_clock::now();
     {
-        pLastCurrentKF = mpCurrentKF;
-        nNumCoincidences = nBestNumCoindicendes;
-        pMatchedKF2 = pBestMatchedKF;
-        pMatchedKF2->SetNotErase();
-        g2oScw = g2oBestScw;
-        
-        vpMPs = vpBestMapPoints;
-        vpMatchedMPs = vpBestMatchedMapPoints;
-        
-        vpMLs = vpBestMapLines;
-        vpMatchedMLs = vpBestMatchedMapLines;    
-        
-        vpMOs = vpBestMapObjects;
-        vpMatchedMOs = vpBestMatchedMapObjects;            
-
-        return nNumCoincidences >= 3;
+        unique_lock<mutex> lock(mMutexBoWCandTimes);
+        vdBoWCandOptimization_ms.push_back(std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndOptimization - time_StartStage).count());
     }
-    else
+#endif
+}
+
+bool LoopClosing::DetectCommonRegionsFromBoW(std::vector<KeyFramePtr> &vpBowCand, KeyFramePtr &pMatchedKF2, KeyFramePtr &pLastCurrentKF, g2o::Sim3 &g2oScw,
+                                             int &nNumCoincidences, std::vector<MapPointPtr> &vpMPs, std::vector<MapPointPtr> &vpMatchedMPs,
+                                             std::vector<MapLinePtr> &vpMLs, std::vector<MapLinePtr> &vpMatchedMLs,
+                                             std::vector<MapObjectPtr> &vpMOs, std::vector<MapObjectPtr> &vpMatchedMOs,
+                                             const std::atomic<bool>* pbCancel)
+{
+    /// < TODO: add line matching here and use it in the Sim3Solver  ?  
+
+    set<KeyFramePtr> spConnectedKeyFrames = mpCurrentKF->GetConnectedKeyFrames();
+
+    int nNumCovisibles = 10;
+
+    // Verify the candidates concurrently
+    const int numCandidates = vpBowCand.size();
+    std::vector<BoWCandidate, Eigen::aligned_allocator<BoWCandidate> > vCandidates(numCandidates);
     {
-        int maxStage = -1;
-        int maxMatched;
-        for(int i=0; i<vnStage.size(); ++i)
+        TaskPool::TaskGroup verifications(mpVerificationPool.get());
+        for(int i=0; i<numCandidates; i++)
         {
-            if(vnStage[i] > maxStage)
+            verifications.Run([this, &vpBowCand, &spConnectedKeyFrames, pbCancel, &vCandidates, i]()
             {
-                maxStage = vnStage[i];
-                maxMatched = vnMatchesStage[i];
-            }
+                VerifyBoWCandidate(vpBowCand[i], spConnectedKeyFrames, pbCancel, vCandidates[i]);
+            });
         }
     }
-    return false;
+
+    if(pbCancel && *pbCancel)
+        return false;
+
+    // Select the candidate with the most matches after the Sim3 optimization (the first one in case of ties)
+    int nBestMatchesReproj = 0;
+    int nBestCandidate = -1;
+    for(int i=0; i<numCandidates; i++)
+    {
+        if(nBestMatchesReproj < vCandidates[i].numProjOptFeatureMatches)
+        {
+            nBestMatchesReproj = vCandidates[i].numProjOptFeatureMatches;
+            nBestCandidate = i;
+        }
+    }
+
+    if(nBestCandidate < 0)
+        return false;
+
+    BoWCandidate& best = vCandidates[nBestCandidate];
+
+#ifdef REGISTER_TIMES
+    std::chrono::steady_clock::time_point time_StartCovisibility = std::chrono::steady_clock::now();
+#endif
+
+    // Check the Sim3 transformation with the current KeyFrame covisibles (only the selected candidate needs it)
+    int nNumKFs = 0;
+    vector<KeyFramePtr> vpCurrentCovKFs = mpCurrentKF->GetBestCovisibilityKeyFrames(nNumCovisibles);
+
+    int j = 0;
+    while(nNumKFs < 3 && j<vpCurrentCovKFs.size())
+    {
+        KeyFramePtr pKFj = vpCurrentCovKFs[j];
+        Sophus::SE3d mTjc = (pKFj->GetPose() * mpCurrentKF->GetPoseInverse()).cast<double>();
+        g2o::Sim3 gSjc(mTjc.unit_quaternion(),mTjc.translation(),1.0);
+        g2o::Sim3 gSjw = gSjc * best.gScw;
+        int numProjMatches_j = 0;
+        vector<MapPointPtr> vpMatchedMPs_j;
+        vector<MapLinePtr> vpMatchedMLs_j;
+        vector<MapObjectPtr> vpMatchedMOs_j;
+        bool bValid = DetectCommonRegionsFromLastKF(pKFj,best.pMostBoWMatchesKF, gSjw,numProjMatches_j, best.vpMapPoints, vpMatchedMPs_j,
+                                                                                                       best.vpMapLines, vpMatchedMLs_j,
+                                                                                                       best.vpMapObjects, vpMatchedMOs_j);
+
+        if(bValid)
+        {
+            nNumKFs++;
+        }
+        j++;
+    }
+
+#ifdef REGISTER_TIMES
+    std::chrono::steady_clock::time_point time_EndCovisibility = std::chrono::steady_clock::now();
+    {
+        unique_lock<mutex> lock(mMutexBoWCandTimes);
+        vdBoWCandCovisibility_ms.push_back(std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndCovisibility - time_StartCovisibility).count());
+    }
+#endif
+
+    pLastCurrentKF = mpCurrentKF;
+    nNumCoincidences = nNumKFs;
+    pMatchedKF2 = best.pMostBoWMatchesKF;
+    pMatchedKF2->SetNotErase();
+    g2oScw = best.gScw;
+    
+    vpMPs = best.vpMapPoints;
+    vpMatchedMPs = best.vpMatchedMapPoints;
+    
+    vpMLs = best.vpMapLines;
+    vpMatchedMLs = best.vpMatchedMapLines;    
+    
+    vpMOs = best.vpMapObjects;
+    vpMatchedMOs = best.vpMatchedMapObjects;            
+
+    return nNumCoincidences >= 3;
 }
 
 bool LoopClosing::DetectCommonRegionsFromLastKF(KeyFramePtr pCurrentKF, KeyFramePtr pMatchedKF, g2o::Sim3 &gScw, int &nNumProjMatches,
@@ -1269,12 +1301,14 @@ void LoopClosing::CorrectLoop()
     mpLocalMapper->EmptyQueue(); // Proccess keyframes in the queue
 
     // If a Global Bundle Adjustment is running, abort it
+    bool bStoppedGBA = false;
     if(isRunningGBA())
     {
 	cout << "Request GBA abort" << endl;
         cout << "Stoping Global Bundle Adjustment...";
         unique_lock<mutex> lock(mMutexGBA);
         mbStopGBA = true;
+        bStoppedGBA = true;
 
         mnFullBAIdx++;
 
@@ -1292,15 +1326,35 @@ void LoopClosing::CorrectLoop()
 #endif
     
     // Wait until Local Mapping has effectively stopped
-    while(!mpLocalMapper->isStopped())
-    {
-        usleep(1000);
-    }
+    mpLocalMapper->WaitUntilStopped();
     
 #if VERBOSE    
     cout << "LoopClosing::CorrectLoop() - local mapper stopped" << endl; 
 #endif
 
+    // Resume from the last iteration of the interrupted GBA instead of throwing it away
+    if(bStoppedGBA && ApplyInterruptedGBA(mpCurrentKF->GetMap()))
+    {
+        // The loop Sim3 was computed with the pose of the matched keyframe before the GBA update
+        const Sophus::SE3d TmwBefore = mpLoopMatchedKF->mTcwBefGBA.cast<double>();
+        const Sophus::SE3d Tmw = mpLoopMatchedKF->GetPose().cast<double>();
+        const g2o::Sim3 g2oSmwBefore(TmwBefore.unit_quaternion(),TmwBefore.translation(),1.0);
+        const g2o::Sim3 g2oSmw(Tmw.unit_quaternion(),Tmw.translation(),1.0);
+        mg2oLoopScw = mg2oLoopScw*g2oSmwBefore.inverse()*g2oSmw;
+    }
+
+    // Poses before the loop correction (to find the keyframes it moves)
+    KeyFrameAndPose PosesBeforeCorrection;
+    if(skUseIncrementalGBA)
+    {
+        const vector<KeyFramePtr> vpKFs = mpCurrentKF->GetMap()->GetAllKeyFrames();
+        for(const KeyFramePtr& pKF : vpKFs)
+        {
+            const Sophus::SE3d Tcw = pKF->GetPose().cast<double>();
+            PosesBeforeCorrection[pKF] = g2o::Sim3(Tcw.unit_quaternion(),Tcw.translation(),1.0);
+        }
+    }
+
     // Ensure current keyframe is updated
     //cout << "Start updating connections" << endl;
     //assert(mpCurrentKF->GetMap()->CheckEssentialGraph());
@@ -1660,7 +1714,11 @@ void LoopClosing::CorrectLoop()
         mbStopGBA = false;
         mnCorrectionGBA = mnNumCorrection;
 
-        mpThreadGBA = new thread(&LoopClosing::RunGlobalBundleAdjustment, this, pLoopMap, mpCurrentKF->mnId);
+        mpGBAProgress = NewGBAProgress(pLoopMap, mpCurrentKF->mnId);
+        if(skUseIncrementalGBA && !pLoopMap->isImuInitialized())
+            mpGBAProgress->sFixedKFs = ComputeGBAFixedKeyFrames(pLoopMap, PosesBeforeCorrection);
+
+        mpThreadGBA = new thread(&LoopClosing::RunGlobalBundleAdjustment, this, pLoopMap, mpCurrentKF->mnId, mpGBAProgress);
 #if VERBOSE     
         cout << "LoopClosing::CorrectLoop() - bundle adjustment done - releasing local mapper" << endl; 
 #endif       
@@ -1684,10 +1742,12 @@ void LoopClosing::StartGlobalBundleAdjustment()
     mpLocalMapper->RequestStop();
 
     // If a Global Bundle Adjustment is running, abort it
+    bool bStoppedGBA = false;
     if(isRunningGBA())
     {
         unique_lock<mutex> lock(mMutexGBA);
         mbStopGBA = true;
+        bStoppedGBA = true;
 
         mnFullBAIdx++;
 
@@ -1703,10 +1763,11 @@ void LoopClosing::StartGlobalBundleAdjustment()
 #endif
     
     // Wait until Local Mapping has effectively stopped
-    while(!mpLocalMapper->isStopped())
-    {
-        usleep(1000);
-    }
+    mpLocalMapper->WaitUntilStopped();
+
+    // Resume from the last iteration of the interrupted GBA
+    if(bStoppedGBA)
+        ApplyInterruptedGBA(mpAtlas->GetCurrentMap());
     
 #if VERBOSE    
     cout << "LoopClosing::StartGlobalBundleAdjustment() - local mapper stopped" << endl; 
@@ -1725,7 +1786,8 @@ void LoopClosing::StartGlobalBundleAdjustment()
     mbFinishedGBA = false;
     mbStopGBA = false;
     // < TODO: ?Luigi add the possibility to BA all the maps?
-    mpThreadGBA = new thread(&LoopClosing::RunGlobalBundleAdjustment, this, mpAtlas->GetCurrentMap(), mpCurrentKF->mnId);
+    mpGBAProgress = NewGBAProgress(mpAtlas->GetCurrentMap(), mpCurrentKF->mnId);
+    mpThreadGBA = new thread(&LoopClosing::RunGlobalBundleAdjustment, this, mpAtlas->GetCurrentMap(), mpCurrentKF->mnId, mpGBAProgress);
 
 #if VERBOSE     
     cout << "LoopClosing::StartGlobalBundleAdjustment() - bundle adjustment done - releasing local mapper" << endl; 
@@ -1769,16 +1831,20 @@ void LoopClosing::MergeLocal()
             delete mpThreadGBA;
         }
         bRelaunchBA = true;
+
+        // the merge changes the map: the result of the interrupted GBA is discarded
+        if(mpGBAProgress)
+        {
+            unique_lock<mutex> lockProgress(mpGBAProgress->mutex);
+            mpGBAProgress->bClosed = true;
+        }
     }
 
     Verbose::PrintMess("MERGE-VISUAL: Request Stop Local Mapping", Verbose::VERBOSITY_DEBUG);
     //cout << "Request Stop Local Mapping" << endl;
     mpLocalMapper->RequestStop();
     // Wait until Local Mapping has effectively stopped
-    while(!mpLocalMapper->isStopped())
-    {
-        usleep(1000);
-    }
+    mpLocalMapper->WaitUntilStopped();
     Verbose::PrintMess("MERGE: Local Map stopped", Verbose::VERBOSITY_DEBUG);
 
     mpLocalMapper->EmptyQueue();
@@ -2592,10 +2658,7 @@ void LoopClosing::MergeLocal()
 
         mpLocalMapper->RequestStop();
         // Wait until Local Mapping has effectively stopped
-        while(!mpLocalMapper->isStopped())
-        {
-            usleep(1000);
-        }
+        mpLocalMapper->WaitUntilStopped();
 
         // Optimize graph (and update the loop position for each element form the begining to the end)
         if(mpTracker->mSensor != System::MONOCULAR)
@@ -2691,7 +2754,8 @@ void LoopClosing::MergeLocal()
         mbRunningGBA = true;
         mbFinishedGBA = false;
         mbStopGBA = false;
-        mpThreadGBA = new thread(&LoopClosing::RunGlobalBundleAdjustment,this, pMergeMap, mpCurrentKF->mnId);
+        mpGBAProgress = NewGBAProgress(pMergeMap, mpCurrentKF->mnId);
+        mpThreadGBA = new thread(&LoopClosing::RunGlobalBundleAdjustment,this, pMergeMap, mpCurrentKF->mnId, mpGBAProgress);
     }
 
     mpMergeMatchedKF->AddMergeEdge(mpCurrentKF);
@@ -2784,16 +2848,20 @@ void LoopClosing::MergeLocal2()
             delete mpThreadGBA;
         }
         bRelaunchBA = true;
+
+        // the merge changes the map: the result of the interrupted GBA is discarded
+        if(mpGBAProgress)
+        {
+            unique_lock<mutex> lockProgress(mpGBAProgress->mutex);
+            mpGBAProgress->bClosed = true;
+        }
     }
 
 
     cout << "Request Stop Local Mapping" << endl;
     mpLocalMapper->RequestStop();
     // Wait until Local Mapping has effectively stopped
-    while(!mpLocalMapper->isStopped())
-    {
-        usleep(1000);
-    }
+    mpLocalMapper->WaitUntilStopped();
     cout << "Local Map stopped" << endl;
 
     Map* pCurrentMap = mpCurrentKF->GetMap();
@@ -3315,16 +3383,9 @@ void LoopClosing::RequestReset()
         unique_lock<mutex> lock(mMutexReset);
         mbResetRequested = true;
     }
+    mWakeUpEvent.Notify();
 
-    while(1)
-    {
-        {
-        unique_lock<mutex> lock2(mMutexReset);
-        if(!mbResetRequested)
-            break;
-        }
-        usleep(5000);
-    }
+    mStateChangedEvent.WaitUntil([this]{ unique_lock<mutex> lock2(mMutexReset); return !mbResetRequested; });
 }
 
 void LoopClosing::RequestResetActiveMap(Map *pMap)
@@ -3334,50 +3395,49 @@ void LoopClosing::RequestResetActiveMap(Map *pMap)
         mbResetActiveMapRequested = true;
         mpMapToReset = pMap;
     }
+    mWakeUpEvent.Notify();
 
-    while(1)
-    {
-        {
-            unique_lock<mutex> lock2(mMutexReset);
-            if(!mbResetActiveMapRequested)
-                break;
-        }
-        usleep(3000);
-    }
+    mStateChangedEvent.WaitUntil([this]{ unique_lock<mutex> lock2(mMutexReset); return !mbResetActiveMapRequested; });
 }
 
 void LoopClosing::ResetIfRequested()
 {
-    unique_lock<mutex> lock(mMutexReset);
-    if(mbResetRequested)
-    {
-        cout << "Loop closer reset requested..." << endl;
-        mlpLoopKeyFrameQueue.clear();
-        mLastLoopKFid=0;  //TODO old variable, it is not use in the new algorithm
-        mbResetRequested=false;
-        mbResetActiveMapRequested = false;
-    }
-    else if(mbResetActiveMapRequested)
+    bool bExecutedReset = false;
     {
-
-        for (list<KeyFramePtr>::const_iterator it=mlpLoopKeyFrameQueue.begin(); it != mlpLoopKeyFrameQueue.end();)
+        unique_lock<mutex> lock(mMutexReset);
+        if(mbResetRequested)
         {
-            KeyFramePtr pKFi = *it;
-            if(pKFi->GetMap() == mpMapToReset)
-            {
-                it = mlpLoopKeyFrameQueue.erase(it);
-            }
-            else
-                ++it;
+            cout << "Loop closer reset requested..." << endl;
+            mlpLoopKeyFrameQueue.clear();
+            mLastLoopKFid=0;  //TODO old variable, it is not use in the new algorithm
+            mbResetRequested=false;
+            mbResetActiveMapRequested = false;
+            bExecutedReset = true;
         }
+        else if(mbResetActiveMapRequested)
+        {
 
-        mLastLoopKFid=mpAtlas->GetLastInitKFid(); //TODO old variable, it is not use in the new algorithm
-        mbResetActiveMapRequested=false;
+            for (list<KeyFramePtr>::const_iterator it=mlpLoopKeyFrameQueue.begin(); it != mlpLoopKeyFrameQueue.end();)
+            {
+                KeyFramePtr pKFi = *it;
+                if(pKFi->GetMap() == mpMapToReset)
+                {
+                    it = mlpLoopKeyFrameQueue.erase(it);
+                }
+                else
+                    ++it;
+            }
 
+            mLastLoopKFid=mpAtlas->GetLastInitKFid(); //TODO old variable, it is not use in the new algorithm
+            mbResetActiveMapRequested=false;
+            bExecutedReset = true;
+        }
     }
+    if(bExecutedReset)
+        mStateChangedEvent.Notify();
 }
 
-void LoopClosing::RunGlobalBundleAdjustment(Map* pActiveMap, unsigned long nLoopKF)
+void LoopClosing::RunGlobalBundleAdjustment(Map* pActiveMap, unsigned long nLoopKF, std::shared_ptr<GlobalBAProgress> pProgress)
 {
     Verbose::PrintMess("Starting Global Bundle Adjustment", Verbose::VERBOSITY_NORMAL);
 
@@ -3393,7 +3453,7 @@ void LoopClosing::RunGlobalBundleAdjustment(Map* pActiveMap, unsigned long nLoop
     const bool bImuInit = pActiveMap->isImuInitialized();
 
     if(!bImuInit)
-        Optimizer::GlobalBundleAdjustemnt(pActiveMap,10,&mbStopGBA,nLoopKF,false);
+        Optimizer::GlobalBundleAdjustemnt(pActiveMap,10,&mbStopGBA,nLoopKF,false,pProgress.get());
     else
         Optimizer::FullInertialBA(pActiveMap,7,false,nLoopKF,&mbStopGBA);
 
@@ -3432,312 +3492,399 @@ void LoopClosing::RunGlobalBundleAdjustment(Map* pActiveMap, unsigned long nLoop
             mpLocalMapper->RequestStop();
             // Wait until Local Mapping has effectively stopped
 
-            while(!mpLocalMapper->isStopped() && !mpLocalMapper->isFinished())
+            mpLocalMapper->WaitUntilStopped();
+
             {
-                usleep(1000);
+                unique_lock<mutex> lockProgress(pProgress->mutex);
+                pProgress->bClosed = true;
             }
 
             // Get Map Mutex
             unique_lock<mutex> lock(pActiveMap->mMutexMapUpdate);
             // cout << "LC: Update Map Mutex adquired" << endl;
 
+            UpdateMapWithGBA(pActiveMap, nLoopKF);
+
+            // TODO Check this update
+            // mpTracker->UpdateFrameIMU(1.0f, mpTracker->GetLastKeyFrame()->GetImuBias(), mpTracker->GetLastKeyFrame());
+
+            mpLocalMapper->Release();
+
+#ifdef REGISTER_TIMES
+            std::chrono::steady_clock::time_point time_EndUpdateMap = std::chrono::steady_clock::now();
+
+            double timeUpdateMap = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndUpdateMap - time_EndGBA).count();
+            vdUpdateMap_ms.push_back(timeUpdateMap);
+
+            double timeFGBA = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndUpdateMap - time_StartFGBA).count();
+            vdFGBATotal_ms.push_back(timeFGBA);
+#endif
+            Verbose::PrintMess("Map updated!", Verbose::VERBOSITY_NORMAL);
+        }
+
+        mbFinishedGBA = true;
+        mbRunningGBA = false;
+    }
+    
+    mSignalGlobalBundleAdjustmentFinished.emit();
+}
+
+std::shared_ptr<LoopClosing::GlobalBAProgress> LoopClosing::NewGBAProgress(Map* pMap, const unsigned long nLoopKF)
+{
+    std::shared_ptr<GlobalBAProgress> pProgress = std::make_shared<GlobalBAProgress>();
+    pProgress->pMap = pMap;
+    pProgress->nLoopKF = nLoopKF;
+    if(skUseIncrementalGBA && mpGBAProgress && mpGBAProgress->pMap == pMap)
+    {
+        unique_lock<mutex> lock(mpGBAProgress->mutex);
+        pProgress->lambda = mpGBAProgress->lambda; // resume the damping of the previous GBA
+    }
+    return pProgress;
+}
+
+bool LoopClosing::ApplyInterruptedGBA(Map* pActiveMap)
+{
+    if(!mpGBAProgress)
+        return false;
+
+    unique_lock<mutex> lockProgress(mpGBAProgress->mutex);
+    const bool bApply = skUseIncrementalGBA && !mpGBAProgress->bClosed && mpGBAProgress->numPublishedIterations > 0 &&
+                        mpGBAProgress->pMap == pActiveMap && !pActiveMap->isImuInitialized();
+    mpGBAProgress->bClosed = true; // the interrupted GBA does not publish anymore
+    if(!bApply)
+        return false;
+
+    Verbose::PrintMess("Applying " + to_string(mpGBAProgress->numPublishedIterations) + " iterations of the interrupted GBA", Verbose::VERBOSITY_NORMAL);
+
+    unique_lock<mutex> lock(pActiveMap->mMutexMapUpdate);
+    UpdateMapWithGBA(pActiveMap, mpGBAProgress->nLoopKF);
+    return true;
+}
+
+std::set<KeyFramePtr> LoopClosing::ComputeGBAFixedKeyFrames(Map* pMap, const KeyFrameAndPose& PosesBeforeCorrection)
+{
+    const vector<KeyFramePtr> vpKFs = pMap->GetAllKeyFrames();
+
+    // keyframes moved by the loop correction (or inserted after it)
+    std::set<KeyFramePtr> sMovedKFs;
+    for(const KeyFramePtr& pKF : vpKFs)
+    {
+        if(pKF->isBad())
+            continue;
+        KeyFrameAndPose::const_iterator it = PosesBeforeCorrection.find(pKF);
+        if(it == PosesBeforeCorrection.end())
+        {
+            sMovedKFs.insert(pKF);
+            continue;
+        }
+        const g2o::Sim3& Scw = it->second;
+        const Eigen::Vector3d OwBefore = -(Scw.rotation().conjugate() * Scw.translation());
+        const Eigen::Vector3d Ow = pKF->GetCameraCenter().cast<double>();
+        const Eigen::AngleAxisd dR(Scw.rotation().conjugate() * pKF->GetPose().unit_quaternion().cast<double>());
+        if(fabs(dR.angle()) > kMinGBAKeyFrameRotCorrection)
+        {
+            sMovedKFs.insert(pKF);
+            continue;
+        }
+        // the displacement is compared with the scene depth, since the map scale is arbitrary (e.g. monocular)
+        const float medianDepth = pKF->ComputeSceneMedianDepth(2);
+        if(medianDepth <= 0 || (Ow - OwBefore).norm() > kMinGBAKeyFrameCorrection * medianDepth)
+            sMovedKFs.insert(pKF);
+    }
+
+    // the correction is not local: full GBA
+    std::set<KeyFramePtr> sFixedKFs;
+    if(sMovedKFs.size() > skMaxAffectedKeyFramesRatio * vpKFs.size())
+        return sFixedKFs;
+
+    for(const KeyFramePtr& pKF : vpKFs)
+    {
+        if(!pKF->isBad() && !sMovedKFs.count(pKF))
+            sFixedKFs.insert(pKF);
+    }
+    Verbose::PrintMess("GBA on the " + to_string(sMovedKFs.size()) + " keyframes moved by the loop correction", Verbose::VERBOSITY_NORMAL);
+    return sFixedKFs;
+}
+
+void LoopClosing::UpdateMapWithGBA(Map* pActiveMap, const unsigned long nLoopKF)
+{
 #if ENABLE_CHANGES_FOR_INFINITE_LOOP_ISSUE              
-            // Reset the visited flag of all the keyframes          
-            vector< KeyFramePtr > vpKeyFrames = pActiveMap->GetAllKeyFrames();
-            for (int i = 0; i < (int)vpKeyFrames.size(); i++)
-                vpKeyFrames[i]->mbVisited = false;
+    // Reset the visited flag of all the keyframes          
+    vector< KeyFramePtr > vpKeyFrames = pActiveMap->GetAllKeyFrames();
+    for (int i = 0; i < (int)vpKeyFrames.size(); i++)
+        vpKeyFrames[i]->mbVisited = false;
 #endif
 
-            //pActiveMap->PrintEssentialGraph();
+    //pActiveMap->PrintEssentialGraph();
 
-            // Correct keyframes starting at map first keyframe
-            list<KeyFramePtr> lpKFtoCheck(pActiveMap->mvpKeyFrameOrigins.begin(),pActiveMap->mvpKeyFrameOrigins.end());
+    // Correct keyframes starting at map first keyframe
+    list<KeyFramePtr> lpKFtoCheck(pActiveMap->mvpKeyFrameOrigins.begin(),pActiveMap->mvpKeyFrameOrigins.end());
 
-            while(!lpKFtoCheck.empty())
-            {
-                KeyFramePtr pKF = lpKFtoCheck.front();
+    while(!lpKFtoCheck.empty())
+    {
+        KeyFramePtr pKF = lpKFtoCheck.front();
 #if ENABLE_CHANGES_FOR_INFINITE_LOOP_ISSUE                     
-                pKF->mbVisited = true;                
+        pKF->mbVisited = true;                
 #endif         
-                const set<KeyFramePtr> sChilds = pKF->GetChilds();
-                //cout << "---Updating KF " << pKF->mnId << " with " << sChilds.size() << " childs" << endl;
-                //cout << " KF mnBAGlobalForKF: " << pKF->mnBAGlobalForKF << endl;
-                Sophus::SE3f Twc = pKF->GetPoseInverse();
-                //cout << "Twc: " << Twc << endl;
-                //cout << "GBA: Correct KeyFrames" << endl;
-                for(set<KeyFramePtr>::const_iterator sit=sChilds.begin();sit!=sChilds.end();sit++)
-                {
-                    KeyFramePtr pChild = *sit;
+        const set<KeyFramePtr> sChilds = pKF->GetChilds();
+        //cout << "---Updating KF " << pKF->mnId << " with " << sChilds.size() << " childs" << endl;
+        //cout << " KF mnBAGlobalForKF: " << pKF->mnBAGlobalForKF << endl;
+        Sophus::SE3f Twc = pKF->GetPoseInverse();
+        //cout << "Twc: " << Twc << endl;
+        //cout << "GBA: Correct KeyFrames" << endl;
+        for(set<KeyFramePtr>::const_iterator sit=sChilds.begin();sit!=sChilds.end();sit++)
+        {
+            KeyFramePtr pChild = *sit;
 #if ENABLE_CHANGES_FOR_INFINITE_LOOP_ISSUE                        
-                    if (pChild->mbVisited) continue;                    
+            if (pChild->mbVisited) continue;                    
 #endif
-                    if(!pChild || pChild->isBad())
-                        continue;
-
-                    if(pChild->mnBAGlobalForKF!=nLoopKF)
-                    {
-                        //cout << "++++New child with flag " << pChild->mnBAGlobalForKF << "; LoopKF: " << nLoopKF << endl;
-                        //cout << " child id: " << pChild->mnId << endl;
-                        Sophus::SE3f Tchildc = pChild->GetPose() * Twc;
-                        //cout << "Child pose: " << Tchildc << endl;
-                        //cout << "pKF->mTcwGBA: " << pKF->mTcwGBA << endl;
-                        pChild->mTcwGBA = Tchildc * pKF->mTcwGBA;//*Tcorc*pKF->mTcwGBA;
-
-                        Sophus::SO3f Rcor = pChild->mTcwGBA.so3().inverse() * pChild->GetPose().so3();
-                        if(pChild->isVelocitySet()){
-                            pChild->mVwbGBA = Rcor * pChild->GetVelocity();
-                        }
-                        else
-                            Verbose::PrintMess("Child velocity empty!! ", Verbose::VERBOSITY_NORMAL);
+            if(!pChild || pChild->isBad())
+                continue;
 
+            if(pChild->mnBAGlobalForKF!=nLoopKF)
+            {
+                //cout << "++++New child with flag " << pChild->mnBAGlobalForKF << "; LoopKF: " << nLoopKF << endl;
+                //cout << " child id: " << pChild->mnId << endl;
+                Sophus::SE3f Tchildc = pChild->GetPose() * Twc;
+                //cout << "Child pose: " << Tchildc << endl;
+                //cout << "pKF->mTcwGBA: " << pKF->mTcwGBA << endl;
+                pChild->mTcwGBA = Tchildc * pKF->mTcwGBA;//*Tcorc*pKF->mTcwGBA;
 
-                        //cout << "Child bias: " << pChild->GetImuBias() << endl;
-                        pChild->mBiasGBA = pChild->GetImuBias();
+                Sophus::SO3f Rcor = pChild->mTcwGBA.so3().inverse() * pChild->GetPose().so3();
+                if(pChild->isVelocitySet()){
+                    pChild->mVwbGBA = Rcor * pChild->GetVelocity();
+                }
+                else
+                    Verbose::PrintMess("Child velocity empty!! ", Verbose::VERBOSITY_NORMAL);
 
 
-                        pChild->mnBAGlobalForKF = nLoopKF;
+                //cout << "Child bias: " << pChild->GetImuBias() << endl;
+                pChild->mBiasGBA = pChild->GetImuBias();
 
-                    }
-                    lpKFtoCheck.push_back(pChild);
-                }
 
-                //cout << "-------Update pose" << endl;
-                pKF->mTcwBefGBA = pKF->GetPose();
-                //cout << "pKF->mTcwBefGBA: " << pKF->mTcwBefGBA << endl;
-                pKF->SetPose(pKF->mTcwGBA);
-                /*cv::Mat Tco_cn = pKF->mTcwBefGBA * pKF->mTcwGBA.inv();
-                cv::Vec3d trasl = Tco_cn.rowRange(0,3).col(3);
-                double dist = cv::norm(trasl);
-                cout << "GBA: KF " << pKF->mnId << " had been moved " << dist << " meters" << endl;
-                double desvX = 0;
-                double desvY = 0;
-                double desvZ = 0;
-                if(pKF->mbHasHessian)
-                {
-                    cv::Mat hessianInv = pKF->mHessianPose.inv();
-
-                    double covX = hessianInv.at<double>(3,3);
-                    desvX = std::sqrt(covX);
-                    double covY = hessianInv.at<double>(4,4);
-                    desvY = std::sqrt(covY);
-                    double covZ = hessianInv.at<double>(5,5);
-                    desvZ = std::sqrt(covZ);
-                    pKF->mbHasHessian = false;
-                }
-                if(dist > 1)
-                {
-                    cout << "--To much distance correction: It has " << pKF->GetConnectedKeyFrames().size() << " connected KFs" << endl;
-                    cout << "--It has " << pKF->GetCovisiblesByWeight(80).size() << " connected KF with 80 common matches or more" << endl;
-                    cout << "--It has " << pKF->GetCovisiblesByWeight(50).size() << " connected KF with 50 common matches or more" << endl;
-                    cout << "--It has " << pKF->GetCovisiblesByWeight(20).size() << " connected KF with 20 common matches or more" << endl;
+                pChild->mnBAGlobalForKF = nLoopKF;
 
-                    cout << "--STD in meters(x, y, z): " << desvX << ", " << desvY << ", " << desvZ << endl;
+            }
+            lpKFtoCheck.push_back(pChild);
+        }
 
+        //cout << "-------Update pose" << endl;
+        pKF->mTcwBefGBA = pKF->GetPose();
+        //cout << "pKF->mTcwBefGBA: " << pKF->mTcwBefGBA << endl;
+        pKF->SetPose(pKF->mTcwGBA);
+        /*cv::Mat Tco_cn = pKF->mTcwBefGBA * pKF->mTcwGBA.inv();
+        cv::Vec3d trasl = Tco_cn.rowRange(0,3).col(3);
+        double dist = cv::norm(trasl);
+        cout << "GBA: KF " << pKF->mnId << " had been moved " << dist << " meters" << endl;
+        double desvX = 0;
+        double desvY = 0;
+        double desvZ = 0;
+        if(pKF->mbHasHessian)
+        {
+            cv::Mat hessianInv = pKF->mHessianPose.inv();
 
-                    string strNameFile = pKF->mNameFile;
-                    cv::Mat imLeft = cv::imread(strNameFile, cv::IMREAD_UNCHANGED);
+            double covX = hessianInv.at<double>(3,3);
+            desvX = std::sqrt(covX);
+            double covY = hessianInv.at<double>(4,4);
+            desvY = std::sqrt(covY);
+            double covZ = hessianInv.at<double>(5,5);
+            desvZ = std::sqrt(covZ);
+            pKF->mbHasHessian = false;
+        }
+        if(dist > 1)
+        {
+            cout << "--To much distance correction: It has " << pKF->GetConnectedKeyFrames().size() << " connected KFs" << endl;
+            cout << "--It has " << pKF->GetCovisiblesByWeight(80).size() << " connected KF with 80 common matches or more" << endl;
+            cout << "--It has " << pKF->GetCovisiblesByWeight(50).size() << " connected KF with 50 common matches or more" << endl;
+            cout << "--It has " << pKF->GetCovisiblesByWeight(20).size() << " connected KF with 20 common matches or more" << endl;
 
-                    cv::cvtColor(imLeft, imLeft, cv::COLOR_GRAY2BGR);
+            cout << "--STD in meters(x, y, z): " << desvX << ", " << desvY << ", " << desvZ << endl;
 
-                    vector<MapPointPtr> vpMapPointsKF = pKF->GetMapPointMatches();
-                    int num_MPs = 0;
-                    for(int i=0; i<vpMapPointsKF.size(); ++i)
-                    {
-                        if(!vpMapPointsKF[i] || vpMapPointsKF[i]->isBad())
-                        {
-                            continue;
-                        }
-                        num_MPs += 1;
-                        string strNumOBs = to_string(vpMapPointsKF[i]->Observations());
-                        cv::circle(imLeft, pKF->mvKeys[i].pt, 2, cv::Scalar(0, 255, 0));
-                        cv::putText(imLeft, strNumOBs, pKF->mvKeys[i].pt, CV_FONT_HERSHEY_DUPLEX, 1, cv::Scalar(255, 0, 0));
-                    }
-                    cout << "--It has " << num_MPs << " MPs matched in the map" << endl;
 
-                    string namefile = "./test_GBA/GBA_" + to_string(nLoopKF) + "_KF" + to_string(pKF->mnId) +"_D" + to_string(dist) +".png";
-                    cv::imwrite(namefile, imLeft);
-                }*/
+            string strNameFile = pKF->mNameFile;
+            cv::Mat imLeft = cv::imread(strNameFile, cv::IMREAD_UNCHANGED);
 
+            cv::cvtColor(imLeft, imLeft, cv::COLOR_GRAY2BGR);
 
-                if(pKF->bImu)
+            vector<MapPointPtr> vpMapPointsKF = pKF->GetMapPointMatches();
+            int num_MPs = 0;
+            for(int i=0; i<vpMapPointsKF.size(); ++i)
+            {
+                if(!vpMapPointsKF[i] || vpMapPointsKF[i]->isBad())
                 {
-                    //cout << "-------Update inertial values" << endl;
-                    pKF->mVwbBefGBA = pKF->GetVelocity();
-                    //if (pKF->mVwbGBA.empty())
-                    //    Verbose::PrintMess("pKF->mVwbGBA is empty", Verbose::VERBOSITY_NORMAL);
-
-                    //assert(!pKF->mVwbGBA.empty());
-                    pKF->SetVelocity(pKF->mVwbGBA);
-                    pKF->SetNewBias(pKF->mBiasGBA);                    
+                    continue;
                 }
-
-                lpKFtoCheck.pop_front();
+                num_MPs += 1;
+                string strNumOBs = to_string(vpMapPointsKF[i]->Observations());
+                cv::circle(imLeft, pKF->mvKeys[i].pt, 2, cv::Scalar(0, 255, 0));
+                cv::putText(imLeft, strNumOBs, pKF->mvKeys[i].pt, CV_FONT_HERSHEY_DUPLEX, 1, cv::Scalar(255, 0, 0));
             }
+            cout << "--It has " << num_MPs << " MPs matched in the map" << endl;
 
-            //cout << "GBA: Correct MapPoints" << endl;
-            // Correct MapPoints
-            const vector<MapPointPtr> vpMPs = pActiveMap->GetAllMapPoints();
+            string namefile = "./test_GBA/GBA_" + to_string(nLoopKF) + "_KF" + to_string(pKF->mnId) +"_D" + to_string(dist) +".png";
+            cv::imwrite(namefile, imLeft);
+        }*/
 
-            for(size_t i=0; i<vpMPs.size(); i++)
-            {
-                MapPointPtr pMP = vpMPs[i];
 
-                if(pMP->isBad())
-                    continue;
+        if(pKF->bImu)
+        {
+            //cout << "-------Update inertial values" << endl;
+            pKF->mVwbBefGBA = pKF->GetVelocity();
+            //if (pKF->mVwbGBA.empty())
+            //    Verbose::PrintMess("pKF->mVwbGBA is empty", Verbose::VERBOSITY_NORMAL);
 
-                if(pMP->mnBAGlobalForKF==nLoopKF)
-                {
-                    // If optimized by Global BA, just update
-                    pMP->SetWorldPos(pMP->mPosGBA);
-                }
-                else
-                {
-                    // Update according to the correction of its reference keyframe
-                    KeyFramePtr pRefKF = pMP->GetReferenceKeyFrame();
+            //assert(!pKF->mVwbGBA.empty());
+            pKF->SetVelocity(pKF->mVwbGBA);
+            pKF->SetNewBias(pKF->mBiasGBA);                    
+        }
 
-                    if(pRefKF->mnBAGlobalForKF!=nLoopKF)
-                        continue;
+        lpKFtoCheck.pop_front();
+    }
 
-                    /*if(pRefKF->mTcwBefGBA.empty())
-                        continue;*/
+    //cout << "GBA: Correct MapPoints" << endl;
+    // Correct MapPoints
+    const vector<MapPointPtr> vpMPs = pActiveMap->GetAllMapPoints();
 
-                    // Map to non-corrected camera
-                    // cv::Mat Rcw = pRefKF->mTcwBefGBA.rowRange(0,3).colRange(0,3);
-                    // cv::Mat tcw = pRefKF->mTcwBefGBA.rowRange(0,3).col(3);
-                    Eigen::Vector3f Xc = pRefKF->mTcwBefGBA * pMP->GetWorldPos();
+    for(size_t i=0; i<vpMPs.size(); i++)
+    {
+        MapPointPtr pMP = vpMPs[i];
 
-                    // Backproject using corrected camera
-                    pMP->SetWorldPos(pRefKF->GetPoseInverse() * Xc);
-                }
-            }
+        if(pMP->isBad())
+            continue;
 
-	    // Correct MapLines
-            if(mpTracker->IsLineTracking())
-            {
-                const vector<MapLinePtr> vpMLs = pActiveMap->GetAllMapLines();
+        if(pMP->mnBAGlobalForKF==nLoopKF)
+        {
+            // If optimized by Global BA, just update
+            pMP->SetWorldPos(pMP->mPosGBA);
+        }
+        else
+        {
+            // Update according to the correction of its reference keyframe
+            KeyFramePtr pRefKF = pMP->GetReferenceKeyFrame();
 
-                for(size_t i=0; i<vpMLs.size(); i++)
-                {
-                    MapLinePtr pML = vpMLs[i];
+            if(pRefKF->mnBAGlobalForKF!=nLoopKF)
+                continue;
 
-                    if(pML->isBad())
-                        continue;
+            /*if(pRefKF->mTcwBefGBA.empty())
+                continue;*/
 
-                    if(pML->mnBAGlobalForKF==nLoopKF)
-                    {
-                        // If optimized by Global BA, just update
-                        pML->SetWorldEndPoints(pML->mPosStartGBA, pML->mPosEndGBA);
-                        pML->UpdateNormalAndDepth();
-                    }
-                    else
-                    {
-                        // Update according to the correction of its reference keyframe
-                        KeyFramePtr pRefKF = pML->GetReferenceKeyFrame();
+            // Map to non-corrected camera
+            // cv::Mat Rcw = pRefKF->mTcwBefGBA.rowRange(0,3).colRange(0,3);
+            // cv::Mat tcw = pRefKF->mTcwBefGBA.rowRange(0,3).col(3);
+            Eigen::Vector3f Xc = pRefKF->mTcwBefGBA * pMP->GetWorldPos();
 
-                        if(pRefKF->mnBAGlobalForKF!=nLoopKF)
-                            continue;
+            // Backproject using corrected camera
+            pMP->SetWorldPos(pRefKF->GetPoseInverse() * Xc);
+        }
+    }
 
-                        // Map to non-corrected camera
-                        //cv::Mat Rcw = pRefKF->mTcwBefGBA.rowRange(0,3).colRange(0,3);
-                        //cv::Mat tcw = pRefKF->mTcwBefGBA.rowRange(0,3).col(3);
-                        
-                        Eigen::Vector3f XSw, XEw;
-                        pML->GetWorldEndPoints(XSw, XEw);  
-                        Eigen::Vector3f XSc = pRefKF->mTcwBefGBA * XSw;
-                        Eigen::Vector3f XEc = pRefKF->mTcwBefGBA * XEw;
+	    // Correct MapLines
+    if(mpTracker->IsLineTracking())
+    {
+        const vector<MapLinePtr> vpMLs = pActiveMap->GetAllMapLines();
 
-                        // Backproject using corrected camera
-                        const Sophus::SE3f Twc = pRefKF->GetPoseInverse();
+        for(size_t i=0; i<vpMLs.size(); i++)
+        {
+            MapLinePtr pML = vpMLs[i];
 
-                        pML->SetWorldEndPoints(Twc*XSc, Twc*XEc);                        
-                        pML->UpdateNormalAndDepth();
-                    }
-                }    
-            }
+            if(pML->isBad())
+                continue;
 
-            // Correct MapObjects
-            if(mpTracker->IsObjectTracking())
+            if(pML->mnBAGlobalForKF==nLoopKF)
             {
-                const vector<MapObjectPtr > vpMObjs = pActiveMap->GetAllMapObjects();
-
-                for(size_t i=0; i<vpMObjs.size(); i++)
-                {
-                    MapObjectPtr pMObj = vpMObjs[i];
+                // If optimized by Global BA, just update
+                pML->SetWorldEndPoints(pML->mPosStartGBA, pML->mPosEndGBA);
+                pML->UpdateNormalAndDepth();
+            }
+            else
+            {
+                // Update according to the correction of its reference keyframe
+                KeyFramePtr pRefKF = pML->GetReferenceKeyFrame();
 
-                    if(pMObj->isBad())
-                        continue;
+                if(pRefKF->mnBAGlobalForKF!=nLoopKF)
+                    continue;
 
-                    if(pMObj->mnBAGlobalForKF==nLoopKF)
-                    {
-                        // If optimized by Global BA, just update
-                        pMObj->SetSim3Pose(pMObj->mSowGBA);
-                        //pMObj->UpdateNormalAndDepth();
-                    }
-                    else
-                    {
-                        // Update according to the correction of its reference keyframe
-                        KeyFramePtr pRefKF = pMObj->GetReferenceKeyFrame();
+                // Map to non-corrected camera
+                //cv::Mat Rcw = pRefKF->mTcwBefGBA.rowRange(0,3).colRange(0,3);
+                //cv::Mat tcw = pRefKF->mTcwBefGBA.rowRange(0,3).col(3);
+                
+                Eigen::Vector3f XSw, XEw;
+                pML->GetWorldEndPoints(XSw, XEw);  
+                Eigen::Vector3f XSc = pRefKF->mTcwBefGBA * XSw;
+                Eigen::Vector3f XEc = pRefKF->mTcwBefGBA * XEw;
 
-                        if(pRefKF->mnBAGlobalForKF!=nLoopKF)
-                            continue;
+                // Backproject using corrected camera
+                const Sophus::SE3f Twc = pRefKF->GetPoseInverse();
 
-                        // Map to non-corrected camera
-                        Eigen::Matrix3f Rcw = pRefKF->mTcwBefGBA.rotationMatrix();
-                        Eigen::Vector3f tcw = pRefKF->mTcwBefGBA.translation();
-                        
-                        Eigen::Matrix3f Rwo; 
-                        Eigen::Vector3f two; 
-                        double scale = pMObj->GetScale();
-                        Rwo = pMObj->GetInverseRotation();
-                        two = pMObj->GetInverseTranslation();
-                        const Eigen::Matrix3f Rco = Rcw*Rwo;
-                        const Eigen::Vector3f tco = Rcw*two+tcw;  
-
-                        // Backproject using corrected camera
-                        const Sophus::SE3f Twc = pRefKF->GetPoseInverse();
-                        Eigen::Matrix3f Rwc = Twc.rotationMatrix();
-                        Eigen::Vector3f twc = Twc.translation();
-                     
-                        const Eigen::Matrix3f RwoNew = Rwc*Rco;
-                        const Eigen::Vector3f twoNew = Rwc*tco+twc;
-                        
-                        pMObj->SetSim3InversePose(RwoNew, twoNew, scale);
-                    }
-                }    
+                pML->SetWorldEndPoints(Twc*XSc, Twc*XEc);                        
+                pML->UpdateNormalAndDepth();
             }
+        }    
+    }
 
-            pActiveMap->InformNewBigChange();
-            pActiveMap->IncreaseChangeIndex();
-
-            // TODO Check this update
-            // mpTracker->UpdateFrameIMU(1.0f, mpTracker->GetLastKeyFrame()->GetImuBias(), mpTracker->GetLastKeyFrame());
+    // Correct MapObjects
+    if(mpTracker->IsObjectTracking())
+    {
+        const vector<MapObjectPtr > vpMObjs = pActiveMap->GetAllMapObjects();
 
-            mpLocalMapper->Release();
+        for(size_t i=0; i<vpMObjs.size(); i++)
+        {
+            MapObjectPtr pMObj = vpMObjs[i];
 
-#ifdef REGISTER_TIMES
-            std::chrono::steady_clock::time_point time_EndUpdateMap = std::chrono::steady_clock::now();
+            if(pMObj->isBad())
+                continue;
 
-            double timeUpdateMap = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndUpdateMap - time_EndGBA).count();
-            vdUpdateMap_ms.push_back(timeUpdateMap);
+            if(pMObj->mnBAGlobalForKF==nLoopKF)
+            {
+                // If optimized by Global BA, just update
+                pMObj->SetSim3Pose(pMObj->mSowGBA);
+                //pMObj->UpdateNormalAndDepth();
+            }
+            else
+            {
+                // Update according to the correction of its reference keyframe
+                KeyFramePtr pRefKF = pMObj->GetReferenceKeyFrame();
 
-            double timeFGBA = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndUpdateMap - time_StartFGBA).count();
-            vdFGBATotal_ms.push_back(timeFGBA);
-#endif
-            Verbose::PrintMess("Map updated!", Verbose::VERBOSITY_NORMAL);
-        }
+                if(pRefKF->mnBAGlobalForKF!=nLoopKF)
+                    continue;
 
-        mbFinishedGBA = true;
-        mbRunningGBA = false;
+                // Map to non-corrected camera
+                Eigen::Matrix3f Rcw = pRefKF->mTcwBefGBA.rotationMatrix();
+                Eigen::Vector3f tcw = pRefKF->mTcwBefGBA.translation();
+                
+                Eigen::Matrix3f Rwo; 
+                Eigen::Vector3f two; 
+                double scale = pMObj->GetScale();
+                Rwo = pMObj->GetInverseRotation();
+                two = pMObj->GetInverseTranslation();
+                const Eigen::Matrix3f Rco = Rcw*Rwo;
+                const Eigen::Vector3f tco = Rcw*two+tcw;  
+
+                // Backproject using corrected camera
+                const Sophus::SE3f Twc = pRefKF->GetPoseInverse();
+                Eigen::Matrix3f Rwc = Twc.rotationMatrix();
+                Eigen::Vector3f twc = Twc.translation();
+             
+                const Eigen::Matrix3f RwoNew = Rwc*Rco;
+                const Eigen::Vector3f twoNew = Rwc*tco+twc;
+                
+                pMObj->SetSim3InversePose(RwoNew, twoNew, scale);
+            }
+        }    
     }
-    
-    mSignalGlobalBundleAdjustmentFinished.emit();
+
+    pActiveMap->InformNewBigChange();
+    pActiveMap->IncreaseChangeIndex();
 }
 
 void LoopClosing::RequestFinish()
 {
-    unique_lock<mutex> lock(mMutexFinish);
-    // cout << "LC: Finish requested" << endl;
-    mbFinishRequested = true;
+    {
+        unique_lock<mutex> lock(mMutexFinish);
+        // cout << "LC: Finish requested" << endl;
+        mbFinishRequested = true;
+    }
+    mWakeUpEvent.Notify();
 }
 
 bool LoopClosing::CheckFinish()
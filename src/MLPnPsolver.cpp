@@ -96,6 +96,10 @@ namespace PLVS2 {
         SetRansacParameters();
     }
 
+    void MLPnPsolver::SetRandomSeed(unsigned int seed){
+        mRng.seed(seed);
+    }
+
     //RANSAC methods
     bool MLPnPsolver::iterate(int nIterations, bool &bNoMore, vector<bool> &vbInliers, int &nInliers, Eigen::Matrix4f &Tout){
         Tout.setIdentity();
@@ -127,7 +131,7 @@ namespace PLVS2 {
 	        // Get min set of points
 	        for(short i = 0; i < mRansacMinSet; ++i)
 	        {
-	            int randi = DUtils::Random::RandomInt(0, vAvailableIndices.size()-1);
+	            int randi = std::uniform_int_distribution<int>(0, vAvailableIndices.size()-1)(mRng);
 
 	            int idx = vAvailableIndices[randi];
 
@@ -208,6 +208,15 @@ Eigen::Vector3f MapLine::GetNormal()
     return mNormalVector;
 }
 
+void MapLine::GetProjectionData(Eigen::Vector3f &PosStart, Eigen::Vector3f &PosEnd, Eigen::Vector3f &Normal, float &maxDistance)
+{
+    unique_lock<mutex> lock(mMutexPos);
+    PosStart = mWorldPosStart;
+    PosEnd = mWorldPosEnd;
+    Normal = mNormalVector;
+    maxDistance = mfMaxDistance;
+}
+
 float MapLine::GetLength()
 {
     unique_lock<mutex> lock(mMutexPos);
@@ -168,6 +168,14 @@ Eigen::Vector3f MapPoint::GetNormal() {
     return mNormalVector;
 }
 
+void MapPoint::GetProjectionData(Eigen::Vector3f &Pos, Eigen::Vector3f &Normal, float &minDistance, float &maxDistance) {
+    unique_lock<mutex> lock(mMutexPos);
+    Pos = mWorldPos;
+    Normal = mNormalVector;
+    minDistance = mfMinDistance;
+    maxDistance = mfMaxDistance;
+}
+
 
 KeyFramePtr MapPoint::GetReferenceKeyFrame()
 {
@@ -0,0 +1,266 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "ORBdescriptorKernel.h"
+
+#include <cstring>
+#include <cmath>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ORB_KERNEL_X86 1
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ORB_KERNEL_NEON 1
+#endif
+
+
+namespace PLVS2
+{
+
+static constexpr float kFactorPI = (float)(CV_PI/180.f);
+
+// the rotated offsets must be rounded exactly as in the vectorized kernels (mul and add, no fused multiply-add)
+#if defined(__clang__)
+#define ORB_KERNEL_NO_FP_CONTRACT _Pragma("clang fp contract(off)")
+#define ORB_KERNEL_NO_FP_CONTRACT_ATTRIBUTE
+#elif defined(__GNUC__)
+#define ORB_KERNEL_NO_FP_CONTRACT
+#define ORB_KERNEL_NO_FP_CONTRACT_ATTRIBUTE __attribute__((optimize("fp-contract=off")))
+#else
+#define ORB_KERNEL_NO_FP_CONTRACT
+#define ORB_KERNEL_NO_FP_CONTRACT_ATTRIBUTE
+#endif
+
+
+// Original (scalar) rBRIEF loop
+ORB_KERNEL_NO_FP_CONTRACT_ATTRIBUTE
+static void computeOrbDescriptorScalar(const cv::KeyPoint& kpt, const cv::Mat& img, const cv::Point* pattern, uchar* desc)
+{
+    ORB_KERNEL_NO_FP_CONTRACT
+    const float angle = (float)kpt.angle*kFactorPI;
+    const float a = (float)cos(angle), b = (float)sin(angle);
+
+    const uchar* center = &img.at<uchar>(cvRound(kpt.pt.y), cvRound(kpt.pt.x));
+    const int step = (int)img.step;
+
+#define GET_VALUE(idx) \
+    center[cvRound(pattern[idx].x*b + pattern[idx].y*a)*step + \
+           cvRound(pattern[idx].x*a - pattern[idx].y*b)]
+
+    for (int i = 0; i < 32; ++i, pattern += 16)
+    {
+        int t0, t1, val;
+        t0 = GET_VALUE(0); t1 = GET_VALUE(1);
+        val = t0 < t1;
+        t0 = GET_VALUE(2); t1 = GET_VALUE(3);
+        val |= (t0 < t1) << 1;
+        t0 = GET_VALUE(4); t1 = GET_VALUE(5);
+        val |= (t0 < t1) << 2;
+        t0 = GET_VALUE(6); t1 = GET_VALUE(7);
+        val |= (t0 < t1) << 3;
+        t0 = GET_VALUE(8); t1 = GET_VALUE(9);
+        val |= (t0 < t1) << 4;
+        t0 = GET_VALUE(10); t1 = GET_VALUE(11);
+        val |= (t0 < t1) << 5;
+        t0 = GET_VALUE(12); t1 = GET_VALUE(13);
+        val |= (t0 < t1) << 6;
+        t0 = GET_VALUE(14); t1 = GET_VALUE(15);
+        val |= (t0 < t1) << 7;
+
+        desc[i] = (uchar)val;
+    }
+
+#undef GET_VALUE
+}
+
+
+#if ORB_KERNEL_X86
+
+// N.B.: _mm256_cvtps_epi32 rounds to nearest-even as cvRound() does on x86 (both use the current MXCSR rounding mode)
+__attribute__((target("avx2")))
+static void computeOrbDescriptorAVX2(const uchar* center, const int step, const float a, const float b,
+                                     const float* patternX, const float* patternY, uchar* desc)
+{
+    alignas(32) int offsets[ORBdescriptorKernel::kNumPatternPoints];
+    alignas(32) uchar values0[256];
+    alignas(32) uchar values1[256];
+
+    const __m256 va = _mm256_set1_ps(a);
+    const __m256 vb = _mm256_set1_ps(b);
+    const __m256i vstep = _mm256_set1_epi32(step);
+
+    for(int k = 0; k < ORBdescriptorKernel::kNumPatternPoints; k += 8)
+    {
+        const __m256 x = _mm256_load_ps(patternX + k);
+        const __m256 y = _mm256_load_ps(patternY + k);
+        const __m256i iy = _mm256_cvtps_epi32(_mm256_add_ps(_mm256_mul_ps(x, vb), _mm256_mul_ps(y, va)));
+        const __m256i ix = _mm256_cvtps_epi32(_mm256_sub_ps(_mm256_mul_ps(x, va), _mm256_mul_ps(y, vb)));
+        _mm256_store_si256((__m256i*)(offsets + k), _mm256_add_epi32(_mm256_mullo_epi32(iy, vstep), ix));
+    }
+
+    // pair p is made of the pattern points (2p, 2p+1) and sets the bit (p%8) of the byte p/8
+    for(int p = 0; p < 256; p++)
+    {
+        values0[p] = center[offsets[2*p]];
+        values1[p] = center[offsets[2*p+1]];
+    }
+
+    const __m256i bias = _mm256_set1_epi8((char)0x80);
+    for(int k = 0; k < 256; k += 32)
+    {
+        const __m256i t0 = _mm256_xor_si256(_mm256_load_si256((const __m256i*)(values0 + k)), bias);
+        const __m256i t1 = _mm256_xor_si256(_mm256_load_si256((const __m256i*)(values1 + k)), bias);
+        const int mask = _mm256_movemask_epi8(_mm256_cmpgt_epi8(t1, t0)); // unsigned t0 < t1
+        memcpy(desc + k/8, &mask, 4);
+    }
+}
+
+#endif // ORB_KERNEL_X86
+
+
+#if ORB_KERNEL_NEON
+
+static void computeOrbDescriptorNEON(const uchar* center, const int step, const float a, const float b,
+                                     const float* patternX, const float* patternY, uchar* desc)
+{
+    alignas(16) int offsets[ORBdescriptorKernel::kNumPatternPoints];
+    alignas(16) uchar values0[256];
+    alignas(16) uchar values1[256];
+
+    const float32x4_t va = vdupq_n_f32(a);
+    const float32x4_t vb = vdupq_n_f32(b);
+    const int32x4_t vstep = vdupq_n_s32(step);
+
+    for(int k = 0; k < ORBdescriptorKernel::kNumPatternPoints; k += 4)
+    {
+        const float32x4_t x = vld1q_f32(patternX + k);
+        const float32x4_t y = vld1q_f32(patternY + k);
+        const int32x4_t iy = vcvtnq_s32_f32(vaddq_f32(vmulq_f32(x, vb), vmulq_f32(y, va)));
+        const int32x4_t ix = vcvtnq_s32_f32(vsubq_f32(vmulq_f32(x, va), vmulq_f32(y, vb)));
+        vst1q_s32(offsets + k, vmlaq_s32(ix, iy, vstep));
+    }
+
+    for(int p = 0; p < 256; p++)
+    {
+        values0[p] = center[offsets[2*p]];
+        values1[p] = center[offsets[2*p+1]];
+    }
+
+    static const uint8_t kBitWeights[16] = {1,2,4,8,16,32,64,128, 1,2,4,8,16,32,64,128};
+    const uint8x16_t weights = vld1q_u8(kBitWeights);
+    for(int k = 0; k < 256; k += 16)
+    {
+        const uint8x16_t lt = vcltq_u8(vld1q_u8(values0 + k), vld1q_u8(values1 + k));
+        const uint8x16_t bits = vandq_u8(lt, weights);
+        desc[k/8]   = vaddv_u8(vget_low_u8(bits));
+        desc[k/8+1] = vaddv_u8(vget_high_u8(bits));
+    }
+}
+
+#endif // ORB_KERNEL_NEON
+
+
+ORBdescriptorKernel::ORBdescriptorKernel(const std::vector<cv::Point>& pattern): pattern_(pattern)
+{
+    if(pattern_.size() < (size_t)kNumPatternPoints)
+    {
+        std::cerr << "ORBdescriptorKernel::ORBdescriptorKernel() - pattern must have " << kNumPatternPoints << " points" << std::endl;
+        pattern_.resize(kNumPatternPoints, cv::Point(0,0));
+    }
+
+    for(int k = 0; k < kNumPatternPoints; k++)
+    {
+        patternX_[k] = (float)pattern_[k].x;
+        patternY_[k] = (float)pattern_[k].y;
+    }
+
+    simdType_ = GetBestSimdType();
+}
+
+ORBdescriptorKernel::SimdType ORBdescriptorKernel::GetBestSimdType()
+{
+#if ORB_KERNEL_X86
+    if(__builtin_cpu_supports("avx2"))
+        return kAVX2;
+#endif
+#if ORB_KERNEL_NEON
+    return kNEON;
+#endif
+    return kScalar;
+}
+
+std::string ORBdescriptorKernel::GetSimdTypeName(SimdType type)
+{
+    switch(type)
+    {
+        case kAVX2: return "AVX2";
+        case kNEON: return "NEON";
+        default:    return "scalar";
+    }
+}
+
+void ORBdescriptorKernel::SetSimdType(SimdType type)
+{
+    // fall back to the scalar implementation if the requested one is not supported
+    const SimdType best = GetBestSimdType();
+    simdType_ = (type == kScalar || type == best) ? type : kScalar;
+}
+
+void ORBdescriptorKernel::Compute(const cv::Mat& img, const std::vector<cv::KeyPoint>& keypoints, cv::Mat& descriptors) const
+{
+    descriptors = cv::Mat::zeros((int)keypoints.size(), 32, CV_8UC1); // 32 elements, each element is uint8_t
+
+    const int step = (int)img.step;
+
+    switch(simdType_)
+    {
+#if ORB_KERNEL_X86
+    case kAVX2:
+        for (size_t i = 0; i < keypoints.size(); i++)
+        {
+            const cv::KeyPoint& kpt = keypoints[i];
+            const float angle = (float)kpt.angle*kFactorPI;
+            const uchar* center = &img.at<uchar>(cvRound(kpt.pt.y), cvRound(kpt.pt.x));
+            computeOrbDescriptorAVX2(center, step, (float)cos(angle), (float)sin(angle), patternX_, patternY_, descriptors.ptr((int)i));
+        }
+        break;
+#endif
+#if ORB_KERNEL_NEON
+    case kNEON:
+        for (size_t i = 0; i < keypoints.size(); i++)
+        {
+            const cv::KeyPoint& kpt = keypoints[i];
+            const float angle = (float)kpt.angle*kFactorPI;
+            const uchar* center = &img.at<uchar>(cvRound(kpt.pt.y), cvRound(kpt.pt.x));
+            computeOrbDescriptorNEON(center, step, (float)cos(angle), (float)sin(angle), patternX_, patternY_, descriptors.ptr((int)i));
+        }
+        break;
+#endif
+    default:
+        for (size_t i = 0; i < keypoints.size(); i++)
+            computeOrbDescriptorScalar(keypoints[i], img, &pattern_[0], descriptors.ptr((int)i));
+        break;
+    }
+}
+
+} // namespace PLVS2
@@ -94,6 +94,8 @@
 #include <iostream>
 
 #include "ORBextractor.h"
+#include "TaskPool.h"
+#include "ORBdescriptorKernel.h"
 
 
 using namespace cv;
@@ -106,6 +108,10 @@ namespace PLVS2
     const int HALF_PATCH_SIZE = 15;
     const int EDGE_THRESHOLD = 19;
 
+    // per-worker scratch buffers of the keypoint detection tasks (see TaskPool::GetScratch())
+    struct FASTCellScratch { vector<cv::KeyPoint> vKeysCell; };
+    struct OctTreeInputScratch { vector<cv::KeyPoint> vToDistributeKeys; };
+
 
 #ifndef USE_CUDA
     static float IC_Angle(const Mat& image, Point2f pt,  const vector<int> & u_max)
@@ -138,47 +144,6 @@ namespace PLVS2
     }
 
 
-    constexpr float factorPI = (float)(CV_PI/180.f);
-    static void computeOrbDescriptor(const KeyPoint& kpt,
-                                     const Mat& img, const Point* pattern,
-                                     uchar* desc)
-    {
-        const float angle = (float)kpt.angle*factorPI;
-        const float a = (float)cos(angle), b = (float)sin(angle);
-
-        const uchar* center = &img.at<uchar>(cvRound(kpt.pt.y), cvRound(kpt.pt.x));
-        const int step = (int)img.step;
-
-#define GET_VALUE(idx) \
-        center[cvRound(pattern[idx].x*b + pattern[idx].y*a)*step + \
-               cvRound(pattern[idx].x*a - pattern[idx].y*b)]
-
-
-        for (int i = 0; i < 32; ++i, pattern += 16)
-        {
-            int t0, t1, val;
-            t0 = GET_VALUE(0); t1 = GET_VALUE(1);
-            val = t0 < t1;
-            t0 = GET_VALUE(2); t1 = GET_VALUE(3);
-            val |= (t0 < t1) << 1;
-            t0 = GET_VALUE(4); t1 = GET_VALUE(5);
-            val |= (t0 < t1) << 2;
-            t0 = GET_VALUE(6); t1 = GET_VALUE(7);
-            val |= (t0 < t1) << 3;
-            t0 = GET_VALUE(8); t1 = GET_VALUE(9);
-            val |= (t0 < t1) << 4;
-            t0 = GET_VALUE(10); t1 = GET_VALUE(11);
-            val |= (t0 < t1) << 5;
-            t0 = GET_VALUE(12); t1 = GET_VALUE(13);
-            val |= (t0 < t1) << 6;
-            t0 = GET_VALUE(14); t1 = GET_VALUE(15);
-            val |= (t0 < t1) << 7;
-
-            desc[i] = (uchar)val;
-        }
-
-#undef GET_VALUE
-    }
 #endif
 
     static int bit_pattern_31_[256*4] =
@@ -447,7 +412,7 @@ namespace PLVS2
     ORBextractor::ORBextractor(int _nfeatures, float _scaleFactor, int _nlevels,
                                int _iniThFAST, int _minThFAST):
             nfeatures(_nfeatures), scaleFactor(_scaleFactor), nlevels(_nlevels),
-            iniThFAST(_iniThFAST), minThFAST(_minThFAST), mbPrecomputedGaussianPyramid(false)
+            iniThFAST(_iniThFAST), minThFAST(_minThFAST), mbPrecomputedGaussianPyramid(false), mpTaskPool(NULL)
     #ifdef USE_CUDA
         ,
         gpuFast(iniThFAST, minThFAST, nfeatures * 2), ic_angle(), gpuOrb()
@@ -519,10 +484,16 @@ namespace PLVS2
     #ifdef USE_CUDA
         cuda::IC_Angle::loadUMax(umax.data(), umax.size());
         cuda::GpuOrb::loadPattern(pattern.data());
+    #else
+        mpDescriptorKernel.reset(new ORBdescriptorKernel(pattern));
     #endif
 
     }
 
+    ORBextractor::~ORBextractor()
+    {
+    }
+
     #ifndef USE_CUDA
     static void computeOrientation(const Mat& image, vector<KeyPoint>& keypoints, const vector<int>& umax)
     {
@@ -865,13 +836,11 @@ namespace PLVS2
         return vResultKeys;
     }
 
+#ifdef USE_CUDA
     void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoints)
     {
         allKeypoints.resize(nlevels);
 
-        //const float W = 30; // Original value in ORBSLAM2
-        const float W = 35;
-
         const int minBorderX = EDGE_THRESHOLD-3;
         const int minBorderY = minBorderX;
             
@@ -883,8 +852,6 @@ namespace PLVS2
             vector<cv::KeyPoint> vToDistributeKeys;
             vToDistributeKeys.reserve(nfeatures*10);
 
-    #ifdef USE_CUDA
-            
             //N.B.: !in this CUDA version FAST keypoints are extracted without considering the iniThFAST and minThFAST (the tiling seems to be used at cuda kernel level)!
             
             // software pipelining
@@ -916,99 +883,15 @@ namespace PLVS2
                     mpGaussianFilter->apply(gMat, gMat, ic_angle.cvStream());
                 }
             }
-    #else
-            const float width = (maxBorderX-minBorderX);
-            const float height = (maxBorderY-minBorderY);
-            if( (width<=0) || (height<=0) ) continue;         
-
-            const int nCols = width/W;
-            const int nRows = height/W;
-            if( (nCols==0) || (nRows==0) ) continue;              
-            const int wCell = ceil(width/nCols);
-            const int hCell = ceil(height/nRows);
-
-            // divide in cells and extract FAST features
-            for(int i=0; i<nRows; i++)
-            {
-                const float iniY =minBorderY+i*hCell;
-                float maxY = iniY+hCell+6;
-
-                if(iniY>=maxBorderY-3)
-                    continue;
-                if(maxY>maxBorderY)
-                    maxY = maxBorderY;
-
-                for(int j=0; j<nCols; j++)
-                {
-                    const float iniX =minBorderX+j*wCell;
-                    float maxX = iniX+wCell+6;
-                    if(iniX>=maxBorderX-6)
-                        continue;
-                    if(maxX>maxBorderX)
-                        maxX = maxBorderX;
-
-                    vector<cv::KeyPoint> vKeysCell;
-
-                    FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                         vKeysCell,iniThFAST,true);
-
-                    /*if(bRight && j <= 13){
-                        FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                             vKeysCell,10,true);
-                    }
-                    else if(!bRight && j >= 16){
-                        FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                             vKeysCell,10,true);
-                    }
-                    else{
-                        FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                             vKeysCell,iniThFAST,true);
-                    }*/
-
-
-                    if(vKeysCell.empty())
-                    {
-                        FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                             vKeysCell,minThFAST,true);
-                        /*if(bRight && j <= 13){
-                            FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                                 vKeysCell,5,true);
-                        }
-                        else if(!bRight && j >= 16){
-                            FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                                 vKeysCell,5,true);
-                        }
-                        else{
-                            FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                                 vKeysCell,minThFAST,true);
-                        }*/
-                    }
-
-                    if(!vKeysCell.empty())
-                    {
-                        for(vector<cv::KeyPoint>::iterator vit=vKeysCell.begin(); vit!=vKeysCell.end();vit++)
-                        {
-                            (*vit).pt.x+=j*wCell;
-                            (*vit).pt.y+=i*hCell;
-                            vToDistributeKeys.push_back(*vit);
-                        }
-                    }
-
-                }
-            }
-    #endif
             
             vector<KeyPoint> & keypoints = allKeypoints[level];
             keypoints.reserve(nfeatures);
 
-    #ifdef USE_CUDA
             PUSH_RANGE("DistributeOctTree", 3);
-    #endif
         
             keypoints = DistributeOctTree(vToDistributeKeys, minBorderX, maxBorderX,
                                         minBorderY, maxBorderY, mnFeaturesPerLevel[level], level);
 
-    #ifdef USE_CUDA
             POP_RANGE;
 
             // Add border to coordinates and scale information
@@ -1033,23 +916,132 @@ namespace PLVS2
         ic_angle.join(allKeypoints[nlevels - 1].data(), allKeypoints[nlevels - 1].size());
         
     }
-    #else        
-            const int scaledPatchSize = PATCH_SIZE*mvScaleFactor[level];
+#else 
+    void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoints)
+    {
+        allKeypoints.resize(nlevels);
 
-            // Add border to coordinates and scale information
-            const int nkps = keypoints.size();
-            for(int i=0; i<nkps ; i++)
+        if(mpTaskPool)
+        {
+            // levels are independent: each level task further splits its FAST detection in cell-row tasks 
+            TaskPool::TaskGroup levelTasks(mpTaskPool);
+            for (int level = 0; level < nlevels; ++level)
             {
-                keypoints[i].pt.x+=minBorderX;
-                keypoints[i].pt.y+=minBorderY;
-                keypoints[i].octave=level;
-                keypoints[i].size = scaledPatchSize;
+                levelTasks.Run([this, level, &allKeypoints]{ ComputeKeyPointsOctTreeLevel(level, allKeypoints[level]); });
             }
+            levelTasks.Wait();
+        }
+        else
+        {
+            for (int level = 0; level < nlevels; ++level)
+                ComputeKeyPointsOctTreeLevel(level, allKeypoints[level]);
+        }
+    }
+
+    void ORBextractor::DetectFASTCellRow(const int level, const int i, const int nCols, const int wCell, const int hCell, 
+                                         const int minBorderX, const int minBorderY, const int maxBorderX, const int maxBorderY, 
+                                         vector<cv::KeyPoint>& vKeysRow)
+    {
+        const float iniY =minBorderY+i*hCell;
+        float maxY = iniY+hCell+6;
+
+        if(iniY>=maxBorderY-3)
+            return;
+        if(maxY>maxBorderY)
+            maxY = maxBorderY;
+
+        vector<cv::KeyPoint>& vKeysCell = TaskPool::GetScratch<FASTCellScratch>().vKeysCell;
+        for(int j=0; j<nCols; j++)
+        {
+            const float iniX =minBorderX+j*wCell;
+            float maxX = iniX+wCell+6;
+            if(iniX>=maxBorderX-6)
+                continue;
+            if(maxX>maxBorderX)
+                maxX = maxBorderX;
+
+            vKeysCell.clear();
+
+            FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
+                 vKeysCell,iniThFAST,true);
+
+            if(vKeysCell.empty())
+            {
+                FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
+                     vKeysCell,minThFAST,true);
+            }
+
+            for(vector<cv::KeyPoint>::iterator vit=vKeysCell.begin(); vit!=vKeysCell.end();vit++)
+            {
+                (*vit).pt.x+=j*wCell;
+                (*vit).pt.y+=i*hCell;
+                vKeysRow.push_back(*vit);
+            }
+        }
+    }
+
+    void ORBextractor::ComputeKeyPointsOctTreeLevel(const int level, vector<KeyPoint>& keypoints)
+    {
+        //const float W = 30; // Original value in ORBSLAM2
+        const float W = 35;
+
+        const int minBorderX = EDGE_THRESHOLD-3;
+        const int minBorderY = minBorderX;
+        const int maxBorderX = mvImagePyramid[level].cols-EDGE_THRESHOLD+3;
+        const int maxBorderY = mvImagePyramid[level].rows-EDGE_THRESHOLD+3;
+
+        const float width = (maxBorderX-minBorderX);
+        const float height = (maxBorderY-minBorderY);
+        if( (width<=0) || (height<=0) ) return;         
+
+        const int nCols = width/W;
+        const int nRows = height/W;
+        if( (nCols==0) || (nRows==0) ) return;              
+        const int wCell = ceil(width/nCols);
+        const int hCell = ceil(height/nRows);
+
+        // divide in cells and extract FAST features (one task per row of cells); 
+        // rows are then concatenated in order so that the octree receives exactly the same input as in the serial case
+        vector<vector<cv::KeyPoint> > vKeysRows(nRows);
+        if(mpTaskPool)
+        {
+            TaskPool::TaskGroup rowTasks(mpTaskPool);
+            for(int i=0; i<nRows; i++)
+            {
+                rowTasks.Run([&, i]{ DetectFASTCellRow(level, i, nCols, wCell, hCell, minBorderX, minBorderY, maxBorderX, maxBorderY, vKeysRows[i]); });
+            }
+            rowTasks.Wait();
+        }
+        else
+        {
+            for(int i=0; i<nRows; i++)
+                DetectFASTCellRow(level, i, nCols, wCell, hCell, minBorderX, minBorderY, maxBorderX, maxBorderY, vKeysRows[i]);
+        }
+
+        vector<cv::KeyPoint>& vToDistributeKeys = TaskPool::GetScratch<OctTreeInputScratch>().vToDistributeKeys;
+        vToDistributeKeys.clear();
+        vToDistributeKeys.reserve(nfeatures*10);
+        for(int i=0; i<nRows; i++)
+            vToDistributeKeys.insert(vToDistributeKeys.end(), vKeysRows[i].begin(), vKeysRows[i].end());
+
+        keypoints.reserve(nfeatures);
+        keypoints = DistributeOctTree(vToDistributeKeys, minBorderX, maxBorderX,
+                                      minBorderY, maxBorderY, mnFeaturesPerLevel[level], level);
+
+        const int scaledPatchSize = PATCH_SIZE*mvScaleFactor[level];
+
+        // Add border to coordinates and scale information
+        const int nkps = keypoints.size();
+        for(int i=0; i<nkps ; i++)
+        {
+            keypoints[i].pt.x+=minBorderX;
+            keypoints[i].pt.y+=minBorderY;
+            keypoints[i].octave=level;
+            keypoints[i].size = scaledPatchSize;
         }
 
         // compute orientations
-        for (int level = 0; level < nlevels; ++level)
-            computeOrientation(mvImagePyramid[level], allKeypoints[level], umax);
+        computeOrientation(mvImagePyramid[level], keypoints, umax);
     }
 
     void ORBextractor::ComputeKeyPointsOld(std::vector<std::vector<KeyPoint> > &allKeypoints)
@@ -1231,14 +1223,6 @@ namespace PLVS2
             computeOrientation(mvImagePyramid[level], allKeypoints[level], umax);
     }
 
-    static void computeDescriptors(const Mat& image, vector<KeyPoint>& keypoints, Mat& descriptors,
-                                const vector<Point>& pattern)
-    {
-        descriptors = Mat::zeros((int)keypoints.size(), 32, CV_8UC1); // 32 elements, each element is uint8_t
-
-        for (size_t i = 0; i < keypoints.size(); i++)
-            computeOrbDescriptor(keypoints[i], image, &pattern[0], descriptors.ptr((int)i));
-    }
 
     #endif
 
@@ -1286,6 +1270,35 @@ namespace PLVS2
         //_keypoints.reserve(nkeypoints);
         _keypoints = vector<cv::KeyPoint>(nkeypoints);
 
+    #ifndef USE_CUDA
+        // filter the pyramid images and compute the descriptors of each level (one task per level if a task pool is set)
+        vector<Mat> vLevelDescriptors(nlevels);
+        {
+            TaskPool::TaskGroup descriptorTasks(mpTaskPool);
+            for (int level = 0; level < nlevels; ++level)
+            {
+                if(allKeypoints[level].empty())
+                    continue;
+
+                descriptorTasks.Run([this, level, &allKeypoints, &vLevelDescriptors]
+                {
+                    //Mat workingMat = mvImagePyramid[level].clone();
+                    //GaussianBlur(workingMat, workingMat, Size(7, 7), 2, 2, BORDER_REFLECT_101);
+                    if(!mbPrecomputedGaussianPyramid)
+                    {
+                        mvImagePyramidFiltered[level] = mvImagePyramid[level].clone();
+                        GaussianBlur(mvImagePyramidFiltered[level], mvImagePyramidFiltered[level], Size(kGaussianKernelSize, kGaussianKernelSize), kGaussianBlurSigma, kGaussianBlurSigma, BORDER_REFLECT_101);
+                    }
+                    const Mat& workingMat = mvImagePyramidFiltered[level];
+
+                    // Compute the descriptors (vectorized kernel selected at runtime)
+                    mpDescriptorKernel->Compute(workingMat, allKeypoints[level], vLevelDescriptors[level]);
+                });
+            }
+            descriptorTasks.Wait();
+        }
+    #endif
+
         int offset = 0;
         //Modified for speeding up stereo fisheye matching
         int monoIndex = 0, stereoIndex = nkeypoints-1;
@@ -1336,20 +1349,8 @@ namespace PLVS2
             }
     #else
 
-            //Mat workingMat = mvImagePyramid[level].clone();
-            //GaussianBlur(workingMat, workingMat, Size(7, 7), 2, 2, BORDER_REFLECT_101);
-                    
-            if(!mbPrecomputedGaussianPyramid)
-            {
-                mvImagePyramidFiltered[level] = mvImagePyramid[level].clone();
-                GaussianBlur(mvImagePyramidFiltered[level], mvImagePyramidFiltered[level], Size(kGaussianKernelSize, kGaussianKernelSize), kGaussianBlurSigma, kGaussianBlurSigma, BORDER_REFLECT_101);
-            }
-            Mat& workingMat = mvImagePyramidFiltered[level];   
-
-            // Compute the descriptors
-            //Mat desc = descriptors.rowRange(offset, offset + nkeypointsLevel);
-            Mat desc = cv::Mat(nkeypointsLevel, 32, CV_8U);
-            computeDescriptors(workingMat, keypoints, desc, pattern);
+            // descriptors have been already computed above 
+            Mat& desc = vLevelDescriptors[level];
 
             offset += nkeypointsLevel;
     #endif        
@@ -38,6 +38,7 @@
 
 
 #include "ORBmatcher.h"
+#include "HammingDistance.h"
 
 #include<limits.h>
 
@@ -68,6 +69,9 @@ namespace PLVS2
 
         const bool bFactor = th!=1.0;
 
+        vector<int> vDistances; // distances between the map point descriptor and the candidate keypoints
+        vector<size_t> vIndices; // candidate keypoints
+
         for(size_t iMP=0; iMP<vpMapPoints.size(); iMP++)
         {
             MapPointPtr pMP = vpMapPoints[iMP];
@@ -82,84 +86,20 @@ namespace PLVS2
 
             if(pMP->mbTrackInView)
             {
-                const int &nPredictedLevel = pMP->mnTrackScaleLevel;
-
-                // The size of the window will depend on the viewing direction
-                float r = RadiusByViewingCos(pMP->mTrackViewCos);
-
-                if(bFactor)
-                    r*=th;
-
-                const vector<size_t> vIndices =
-                        F.GetFeaturesInArea(pMP->mTrackProjX,pMP->mTrackProjY,r*F.mvScaleFactors[nPredictedLevel],nPredictedLevel-1,nPredictedLevel);
-
-                if(!vIndices.empty()){
-                    const cv::Mat MPdescriptor = pMP->GetDescriptor();
-
-                    int bestDist=256;
-                    int bestLevel= -1;
-                    int bestDist2=256;
-                    int bestLevel2 = -1;
-                    int bestIdx =-1 ;
-
-                    // Get best and second matches with near keypoints
-                    for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
-                    {
-                        const size_t idx = *vit;
-
-                        if(F.mvpMapPoints[idx])
-                            if(F.mvpMapPoints[idx]->Observations()>0)
-                                continue;
-
-                        if(F.Nleft == -1 && F.mvuRight[idx]>0)
-                        {
-                            const float er = fabs(pMP->mTrackProjXR-F.mvuRight[idx]);
-                            if(er>r*F.mvScaleFactors[nPredictedLevel])
-                                continue;
-                        }
-
-                        const cv::Mat &d = F.mDescriptors.row(idx);
-
-                        const int dist = DescriptorDistance(MPdescriptor,d);
-
-                        if(dist<bestDist)
-                        {
-                            bestDist2=bestDist;
-                            bestDist=dist;
-                            bestLevel2 = bestLevel;
-                            bestLevel = (F.Nleft == -1) ? F.mvKeysUn[idx].octave
-                                                        : (idx < F.Nleft) ? F.mvKeys[idx].octave
-                                                                          : F.mvKeysRight[idx - F.Nleft].octave;
-                            bestIdx=idx;
-                        }
-                        else if(dist<bestDist2)
-                        {
-                            bestLevel2 = (F.Nleft == -1) ? F.mvKeysUn[idx].octave
-                                                         : (idx < F.Nleft) ? F.mvKeys[idx].octave
-                                                                           : F.mvKeysRight[idx - F.Nleft].octave;
-                            bestDist2=dist;
-                        }
-                    }
-
-                    // Apply ratio to second match (only if best and second are in the same scale level)
-                    if(bestDist<=TH_HIGH)
-                    {
-                        if(bestLevel==bestLevel2 && bestDist>mfNNratio*bestDist2)
-                            continue;
-
-                        if(bestLevel!=bestLevel2 || bestDist<=mfNNratio*bestDist2){
-                            F.mvpMapPoints[bestIdx]=pMP;
-
-                            if(F.Nleft != -1 && F.mvLeftToRightMatch[bestIdx] != -1){ //Also match with the stereo observation at right camera
-                                F.mvpMapPoints[F.mvLeftToRightMatch[bestIdx] + F.Nleft] = pMP;
-                                nmatches++;
-                                right++;
-                            }
-
-                            nmatches++;
-                            left++;
-                        }
-                    }
+                MapPointProjection proj;
+                proj.u = pMP->mTrackProjX;
+                proj.v = pMP->mTrackProjY;
+                proj.uR = pMP->mTrackProjXR;
+                proj.depth = pMP->mTrackDepth;
+                proj.viewCos = pMP->mTrackViewCos;
+                proj.level = pMP->mnTrackScaleLevel;
+
+                const int nNewMatches = MatchProjectedPoint(F, pMP, proj, th, vIndices, vDistances);
+                if(nNewMatches > 0)
+                {
+                    nmatches += nNewMatches;
+                    left++;
+                    if(nNewMatches > 1) right++;
                 }
             }
 
@@ -168,13 +108,13 @@ namespace PLVS2
                 if(nPredictedLevel != -1){
                     float r = RadiusByViewingCos(pMP->mTrackViewCosR);
 
-                    const vector<size_t> vIndices =
-                            F.GetFeaturesInArea(pMP->mTrackProjXR,pMP->mTrackProjYR,r*F.mvScaleFactors[nPredictedLevel],nPredictedLevel-1,nPredictedLevel,true);
+                    F.GetFeaturesInArea(pMP->mTrackProjXR,pMP->mTrackProjYR,r*F.mvScaleFactors[nPredictedLevel],nPredictedLevel-1,nPredictedLevel,true,vIndices);
 
                     if(vIndices.empty())
                         continue;
 
                     const cv::Mat MPdescriptor = pMP->GetDescriptor();
+                    HammingDistance::ComputeDistances(MPdescriptor, F.mDescriptors, vIndices, vDistances, F.Nleft);
 
                     int bestDist=256;
                     int bestLevel= -1;
@@ -191,10 +131,7 @@ namespace PLVS2
                             if(F.mvpMapPoints[idx + F.Nleft]->Observations()>0)
                                 continue;
 
-
-                        const cv::Mat &d = F.mDescriptors.row(idx + F.Nleft);
-
-                        const int dist = DescriptorDistance(MPdescriptor,d);
+                        const int dist = vDistances[vit-vIndices.begin()];
 
                         if(dist<bestDist)
                         {
@@ -237,6 +174,120 @@ namespace PLVS2
         return nmatches;
     }
 
+    // used by Tracking::SearchLocalPoints() with LocalMapProjector
+    int ORBmatcher::SearchByProjection(Frame &F, const vector<MapPointPtr> &vpMapPoints, const vector<uint8_t> &vbInView, const vector<MapPointProjection> &vProjections,
+                                       const float th, const bool bFarPoints, const float thFarPoints)
+    {
+        int nmatches=0;
+
+        vector<int> vDistances; // distances between the map point descriptor and the candidate keypoints
+        vector<size_t> vIndices; // candidate keypoints
+
+        for(size_t iMP=0; iMP<vpMapPoints.size(); iMP++)
+        {
+            if(!vbInView[iMP])
+                continue;
+
+            const MapPointProjection& proj = vProjections[iMP];
+            if(bFarPoints && proj.depth>thFarPoints)
+                continue;
+
+            MapPointPtr pMP = vpMapPoints[iMP];
+            if(pMP->isBad())
+                continue;
+
+            const int nNewMatches = MatchProjectedPoint(F, pMP, proj, th, vIndices, vDistances);
+            nmatches += nNewMatches;
+        }
+
+        return nmatches;
+    }
+
+    int ORBmatcher::MatchProjectedPoint(Frame &F, const MapPointPtr& pMP, const MapPointProjection& proj, const float th, 
+                                        vector<size_t> &vIndices, vector<int> &vDistances)
+    {
+        const bool bFactor = th!=1.0;
+
+        const int &nPredictedLevel = proj.level;
+
+        // The size of the window will depend on the viewing direction
+        float r = RadiusByViewingCos(proj.viewCos);
+
+        if(bFactor)
+            r*=th;
+
+        F.GetFeaturesInArea(proj.u,proj.v,r*F.mvScaleFactors[nPredictedLevel],nPredictedLevel-1,nPredictedLevel,false,vIndices);
+
+        if(!vIndices.empty()){
+            const cv::Mat MPdescriptor = pMP->GetDescriptor();
+            HammingDistance::ComputeDistances(MPdescriptor, F.mDescriptors, vIndices, vDistances);
+
+            int bestDist=256;
+            int bestLevel= -1;
+            int bestDist2=256;
+            int bestLevel2 = -1;
+            int bestIdx =-1 ;
+
+            // Get best and second matches with near keypoints
+            for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
+            {
+                const size_t idx = *vit;
+
+                if(F.mvpMapPoints[idx])
+                    if(F.mvpMapPoints[idx]->Observations()>0)
+                        continue;
+
+                if(F.Nleft == -1 && F.mvuRight[idx]>0)
+                {
+                    const float er = fabs(proj.uR-F.mvuRight[idx]);
+                    if(er>r*F.mvScaleFactors[nPredictedLevel])
+                        continue;
+                }
+
+                const int dist = vDistances[vit-vIndices.begin()];
+
+                if(dist<bestDist)
+                {
+                    bestDist2=bestDist;
+                    bestDist=dist;
+                    bestLevel2 = bestLevel;
+                    bestLevel = (F.Nleft == -1) ? F.mvKeysUn[idx].octave
+                                                : (idx < F.Nleft) ? F.mvKeys[idx].octave
+                                                                  : F.mvKeysRight[idx - F.Nleft].octave;
+                    bestIdx=idx;
+                }
+                else if(dist<bestDist2)
+                {
+                    bestLevel2 = (F.Nleft == -1) ? F.mvKeysUn[idx].octave
+                                                 : (idx < F.Nleft) ? F.mvKeys[idx].octave
+                                                                   : F.mvKeysRight[idx - F.Nleft].octave;
+                    bestDist2=dist;
+                }
+            }
+
+            // Apply ratio to second match (only if best and second are in the same scale level)
+            if(bestDist<=TH_HIGH)
+            {
+                if(bestLevel==bestLevel2 && bestDist>mfNNratio*bestDist2)
+                    return 0;
+
+                if(bestLevel!=bestLevel2 || bestDist<=mfNNratio*bestDist2){
+                    F.mvpMapPoints[bestIdx]=pMP;
+
+                    int nNewMatches = 1;
+                    if(F.Nleft != -1 && F.mvLeftToRightMatch[bestIdx] != -1){ //Also match with the stereo observation at right camera
+                        F.mvpMapPoints[F.mvLeftToRightMatch[bestIdx] + F.Nleft] = pMP;
+                        nNewMatches++;
+                    }
+
+                    return nNewMatches;
+                }
+            }
+        }
+
+        return 0;
+    }
+
     float ORBmatcher::RadiusByViewingCos(const float &viewCos)
     {
         if(viewCos>0.998)
@@ -301,6 +352,8 @@ namespace PLVS2
 
         int nmatches=0;
 
+        vector<int> vDistances; // distances between a keyframe descriptor and the frame descriptors of the same node
+
         vector<int> rotHist[HISTO_LENGTH];
         for(int i=0;i<HISTO_LENGTH;i++)
             rotHist[i].reserve(500);
@@ -332,6 +385,7 @@ namespace PLVS2
                         continue;
 
                     const cv::Mat &dKF= pKF->mDescriptors.row(realIdxKF);
+                    HammingDistance::ComputeDistances(dKF, F.mDescriptors, vIndicesF, vDistances);
 
                     int bestDist1=256;
                     int bestIdxF =-1 ;
@@ -349,9 +403,7 @@ namespace PLVS2
                             if(vpMapPointMatches[realIdxF])
                                 continue;
 
-                            const cv::Mat &dF = F.mDescriptors.row(realIdxF);
-
-                            const int dist =  DescriptorDistance(dKF,dF);
+                            const int dist = vDistances[iF];
 
                             if(dist<bestDist1)
                             {
@@ -370,9 +422,7 @@ namespace PLVS2
                             if(vpMapPointMatches[realIdxF])
                                 continue;
 
-                            const cv::Mat &dF = F.mDescriptors.row(realIdxF);
-
-                            const int dist =  DescriptorDistance(dKF,dF);
+                            const int dist = vDistances[iF];
 
                             if(realIdxF < F.Nleft && dist<bestDist1){
                                 bestDist2=bestDist1;
@@ -513,6 +563,8 @@ namespace PLVS2
         spAlreadyFound.erase(static_cast<MapPointPtr>(NULL));
 
         int nmatches=0;
+        vector<int> vDistances;
+        vector<size_t> vIndices; // candidate keypoints
 
         // For each Candidate MapPoint Project and Match
         for(int iMP=0, iendMP=vpPoints.size(); iMP<iendMP; iMP++)
@@ -560,7 +612,7 @@ namespace PLVS2
             // Search in a radius
             const float radius = th*pKF->mvScaleFactors[nPredictedLevel];
 
-            const vector<size_t> vIndices = pKF->GetFeaturesInArea(uv(0),uv(1),radius);
+            pKF->GetFeaturesInArea(uv(0),uv(1),radius,false,vIndices);
 
             if(vIndices.empty())
                 continue;
@@ -570,6 +622,7 @@ namespace PLVS2
 
             int bestDist = 256;
             int bestIdx = -1;
+            HammingDistance::ComputeDistances(dMP, pKF->mDescriptors, vIndices, vDistances);
             for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
             {
                 const size_t idx = *vit;
@@ -581,9 +634,7 @@ namespace PLVS2
                 if(kpLevel<nPredictedLevel-1 || kpLevel>nPredictedLevel)
                     continue;
 
-                const cv::Mat &dKF = pKF->mDescriptors.row(idx);
-
-                const int dist = DescriptorDistance(dMP,dKF);
+                const int dist = vDistances[vit-vIndices.begin()];
 
                 if(dist<bestDist)
                 {
@@ -620,6 +671,8 @@ namespace PLVS2
         spAlreadyFound.erase(static_cast<MapPointPtr>(NULL));
 
         int nmatches=0;
+        vector<int> vDistances;
+        vector<size_t> vIndices; // candidate keypoints
 
         // For each Candidate MapPoint Project and Match
         for(int iMP=0, iendMP=vpPoints.size(); iMP<iendMP; iMP++)
@@ -673,7 +726,7 @@ namespace PLVS2
             // Search in a radius
             const float radius = th*pKF->mvScaleFactors[nPredictedLevel];
 
-            const vector<size_t> vIndices = pKF->GetFeaturesInArea(u,v,radius);
+            pKF->GetFeaturesInArea(u,v,radius,false,vIndices);
 
             if(vIndices.empty())
                 continue;
@@ -683,6 +736,7 @@ namespace PLVS2
 
             int bestDist = 256;
             int bestIdx = -1;
+            HammingDistance::ComputeDistances(dMP, pKF->mDescriptors, vIndices, vDistances);
             for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
             {
                 const size_t idx = *vit;
@@ -694,9 +748,7 @@ namespace PLVS2
                 if(kpLevel<nPredictedLevel-1 || kpLevel>nPredictedLevel)
                     continue;
 
-                const cv::Mat &dKF = pKF->mDescriptors.row(idx);
-
-                const int dist = DescriptorDistance(dMP,dKF);
+                const int dist = vDistances[vit-vIndices.begin()];
 
                 if(dist<bestDist)
                 {
@@ -720,6 +772,8 @@ namespace PLVS2
     int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2, vector<cv::Point2f> &vbPrevMatched, vector<int> &vnMatches12, int windowSize)
     {
         int nmatches=0;
+        vector<int> vDistances;
+        vector<size_t> vIndices2; // candidate keypoints
         vnMatches12 = vector<int>(F1.mvKeysUn.size(),-1);
 
         vector<int> rotHist[HISTO_LENGTH];
@@ -737,7 +791,7 @@ namespace PLVS2
             if(level1>0)
                 continue;
 
-            vector<size_t> vIndices2 = F2.GetFeaturesInArea(vbPrevMatched[i1].x,vbPrevMatched[i1].y, windowSize,level1,level1);
+            F2.GetFeaturesInArea(vbPrevMatched[i1].x,vbPrevMatched[i1].y, windowSize,level1,level1,false,vIndices2);
 
             if(vIndices2.empty())
                 continue;
@@ -748,13 +802,12 @@ namespace PLVS2
             int bestDist2 = INT_MAX;
             int bestIdx2 = -1;
 
+            HammingDistance::ComputeDistances(d1, F2.mDescriptors, vIndices2, vDistances);
             for(vector<size_t>::iterator vit=vIndices2.begin(); vit!=vIndices2.end(); vit++)
             {
                 size_t i2 = *vit;
 
-                cv::Mat d2 = F2.mDescriptors.row(i2);
-
-                int dist = DescriptorDistance(d1,d2);
+                int dist = vDistances[vit-vIndices2.begin()];
 
                 if(vMatchedDistance[i2]<=dist)
                     continue;
@@ -856,6 +909,7 @@ namespace PLVS2
         const float factor = 1.0f/HISTO_LENGTH;
 
         int nmatches = 0;
+        vector<int> vDistances;
 
         DBoW2::FeatureVector::const_iterator f1it = vFeatVec1.begin();
         DBoW2::FeatureVector::const_iterator f2it = vFeatVec2.begin();
@@ -885,6 +939,7 @@ namespace PLVS2
                     int bestIdx2 =-1 ;
                     int bestDist2=256;
 
+                    HammingDistance::ComputeDistances(d1, Descriptors2, f2it->second, vDistances);
                     for(size_t i2=0, iend2=f2it->second.size(); i2<iend2; i2++)
                     {
                         const size_t idx2 = f2it->second[i2];
@@ -901,9 +956,7 @@ namespace PLVS2
                         if(pMP2->isBad())
                             continue;
 
-                        const cv::Mat &d2 = Descriptors2.row(idx2);
-
-                        int dist = DescriptorDistance(d1,d2);
+                        int dist = vDistances[i2];
 
                         if(dist<bestDist1)
                         {
@@ -1020,6 +1073,7 @@ namespace PLVS2
         int nmatches=0;
         vector<bool> vbMatched2(pKF2->N,false);
         vector<int> vMatches12(pKF1->N,-1);
+        vector<int> vDistances;
 
         vector<int> rotHist[HISTO_LENGTH];
         for(int i=0;i<HISTO_LENGTH;i++)
@@ -1066,6 +1120,7 @@ namespace PLVS2
                     int bestDist = TH_LOW;
                     int bestIdx2 = -1;
 
+                    HammingDistance::ComputeDistances(d1, pKF2->mDescriptors, f2it->second, vDistances);
                     for(size_t i2=0, iend2=f2it->second.size(); i2<iend2; i2++)
                     {
                         size_t idx2 = f2it->second[i2];
@@ -1082,9 +1137,7 @@ namespace PLVS2
                             if(!bStereo2)
                                 continue;
 
-                        const cv::Mat &d2 = pKF2->mDescriptors.row(idx2);
-
-                        const int dist = DescriptorDistance(d1,d2);
+                        const int dist = vDistances[i2];
 
                         if(dist>TH_LOW || dist>bestDist)
                             continue;
@@ -1241,6 +1294,8 @@ namespace PLVS2
         const float &bf = pKF->mbf;
 
         int nFused=0;
+        vector<int> vDistances;
+        vector<size_t> vIndices; // candidate keypoints
 
         const int nMPs = vpMapPoints.size();
 
@@ -1315,7 +1370,7 @@ namespace PLVS2
             // Search in a radius
             const float radius = th*pKF->mvScaleFactors[nPredictedLevel];
 
-            const vector<size_t> vIndices = pKF->GetFeaturesInArea(uv(0),uv(1),radius,bRight);
+            pKF->GetFeaturesInArea(uv(0),uv(1),radius,bRight,vIndices);
 
             if(vIndices.empty())
             {
@@ -1326,6 +1381,7 @@ namespace PLVS2
             // Match to the most similar keypoint in the radius
 
             const cv::Mat dMP = pMP->GetDescriptor();
+            HammingDistance::ComputeDistances(dMP, pKF->mDescriptors, vIndices, vDistances, bRight ? pKF->NLeft : 0);
 
             int bestDist = 256;
             int bestIdx = -1;
@@ -1369,9 +1425,7 @@ namespace PLVS2
 
                 if(bRight) idx += pKF->NLeft;
 
-                const cv::Mat &dKF = pKF->mDescriptors.row(idx);
-
-                const int dist = DescriptorDistance(dMP,dKF);
+                const int dist = vDistances[vit-vIndices.begin()];
 
                 if(dist<bestDist)
                 {
@@ -1426,6 +1480,8 @@ namespace PLVS2
         const set<MapPointPtr> spAlreadyFound = pKF->GetMapPoints();
 
         int nFused=0;
+        vector<int> vDistances;
+        vector<size_t> vIndices; // candidate keypoints
 
         const int nPoints = vpPoints.size();
 
@@ -1476,7 +1532,7 @@ namespace PLVS2
             // Search in a radius
             const float radius = th*pKF->mvScaleFactors[nPredictedLevel];
 
-            const vector<size_t> vIndices = pKF->GetFeaturesInArea(uv(0),uv(1),radius);
+            pKF->GetFeaturesInArea(uv(0),uv(1),radius,false,vIndices);
 
             if(vIndices.empty())
                 continue;
@@ -1487,6 +1543,7 @@ namespace PLVS2
 
             int bestDist = INT_MAX;
             int bestIdx = -1;
+            HammingDistance::ComputeDistances(dMP, pKF->mDescriptors, vIndices, vDistances);
             for(vector<size_t>::const_iterator vit=vIndices.begin(); vit!=vIndices.end(); vit++)
             {
                 const size_t idx = *vit;
@@ -1495,9 +1552,7 @@ namespace PLVS2
                 if(kpLevel<nPredictedLevel-1 || kpLevel>nPredictedLevel)
                     continue;
 
-                const cv::Mat &dKF = pKF->mDescriptors.row(idx);
-
-                int dist = DescriptorDistance(dMP,dKF);
+                int dist = vDistances[vit-vIndices.begin()];
 
                 if(dist<bestDist)
                 {
@@ -1564,6 +1619,8 @@ namespace PLVS2
 
         vector<int> vnMatch1(N1,-1);
         vector<int> vnMatch2(N2,-1);
+        vector<int> vDistances;
+        vector<size_t> vIndices; // candidate keypoints
 
         // Transform from KF1 to KF2 and search
         for(int i1=0; i1<N1; i1++)
@@ -1609,7 +1666,7 @@ namespace PLVS2
             // Search in a radius
             const float radius = th*pKF2->mvScaleFactors[nPredictedLevel];
 
-            const vector<size_t> vIndices = pKF2->GetFeaturesInArea(u,v,radius);
+            pKF2->GetFeaturesInArea(u,v,radius,false,vIndices);
 
             if(vIndices.empty())
                 continue;
@@ -1619,6 +1676,7 @@ namespace PLVS2
 
             int bestDist = INT_MAX;
             int bestIdx = -1;
+            HammingDistance::ComputeDistances(dMP, pKF2->mDescriptors, vIndices, vDistances);
             for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
             {
                 const size_t idx = *vit;
@@ -1628,9 +1686,7 @@ namespace PLVS2
                 if(kp.octave<nPredictedLevel-1 || kp.octave>nPredictedLevel)
                     continue;
 
-                const cv::Mat &dKF = pKF2->mDescriptors.row(idx);
-
-                const int dist = DescriptorDistance(dMP,dKF);
+                const int dist = vDistances[vit-vIndices.begin()];
 
                 if(dist<bestDist)
                 {
@@ -1689,7 +1745,7 @@ namespace PLVS2
             // Search in a radius of 2.5*sigma(ScaleLevel)
             const float radius = th*pKF1->mvScaleFactors[nPredictedLevel];
 
-            const vector<size_t> vIndices = pKF1->GetFeaturesInArea(u,v,radius);
+            pKF1->GetFeaturesInArea(u,v,radius,false,vIndices);
 
             if(vIndices.empty())
                 continue;
@@ -1699,6 +1755,7 @@ namespace PLVS2
 
             int bestDist = INT_MAX;
             int bestIdx = -1;
+            HammingDistance::ComputeDistances(dMP, pKF1->mDescriptors, vIndices, vDistances);
             for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
             {
                 const size_t idx = *vit;
@@ -1708,9 +1765,7 @@ namespace PLVS2
                 if(kp.octave<nPredictedLevel-1 || kp.octave>nPredictedLevel)
                     continue;
 
-                const cv::Mat &dKF = pKF1->mDescriptors.row(idx);
-
-                const int dist = DescriptorDistance(dMP,dKF);
+                const int dist = vDistances[vit-vIndices.begin()];
 
                 if(dist<bestDist)
                 {
@@ -1749,6 +1804,8 @@ namespace PLVS2
     int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame, const float th, const bool bMono)
     {
         int nmatches = 0;
+        vector<int> vDistances;
+        vector<size_t> vIndices2; // candidate keypoints
 
         // Rotation Histogram (to check rotation consistency)
         vector<int> rotHist[HISTO_LENGTH];
@@ -1796,14 +1853,12 @@ namespace PLVS2
                     // Search in a window. Size depends on scale
                     float radius = th*CurrentFrame.mvScaleFactors[nLastOctave];
 
-                    vector<size_t> vIndices2;
-
                     if(bForward)
-                        vIndices2 = CurrentFrame.GetFeaturesInArea(uv(0),uv(1), radius, nLastOctave);
+                        CurrentFrame.GetFeaturesInArea(uv(0),uv(1), radius, nLastOctave, Frame::kMaxInt, false, vIndices2);
                     else if(bBackward)
-                        vIndices2 = CurrentFrame.GetFeaturesInArea(uv(0),uv(1), radius, 0, nLastOctave);
+                        CurrentFrame.GetFeaturesInArea(uv(0),uv(1), radius, 0, nLastOctave, false, vIndices2);
                     else
-                        vIndices2 = CurrentFrame.GetFeaturesInArea(uv(0),uv(1), radius, nLastOctave-1, nLastOctave+1);
+                        CurrentFrame.GetFeaturesInArea(uv(0),uv(1), radius, nLastOctave-1, nLastOctave+1, false, vIndices2);
 
                     if(vIndices2.empty())
                         continue;
@@ -1813,6 +1868,7 @@ namespace PLVS2
                     int bestDist = 256;
                     int bestIdx2 = -1;
 
+                    HammingDistance::ComputeDistances(dMP, CurrentFrame.mDescriptors, vIndices2, vDistances);
                     for(vector<size_t>::const_iterator vit=vIndices2.begin(), vend=vIndices2.end(); vit!=vend; vit++)
                     {
                         const size_t i2 = *vit;
@@ -1829,9 +1885,7 @@ namespace PLVS2
                                 continue;
                         }
 
-                        const cv::Mat &d = CurrentFrame.mDescriptors.row(i2);
-
-                        const int dist = DescriptorDistance(dMP,d);
+                        const int dist = vDistances[vit-vIndices2.begin()];
 
                         if(dist<bestDist)
                         {
@@ -1874,20 +1928,19 @@ namespace PLVS2
                         // Search in a window. Size depends on scale
                         float radius = th*CurrentFrame.mvScaleFactors[nLastOctave];
 
-                        vector<size_t> vIndices2;
-
                         if(bForward)
-                            vIndices2 = CurrentFrame.GetFeaturesInArea(uv(0),uv(1), radius, nLastOctave, -1,true);
+                            CurrentFrame.GetFeaturesInArea(uv(0),uv(1), radius, nLastOctave, -1, true, vIndices2);
                         else if(bBackward)
-                            vIndices2 = CurrentFrame.GetFeaturesInArea(uv(0),uv(1), radius, 0, nLastOctave, true);
+                            CurrentFrame.GetFeaturesInArea(uv(0),uv(1), radius, 0, nLastOctave, true, vIndices2);
                         else
-                            vIndices2 = CurrentFrame.GetFeaturesInArea(uv(0),uv(1), radius, nLastOctave-1, nLastOctave+1, true);
+                            CurrentFrame.GetFeaturesInArea(uv(0),uv(1), radius, nLastOctave-1, nLastOctave+1, true, vIndices2);
 
                         const cv::Mat dMP = pMP->GetDescriptor();
 
                         int bestDist = 256;
                         int bestIdx2 = -1;
 
+                        HammingDistance::ComputeDistances(dMP, CurrentFrame.mDescriptors, vIndices2, vDistances, CurrentFrame.Nleft);
                         for(vector<size_t>::const_iterator vit=vIndices2.begin(), vend=vIndices2.end(); vit!=vend; vit++)
                         {
                             const size_t i2 = *vit;
@@ -1895,9 +1948,7 @@ namespace PLVS2
                                 if(CurrentFrame.mvpMapPoints[i2 + CurrentFrame.Nleft]->Observations()>0)
                                     continue;
 
-                            const cv::Mat &d = CurrentFrame.mDescriptors.row(i2 + CurrentFrame.Nleft);
-
-                            const int dist = DescriptorDistance(dMP,d);
+                            const int dist = vDistances[vit-vIndices2.begin()];
 
                             if(dist<bestDist)
                             {
@@ -1966,6 +2017,8 @@ namespace PLVS2
     int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFramePtr& pKF, const set<MapPointPtr> &sAlreadyFound, const float th , const int ORBdist)
     {
         int nmatches = 0;
+        vector<int> vDistances;
+        vector<size_t> vIndices2; // candidate keypoints
 
         const Sophus::SE3f Tcw = CurrentFrame.GetPose();
         Eigen::Vector3f Ow = Tcw.inverse().translation();
@@ -2013,7 +2066,7 @@ namespace PLVS2
                     // Search in a window
                     const float radius = th*CurrentFrame.mvScaleFactors[nPredictedLevel];
 
-                    const vector<size_t> vIndices2 = CurrentFrame.GetFeaturesInArea(uv(0), uv(1), radius, nPredictedLevel-1, nPredictedLevel+1);
+                    CurrentFrame.GetFeaturesInArea(uv(0), uv(1), radius, nPredictedLevel-1, nPredictedLevel+1, false, vIndices2);
 
                     if(vIndices2.empty())
                         continue;
@@ -2023,15 +2076,14 @@ namespace PLVS2
                     int bestDist = 256;
                     int bestIdx2 = -1;
 
+                    HammingDistance::ComputeDistances(dMP, CurrentFrame.mDescriptors, vIndices2, vDistances);
                     for(vector<size_t>::const_iterator vit=vIndices2.begin(); vit!=vIndices2.end(); vit++)
                     {
                         const size_t i2 = *vit;
                         if(CurrentFrame.mvpMapPoints[i2])
                             continue;
 
-                        const cv::Mat &d = CurrentFrame.mDescriptors.row(i2);
-
-                        const int dist = DescriptorDistance(dMP,d);
+                        const int dist = vDistances[vit-vIndices2.begin()];
 
                         if(dist<bestDist)
                         {
@@ -2130,66 +2182,10 @@ namespace PLVS2
     }
 
 
-#if 0 
-
-// Bit set count operation from
-// http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
+// Bit set count operation (see HammingDistance)
     int ORBmatcher::DescriptorDistance(const cv::Mat &a, const cv::Mat &b)
     {
-        const uint32_t *pa = a.ptr<uint32_t>();
-        const uint32_t *pb = b.ptr<uint32_t>();
-
-        int dist=0;      
-
-        for(int i=0; i<8; i++, pa++, pb++)
-        {
-//#include <immintrin.h>             
-#ifdef __POPCNT__    
-            // SIMD optimization by using 32-size instruction
-            dist += _mm_popcnt_u32(*pa ^ *pb); // count number of 1 over XOR
-#else                  
-            unsigned int v = *pa ^ *pb;
-            v = v - ((v >> 1) & 0x55555555);
-            v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
-            dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
-#endif             
-        }
-        return dist;
+        return HammingDistance::Distance(a.ptr(), b.ptr());
     }
 
-#else 
-
-// Bit set count operation from
-// http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
-    int ORBmatcher::DescriptorDistance(const cv::Mat &a, const cv::Mat &b)
-    {
-        const uint64_t *pa = a.ptr<uint64_t>();
-        const uint64_t *pb = b.ptr<uint64_t>();
-
-        uint64_t dist=0;      
-
-        for(int i=0; i<4; i++, pa++, pb++)
-        {
-//#include <immintrin.h>             
-#ifdef __POPCNT__    
-            // SIMD optimization by using 64-size instruction
-            dist += _mm_popcnt_u64(*pa ^ *pb); // count number of 1 over XOR
-#else             
-            using T = uint64_t;   
-            uint64_t v = *pa ^ *pb;
-            // v = v - ((v >> 1) & 0x55555555);
-            // v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
-            // dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
-
-            v = v - ((v >> 1) & (T)~(T)0/3);                           // temp
-            v = (v & (T)~(T)0/15*3) + ((v >> 2) & (T)~(T)0/15*3);      // temp
-            v = (v + (v >> 4)) & (T)~(T)0/255*15;                      // temp
-            dist += (T)(v * ((T)~(T)0/255)) >> (sizeof(T) - 1) * CHAR_BIT; // count            
-#endif             
-        }
-        return dist;
-    }    
-    
-#endif 
-
 } // namespace PLVS2
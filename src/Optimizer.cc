@@ -81,6 +81,9 @@
 #include "G2oTypes.h"
 #include "G2oLineTypes.h"
 #include "Converter.h"
+#include "PoseSolver.h"
+#include "BASolver.h"
+#include "PoseGraphSolver.h"
 
 #include<Eigen/StdVector>
 
@@ -97,6 +100,8 @@
 #include "Geom2DUtils.h"
 
 #include<mutex>
+#include<chrono>
+#include<functional>
 
 #define USE_LINES 1                                  // set to zero to completely exclude lines from optimization
 #define USE_LINE_STEREO             (1 && USE_LINES)
@@ -144,6 +149,9 @@
 
 #define PRINT_COVARIANCE ( 0 && USE_G2O_NEW)
 
+// the fixed-size pose solver (see PoseSolver) supports the default information matrices and robust kernels of PoseOptimization()
+#define USE_FIXED_SIZE_POSE_SOLVER (!USE_RGBD_POINT_REPROJ_ERR && !USE_NEW_STEREO_POINT_INFORMATION_MAT && !USE_NEW_LINE_INFORMATION_MAT && !USE_CAUCHY_KERNEL_FOR_LINES)
+
 #include "OptimizableTypes.h"
 
 
@@ -161,6 +169,10 @@ const float Optimizer::kMinLineSegmentLength = 0.05f; // [m]  /// < NOT USED to
 const float Optimizer::kInvMinLineSegmentLength = 1.0/Optimizer::kMinLineSegmentLength; 
 
 float Optimizer::skSigmaZFactor = 6; // 1, 3, 6, 9  (used for scaling the computed Utils::SigmaZ(depth) noise model)
+bool Optimizer::skUseFixedSizePoseSolver = false; // use PoseSolver instead of a g2o graph in PoseOptimization() when the frame allows it (off by default: inlier counts checked on synthetic frames only)
+int Optimizer::skNumOptimizerThreads = 4; // threads of the local/global/inertial BAs, inertial initialization and essential graph optimizations (the pose optimizations are single-threaded)
+bool Optimizer::skUseSchurBASolver = false; // use BASolver instead of the g2o algorithm in the local/global BAs when the graph allows it 
+bool Optimizer::skUsePoseGraphSolver = true; // use PoseGraphLinearSolver (symbolic analysis kept across loop closures) in the essential graph optimizations 
 
 const float Optimizer::kSigmaPointLineDistance = 0.05; // [m]  was 0.1 
 const float Optimizer::kInvSigma2PointLineDistance = 1.0/(Optimizer::kSigmaPointLineDistance * Optimizer::kSigmaPointLineDistance); 
@@ -169,6 +181,79 @@ float Optimizer::skMuWeightForLine3dDist = 0.5; // weight default value
 float Optimizer::skSigmaLineError3D = Optimizer::kSigmaPointLineDistance;//*(1 + Optimizer::skMuWeightForLine3dDist);    
 float Optimizer::skInvSigma2LineError3D = 1.0/(Optimizer::skSigmaLineError3D * Optimizer::skSigmaLineError3D ); 
 
+// Set the thread budget of a large optimization (errors, Jacobians and Schur complement, see g2o::SparseOptimizer::setNumThreads())
+static inline void SetOptimizerThreads(g2o::SparseOptimizer& optimizer)
+{
+#ifndef USE_G2O_NEW
+    optimizer.setNumThreads(Optimizer::skNumOptimizerThreads);
+#endif
+}
+
+#ifndef USE_G2O_NEW
+// Symbolic analyses of the essential graphs of OptimizeEssentialGraph() and OptimizeEssentialGraph4DoF(), kept from a loop 
+// closure to the next one (both optimizations run in the loop closing thread)
+static PoseGraphSymbolicCache sEssentialGraphCache;
+static PoseGraphSymbolicCache sEssentialGraph4DoFCache;
+#endif
+
+// Run the Levenberg-Marquardt iterations of a (local or global) BA graph: with BASolver if enabled and if the graph
+// is supported, otherwise with the g2o algorithm of the optimizer (to be called after initializeOptimization()).
+// If pFinalLambda is not NULL, it gets the damping of the last iteration.
+static inline int OptimizeBA(g2o::SparseOptimizer& optimizer, const int numIterations, double* pFinalLambda = NULL)
+{
+    g2o::OptimizationAlgorithmLevenberg* pLevenberg = dynamic_cast<g2o::OptimizationAlgorithmLevenberg*>(optimizer.algorithm());
+#ifndef USE_G2O_NEW
+    if(Optimizer::skUseSchurBASolver)
+    {
+        BASolver::Params params;
+        params.numThreads = Optimizer::skNumOptimizerThreads;
+        if(pLevenberg)
+            params.lambdaInit = pLevenberg->userLambdaInit();
+
+        BASolver solver;
+        solver.SetParams(params);
+        if(solver.Init(&optimizer))
+        {
+            const int numDoneIterations = solver.Optimize(numIterations);
+            if(pFinalLambda)
+                *pFinalLambda = solver.FinalLambda();
+            return numDoneIterations;
+        }
+    }
+#endif
+    const int numDoneIterations = optimizer.optimize(numIterations);
+    if(pFinalLambda && pLevenberg)
+        *pFinalLambda = pLevenberg->currentLambda();
+    return numDoneIterations;
+}
+
+// g2o action that calls a function after each iteration of the optimizer
+class PostIterationCallback : public g2o::HyperGraphAction
+{
+public:
+    explicit PostIterationCallback(const std::function<void()>& callback) : callback_(callback) {}
+
+    virtual g2o::HyperGraphAction* operator()(const g2o::HyperGraph* graph, Parameters* parameters = 0)
+    {
+        callback_();
+        return this;
+    }
+
+protected:
+    std::function<void()> callback_;
+};
+
+// Return true if all the keyframes observing a map feature are in sFixedKFs (the feature can be left out of a partial GBA)
+static inline bool IsObservedOnlyByFixedKFs(const map<KeyFramePtr,tuple<int,int>>& observations, const std::set<KeyFramePtr>& sFixedKFs)
+{
+    for(map<KeyFramePtr,tuple<int,int>>::const_iterator mit=observations.begin(); mit!=observations.end(); mit++)
+    {
+        if(!mit->first->isBad() && !sFixedKFs.count(mit->first))
+            return false;
+    }
+    return true;
+}
+
 inline float ComputeDepthSigma2(const float one_over_bf, const float depth)  
 {
 #if 0     
@@ -455,7 +540,8 @@ bool sortByValLines(const pair<MapLinePtr , int> &a, const pair<MapLinePtr , int
 
 /// < < < < < <  < < < < <  < < < < <  < < < < <  < < < < <  < < < < < 
 
-void Optimizer::GlobalBundleAdjustemnt(Map* pMap, int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust)
+void Optimizer::GlobalBundleAdjustemnt(Map* pMap, int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust,
+                                       LoopClosing::GlobalBAProgress* pProgress)
 {
     vector<KeyFramePtr> vpKFs = pMap->GetAllKeyFrames();
     vector<MapPointPtr> vpMPoints = pMap->GetAllMapPoints();
@@ -472,13 +558,14 @@ void Optimizer::GlobalBundleAdjustemnt(Map* pMap, int nIterations, bool* pbStopF
     vector<MapObjectPtr> vpMObjects;
 #endif    
     
-    BundleAdjustment(vpKFs, vpMPoints, vpMLines, vpMObjects, nIterations, pbStopFlag, nLoopKF, bRobust);
+    BundleAdjustment(vpKFs, vpMPoints, vpMLines, vpMObjects, nIterations, pbStopFlag, nLoopKF, bRobust, pProgress);
 }
 
 
 void Optimizer::BundleAdjustment(const vector<KeyFramePtr> &vpKFs, const vector<MapPointPtr> &vpMPoints, 
                                  const vector<MapLinePtr> &vpMLines, const vector<MapObjectPtr > &vpMObjects,
-                                 int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust)
+                                 int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust,
+                                 LoopClosing::GlobalBAProgress* pProgress)
 {
 #if VERBOSE_BA
     std::cout << "******************************" << std::endl; 
@@ -501,6 +588,17 @@ void Optimizer::BundleAdjustment(const vector<KeyFramePtr> &vpKFs, const vector<
 
     Map* pMap = vpKFs[0]->GetMap();
 
+    // partial GBA: the keyframes that were not affected by the last correction are fixed and the features they only observe are left out
+    std::set<KeyFramePtr> sFixedKFs;
+    double lambdaInit = 0;
+    if(pProgress)
+    {
+        unique_lock<mutex> lock(pProgress->mutex);
+        sFixedKFs = pProgress->sFixedKFs;
+        lambdaInit = pProgress->lambda;
+    }
+    const std::set<KeyFramePtr>* pFixedKFs = sFixedKFs.empty() ? NULL : &sFixedKFs;
+
     g2o::SparseOptimizer optimizer;
     g2o::OptimizationAlgorithmLevenberg* solver;
 
@@ -549,7 +647,10 @@ void Optimizer::BundleAdjustment(const vector<KeyFramePtr> &vpKFs, const vector<
 #endif  // USE_LINES_BA || USE_OBJECTS_BA
     
     //g2o::OptimizationAlgorithmLevenberg* solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
+    if(lambdaInit > 0)
+        solver->setUserLambdaInit(lambdaInit); // resume with the damping of the interrupted GBA
     optimizer.setAlgorithm(solver);
+    SetOptimizerThreads(optimizer);
     optimizer.setVerbose(false);
 
     if(pbStopFlag)
@@ -645,6 +746,8 @@ void Optimizer::BundleAdjustment(const vector<KeyFramePtr> &vpKFs, const vector<
         vSE3->setId(pKF->mnId);
         vSE3->setFixed(pKF->mnId==pMap->GetInitKFid());
         vSE3->setFixed(pKF->mbFixed);
+        if(pFixedKFs && pFixedKFs->count(pKF))
+            vSE3->setFixed(true);
         optimizer.addVertex(vSE3);
         if(pKF->mnId>maxKFid)
             maxKFid=pKF->mnId;
@@ -664,6 +767,11 @@ void Optimizer::BundleAdjustment(const vector<KeyFramePtr> &vpKFs, const vector<
         MapPointPtr pMP = vpMPoints[i];
         if(pMP->isBad())
             continue;
+        if(pFixedKFs && IsObservedOnlyByFixedKFs(pMP->GetObservations(), *pFixedKFs))
+        {
+            vbNotIncludedMPoints[i]=true;
+            continue;
+        }
         g2o::VertexSBAPointXYZ* vPoint = new g2o::VertexSBAPointXYZ();
         vPoint->setEstimate(pMP->GetWorldPos().cast<double>());
         const int id = pMP->mnId+maxKFid+1;
@@ -844,6 +952,11 @@ void Optimizer::BundleAdjustment(const vector<KeyFramePtr> &vpKFs, const vector<
         MapLinePtr pML = vpMLines[i];
         if(pML->isBad())
             continue;
+        if(pFixedKFs && IsObservedOnlyByFixedKFs(pML->GetObservations(), *pFixedKFs))
+        {
+            vbNotIncludedMLines[i]=true;
+            continue;
+        }
         g2o::VertexSBALine* vLine = new g2o::VertexSBALine();
         Eigen::Vector3f posStart, posEnd;
         pML->GetWorldEndPoints(posStart, posEnd);                          
@@ -1188,12 +1301,84 @@ void Optimizer::BundleAdjustment(const vector<KeyFramePtr> &vpKFs, const vector<
     
 //------------------------------------------------------------------------------
 
+    // Anytime GBA: the estimates of each iteration are published in the GBA fields (mTcwGBA, mPosGBA, ...), so that 
+    // LoopClosing can apply the last published iteration when the GBA is interrupted instead of throwing it away
+    const bool bPublish = pProgress && nLoopKF!=pMap->GetOriginKF()->mnId;
+    auto publishEstimates = [&]()
+    {
+        unique_lock<mutex> lock(pProgress->mutex);
+        if(pProgress->bClosed)
+            return;
+        for(size_t i=0; i<vpKFs.size(); i++)
+        {
+            KeyFramePtr pKF = vpKFs[i];
+            if(pKF->isBad())
+                continue;
+            g2o::VertexSE3Expmap* vSE3 = static_cast<g2o::VertexSE3Expmap*>(optimizer.vertex(pKF->mnId));
+            if(!vSE3)
+                continue;
+            const g2o::SE3Quat SE3quat = vSE3->estimate();
+            pKF->mTcwGBA = Sophus::SE3d(SE3quat.rotation(),SE3quat.translation()).cast<float>();
+            pKF->mnBAGlobalForKF = nLoopKF;
+        }
+        for(size_t i=0; i<vpMPoints.size(); i++)
+        {
+            MapPointPtr pMP = vpMPoints[i];
+            if(vbNotIncludedMPoints[i] || pMP->isBad())
+                continue;
+            g2o::VertexSBAPointXYZ* vPoint = static_cast<g2o::VertexSBAPointXYZ*>(optimizer.vertex(pMP->mnId+maxKFid+1));
+            pMP->mPosGBA = vPoint->estimate().cast<float>();
+            pMP->mnBAGlobalForKF = nLoopKF;
+        }
+#if USE_LINES_BA
+        for(size_t i=0; i<vpMLines.size(); i++)
+        {
+            MapLinePtr pML = vpMLines[i];
+            if(vbNotIncludedMLines[i] || pML->isBad())
+                continue;
+            g2o::VertexSBALine* vLine = static_cast<g2o::VertexSBALine*>(optimizer.vertex(pML->mnId+maxPointId+1));
+            pML->mPosStartGBA = (static_cast<const Eigen::Matrix<double,3,1> >(vLine->estimate().head(3))).cast<float>();
+            pML->mPosEndGBA = (static_cast<const Eigen::Matrix<double,3,1> >(vLine->estimate().tail(3))).cast<float>();
+            pML->mnBAGlobalForKF = nLoopKF;
+        }
+#endif
+#if USE_OBJECTS_BA
+        for(size_t i=0; i<vpMObjects.size(); i++)
+        {
+            MapObjectPtr pMObj = vpMObjects[i];
+            if(vbNotIncludedMObjects[i] || pMObj->isBad())
+                continue;
+            g2o::VertexSim3Expmap* vObject = static_cast<g2o::VertexSim3Expmap*>(optimizer.vertex(pMObj->mnId+maxLineId+1));
+            const g2o::Sim3 g2oSow = vObject->estimate();
+            pMObj->mSowGBA = Sophus::Sim3f(Sophus::RxSO3d(g2oSow.scale(), g2oSow.rotation().toRotationMatrix()).cast<float>(), g2oSow.translation().cast<float>());
+            pMObj->mnBAGlobalForKF = nLoopKF;
+        }
+#endif
+        pProgress->numPublishedIterations++;
+    };
+    PostIterationCallback publishAction(publishEstimates);
+    if(bPublish)
+        optimizer.addPostIterationAction(&publishAction);
+
     // Optimize!
     optimizer.setVerbose(false);
     optimizer.initializeOptimization();
-    optimizer.optimize(nIterations);
+    double finalLambda = 0;
+    OptimizeBA(optimizer, nIterations, &finalLambda);
     Verbose::PrintMess("BA: End of the optimization", Verbose::VERBOSITY_NORMAL);
 
+    // The progress lock is held until the end of the write-back below: LoopClosing::ApplyInterruptedGBA() cannot close the 
+    // progress and read the GBA fields while they are being written
+    unique_lock<mutex> lockProgress;
+    if(bPublish)
+    {
+        optimizer.removePostIterationAction(&publishAction);
+        lockProgress = unique_lock<mutex>(pProgress->mutex);
+        pProgress->lambda = finalLambda;
+        if(pProgress->bClosed)
+            return; // the GBA was interrupted and LoopClosing already applied (or discarded) its last published iteration
+    }
+
     // Recover optimized data
 
     //Keyframes
@@ -1508,6 +1693,7 @@ void Optimizer::FullInertialBA(Map *pMap, int its, const bool bFixLocal, const l
 
     solver->setUserLambdaInit(1e-5);
     optimizer.setAlgorithm(solver);
+    SetOptimizerThreads(optimizer);
     optimizer.setVerbose(false);
 
     if(pbStopFlag)
@@ -2314,6 +2500,11 @@ int Optimizer::PoseOptimization(Frame *pFrame)
     std::cout << "Optimizer::PoseOptimization() " << std::endl; 
 #endif  
 
+#if USE_FIXED_SIZE_POSE_SOLVER
+    if(skUseFixedSizePoseSolver && !pFrame->mpCamera2 && pFrame->mpCamera->GetType() == GeometricCamera::CAM_PINHOLE)
+        return PoseOptimizationFixedSize(pFrame);
+#endif
+
     g2o::SparseOptimizer optimizer;
     g2o::OptimizationAlgorithmLevenberg* solver;
         
@@ -3042,6 +3233,147 @@ int Optimizer::PoseOptimization(Frame *pFrame)
 }
 
 
+int Optimizer::PoseOptimizationFixedSize(Frame *pFrame)
+{
+#if USE_FIXED_SIZE_POSE_SOLVER
+    
+#if VERBOSE_POSE_OPTIMIZATION
+    std::cout << "Optimizer::PoseOptimizationFixedSize() " << std::endl; 
+#endif  
+    
+    // same problem, thresholds and schedule as PoseOptimization() (pinhole camera, no second camera)
+    PoseSolver solver;
+    solver.Reset(pFrame->fx, pFrame->fy, pFrame->cx, pFrame->cy, pFrame->mbf);
+
+    const int N = pFrame->N;
+    vector<size_t> vnIndexMono, vnIndexStereo;
+    vnIndexMono.reserve(N);
+    vnIndexStereo.reserve(N);
+
+#if USE_LINES_POSE_OPTIMIZATION 
+    const int Nlines = pFrame->Nlines;
+    vector<size_t> vnIndexLineMono, vnIndexLineStereo;
+    vnIndexLineMono.reserve(Nlines);
+    vnIndexLineStereo.reserve(Nlines);
+#endif
+
+    int nInitialCorrespondences=0;
+    int nInitialLineCorrespondences=0;
+
+    {
+    unique_lock<mutex> lock(MapPoint::mGlobalMutex);
+
+    for(int i=0; i<N; i++)
+    {
+        MapPointPtr pMP = pFrame->mvpMapPoints[i];
+        if(!pMP)
+            continue;
+
+        nInitialCorrespondences++;
+        pFrame->mvbOutlier[i] = false;
+
+        const cv::KeyPoint &kpUn = pFrame->mvKeysUn[i];
+        const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
+        if(pFrame->mvuRight[i]<0)
+        {
+            // Monocular observation
+            solver.AddMonoPoint(pMP->GetWorldPos(), kpUn.pt.x, kpUn.pt.y, invSigma2);
+            vnIndexMono.push_back(i);
+        }
+        else 
+        {
+            // Stereo observation
+            solver.AddStereoPoint(pMP->GetWorldPos(), kpUn.pt.x, kpUn.pt.y, pFrame->mvuRight[i], invSigma2);
+            vnIndexStereo.push_back(i);
+        }
+    }
+
+#if USE_LINES_POSE_OPTIMIZATION 
+    for(int i=0; i<Nlines; i++)
+    {
+        MapLinePtr pML = pFrame->mvpMapLines[i];
+        if(!pML)
+            continue;
+
+        nInitialLineCorrespondences++;
+        pFrame->mvbLineOutlier[i] = false;
+        pFrame->mvuNumLinePosOptFailures[i] = 0;
+
+        const cv::line_descriptor_c::KeyLine &klUn = pFrame->mvKeyLinesUn[i];
+        Line2DRepresentation lineRepresentation;
+        Geom2DUtils::GetLine2dRepresentationNoTheta(klUn.startPointX,klUn.startPointY,klUn.endPointX,klUn.endPointY, lineRepresentation);
+        const Eigen::Vector3d obs(lineRepresentation.nx, lineRepresentation.ny, -lineRepresentation.d);
+        const float invSigma2 = pFrame->mvLineInvLevelSigma2[klUn.octave];
+
+        Eigen::Vector3f XSw, XEw;
+        pML->GetWorldEndPoints(XSw, XEw);
+
+    #if USE_LINE_STEREO
+        if( (pFrame->mvuRightLineStart[i]>=0) && (pFrame->mvuRightLineEnd[i]>=0) )
+        {
+            // Stereo observation: back-project the detected endpoints with their depths
+            const float depthS = pFrame->mvDepthLineStart[i];
+            const float depthE = pFrame->mvDepthLineEnd[i];
+            const Eigen::Vector3d XSc((klUn.startPointX-pFrame->cx)*depthS/pFrame->fx, (klUn.startPointY-pFrame->cy)*depthS/pFrame->fy, depthS);
+            const Eigen::Vector3d XEc((klUn.endPointX-pFrame->cx)*depthE/pFrame->fx, (klUn.endPointY-pFrame->cy)*depthE/pFrame->fy, depthE);
+            // N.B: we modulate all the information matrix with invSigma2 (as in PoseOptimization())
+            solver.AddStereoLine(XSw, XEw, obs, XSc, XEc, invSigma2, kInvSigma2PointLineDistance * invSigma2);
+            vnIndexLineStereo.push_back(i);
+        }
+        else
+    #endif
+        {
+            // Monocular observation
+            solver.AddMonoLine(XSw, XEw, obs, invSigma2);
+            vnIndexLineMono.push_back(i);
+        }
+    }
+#endif // USE_LINES_POSE_OPTIMIZATION
+
+    } // end lock MapPoint::mGlobalMutex
+
+    if(nInitialCorrespondences + Tracking::sknLineTrackWeigth * nInitialLineCorrespondences < 3)
+    {
+        std::cout << "Optimizer::PoseOptimizationFixedSize() not enough correspondences " << std::endl; 
+        return 0;
+    }
+
+    Sophus::SE3<float> Tcw = pFrame->GetPose();
+    solver.Optimize(Tcw);
+
+    const vector<uint8_t>& vbMonoOutliers = solver.MonoPointOutliers();
+    for(size_t i=0; i<vnIndexMono.size(); i++)
+        pFrame->mvbOutlier[vnIndexMono[i]] = vbMonoOutliers[i];
+    const vector<uint8_t>& vbStereoOutliers = solver.StereoPointOutliers();
+    for(size_t i=0; i<vnIndexStereo.size(); i++)
+        pFrame->mvbOutlier[vnIndexStereo[i]] = vbStereoOutliers[i];
+
+#if USE_LINES_POSE_OPTIMIZATION 
+    const vector<uint8_t>& vbLineMonoOutliers = solver.MonoLineOutliers();
+    for(size_t i=0; i<vnIndexLineMono.size(); i++)
+        pFrame->mvbLineOutlier[vnIndexLineMono[i]] = vbLineMonoOutliers[i];
+    const vector<uint8_t>& vbLineStereoOutliers = solver.StereoLineOutliers();
+    for(size_t i=0; i<vnIndexLineStereo.size(); i++)
+        pFrame->mvbLineOutlier[vnIndexLineStereo[i]] = vbLineStereoOutliers[i];
+#endif
+
+    const int nBad = solver.NumPointOutliers();
+    const int nBadLines = solver.NumLineOutliers();
+
+#if VERBOSE_POSE_OPTIMIZATION    
+    std::cout << "PoseOptimizationFixedSize() - points: " << nInitialCorrespondences <<" , outliers perc: " << 100*nBad/((float)nInitialCorrespondences) << std::endl; 
+    std::cout << "PoseOptimizationFixedSize() - lines: " << nInitialLineCorrespondences <<" , outliers perc: " << 100*nBadLines/((float)nInitialLineCorrespondences) << std::endl; 
+#endif
+
+    pFrame->SetPose(Tcw);
+
+    return (nInitialCorrespondences-nBad) + Tracking::sknLineTrackWeigth*(nInitialLineCorrespondences-nBadLines);
+    
+#else
+    return PoseOptimization(pFrame);
+#endif // USE_FIXED_SIZE_POSE_SOLVER
+}
+
 /// < < 
 
 // OK Lines, Ok Objects
@@ -3269,6 +3601,7 @@ void Optimizer::LocalBundleAdjustment(KeyFramePtr pKF, bool* pbStopFlag, Map* pM
         solver->setUserLambdaInit(100.0);
 
     optimizer.setAlgorithm(solver);
+    SetOptimizerThreads(optimizer);
     optimizer.setVerbose(false);
 
     if(pbStopFlag)
@@ -3937,7 +4270,7 @@ void Optimizer::LocalBundleAdjustment(KeyFramePtr pKF, bool* pbStopFlag, Map* pM
             return;
 
     optimizer.initializeOptimization();
-    optimizer.optimize(10);
+    OptimizeBA(optimizer, 10);
 
     // NOTE: here there is NO outlier removal during optimization as in ORBSLAM2/PLVS!
     //       Below, there is outlier removal after optimization!
@@ -4274,13 +4607,19 @@ void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFramePtr pLoopKF, KeyFrameP
     solver = new g2o::OptimizationAlgorithmLevenberg(
         g2o::make_unique<g2o::BlockSolver_7_3>(g2o::make_unique<g2o::LinearSolverEigen<g2o::BlockSolver_7_3::PoseMatrixType>>()));        
 #else    
-    g2o::BlockSolver_7_3::LinearSolverType * linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolver_7_3::PoseMatrixType>();
+    g2o::BlockSolver_7_3::LinearSolverType * linearSolver;
+    PoseGraphLinearSolver<7>* pPoseGraphSolver = NULL;
+    if(skUsePoseGraphSolver)
+        linearSolver = pPoseGraphSolver = new PoseGraphLinearSolver<7>(&sEssentialGraphCache);
+    else
+        linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolver_7_3::PoseMatrixType>();
     g2o::BlockSolver_7_3 * solver_ptr= new g2o::BlockSolver_7_3(linearSolver);
     solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
 #endif
 
     solver->setUserLambdaInit(1e-16);
     optimizer.setAlgorithm(solver);
+    SetOptimizerThreads(optimizer);
 
     const vector<KeyFramePtr> vpKFs = pMap->GetAllKeyFrames();
     const vector<MapPointPtr> vpMPs = pMap->GetAllMapPoints();
@@ -4514,6 +4853,10 @@ void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFramePtr pLoopKF, KeyFrameP
 
     // Optimize!
     optimizer.initializeOptimization();
+#ifndef USE_G2O_NEW
+    if(pPoseGraphSolver)
+        pPoseGraphSolver->SetBlockKeys(optimizer);
+#endif
     optimizer.computeActiveErrors();
     optimizer.optimize(20);
     optimizer.computeActiveErrors();
@@ -4689,6 +5032,7 @@ void Optimizer::OptimizeEssentialGraph(KeyFramePtr pCurKF, vector<KeyFramePtr> &
 
     solver->setUserLambdaInit(1e-16);
     optimizer.setAlgorithm(solver);
+    SetOptimizerThreads(optimizer);
 
     Map* pMap = pCurKF->GetMap();
     const unsigned int nMaxKFid = pMap->GetMaxKFid();
@@ -5581,6 +5925,7 @@ void Optimizer::LocalInertialBA(KeyFramePtr pKF, bool *pbStopFlag, Map *pMap, in
         solver->setUserLambdaInit(1e0);
         optimizer.setAlgorithm(solver);
     }
+    SetOptimizerThreads(optimizer);
 
 
     // Set Local temporal KeyFrame vertices
@@ -6481,6 +6826,7 @@ void Optimizer::InertialOptimization(Map *pMap, Eigen::Matrix3d &Rwg, double &sc
         solver->setUserLambdaInit(1e3);
 
     optimizer.setAlgorithm(solver);
+    SetOptimizerThreads(optimizer);
 
     // Set KeyFrame vertices (fixed poses and optimizable velocities)
     for(size_t i=0; i<vpKFs.size(); i++)
@@ -6631,14 +6977,10 @@ void Optimizer::InertialOptimization(Map *pMap, Eigen::Matrix3d &Rwg, double &sc
         Eigen::Vector3d Vw = VV->estimate(); // Velocity is scaled after
         pKFi->SetVelocity(Vw.cast<float>());
 
-        if ((pKFi->GetGyroBias() - bg.cast<float>()).norm() > 0.01)
-        {
-            pKFi->SetNewBias(b);
-            if (pKFi->mpImuPreintegrated)
-                pKFi->mpImuPreintegrated->Reintegrate();
-        }
-        else
-            pKFi->SetNewBias(b);
+        // the preintegration is recomputed only if the bias moved too far for the first-order correction
+        pKFi->SetNewBias(b);
+        if (pKFi->mpImuPreintegrated)
+            pKFi->mpImuPreintegrated->ReintegrateIfNeeded();
 
 
     }
@@ -6665,6 +7007,7 @@ void Optimizer::InertialOptimization(Map *pMap, Eigen::Vector3d &bg, Eigen::Vect
 
     solver->setUserLambdaInit(1e3);
     optimizer.setAlgorithm(solver);
+    SetOptimizerThreads(optimizer);
 
     // Set KeyFrame vertices (fixed poses and optimizable velocities)
     for(size_t i=0; i<vpKFs.size(); i++)
@@ -6798,23 +7141,68 @@ void Optimizer::InertialOptimization(Map *pMap, Eigen::Vector3d &bg, Eigen::Vect
         Eigen::Vector3d Vw = VV->estimate();
         pKFi->SetVelocity(Vw.cast<float>());
 
-        if ((pKFi->GetGyroBias() - bg.cast<float>()).norm() > 0.01)
-        {
-            pKFi->SetNewBias(b);
-            if (pKFi->mpImuPreintegrated)
-                pKFi->mpImuPreintegrated->Reintegrate();
-        }
-        else
-            pKFi->SetNewBias(b);
+        // the preintegration is recomputed only if the bias moved too far for the first-order correction
+        pKFi->SetNewBias(b);
+        if (pKFi->mpImuPreintegrated)
+            pKFi->mpImuPreintegrated->ReintegrateIfNeeded();
     }
 }
 
 void Optimizer::InertialOptimization(Map *pMap, Eigen::Matrix3d &Rwg, double &scale)
 {
-    int its = 10;
+    InertialStateSnapshot snapshot;
+    TakeInertialStateSnapshot(pMap, snapshot);
+    InertialOptimization(snapshot, Rwg, scale);
+}
+
+void Optimizer::TakeInertialStateSnapshot(Map *pMap, InertialStateSnapshot &snapshot)
+{
     long unsigned int maxKFid = pMap->GetMaxKFid();
     const vector<KeyFramePtr> vpKFs = pMap->GetAllKeyFrames();
 
+    snapshot.vKFs.clear();
+    snapshot.vKFs.reserve(vpKFs.size());
+    snapshot.bg.setZero();
+    snapshot.ba.setZero();
+    if(vpKFs.empty())
+        return;
+    snapshot.bg = vpKFs.front()->GetGyroBias().cast<double>();
+    snapshot.ba = vpKFs.front()->GetAccBias().cast<double>();
+
+    map<KeyFramePtr, int> mapKFIdx; // keyframe -> index of its state
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFramePtr pKFi = vpKFs[i];
+        if(pKFi->mnId>maxKFid)
+            continue;
+        InertialStateSnapshot::KeyFrameState state;
+        state.Rwb = pKFi->GetImuRotation().cast<double>();
+        state.twb = pKFi->GetImuPosition().cast<double>();
+        state.Vw = pKFi->GetVelocity().cast<double>();
+        state.prevIdx = -1;
+        mapKFIdx[pKFi] = snapshot.vKFs.size();
+        snapshot.vKFs.push_back(state);
+    }
+
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFramePtr pKFi = vpKFs[i];
+        if(!pKFi->mPrevKF || pKFi->mnId>maxKFid || pKFi->isBad() || !pKFi->mpImuPreintegrated)
+            continue;
+        map<KeyFramePtr, int>::const_iterator itPrev = mapKFIdx.find(pKFi->mPrevKF);
+        if(itPrev == mapKFIdx.end())
+            continue;
+        InertialStateSnapshot::KeyFrameState& state = snapshot.vKFs[mapKFIdx.at(pKFi)];
+        state.prevIdx = itPrev->second;
+        state.pImuPreintegrated.reset(new IMU::Preintegrated(pKFi->mpImuPreintegrated)); // aligned operator new
+    }
+}
+
+void Optimizer::InertialOptimization(const InertialStateSnapshot &snapshot, Eigen::Matrix3d &Rwg, double &scale)
+{
+    int its = 10;
+    const int numKFs = snapshot.vKFs.size();
+
     // Setup optimizer
     g2o::SparseOptimizer optimizer;
 #ifdef USE_G2O_NEW        
@@ -6827,84 +7215,72 @@ void Optimizer::InertialOptimization(Map *pMap, Eigen::Matrix3d &Rwg, double &sc
 #endif // USE_G2O_NEW
 
     optimizer.setAlgorithm(solver);
-
-    // Set KeyFrame vertices (all variables are fixed)
-    for(size_t i=0; i<vpKFs.size(); i++)
-    {
-        KeyFramePtr pKFi = vpKFs[i];
-        if(pKFi->mnId>maxKFid)
-            continue;
-        VertexPose * VP = new VertexPose(pKFi);
-        VP->setId(pKFi->mnId);
+    SetOptimizerThreads(optimizer);
+
+    // Set KeyFrame vertices (all variables are fixed): vertex ids are the indices of the keyframe states
+    for(int i=0; i<numKFs; i++)
+    {
+        const InertialStateSnapshot::KeyFrameState& state = snapshot.vKFs[i];
+        ImuCamPose pose;
+        pose.Rwb = state.Rwb;
+        pose.twb = state.twb;
+        VertexPose * VP = new VertexPose();
+        VP->setEstimate(pose); // only the IMU pose is read by the inertial edges
+        VP->setId(i);
         VP->setFixed(true);
         optimizer.addVertex(VP);
 
-        VertexVelocity* VV = new VertexVelocity(pKFi);
-        VV->setId(maxKFid+1+(pKFi->mnId));
+        VertexVelocity* VV = new VertexVelocity();
+        VV->setEstimate(state.Vw);
+        VV->setId(numKFs+i);
         VV->setFixed(true);
         optimizer.addVertex(VV);
-
-        // Vertex of fixed biases
-        VertexGyroBias* VG = new VertexGyroBias(vpKFs.front());
-        VG->setId(2*(maxKFid+1)+(pKFi->mnId));
-        VG->setFixed(true);
-        optimizer.addVertex(VG);
-        VertexAccBias* VA = new VertexAccBias(vpKFs.front());
-        VA->setId(3*(maxKFid+1)+(pKFi->mnId));
-        VA->setFixed(true);
-        optimizer.addVertex(VA);
     }
 
+    // Vertices of fixed biases
+    VertexGyroBias* VG = new VertexGyroBias();
+    VG->setEstimate(snapshot.bg);
+    VG->setId(2*numKFs);
+    VG->setFixed(true);
+    optimizer.addVertex(VG);
+    VertexAccBias* VA = new VertexAccBias();
+    VA->setEstimate(snapshot.ba);
+    VA->setId(2*numKFs+1);
+    VA->setFixed(true);
+    optimizer.addVertex(VA);
+
     // Gravity and scale
     VertexGDir* VGDir = new VertexGDir(Rwg);
-    VGDir->setId(4*(maxKFid+1));
+    VGDir->setId(2*numKFs+2);
     VGDir->setFixed(false);
     optimizer.addVertex(VGDir);
     VertexScale* VS = new VertexScale(scale);
-    VS->setId(4*(maxKFid+1)+1);
+    VS->setId(2*numKFs+3);
     VS->setFixed(false);
     optimizer.addVertex(VS);
 
     // Graph edges
     int count_edges = 0;
-    for(size_t i=0;i<vpKFs.size();i++)
+    for(int i=0; i<numKFs; i++)
     {
-        KeyFramePtr pKFi = vpKFs[i];
-
-        if(pKFi->mPrevKF && pKFi->mnId<=maxKFid)
-        {
-            if(pKFi->isBad() || pKFi->mPrevKF->mnId>maxKFid)
-                continue;
-                
-            g2o::HyperGraph::Vertex* VP1 = optimizer.vertex(pKFi->mPrevKF->mnId);
-            g2o::HyperGraph::Vertex* VV1 = optimizer.vertex((maxKFid+1)+pKFi->mPrevKF->mnId);
-            g2o::HyperGraph::Vertex* VP2 =  optimizer.vertex(pKFi->mnId);
-            g2o::HyperGraph::Vertex* VV2 = optimizer.vertex((maxKFid+1)+pKFi->mnId);
-            g2o::HyperGraph::Vertex* VG = optimizer.vertex(2*(maxKFid+1)+pKFi->mPrevKF->mnId);
-            g2o::HyperGraph::Vertex* VA = optimizer.vertex(3*(maxKFid+1)+pKFi->mPrevKF->mnId);
-            g2o::HyperGraph::Vertex* VGDir = optimizer.vertex(4*(maxKFid+1));
-            g2o::HyperGraph::Vertex* VS = optimizer.vertex(4*(maxKFid+1)+1);
-            if(!VP1 || !VV1 || !VG || !VA || !VP2 || !VV2 || !VGDir || !VS)
-            {
-                Verbose::PrintMess("Error" + to_string(VP1->id()) + ", " + to_string(VV1->id()) + ", " + to_string(VG->id()) + ", " + to_string(VA->id()) + ", " + to_string(VP2->id()) + ", " + to_string(VV2->id()) +  ", " + to_string(VGDir->id()) + ", " + to_string(VS->id()), Verbose::VERBOSITY_NORMAL);
+        const InertialStateSnapshot::KeyFrameState& state = snapshot.vKFs[i];
+        if(state.prevIdx<0)
+            continue;
 
-                continue;
-            }
-            count_edges++;
-            EdgeInertialGS* ei = new EdgeInertialGS(pKFi->mpImuPreintegrated);
-            ei->setVertex(0,dynamic_cast<g2o::OptimizableGraph::Vertex*>(VP1));
-            ei->setVertex(1,dynamic_cast<g2o::OptimizableGraph::Vertex*>(VV1));
-            ei->setVertex(2,dynamic_cast<g2o::OptimizableGraph::Vertex*>(VG));
-            ei->setVertex(3,dynamic_cast<g2o::OptimizableGraph::Vertex*>(VA));
-            ei->setVertex(4,dynamic_cast<g2o::OptimizableGraph::Vertex*>(VP2));
-            ei->setVertex(5,dynamic_cast<g2o::OptimizableGraph::Vertex*>(VV2));
-            ei->setVertex(6,dynamic_cast<g2o::OptimizableGraph::Vertex*>(VGDir));
-            ei->setVertex(7,dynamic_cast<g2o::OptimizableGraph::Vertex*>(VS));
-            g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
-            ei->setRobustKernel(rk);
-            rk->setDelta(1.f);
-            optimizer.addEdge(ei);
-        }
+        count_edges++;
+        EdgeInertialGS* ei = new EdgeInertialGS(state.pImuPreintegrated.get());
+        ei->setVertex(0,dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(state.prevIdx)));
+        ei->setVertex(1,dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(numKFs+state.prevIdx)));
+        ei->setVertex(2,VG);
+        ei->setVertex(3,VA);
+        ei->setVertex(4,dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(i)));
+        ei->setVertex(5,dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(numKFs+i)));
+        ei->setVertex(6,VGDir);
+        ei->setVertex(7,VS);
+        g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
+        ei->setRobustKernel(rk);
+        rk->setDelta(1.f);
+        optimizer.addEdge(ei);
     }
 
     // Compute error for different scales
@@ -6973,6 +7349,7 @@ void Optimizer::LocalBundleAdjustment(KeyFramePtr pMainKF, vector<KeyFramePtr> v
 #endif // USE_LINES_LOCAL_BA    
     
     optimizer.setAlgorithm(solver);
+    SetOptimizerThreads(optimizer);
     optimizer.setVerbose(false);
     /*if(numObjects>0)
     {
@@ -8411,6 +8788,7 @@ void Optimizer::MergeInertialBA(KeyFramePtr pCurrKF, KeyFramePtr pMergeKF, bool
     solver->setUserLambdaInit(1e3);
 
     optimizer.setAlgorithm(solver);
+    SetOptimizerThreads(optimizer);
     optimizer.setVerbose(false);
 
     // Set Local KeyFrame vertices
@@ -10589,8 +10967,6 @@ void Optimizer::OptimizeEssentialGraph4DoF(Map* pMap, KeyFramePtr pLoopKF, KeyFr
                                        const LoopClosing::KeyFrameAndPose &CorrectedSim3,
                                        const map<KeyFramePtr, set<KeyFramePtr> > &LoopConnections)
 {
-    //typedef g2o::BlockSolver< g2o::BlockSolverTraits<4, 4> > BlockSolver_4_4;
-
     // Setup optimizer
     g2o::SparseOptimizer optimizer;
     optimizer.setVerbose(false);
@@ -10599,9 +10975,21 @@ void Optimizer::OptimizeEssentialGraph4DoF(Map* pMap, KeyFramePtr pLoopKF, KeyFr
     g2o::OptimizationAlgorithmLevenberg* solver = new g2o::OptimizationAlgorithmLevenberg(
         g2o::make_unique<g2o::BlockSolverX>(g2o::make_unique<g2o::LinearSolverEigen<g2o::BlockSolverX::PoseMatrixType>>()));        
 #else
-    g2o::BlockSolverX::LinearSolverType * linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolverX::PoseMatrixType>();
-    g2o::BlockSolverX * solver_ptr = new g2o::BlockSolverX(linearSolver);
-    g2o::OptimizationAlgorithmLevenberg* solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
+    typedef g2o::BlockSolver< g2o::BlockSolverTraits<4, 4> > BlockSolver_4_4;
+    g2o::OptimizationAlgorithmLevenberg* solver;
+    PoseGraphLinearSolver<4>* pPoseGraphSolver = NULL;
+    if(skUsePoseGraphSolver)
+    {
+        // fixed-size 4x4 pose blocks (all the vertices are VertexPose4DoF)
+        pPoseGraphSolver = new PoseGraphLinearSolver<4>(&sEssentialGraph4DoFCache);
+        solver = new g2o::OptimizationAlgorithmLevenberg(new BlockSolver_4_4(pPoseGraphSolver));
+    }
+    else
+    {
+        g2o::BlockSolverX::LinearSolverType * linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolverX::PoseMatrixType>();
+        g2o::BlockSolverX * solver_ptr = new g2o::BlockSolverX(linearSolver);
+        solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
+    }
 #endif // USE_G2O_NEW
 
     optimizer.setAlgorithm(solver);
@@ -10846,6 +11234,10 @@ void Optimizer::OptimizeEssentialGraph4DoF(Map* pMap, KeyFramePtr pLoopKF, KeyFr
     }
 
     optimizer.initializeOptimization();
+#ifndef USE_G2O_NEW
+    if(pPoseGraphSolver)
+        pPoseGraphSolver->SetBlockKeys(optimizer);
+#endif
     optimizer.computeActiveErrors();
     optimizer.optimize(20);
 
@@ -26,6 +26,7 @@
 #include "PointCloudMapOctreePointCloud.h"
 #include "PointCloudMapOctomap.h"
 #include "PointCloudMapVoxelGridFilter.h"
+#include "PointCloudMapVoxelHash.h"
 #include "Utils.h"
 
 namespace PLVS2
@@ -136,6 +137,11 @@ typename PointCloudMap<PointT>::Ptr PointCloudAtlas<PointT>::NewPointCloudMap(Ma
         pPointCloudMap = std::make_shared<PointCloudMapVoxblox<PointT> >(pMap, pPointCloudMapParameters_);
         pointCloudMapType = PointCloudMapTypes::kVoxblox;
     }    
+    else if (pointCloudMapStringType == PointCloudMapTypes::kPointCloudMapTypeStrings[PointCloudMapTypes::kVoxelHash])
+    {
+        pPointCloudMap = std::make_shared<PointCloudMapVoxelHash<PointT> >(pMap, pPointCloudMapParameters_);
+        pointCloudMapType = PointCloudMapTypes::kVoxelHash;
+    }
     else
     {
         // default 
@@ -70,6 +70,9 @@ std::shared_ptr<sgm::StereoSGM> PointCloudKeyFrame<PointT>::pSgm = 0;
 template<typename PointT>
 std::shared_ptr<StereoDisparity> PointCloudKeyFrame<PointT>::pSd = 0;
 
+template<typename PointT>
+std::mutex PointCloudKeyFrame<PointT>::stereoMutex;
+
 template<typename PointT>
 PointCloudKeyFrame<PointT>::PointCloudKeyFrame()
 : pKF(0), bCloudReady(false), bInMap(false), bIsValid(true), bStereo(false)
@@ -152,6 +155,8 @@ void PointCloudKeyFrame<PointT>::PreProcess()
     
     if( bStereo && imgDepth.empty() )
     {
+        std::unique_lock<std::mutex> lockStereo(stereoMutex);
+        
         switch(ksStereoLibrary)
         {
             
@@ -23,6 +23,9 @@
 
 #include "PointUtils.h"
 
+#include <algorithm>
+#include <functional>
+
 #include <pcl/io/ply_io.h>
 #include <pcl/filters/crop_box.h>
 #include <pcl/filters/extract_indices.h>
@@ -41,7 +44,6 @@
 namespace PLVS2
 {
 
-
 template<typename PointT>
 PointCloudMapChisel<PointT>::PointCloudMapChisel(Map* pMap, const std::shared_ptr<PointCloudMapParameters>& params) : PointCloudMap<PointT>(pMap, params)
 {
@@ -202,6 +204,8 @@ void PointCloudMapChisel<PointT>::InsertData(typename PointCloudMapInput<PointT>
     uint32_t kfid = pKF->mnId;    
     this->mapKfidPointCloudKeyFrame_[kfid] = pData->pPointCloudKeyFrame;         
 
+    const unsigned long long int startTime = Stopwatch::getCurrentSystemTime();
+
     switch (pData->type)
     {
     case PointCloudMapInput<PointT>::kPointCloud:
@@ -222,6 +226,11 @@ void PointCloudMapChisel<PointT>::InsertData(typename PointCloudMapInput<PointT>
         std::cout << "PointCloudMapChisel<PointT>::InsertData() - ERROR - unknown data mode" << std::endl;
         quick_exit(-1);
     }
+
+    const double integrationTimeMs = (Stopwatch::getCurrentSystemTime() - startTime)/1000.; // [ms]
+    integrationTimeMs_ += integrationTimeMs;
+    numIntegrations_++;
+    std::cout << "PointCloudMapChisel - integration: " << integrationTimeMs << " ms (average: " << integrationTimeMs_/numIntegrations_ << " ms/KF)" << std::endl;
 }
 
 template<typename PointT>
@@ -233,9 +242,16 @@ int PointCloudMapChisel<PointT>::UpdateMap()
     if (!this->pPointCloud_) this->pPointCloud_.reset(new PointCloudT());
 
     std::cout << "\nPointCloudMapChisel - updating mesh" << std::endl;
+    const unsigned long long int startTime = Stopwatch::getCurrentSystemTime();
     this->pChiselServer_->UpdateMesh();
+    const double meshingTimeMs = (Stopwatch::getCurrentSystemTime() - startTime)/1000.; // [ms]
+    meshingTimeMs_ += meshingTimeMs;
+    numMeshings_++;
+    std::cout << "PointCloudMapChisel - meshing: " << meshingTimeMs << " ms, updated meshes: " << this->pChiselServer_->GetUpdatedMeshes().size()
+              << " (average: " << meshingTimeMs_/std::max(numIntegrations_, numMeshings_) << " ms/KF)" << std::endl;
+
     std::cout << "\nPointCloudMapChisel - getting cloud" << std::endl;
-    this->pChiselServer_->GetPointCloud(*(this->pPointCloud_));
+    this->UpdateMeshClouds();
 
     std::cout << "\nPointCloudMapChisel - generated map - size: " << this->pPointCloud_->size() << std::endl;
 
@@ -245,6 +261,128 @@ int PointCloudMapChisel<PointT>::UpdateMap()
     return this->pPointCloud_->size();
 }
 
+template<typename PointT>
+void PointCloudMapChisel<PointT>::UpdateMeshClouds()
+{
+    PointCloudT& cloud = *(this->pPointCloud_);
+
+    std::vector<chisel::ChunkID> chunksToExport;
+    if (cloud.points.size() != pointChunkKeys_.size())
+    {
+        // the cloud was changed from outside (e.g. by PointCloudMap::LoadMap()): export all the meshes again
+        cloud.clear();
+        ClearChunkPoints();
+        for (const auto& mesh : this->pChiselServer_->GetChiselMap()->GetChunkManager().GetAllMeshes())
+        {
+            chunksToExport.push_back(mesh.first);
+        }
+    }
+    else
+    {
+        // drop the vertices of the meshes removed in the meantime (garbage collection, reset)
+        std::vector<uint64_t> removedKeys;
+        for (const auto& chunkIndices : mapChunkPointIndices_)
+        {
+            int x, y, z;
+            Utils::UnpackGridKey(chunkIndices.first, x, y, z);
+            if (!this->pChiselServer_->HasMesh(chisel::ChunkID(x, y, z))) removedKeys.push_back(chunkIndices.first);
+        }
+        for (const uint64_t key : removedKeys)
+        {
+            RemoveChunkPoints(key);
+        }
+
+        // only the recomputed (or deformed) meshes are converted 
+        for (const auto& updatedMesh : this->pChiselServer_->GetUpdatedMeshes())
+        {
+            chunksToExport.push_back(updatedMesh.first);
+        }
+    }
+
+    PointCloudT chunkCloud;
+    for (const chisel::ChunkID& chunkID : chunksToExport)
+    {
+        const uint64_t key = Utils::PackGridKey(chunkID(0), chunkID(1), chunkID(2));
+        if (!this->pChiselServer_->GetMeshPointCloud(chunkID, chunkCloud))
+        {
+            RemoveChunkPoints(key);
+            continue;
+        }
+
+        auto it = mapChunkPointIndices_.find(key);
+        if (it != mapChunkPointIndices_.end() && it->second.size() == chunkCloud.size())
+        {
+            // same number of vertices: overwrite them in place
+            const std::vector<size_t>& indices = it->second;
+            for (size_t ii = 0; ii < indices.size(); ii++)
+            {
+                cloud.points[indices[ii]] = chunkCloud.points[ii];
+            }
+        }
+        else
+        {
+            RemoveChunkPoints(key);
+            AddChunkPoints(key, chunkCloud);
+        }
+    }
+
+    cloud.width = cloud.points.size();
+    cloud.height = 1;
+    cloud.header.stamp = Stopwatch::getCurrentSystemTime(); // [us]
+}
+
+template<typename PointT>
+void PointCloudMapChisel<PointT>::AddChunkPoints(const uint64_t key, const PointCloudT& chunkCloud)
+{
+    PointCloudT& cloud = *(this->pPointCloud_);
+
+    std::vector<size_t>& indices = mapChunkPointIndices_[key];
+    indices.reserve(indices.size() + chunkCloud.size());
+    for (const PointT& point : chunkCloud.points)
+    {
+        pointChunkKeys_.push_back(key);
+        pointSlots_.push_back(indices.size());
+        indices.push_back(cloud.points.size());
+        cloud.points.push_back(point);
+    }
+}
+
+template<typename PointT>
+void PointCloudMapChisel<PointT>::RemoveChunkPoints(const uint64_t key)
+{
+    auto it = mapChunkPointIndices_.find(key);
+    if (it == mapChunkPointIndices_.end()) return;
+
+    PointCloudT& cloud = *(this->pPointCloud_);
+
+    // in descending order, the last point of the cloud never belongs to the removed chunk (but when it is the removed point itself)
+    std::vector<size_t>& indices = it->second;
+    std::sort(indices.begin(), indices.end(), std::greater<size_t>());
+    for (const size_t idx : indices)
+    {
+        const size_t last = cloud.points.size() - 1;
+        if (idx != last)
+        {
+            cloud.points[idx] = cloud.points[last];
+            pointChunkKeys_[idx] = pointChunkKeys_[last];
+            pointSlots_[idx] = pointSlots_[last];
+            mapChunkPointIndices_[pointChunkKeys_[idx]][pointSlots_[idx]] = idx;
+        }
+        cloud.points.pop_back();
+        pointChunkKeys_.pop_back();
+        pointSlots_.pop_back();
+    }
+    mapChunkPointIndices_.erase(it);
+}
+
+template<typename PointT>
+void PointCloudMapChisel<PointT>::ClearChunkPoints()
+{
+    mapChunkPointIndices_.clear();
+    pointChunkKeys_.clear();
+    pointSlots_.clear();
+}
+
 template<typename PointT>
 void PointCloudMapChisel<PointT>::Clear()
 {
@@ -253,6 +391,7 @@ void PointCloudMapChisel<PointT>::Clear()
     std::unique_lock<std::recursive_timed_mutex> lck(this->pointCloudMutex_);
 
     this->pChiselServer_->Reset();
+    ClearChunkPoints();
 
     /// < clear basic class !
     PointCloudMap<PointT>::Clear();
@@ -28,7 +28,8 @@ namespace PLVS2
         "octree_point",
         "chisel",
         "fastfusion",
-        "voxblox"            
+        "voxblox",
+        "voxelhash"
     };
 
 } //namespace PLVS2
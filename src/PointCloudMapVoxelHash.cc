@@ -0,0 +1,376 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "PointCloudMapVoxelHash.h"
+
+#include "PointUtils.h"
+
+#include <cmath>
+#include <limits>
+
+#include "Converter.h"
+#include "KeyFrame.h"
+#include "Utils.h"
+
+
+namespace PLVS2
+{
+
+namespace
+{
+
+// weighted Boyer-Moore majority vote: the candidate wins only if it collected more votes than all the others
+inline void vote(uint32_t& candidate, uint32_t& votes, const uint32_t id, const uint32_t weight)
+{
+    if(candidate == id)
+    {
+        votes += weight;
+    }
+    else if(votes >= weight)
+    {
+        votes -= weight;
+    }
+    else
+    {
+        candidate = id;
+        votes = weight - votes;
+    }
+}
+
+}
+
+template<typename PointT>
+const uint32_t PointCloudMapVoxelHash<PointT>::kNoKfid = std::numeric_limits<uint32_t>::max();
+
+template<typename PointT>
+PointCloudMapVoxelHash<PointT>::PointCloudMapVoxelHash(Map* pMap, const std::shared_ptr<PointCloudMapParameters>& params) : PointCloudMap<PointT>(pMap, params)
+{
+    invResolution_ = 1./params->resolution;
+    minWeight_ = std::max(params->nPointCounterThreshold, 1);
+}
+
+template<typename PointT>
+void PointCloudMapVoxelHash<PointT>::InsertCloud(typename PointCloudMap<PointT>::PointCloudT::ConstPtr cloud_world, double x_sensor_origin, double y_sensor_origin, double z_sensor_origin, double max_range)
+{
+    std::unique_lock<std::recursive_timed_mutex> lck(this->pointCloudMutex_);
+    Integrate(*cloud_world, kNoKfid);
+}
+
+template<typename PointT>
+void PointCloudMapVoxelHash<PointT>::InsertData(typename PointCloudMapInput<PointT>::Ptr pData)
+{
+    std::unique_lock<std::recursive_timed_mutex> lck(this->pointCloudMutex_);
+
+    this->lastTimestamp_ = pData->timestamp;
+
+    assert(pData->type == PointCloudMapInput<PointT>::kPointCloud);
+
+    typename PointCloudKeyFrameT::Ptr pcKF = pData->pPointCloudKeyFrame;
+    const uint32_t kfid = pcKF->pKF->mnId;
+    this->mapKfidPointCloudKeyFrame_[kfid] = pcKF;
+
+    typename PointCloudT::Ptr pCloudWorld(new PointCloudT);
+    pcKF->TwcIntegration = pcKF->GetCameraPose();
+
+    this->TransformCameraCloudInWorldFrame(pcKF->pCloudCamera, Converter::toIsometry3d(pcKF->TwcIntegration), pCloudWorld);
+
+    Integrate(*pCloudWorld, kfid);
+}
+
+template<typename PointT>
+void PointCloudMapVoxelHash<PointT>::Integrate(const PointCloudT& cloud, const uint32_t kfid)
+{
+    Voxel v;
+    v.weight = 1;
+    v.kfidVotes = 1;
+    v.labelVotes = 1;
+    for(size_t ii=0, iiEnd=cloud.size(); ii<iiEnd; ii++)
+    {
+        const PointT& point = cloud.points[ii];
+        if(!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z)) continue;
+
+        v.x = point.x; v.y = point.y; v.z = point.z;
+        v.r = point.r; v.g = point.g; v.b = point.b;
+        PointUtils::getNormal(point, v.nx, v.ny, v.nz);
+        v.depth = PointUtils::getDepth(point);
+        v.kfid = (kfid != kNoKfid) ? kfid : PointUtils::getKfid(point, kNoKfid);
+        v.label = PointUtils::getLabel(point);
+
+        IntegrateVoxel(v);
+    }
+}
+
+template<typename PointT>
+void PointCloudMapVoxelHash<PointT>::IntegrateVoxel(const Voxel& m)
+{
+    const int vx = (int)std::floor(m.x*invResolution_);
+    const int vy = (int)std::floor(m.y*invResolution_);
+    const int vz = (int)std::floor(m.z*invResolution_);
+
+    Block& block = GetBlock(Utils::PackGridKey(vx >> kBlockBits, vy >> kBlockBits, vz >> kBlockBits));
+
+    const int kMask = kBlockSize - 1;
+    int16_t& index = block.voxelIndex[((vz & kMask) << (2*kBlockBits)) | ((vy & kMask) << kBlockBits) | (vx & kMask)];
+    if(index < 0)
+    {
+        index = block.voxels.size();
+        block.voxels.push_back(m);
+        block.voxels.back().slot = -1;
+        numVoxels_++;
+    }
+    else
+    {
+        Voxel& v = block.voxels[index];
+        const uint32_t weight = v.weight + m.weight;
+        const float alpha = (float)m.weight/weight;
+        v.x += (m.x - v.x)*alpha;
+        v.y += (m.y - v.y)*alpha;
+        v.z += (m.z - v.z)*alpha;
+        v.r += (m.r - v.r)*alpha;
+        v.g += (m.g - v.g)*alpha;
+        v.b += (m.b - v.b)*alpha;
+        v.nx += (m.nx - v.nx)*alpha;
+        v.ny += (m.ny - v.ny)*alpha;
+        v.nz += (m.nz - v.nz)*alpha;
+        v.depth += (m.depth - v.depth)*alpha;
+        v.weight = weight;
+        vote(v.kfid, v.kfidVotes, m.kfid, m.kfidVotes);
+        vote(v.label, v.labelVotes, m.label, m.labelVotes);
+    }
+
+    if(!block.bDirty)
+    {
+        block.bDirty = true;
+        dirtyBlocks_.push_back(&block);
+    }
+}
+
+template<typename PointT>
+typename PointCloudMapVoxelHash<PointT>::Block& PointCloudMapVoxelHash<PointT>::GetBlock(const uint64_t key)
+{
+    // consecutive points of a cloud mostly fall in the same block
+    if(pLastBlock_ && key == lastBlockKey_) return *pLastBlock_;
+
+    Block& block = blocks_[key]; // the references to the elements of an unordered_map survive rehashing
+    lastBlockKey_ = key;
+    pLastBlock_ = &block;
+    return block;
+}
+
+template<typename PointT>
+void PointCloudMapVoxelHash<PointT>::ExportVoxel(const Voxel& v, PointT& point) const
+{
+    point.x = v.x;
+    point.y = v.y;
+    point.z = v.z;
+    point.r = (uint8_t)(v.r + 0.5f);
+    point.g = (uint8_t)(v.g + 0.5f);
+    point.b = (uint8_t)(v.b + 0.5f);
+
+    const float norm = std::sqrt(v.nx*v.nx + v.ny*v.ny + v.nz*v.nz);
+    if(norm > 0.f)
+        PointUtils::updateNormal(v.nx/norm, v.ny/norm, v.nz/norm, point);
+    else
+        PointUtils::updateNormal(0.f, 0.f, 0.f, point);
+
+    PointUtils::updateDepth(v.depth, point);
+    PointUtils::setKFid(point, v.kfid);
+    PointUtils::updateLabel(v.label, v.labelVotes, point);
+}
+
+template<typename PointT>
+int PointCloudMapVoxelHash<PointT>::UpdateMap()
+{
+    std::unique_lock<std::recursive_timed_mutex> lck(this->pointCloudMutex_);
+
+    PointCloudT& cloud = *(this->pPointCloud_);
+
+    if(cloud.points.size() != numExportedVoxels_)
+    {
+        // the cloud was changed from outside (e.g. by PointCloudMap::ResetPointCloud()): export all the voxels again
+        cloud.clear();
+        numExportedVoxels_ = 0;
+        dirtyBlocks_.clear();
+        for(auto& item : blocks_)
+        {
+            Block& block = item.second;
+            for(Voxel& v : block.voxels) v.slot = -1;
+            block.bDirty = true;
+            dirtyBlocks_.push_back(&block);
+        }
+    }
+
+    for(Block* pBlock : dirtyBlocks_)
+    {
+        for(Voxel& v : pBlock->voxels)
+        {
+            if(v.weight < minWeight_) continue;
+            if(v.slot < 0)
+            {
+                v.slot = cloud.points.size();
+                cloud.points.push_back(PointT());
+            }
+            ExportVoxel(v, cloud.points[v.slot]);
+        }
+        pBlock->bDirty = false;
+    }
+    dirtyBlocks_.clear();
+
+    numExportedVoxels_ = cloud.points.size();
+    cloud.width = cloud.points.size();
+    cloud.height = 1;
+
+    /// < update timestamp !
+    this->UpdateMapTimestamp();
+
+    return cloud.size();
+}
+
+template<typename PointT>
+void PointCloudMapVoxelHash<PointT>::ClearVoxels()
+{
+    blocks_.clear();
+    dirtyBlocks_.clear();
+    numVoxels_ = 0;
+    numExportedVoxels_ = 0;
+    pLastBlock_ = nullptr;
+}
+
+template<typename PointT>
+void PointCloudMapVoxelHash<PointT>::Clear()
+{
+    std::unique_lock<std::recursive_timed_mutex> lck(this->pointCloudMutex_);
+
+    ClearVoxels();
+
+    /// < clear basic class !
+    PointCloudMap<PointT>::Clear();
+}
+
+template<typename PointT>
+void PointCloudMapVoxelHash<PointT>::DeformMap()
+{
+    struct Correction
+    {
+        bool bValid;
+        bool bMoved;
+        Sophus::SE3f Twnwo; // from world old to world new
+    };
+
+    // correction of each keyframe: its voxels move with it
+    std::unordered_map<uint32_t, Correction> corrections;
+    for(auto& item : mapKfidPointCloudKeyFrame_)
+    {
+        typename PointCloudKeyFrameT::Ptr& pcKF = item.second;
+        Correction& correction = corrections[item.first];
+
+        correction.bValid = pcKF->bIsValid && !pcKF->pKF->isBad();
+        correction.bMoved = false;
+        if(!correction.bValid) continue;
+
+        const Sophus::SE3f TwcNew = pcKF->pKF->GetPoseInverse(); // new corrected pose
+        correction.Twnwo = TwcNew * pcKF->TwcIntegration.inverse();
+
+        // check if the transformation is "big" enough otherwise do not move the voxels
+        const double norm = (correction.Twnwo.matrix3x4() - Sophus::SE3f().matrix3x4()).norm();
+        correction.bMoved = norm > kNormThresholdForEqualMatrices;
+
+        // update integration pose
+        pcKF->TwcIntegration = TwcNew;
+    }
+
+    std::vector<Voxel> voxels;
+    voxels.reserve(numVoxels_);
+    for(auto& item : blocks_)
+    {
+        voxels.insert(voxels.end(), item.second.voxels.begin(), item.second.voxels.end());
+    }
+
+    ClearVoxels();
+    PointCloudMap<PointT>::Clear();
+
+    // re-integrate the corrected voxels (with their weights)
+    for(Voxel& v : voxels)
+    {
+        auto it = corrections.find(v.kfid);
+        if(it != corrections.end())
+        {
+            const Correction& correction = it->second;
+            if(!correction.bValid) continue;
+            if(correction.bMoved)
+            {
+                const Eigen::Vector3f p = correction.Twnwo * Eigen::Vector3f(v.x, v.y, v.z);
+                const Eigen::Vector3f n = correction.Twnwo.so3() * Eigen::Vector3f(v.nx, v.ny, v.nz);
+                v.x = p.x(); v.y = p.y(); v.z = p.z();
+                v.nx = n.x(); v.ny = n.y(); v.nz = n.z();
+            }
+        }
+        IntegrateVoxel(v);
+    }
+}
+
+template<typename PointT>
+void PointCloudMapVoxelHash<PointT>::OnMapChange()
+{
+    std::unique_lock<std::recursive_timed_mutex> lck(this->pointCloudMutex_);
+    if (this->pPointCloudMapParameters_->bResetOnSparseMapChange)
+    {
+        std::cout << "PointCloudMapVoxelHash<PointT>::OnMapChange() - point cloud map reset *** " << std::endl;
+        this->Clear();
+    }
+
+    if (this->pPointCloudMapParameters_->bCloudDeformationOnSparseMapChange)
+    {
+        std::cout << "PointCloudMapVoxelHash<PointT>::OnMapChange() - point cloud KF adjustment" << std::endl;
+        DeformMap();
+        this->UpdateMap(); // export and update timestamp
+    }
+}
+
+template<typename PointT>
+bool PointCloudMapVoxelHash<PointT>::LoadMap(const std::string& filename)
+{
+    std::unique_lock<std::recursive_timed_mutex> lck(this->pointCloudMutex_);
+
+    if(!PointCloudMap<PointT>::LoadMap(filename)) return false;
+
+    // fuse the loaded points in the voxels
+    PointCloudT loadedCloud;
+    loadedCloud.swap(*(this->pPointCloud_));
+    ClearVoxels();
+    Integrate(loadedCloud, kNoKfid);
+    this->UpdateMap();
+    return true;
+}
+
+template<typename PointT>
+size_t PointCloudMapVoxelHash<PointT>::GetNumBlocks()
+{
+    std::unique_lock<std::recursive_timed_mutex> lck(this->pointCloudMutex_);
+    return blocks_.size();
+}
+
+template<typename PointT>
+size_t PointCloudMapVoxelHash<PointT>::GetNumVoxels()
+{
+    std::unique_lock<std::recursive_timed_mutex> lck(this->pointCloudMutex_);
+    return numVoxels_;
+}
+
+} //namespace PLVS2
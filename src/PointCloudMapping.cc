@@ -20,6 +20,7 @@
 
 
 #include <limits>
+#include <algorithm>
 #include <unordered_map>
 #include <utility>
 
@@ -48,6 +49,9 @@
 #include "Stopwatch.h"
 #include "PointUtils.h"
 #include "Neighborhood.h"
+#include "DepthCloudKernel.h"
+#include "TaskPool.h"
+#include "LatencyTrace.h"
 
 
 //#define PCL_VIEWER
@@ -68,10 +72,13 @@ const double PointCloudMapping::kMaxDepthDistance = 10; // [m]
 const double PointCloudMapping::kMinDepthDistance = 0.01; // [m]
 
 const int PointCloudMapping::kNumKeyframesToQueueBeforeProcessing = 5;//5;
+const int PointCloudMapping::kNumPreprocessingWorkers = 2;
+const int PointCloudMapping::kNumCloudGenerationThreads = 2;
 const int PointCloudMapping::kMaxNumKeyFramesToInsertInMapInOneStep = 5;
 const int PointCloudMapping::kTimeoutForWaitingKeyFramesMs = 5000; // [ms]    
+const int PointCloudMapping::kTimeoutForWaitingLBAMs = 50; // [ms]    
 
-const int PointCloudMapping::kMainThreadSleepMs = 10; // [ms]
+const int PointCloudMapping::kMainThreadSleepMs = 0; // [ms] (the main loop waits on keyFramesCond_)
 const int PointCloudMapping::kPerKeyFrameProcessSleepMs = 5; // [ms]
 
 const double PointCloudMapping::kGridMapDefaultResolution = 0.05;
@@ -97,7 +104,7 @@ typedef EigthNeighborhoodIndicesFast NeighborhoodT;
 
 
 PointCloudMapping::PointCloudMapping(const string &strSettingPath, Atlas* atlas, LocalMapping* localMap): 
-mpAtlas(atlas), mpLocalMapping(localMap), bInitCamGridPoints_(false),bFinished_(true),mnSaveMapCount_(0)
+mpAtlas(atlas), mpLocalMapping(localMap), bFinished_(true),mnSaveMapCount_(0)
 {
     cv::FileStorage fsSettings(strSettingPath, cv::FileStorage::READ);
     
@@ -119,6 +126,8 @@ mpAtlas(atlas), mpLocalMapping(localMap), bInitCamGridPoints_(false),bFinished_(
     std::cout << "point cloud map type: " << pointCloudMapStringType << std::endl;
     
     numKeyframesToQueueBeforeProcessing_ = Utils::GetParam(fsSettings, "PointCloudMapping.numKeyframesToQueueBeforeProcessing", kNumKeyframesToQueueBeforeProcessing);
+    numPreprocessingWorkers_ = std::max(1, Utils::GetParam(fsSettings, "PointCloudMapping.numPreprocessingWorkers", kNumPreprocessingWorkers));
+    numCloudGenerationThreads_ = std::max(0, Utils::GetParam(fsSettings, "PointCloudMapping.numCloudGenerationThreads", kNumCloudGenerationThreads));
     
     skDownsampleStep = Utils::GetParam(fsSettings, "PointCloudMapping.downSampleStep", 2);
     
@@ -195,6 +204,9 @@ mpAtlas(atlas), mpLocalMapping(localMap), bInitCamGridPoints_(false),bFinished_(
         
         std::cout << "WARNING: forcing filter depth on" << std::endl; 
         bFilterDepthImages = true; 
+        
+        std::cout << "WARNING: forcing numPreprocessingWorkers to 1" << std::endl;  // the segmentation images are shared with the viewer 
+        numPreprocessingWorkers_ = 1; 
     }    
     bool bSegmentationErosionDilationOn = static_cast<int> (Utils::GetParam(fsSettings, "Segmentation.erosionDilationOn", 1)) != 0;
     
@@ -276,9 +288,17 @@ mpAtlas(atlas), mpLocalMapping(localMap), bInitCamGridPoints_(false),bFinished_(
         pPointCloudMap_->LoadMap(msLoadFilename_);
     }
     
-    /// < last, launch the thread
+    /// < last, launch the threads
     if(bActive_)
     {
+        if(numCloudGenerationThreads_ > 0)
+        {
+            pCloudGenerationPool_ = std::make_shared<TaskPool>(numCloudGenerationThreads_);
+        }
+        for(int i=0; i<numPreprocessingWorkers_; i++)
+        {
+            preprocessingThreads_.push_back(make_shared<thread>(bind(&PointCloudMapping::RunPreprocessing, this)));
+        }
         viewerThread_ = make_shared<thread>(bind(&PointCloudMapping::Run, this));
     }
     
@@ -294,6 +314,11 @@ void PointCloudMapping::Shutdown()
 
         unique_lock<mutex> lck_keyframes(keyframesMutex_);
         keyFramesCond_.notify_one();
+        preprocessingCond_.notify_all();
+    }
+    for(auto& pThread : preprocessingThreads_)
+    {
+        pThread->join();
     }
     viewerThread_->join();
 }
@@ -333,14 +358,11 @@ void PointCloudMapping::InsertKeyFrame(PointCloudKeyFrame<PointT>::Ptr pcKeyFram
     pcKeyFrame->Init(); // N.B.: no memory sharing for color and depth  
 #endif 
     
+    pcKeyFrame->nInsertionTime = Stopwatch::getCurrentSystemTime();
     pcKeyframesIn_.push_back(pcKeyFrame);
+    COUNTERCLOUD("PC::#KFsToPreprocess", pcKeyframesIn_.size());
 
-    bKeyframesAvailable_ = true;
-
-    if (pcKeyframesIn_.size() >= numKeyframesToQueueBeforeProcessing_)
-    {
-        keyFramesCond_.notify_one();
-    }    
+    preprocessingCond_.notify_one();
 }
 
 //void PointCloudMapping::PrepareNewKeyFramesOld()
@@ -366,35 +388,98 @@ void PointCloudMapping::InsertKeyFrame(PointCloudKeyFrame<PointT>::Ptr pcKeyFram
 //    bKeyframesAvailable_ = false;
 //}
 
-void PointCloudMapping::PrepareNewKeyFrames()
+void PointCloudMapping::RunPreprocessing()
 {
-    unique_lock<mutex> lck_pcKeyframes(pcKeyframesMutex_);
+    while (1)
+    {
+        PointCloudKeyFrame<PointT>::Ptr pcKeyframe;
+        int resetCount = 0;
+        {
+            unique_lock<mutex> lck(keyframesMutex_);
+            preprocessingCond_.wait(lck, [this]{ return bShutDown_ || !pcKeyframesIn_.empty(); });
+            if (bShutDown_)
+            {
+                break;
+            }
+            
+            pcKeyframe = pcKeyframesIn_.front();
+            pcKeyframesIn_.pop_front();
+            numKeyframesInPreprocessing_++;
+            resetCount = resetCount_;
+            
+            COUNTERCLOUD("PC::#KFsToPreprocess", pcKeyframesIn_.size());
+            COUNTERCLOUD("PC::#KFsInPreprocessing", numKeyframesInPreprocessing_);
+        }
+        
+        const double queueLatencyMs = (Stopwatch::getCurrentSystemTime() - pcKeyframe->nInsertionTime)/1000.; // [ms]
+        COUNTERCLOUD("PC::PreprocessQueueLatency[ms]", queueLatencyMs);
+        LatencyTrace::GetInstance().Add(LatencyTrace::kPointCloudMapping, queueLatencyMs);
+        
+        STOPWATCHCLOUD("PC::Preprocess", PreprocessKeyFrame(pcKeyframe););
+        
+        {
+            unique_lock<mutex> lck(keyframesMutex_);
+            numKeyframesInPreprocessing_--;
+            COUNTERCLOUD("PC::#KFsInPreprocessing", numKeyframesInPreprocessing_);
+            
+            if (resetCount != resetCount_) continue; // the keyframe was queued before a reset 
+            
+            // keep the keyframes sorted by id (the workers may complete them out of order)
+            const long unsigned int id = pcKeyframe->pKF->mnId;
+            auto it = std::upper_bound(pcKeyframesPreprocessed_.begin(), pcKeyframesPreprocessed_.end(), id, 
+                                       [](const long unsigned int kfId, const PointCloudKeyFrame<PointT>::Ptr& pcKF){ return kfId < pcKF->pKF->mnId; });
+            pcKeyframesPreprocessed_.insert(it, pcKeyframe);
+            COUNTERCLOUD("PC::#KFsWaitingLBA", pcKeyframesPreprocessed_.size());
 
+            bKeyframesAvailable_ = true;
+
+            if (pcKeyframesPreprocessed_.size() >= numKeyframesToQueueBeforeProcessing_)
+            {
+                keyFramesCond_.notify_one();
+            }
+        }
+    }
+}
+
+void PointCloudMapping::PreprocessKeyFrame(PointCloudKeyFrame<PointT>::Ptr pcKeyframe)
+{
+    cout << "Preparing keyframe, id = " << pcKeyframe->pKF->mnId << " (Bad: " << (int)pcKeyframe->pKF->isBad() << ")" << endl;
+    
+#if !INIT_PCKF_ON_INSERT          
+    pcKeyframe->Init(); // N.B.: no memory sharing for color and depth  
+#endif 
+        
+    pcKeyframe->PreProcess();
+    
+    // the cloud in camera frame does not depend on the KF pose: generate it here instead of at integration time 
+    GeneratePointCloudInCameraFrame(pcKeyframe);
+}
+
+void PointCloudMapping::PrepareNewKeyFrames()
+{
     unique_lock<mutex> lck(keyframesMutex_);
     
-    if(pcKeyframesIn_.empty()) return; 
+    // the keyframes left in pcKeyframesPreprocessed_ are polled by Run() until they are ready 
+    bKeyframesAvailable_ = false;
+    
+    if(pcKeyframesPreprocessed_.empty()) return; 
     
     if(mpAtlas->isInertial())
     {
         if(!mpAtlas->isImuInitialized()) return; 
     }
 
-    for (auto it=pcKeyframesIn_.begin(); it != pcKeyframesIn_.end(); )
+    unique_lock<mutex> lck_pcKeyframes(pcKeyframesMutex_);
+
+    for (auto it=pcKeyframesPreprocessed_.begin(); it != pcKeyframesPreprocessed_.end(); )
     {
         PointCloudKeyFrame<PointT>::Ptr pcKeyframe = *it;
-        cout << "Preparing keyframe, id = " << pcKeyframe->pKF->mnId << " (Bad: " << (int)pcKeyframe->pKF->isBad() << ", LBA count: " << pcKeyframe->pKF->mnLBACount <<  ") (#queued: " << pcKeyframesIn_.size() << ")" << endl;
-        
-#if !INIT_PCKF_ON_INSERT          
-        pcKeyframe->Init(); // N.B.: no memory sharing for color and depth  
-#endif 
-        
-        pcKeyframe->PreProcess();
         
         //NOTE: insert only once LBA has adjusted the KF a first time
         if(pcKeyframe->pKF->mnLBACount>0 || pcKeyframe->pKF->mbFixed)
         {
             pcKeyframes_.push_back(pcKeyframe);
-            it = pcKeyframesIn_.erase(it);
+            it = pcKeyframesPreprocessed_.erase(it);
         }
         else
         {
@@ -402,9 +487,7 @@ void PointCloudMapping::PrepareNewKeyFrames()
         }
         
     }
-    //pcKeyframesIn_.clear();
-
-    bKeyframesAvailable_ = false;
+    COUNTERCLOUD("PC::#KFsWaitingLBA", pcKeyframesPreprocessed_.size());
 }
 
 void PointCloudMapping::Run()
@@ -427,12 +510,10 @@ void PointCloudMapping::Run()
         }
         {
             unique_lock<mutex> lck_keyframes(keyframesMutex_);
-            if ((!bKeyframesAvailable_) && (!bKeyframesToInsertInMap_))
-            {
-                //keyFramesCond_.wait(lck_keyframes); 
-                keyFramesCond_.wait_for(lck_keyframes, std::chrono::milliseconds(kTimeoutForWaitingKeyFramesMs));  
-                
-            }
+            // the keyframes waiting for LBA are not notified when LBA adjusts them: poll them with a short timeout 
+            const int timeoutMs = pcKeyframesPreprocessed_.empty() ? kTimeoutForWaitingKeyFramesMs : kTimeoutForWaitingLBAMs; 
+            keyFramesCond_.wait_for(lck_keyframes, std::chrono::milliseconds(timeoutMs), 
+                                    [this]{ return bKeyframesAvailable_ || bKeyframesToInsertInMap_ || bShutDown_; });
         }
 
         PrepareNewKeyFrames();
@@ -469,74 +550,107 @@ bool PointCloudMapping::UpdateMap()
     set<KeyFramePtr> set_pKFs = map->GetSetKeyFrames();
     mpLocalMapping->AddNewKeyFramesToSet(set_pKFs);
     
-
-    unique_lock<recursive_timed_mutex> lck_globalMap(pointCloudMutex_);
-    unique_lock<mutex> lck_pcKeyframes(pcKeyframesMutex_);
-    
-    pPointCloudMap_ = mpPointCloudAtlas->GetCurrentMap();
-
-    size_t i, iEnd;
-        
-    /// < integrate most recent keyframes 
-    for (i = lastKeyframeIndex_, iEnd=pcKeyframes_.size(); i < iEnd; i++)
+    // same check of IntegratePointCloudKeyframe()
+    auto isToIntegrate = [&set_pKFs](const PointCloudKeyFrame<PointT>::Ptr& pcKeyframe)
     {
-        PointCloudKeyFrame<PointT>::Ptr pcKeyframe = pcKeyframes_[i];
+        return pcKeyframe && pcKeyframe->bIsValid && !pcKeyframe->bInMap && (set_pKFs.count(pcKeyframe->pKF) > 0);
+    };
+    
+    /// < collect the keyframes to integrate: the lock is held only for the queue operations 
+    std::vector<PointCloudKeyFrame<PointT>::Ptr> vpcKeyframesToIntegrate;
+    size_t num_new_keyframes = 0; 
+    int num_keyframes_to_insert_in_map = 0;
+    int resetCount = 0; 
+    {
+        unique_lock<mutex> lck_pcKeyframes(pcKeyframesMutex_);
+        resetCount = resetCount_;
 
-        if(IntegratePointCloudKeyframe(set_pKFs, pcKeyframe))
-        {
-            num_keyframes_inserted_in_map++;
-        }
+        size_t i, iEnd;
 
-        if (kPerKeyFrameProcessSleepMs > 0)
+        /// < most recent keyframes 
+        for (i = lastKeyframeIndex_, iEnd=pcKeyframes_.size(); i < iEnd; i++)
         {
-            //boost::this_thread::sleep(boost::posix_time::milliseconds(kPerFrameProcessSleepMs));
-            std::this_thread::sleep_for(std::chrono::milliseconds(kPerKeyFrameProcessSleepMs));
+            vpcKeyframesToIntegrate.push_back(pcKeyframes_[i]);
+            
+            if(isToIntegrate(pcKeyframes_[i]))
+            {
+                num_keyframes_to_insert_in_map++;
+            }
+            
+            if (num_keyframes_to_insert_in_map >= kMaxNumKeyFramesToInsertInMapInOneStep) 
+            {
+                b_have_time_to_reinsert_old_frames = false;
+                break; /// < STOP loop
+            }
         }
+        num_new_keyframes = vpcKeyframesToIntegrate.size();
 
-        if (num_keyframes_inserted_in_map >= kMaxNumKeyFramesToInsertInMapInOneStep) 
+        bKeyframesToInsertInMap_ = i < pcKeyframes_.size();
+        //lastKeyframeSize = pcKeyframes.size();
+        lastKeyframeIndex_ = std::max(0, (int) i - 1);
+        std::cout << "lastKeyframeIndex: " << lastKeyframeIndex_ << std::endl; 
+        COUNTERCLOUD("PC::#KFsToIntegrate", pcKeyframes_.size() - i);
+
+        /// < old keyframes which must be reintegrated 
+        if(b_have_time_to_reinsert_old_frames)
         {
-            b_have_time_to_reinsert_old_frames = false;
-            break; /// < STOP loop
+            while(!pcKeyframesToReinsert_.empty())
+            {
+                PointCloudKeyFrame<PointT>::Ptr pcKeyframe = pcKeyframesToReinsert_.back();
+                pcKeyframesToReinsert_.pop_back();
+                vpcKeyframesToIntegrate.push_back(pcKeyframe);
+
+                if(isToIntegrate(pcKeyframe))
+                {
+                    num_keyframes_to_insert_in_map++;
+                }
+
+                if (num_keyframes_to_insert_in_map >= kMaxNumKeyFramesToInsertInMapInOneStep) 
+                {
+                    break; /// < STOP loop
+                }
+            }    
         }
+        bKeyframesToInsertInMap_ = bKeyframesToInsertInMap_ || (!pcKeyframesToReinsert_.empty());
+        COUNTERCLOUD("PC::#KFsToReinsert", pcKeyframesToReinsert_.size());
     }
-
-    bKeyframesToInsertInMap_ = i < pcKeyframes_.size();
-    //lastKeyframeSize = pcKeyframes.size();
-    lastKeyframeIndex_ = std::max(0, (int) i - 1);
-    std::cout << "lastKeyframeIndex: " << lastKeyframeIndex_ << std::endl; 
     
-    
-    /// < integrate old keyframes which must be reintegrated 
-    if(b_have_time_to_reinsert_old_frames)
+    /// < integrate the collected keyframes 
+    for (size_t i = 0; i < vpcKeyframesToIntegrate.size(); i++)
     {
-        while(!pcKeyframesToReinsert_.empty())
         {
-            PointCloudKeyFrame<PointT>::Ptr pcKeyframe = pcKeyframesToReinsert_.back();
-            pcKeyframesToReinsert_.pop_back();
+            unique_lock<recursive_timed_mutex> lck_globalMap(pointCloudMutex_);
+            
+            if (resetCount != resetCount_) break; // the collected keyframes were reset 
+            
+            pPointCloudMap_ = mpPointCloudAtlas->GetCurrentMap();
 
+            PointCloudKeyFrame<PointT>::Ptr& pcKeyframe = vpcKeyframesToIntegrate[i];
             if(IntegratePointCloudKeyframe(set_pKFs, pcKeyframe))
             {
                 num_keyframes_inserted_in_map++;
-            }
-
-            if (kPerKeyFrameProcessSleepMs > 0)
-            {
-                //boost::this_thread::sleep(boost::posix_time::milliseconds(kPerFrameProcessSleepMs));
-                std::this_thread::sleep_for(std::chrono::milliseconds(kPerKeyFrameProcessSleepMs));
                 
+                if(i < num_new_keyframes)
+                {
+                    const double integrationLatencyMs = (Stopwatch::getCurrentSystemTime() - pcKeyframe->nInsertionTime)/1000.; // [ms]
+                    COUNTERCLOUD("PC::IntegrationLatency", integrationLatencyMs);
+                    LatencyTrace::GetInstance().Add(LatencyTrace::kPointCloudIntegration, integrationLatencyMs);
+                }
             }
+        }
 
-            if (num_keyframes_inserted_in_map >= kMaxNumKeyFramesToInsertInMapInOneStep) 
-            {
-                break; /// < STOP loop
-            }
-        }    
+        if (kPerKeyFrameProcessSleepMs > 0)
+        {
+            //boost::this_thread::sleep(boost::posix_time::milliseconds(kPerFrameProcessSleepMs));
+            std::this_thread::sleep_for(std::chrono::milliseconds(kPerKeyFrameProcessSleepMs));
+        }
     }
-    bKeyframesToInsertInMap_ = bKeyframesToInsertInMap_ || (!pcKeyframesToReinsert_.empty());
-    
     
     if (num_keyframes_inserted_in_map>0)
     {
+        unique_lock<recursive_timed_mutex> lck_globalMap(pointCloudMutex_);
+        pPointCloudMap_ = mpPointCloudAtlas->GetCurrentMap();
+        
         TICKCLOUD("PC::UpdateMap");
         int size_new_map = pPointCloudMap_->UpdateMap();
         TOCKCLOUD("PC::UpdateMap");
@@ -570,7 +684,7 @@ bool PointCloudMapping::IntegratePointCloudKeyframe(const std::set<KeyFramePtr>&
     {
         if (!pcKeyframe->bInMap)
         {
-            cout << "Integrating point cloud of KF " << pcKeyframe->pKF->mnId << "/" << (pcKeyframes_.size()-1) + baseKeyframeId_ << " (Map: "<<  pcKeyframe->pKF->GetMap()->GetId() << ")" << endl;
+            cout << "Integrating point cloud of KF " << pcKeyframe->pKF->mnId << " (Map: "<<  pcKeyframe->pKF->GetMap()->GetId() << ")" << endl;
    
             PointCloudT::Ptr pCloudCamera = GeneratePointCloudInCameraFrame(pcKeyframe);  
             
@@ -650,7 +764,7 @@ bool PointCloudMapping::IntegratePointCloudKeyframe(const std::set<KeyFramePtr>&
     }
     else
     {
-        cout << "discarding point cloud for kf " << pcKeyframe->pKF->mnId << "/" << pcKeyframes_.size() << " ********************* " << endl;
+        cout << "discarding point cloud for kf " << pcKeyframe->pKF->mnId << " ********************* " << endl;
         //cout << "reason -  valid: " << pcKeyframe->bIsValid << ", in keyframes: " << set_pKFs.count(pcKeyframe->pKF) << std::endl;
         // get rid of unused keyframes 
         if (pcKeyframe->bIsValid) pcKeyframe->Clear();
@@ -677,6 +791,8 @@ void PointCloudMapping::Reset()
     bKeyframesAvailable_ = false;
     bKeyframesToInsertInMap_ = false; 
     pcKeyframesIn_.clear();
+    pcKeyframesPreprocessed_.clear();
+    resetCount_++;
     
     
     unique_lock<mutex> lckPcKFs(pcKeyframesMutex_);
@@ -696,14 +812,13 @@ void PointCloudMapping::RebuildMap()
     std::cout << "PointCloudMapping::RebuildMap() ***************" << std::endl;
     std::cout << "***********************************************" << std::endl;
 
+    unique_lock<recursive_timed_mutex> lckPc(pointCloudMutex_); // NOTE: this is needed in order to sync w.r.t. the integration of the keyframes
+    
     unique_lock<mutex> lck(keyframesMutex_); // block the insertion of new frames
 
-    {
-        unique_lock<recursive_timed_mutex> lck(pointCloudMutex_);
-        pPointCloudMap_ = mpPointCloudAtlas->GetCurrentMap();
-        //pPointCloudMap_->Clear();
-        pPointCloudMap_->OnMapChange();
-    }
+    pPointCloudMap_ = mpPointCloudAtlas->GetCurrentMap();
+    //pPointCloudMap_->Clear();
+    pPointCloudMap_->OnMapChange();
 
     if(!pPointCloudMapParameters_->bCloudDeformationOnSparseMapChange)
     {
@@ -735,78 +850,24 @@ void PointCloudMapping::RebuildMap()
     
 }
 
-/// < here we assume the camera calibration matrix is fixed (all the keyframes must share the same kf->mK, kf->mDistCoef)
-// this is just computed once!
-void PointCloudMapping::InitCamGridPoints(KeyFramePtr& kf, cv::Mat& depth)
+/// < a kernel is built for each camera: all the keyframes with the same depth resolution must share the same kf->mK, kf->mDistCoef
+std::shared_ptr<DepthCloudKernel> PointCloudMapping::GetDepthCloudKernel(KeyFramePtr& kf, const cv::Mat& depth)
 {
-    if (bInitCamGridPoints_) return;
-    bInitCamGridPoints_ = true;
-
-    //std::cout << "PointCloudMapping::initCamGridPoints() ***************" << std::endl;
-
-    // Fill matrix with matrix grid points
-    int N = (int) ceil( float(depth.rows * depth.cols)/skDownsampleStep);
-    matCamGridPoints_ = cv::Mat(N, 2, CV_32F);
-
-    // Fill matrix with indices of points. -1 means invalid
-    cv::Mat matPointIdxs = cv::Mat_<int>(depth.rows, depth.cols, -1); 
+    unique_lock<mutex> lck(depthCloudKernelsMutex_); // called by the preprocessing workers
     
-    // generate points on the image plane 
-    int ii = 0;
-    for (int m = 0; m < depth.rows; m += skDownsampleStep)
-    {
-        for (int n = 0; n < depth.cols; n += skDownsampleStep, ii++)
-        {
-            matCamGridPoints_.at<float>(ii, 0) = n; // x
-            matCamGridPoints_.at<float>(ii, 1) = m; // y
-            
-            matPointIdxs.at<int>(m,n) = ii;   
-        }
-    }
-
-#if 1
-    // undistort grid points: these are used for backprojections while 'distorted'(original) coordinates are used to read color and registered depth 
-    if (kf->mDistCoef.at<float>(0) != 0.0)
+    for(const std::shared_ptr<DepthCloudKernel>& pKernel : depthCloudKernels_)
     {
-        cout << "undistorting grid points" << endl;
-        // Undistort grid points
-        matCamGridPoints_ = matCamGridPoints_.reshape(2);
-        cv::undistortPoints(matCamGridPoints_, matCamGridPoints_, kf->mK, kf->mDistCoef, cv::Mat(), kf->mK);
-        matCamGridPoints_ = matCamGridPoints_.reshape(1);
+        if(pKernel->Matches(depth.rows, depth.cols, skDownsampleStep, kf->mK, kf->mDistCoef)) 
+            return pKernel;
     }
-#endif
-    
-    // vector of neighbors indexes
-    vCamGridPointsNeighborsIdxs_.resize(N);
     
-    // define neighborhood deltas 
-    //int dm[4]={-1, 0, 1, 0};
-    //int dn[4]={ 0,-1, 0, 1};
+    const DepthCloudKernel::Neighborhood neighborhood = {NeighborhoodT::kSize, NeighborhoodT::dm, NeighborhoodT::dn, NeighborhoodT::kiStartNormal, NeighborhoodT::kDiNormal};
+    std::shared_ptr<DepthCloudKernel> pKernel = std::make_shared<DepthCloudKernel>(depth.rows, depth.cols, skDownsampleStep, kf->mK, kf->mDistCoef, neighborhood);
+    depthCloudKernels_.push_back(pKernel);
     
-    // back project the points on the camera plane z=1
-    ii = 0;
-    for (int m = 0; m < depth.rows; m += skDownsampleStep)
-    {
-        for (int n = 0; n < depth.cols; n += skDownsampleStep, ii++)
-        {
-            matCamGridPoints_.at<float>(ii, 0) = (matCamGridPoints_.at<float>(ii, 0) - kf->cx) / kf->fx;
-            matCamGridPoints_.at<float>(ii, 1) = (matCamGridPoints_.at<float>(ii, 1) - kf->cy) / kf->fy;
-            
-            for(int q=0;q<NeighborhoodT::kSize;q++)
-            {
-                int elem_m = m + NeighborhoodT::dm[q]*skDownsampleStep;
-                int elem_n = n + NeighborhoodT::dn[q]*skDownsampleStep; 
-                if( (elem_m >=0) && (elem_m < depth.rows) && (elem_n>=0) && (elem_n<depth.cols) )
-                {   
-                    vCamGridPointsNeighborsIdxs_[ii].push_back(matPointIdxs.at<int>(elem_m,elem_n));
-                }
-                else
-                {
-                    vCamGridPointsNeighborsIdxs_[ii].push_back(-1);
-                }
-            }
-        }
-    }    
+    std::cout << "PointCloudMapping - new depth cloud kernel " << depth.cols << "x" << depth.rows 
+              << " (" << DepthCloudKernel::GetSimdTypeName(pKernel->GetSimdType()) << ")" << std::endl; 
+    return pKernel;
 }
 
 
@@ -840,115 +901,76 @@ PointCloudMapping::PointCloudT::Ptr PointCloudMapping::GeneratePointCloudInCamer
 {
     PointCloudT::Ptr cloud_camera(new PointCloudT());
 
-    InitCamGridPoints(kf, depth);
+    std::shared_ptr<DepthCloudKernel> pKernel = GetDepthCloudKernel(kf, depth);
     
     int kfid = kf->mnId; 
     
-    TICKCLOUD("PC::DepthFilter");  
     if(pPointCloudMapParameters_->bFilterDepthImages) 
     {
-        FilterDepthimage(depth,  pPointCloudMapParameters_->depthFilterDiameter, pPointCloudMapParameters_->depthFilterSigmaDepth, pPointCloudMapParameters_->depthSigmaSpace);
+        STOPWATCHCLOUD("PC::DepthFilter", FilterDepthimage(depth,  pPointCloudMapParameters_->depthFilterDiameter, pPointCloudMapParameters_->depthFilterSigmaDepth, pPointCloudMapParameters_->depthSigmaSpace););
     }
-    TOCKCLOUD("PC::DepthFilter");  
     
-    static const int N = (int) ceil( float(depth.rows * depth.cols)/skDownsampleStep);
-    cloud_camera->reserve(N); 
+    /// < back-project the downsampled depth image, compute the normals and the segmentation measures (rows in parallel)
+    const bool bSegmentation = COMPUTE_SEGMENTS && pPointCloudMapParameters_->bSegmentationOn;
+    DepthCloudKernel::Output grid;
+    STOPWATCHCLOUD("PC::DepthCloudKernel", pKernel->Compute(depth, pPointCloudMapParameters_->minDepthDistance, pPointCloudMapParameters_->maxDepthDistance, 
+                                                            COMPUTE_NORMALS, bSegmentation, pCloudGenerationPool_.get(), grid););
     
     pixelToPointIndex = cv::Mat_<int>(depth.rows, depth.cols, -1); // -1 means invalid
     
-#if COMPUTE_NORMALS
-    std::vector<int> idxCloud(N,-1); // -1 means invalid
-#endif
-         
-    const cv::Vec2f* grid_point = matCamGridPoints_.ptr<cv::Vec2f>(0); 
-    
-    int ii = 0;
-    for (int m = 0; m < depth.rows; m += skDownsampleStep)
+    /// < write the points into the preallocated cloud (each row starts at grid.rowStart[md])
+    cloud_camera->points.resize(grid.NumPoints());
+    const int step = pKernel->DownsampleStep();
+    DepthCloudKernel::ForEachRowBand(pCloudGenerationPool_.get(), grid.rows, [&](const int rBegin, const int rEnd)
     {
-        const float* depth_row_m = depth.ptr<float>(m);
-        const uchar* color_row_m = color.ptr<uchar>(m);
-        int* pixelToPointIndex_row_m = pixelToPointIndex.ptr<int>(m);
-        
-        for (int n = 0; n < depth.cols; n += skDownsampleStep, ii++)
+        for (int md = rBegin; md < rEnd; md++)
         {
-            const float& d = depth_row_m[n];
+            const int m = md * step;
+            const uchar* color_row_m = color.ptr<uchar>(m);
+#if COMPUTE_NORMALS
+            int* pixelToPointIndex_row_m = pixelToPointIndex.ptr<int>(m);
+#endif
+            const int* point_idx_row_md = &grid.pointIdx[md * grid.cols];
+            const int c0 = grid.Cell(md, 0);
 
-            if ((d > pPointCloudMapParameters_->minDepthDistance) && (d < pPointCloudMapParameters_->maxDepthDistance))
+            for (int nd = 0, n = 0; nd < grid.cols; nd++, n += step)
             {
-                PointT p;
-                p.z = d;
-                //p.x = mat_cam_grid_points_.at<float>(ii, 0) * d;
-                //p.y = mat_cam_grid_points_.at<float>(ii, 1) * d;
-                p.x = grid_point[ii][0] * d;
-                p.y = grid_point[ii][1] * d;
-                
+                const int index = point_idx_row_md[nd];
+                if (index < 0) continue; // invalid depth
+
+                const int c = c0 + nd;
+                PointT& p = cloud_camera->points[index];
+                p.x = grid.x[c];
+                p.y = grid.y[c];
+                p.z = grid.z[c];
+
                 const int n3 = n * 3;
                 // write colors into BGRA (invert for drawing in openGL)
                 p.r = color_row_m[n3]; // B
                 p.g = color_row_m[n3 + 1]; // G
                 p.b = color_row_m[n3 + 2]; // R
                 //p.a = 255; 
-                
-                PointUtils::setKFid(p,kfid);
-                PointUtils::updateDepth(d,p);
-
-                cloud_camera->points.push_back(p);
 
-#if COMPUTE_NORMALS                
-                const size_t index = cloud_camera->points.size()-1;
-                idxCloud[ii] = index;
-                pixelToPointIndex_row_m[n] = index; 
-#endif          
-            }
+                PointUtils::setKFid(p,kfid);
+                PointUtils::updateDepth(p.z,p);
 
-        }
-    }
-    
 #if COMPUTE_NORMALS
-    ii = 0;
-    for (int m = 0; m < depth.rows; m += skDownsampleStep)
-    {        
-        for (int n = 0; n < depth.cols; n += skDownsampleStep, ii++)
-        {
-            if(idxCloud[ii]>=0) // central point is valid 
-            {
-                Eigen::Vector3d normal(0.d,0.d,0.d);  
-                PointT& pc = cloud_camera->points[idxCloud[ii]];
-                const Eigen::Vector3d vpc(pc.x,pc.y,pc.z);
-                // get the other points in the neighborhood 
-                for(int kk=NeighborhoodT::kiStartNormal;kk<NeighborhoodT::kSize;kk+=NeighborhoodT::kDiNormal)
-                {
-                    const int& point1IdxGrid = vCamGridPointsNeighborsIdxs_[ii][kk];
-                    const int& point2IdxGrid = vCamGridPointsNeighborsIdxs_[ii][(kk+NeighborhoodT::kDiNormal)%NeighborhoodT::kSize];
-                    if((point1IdxGrid<0) || (point2IdxGrid<0)) continue; 
-                    
-                    const int& point1IdxCloud = idxCloud[point1IdxGrid];
-                    const int& point2IdxCloud = idxCloud[point2IdxGrid];
-                    if((point1IdxCloud<0) || (point2IdxCloud<0)) continue;
-
-                    const PointT& p1 = cloud_camera->points[point1IdxCloud];
-                    const PointT& p2 = cloud_camera->points[point2IdxCloud];
-                    const Eigen::Vector3d vp1(p1.x, p1.y, p1.z);
-                    const Eigen::Vector3d vp2(p2.x, p2.y, p2.z);
-                    //normal += (vp1-vpc).cross(vp2-vpc).normalized();  // uniform weighting
-                    normal += (vp1-vpc).cross(vp2-vpc); // area weighting (we multiply for the norm which is 2*SpannedArea)
-                }
-                normal.normalize();
-                pc.normal_x = normal[0];
-                pc.normal_y = normal[1];
-                pc.normal_z = normal[2];
+                p.normal_x = grid.nx[c];
+                p.normal_y = grid.ny[c];
+                p.normal_z = grid.nz[c];
+                pixelToPointIndex_row_m[n] = index; 
+#endif
             }
         }
-    }
-#endif    
+    });
     
     
 #if COMPUTE_SEGMENTS
 
-    if(pPointCloudMapParameters_->bSegmentationOn)
+    if(bSegmentation)
     {        
-        static const int downsampleRows = (int) ceil( float(depth.rows)/skDownsampleStep);
-        static const int downsampleCols = (int) ceil( float(depth.cols)/skDownsampleStep);
+        const int downsampleRows = grid.rows;
+        const int downsampleCols = grid.cols;
         
         const std::vector<cv::line_descriptor_c::KeyLine>& keyLines = kf->mvKeyLines; 
         cv::Mat& linesImg = vecImages_[3].img;
@@ -974,67 +996,28 @@ PointCloudMapping::PointCloudT::Ptr PointCloudMapping::GeneratePointCloudInCamer
         vecImages_[1].bReady = true;
         vecImages_[2].bReady = true;
 
-        ii = 0;
-        for (int m = 0, md = 0; m < depth.rows; m += skDownsampleStep, md++)
+        for (int md = 0; md < downsampleRows; md++)
         {        
-            for (int n = 0, nd = 0; n < depth.cols; n += skDownsampleStep, ii++, nd++)
+            for (int nd = 0; nd < downsampleCols; nd++)
             {
-                if(idxCloud[ii]>=0) // central point is valid 
-                {
-                    float minFi = std::numeric_limits<float>::max();  
-                    float maxDelta = 0; 
-                    PointT& pc = cloud_camera->points[idxCloud[ii]];
-                    const Eigen::Vector3d vpc(pc.x,pc.y,pc.z);
-                    const Eigen::Vector3d normal(pc.normal_x,pc.normal_y,pc.normal_z);
-                    if(pc.z > pPointCloudMapParameters_->sementationMaxDepth) continue; 
-
-                    // get the other points in the neighborhood 
-                    for(int kk=0;kk<NeighborhoodT::kSize;kk++)
-                    {
-                        const int& point1IdxGrid = vCamGridPointsNeighborsIdxs_[ii][kk];
-                        if(point1IdxGrid<0) continue; 
-
-                        const int& point1IdxCloud = idxCloud[point1IdxGrid];
-                        if(point1IdxCloud<0) continue;
-
-                        const PointT& p1 = cloud_camera->points[point1IdxCloud];
-                        const Eigen::Vector3d vp1(p1.x, p1.y, p1.z);
-                        const Eigen::Vector3d deltav = (vp1-vpc);
-                        float fi = 1;
-                        const float weigth = Utils::SigmaZminOverSigmaZ(pc.z);
-#if 1
-                        const float deltavDotNormal = deltav.dot(normal);
-                        if(deltavDotNormal >=0)
-                        {
-                            const Eigen::Vector3d normal1(p1.normal_x,p1.normal_y,p1.normal_z);
-                            fi = normal1.dot(normal); 
-                        }
-#else
-                        const Eigen::Vector3d normal1(p1.normal_x,p1.normal_y,p1.normal_z);
-                        fi = normal1.dot(normal); 
-                        if(deltav.dot(normal)<0)
-                        {
-                            fi *= fi;
-                        }
-#endif
-                        if(minFi>fi) minFi = fi; 
+                const int c = grid.Cell(md, nd);
+                if(grid.z[c] <= 0.f) continue; // central point is not valid 
+                if(grid.z[c] > pPointCloudMapParameters_->sementationMaxDepth) continue; 
 
-                        const float delta = deltav.norm()*weigth;
-                        //const float delta = fabs(deltavDotNormal)*weigth;
-                        if(maxDelta < delta) maxDelta = std::min(delta,1.0f);
-                    }
+                // min fi and max delta over the neighborhood (computed by the kernel)
+                const float minFi = grid.fi[c];
+                const float maxDelta = grid.delta[c];
 
-                    matFi.at<uchar>(md,nd) = static_cast<uchar>(std::min(minFi,1.0f)*255); 
-                    if(maxDelta > pPointCloudMapParameters_->segmentationMaxDelta)
-                        matGamma.at<uchar>(md,nd) = 255;
-                    
-                    const bool lineEdge = (linesImg.at<uchar>(md,nd) == 255);
-                    
-                    // here we mark the areas which are supposed to be convex and made of contiguous vertices
-                    if( (minFi > pPointCloudMapParameters_->segmentationMinFi) && (maxDelta <= pPointCloudMapParameters_->segmentationMaxDelta) && !lineEdge) 
-                    {
-                        matFiBinaryTh.at<uchar>(md,nd) = 255;
-                    }
+                matFi.at<uchar>(md,nd) = static_cast<uchar>(std::min(minFi,1.0f)*255); 
+                if(maxDelta > pPointCloudMapParameters_->segmentationMaxDelta)
+                    matGamma.at<uchar>(md,nd) = 255;
+
+                const bool lineEdge = (linesImg.at<uchar>(md,nd) == 255);
+
+                // here we mark the areas which are supposed to be convex and made of contiguous vertices
+                if( (minFi > pPointCloudMapParameters_->segmentationMinFi) && (maxDelta <= pPointCloudMapParameters_->segmentationMaxDelta) && !lineEdge) 
+                {
+                    matFiBinaryTh.at<uchar>(md,nd) = 255;
                 }
             }
         }
@@ -1090,10 +1073,9 @@ PointCloudMapping::PointCloudT::Ptr PointCloudMapping::GeneratePointCloudInCamer
         connectedComponents = cv::Mat_<cv::Vec3b>::zeros(downsampleRows, downsampleCols); //cv::Mat(matFiBinaryTh.size(), CV_8UC3);
         
         /// < label current point cloud  
-        ii = 0;
-        for (int m = 0, md = 0; m < depth.rows; m += skDownsampleStep, md++)
+        for (int md = 0; md < downsampleRows; md++)
         {        
-            for (int n = 0, nd = 0; n < depth.cols; n += skDownsampleStep, ii++, nd++)
+            for (int nd = 0; nd < downsampleCols; nd++)
             {
                 const int& label = labelImage.at<int>(md, nd);
                 
@@ -1102,9 +1084,10 @@ PointCloudMapping::PointCloudT::Ptr PointCloudMapping::GeneratePointCloudInCamer
                 cv::Vec3b &pixel = connectedComponents.at<cv::Vec3b>(md, nd);
                 pixel = colors[label];
                                                 
-                if(idxCloud[ii]>=0) // point is valid 
+                const int index = grid.pointIdx[md*downsampleCols + nd];
+                if(index>=0) // point is valid 
                 {
-                    PointT& pc = cloud_camera->points[idxCloud[ii]];
+                    PointT& pc = cloud_camera->points[index];
                     pc.label = label;
                     
                     segmentsCardinality[label]++;
@@ -0,0 +1,439 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "PoseGraphSolver.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include <Eigen/Cholesky>
+#include <Eigen/SparseCore>
+#include <Eigen/OrderingMethods>
+
+
+namespace PLVS2
+{
+
+const float PoseGraphSymbolicCache::kMaxChangedBlocksRatio = 0.2f;
+const float PoseGraphSymbolicCache::kMaxFillGrowth = 1.3f;
+
+void PoseGraphSymbolicCache::Clear()
+{
+    keys_.clear(); colStart_.clear(); rows_.clear();
+    orderedKeys_.clear();
+    numBlocksAtOrdering_ = 0;
+    numFactorBlocksAtOrdering_ = 0;
+    perm_.clear(); invPerm_.clear();
+    LcolStart_.clear(); Lrows_.clear();
+    LrowStart_.clear(); LrowCols_.clear(); LrowPos_.clear();
+}
+
+void PoseGraphSymbolicCache::Analyze(const std::vector<int>& keys, const std::vector<int>& colStart, const std::vector<int>& rows)
+{
+    if(!invPerm_.empty() && keys == keys_ && colStart == colStart_ && rows == rows_)
+    {
+        stats_.numReuses++;
+        return;
+    }
+
+    keys_ = keys;
+    colStart_ = colStart;
+    rows_ = rows;
+
+    // the new vertices are placed before or after the surviving ones, whichever gives the smaller factor
+    const int maxFactorBlocks = kMaxFillGrowth*numFactorBlocksAtOrdering_*keys_.size()/std::max(numBlocksAtOrdering_,1);
+    int bestFactorBlocks = -1;
+    bool bBestNewFirst = true;
+    for(const bool bNewFirst : {true, false})
+    {
+        int numNewBlocks = 0;
+        if(!ReuseOrdering(bNewFirst, numNewBlocks))
+            break;
+        ComputeFactorPattern();
+        if(bestFactorBlocks < 0 || NumFactorBlocks() < bestFactorBlocks)
+        {
+            bestFactorBlocks = NumFactorBlocks();
+            bBestNewFirst = bNewFirst;
+        }
+        if(numNewBlocks == 0)
+            break;
+    }
+    if(bestFactorBlocks >= 0 && bestFactorBlocks <= maxFactorBlocks)
+    {
+        if(bestFactorBlocks != NumFactorBlocks())
+        {
+            int numNewBlocks = 0;
+            ReuseOrdering(bBestNewFirst, numNewBlocks);
+            ComputeFactorPattern();
+        }
+        orderedKeys_.resize(invPerm_.size());
+        for(size_t j=0; j<invPerm_.size(); j++)
+            orderedKeys_[j] = keys_[invPerm_[j]];
+        return;
+    }
+
+    ComputeAMDOrdering();
+    ComputeFactorPattern();
+    numBlocksAtOrdering_ = NumBlocks();
+    numFactorBlocksAtOrdering_ = NumFactorBlocks();
+    orderedKeys_.resize(invPerm_.size());
+    for(size_t j=0; j<invPerm_.size(); j++)
+        orderedKeys_[j] = keys_[invPerm_[j]];
+}
+
+bool PoseGraphSymbolicCache::ReuseOrdering(const bool bNewFirst, int& numNewBlocks)
+{
+    if(orderedKeys_.empty())
+        return false;
+
+    const int n = keys_.size();
+    std::unordered_map<int,int> blockOfKey;
+    blockOfKey.reserve(n);
+    for(int i=0; i<n; i++)
+        blockOfKey[keys_[i]] = i;
+
+    // the surviving vertices keep their relative order
+    std::vector<int> vKeptBlocks;
+    vKeptBlocks.reserve(n);
+    std::vector<bool> vbKept(n, false);
+    for(const int key : orderedKeys_)
+    {
+        const auto it = blockOfKey.find(key);
+        if(it == blockOfKey.end())
+            continue;
+        vKeptBlocks.push_back(it->second);
+        vbKept[it->second] = true;
+    }
+
+    const int numKept = vKeptBlocks.size();
+    const int numChanged = (n - numKept) + ((int)orderedKeys_.size() - numKept);
+    if(numChanged > kMaxChangedBlocksRatio*n)
+        return false;
+
+    // the new vertices are eliminated in the order of their ids (i.e. of their creation)
+    std::vector<int> vNewBlocks;
+    for(int i=0; i<n; i++)
+        if(!vbKept[i])
+            vNewBlocks.push_back(i);
+    std::sort(vNewBlocks.begin(), vNewBlocks.end(), [&](const int a, const int b) { return keys_[a] < keys_[b]; });
+    numNewBlocks = vNewBlocks.size();
+
+    invPerm_.clear();
+    if(bNewFirst)
+    {
+        invPerm_.insert(invPerm_.end(), vNewBlocks.begin(), vNewBlocks.end());
+        invPerm_.insert(invPerm_.end(), vKeptBlocks.begin(), vKeptBlocks.end());
+    }
+    else
+    {
+        invPerm_.insert(invPerm_.end(), vKeptBlocks.begin(), vKeptBlocks.end());
+        invPerm_.insert(invPerm_.end(), vNewBlocks.begin(), vNewBlocks.end());
+    }
+
+    perm_.resize(n);
+    for(int j=0; j<n; j++)
+        perm_[invPerm_[j]] = j;
+    return true;
+}
+
+void PoseGraphSymbolicCache::ComputeAMDOrdering()
+{
+    stats_.numOrderings++;
+
+    const int n = keys_.size();
+    Eigen::SparseMatrix<int> pattern(n,n);
+    pattern.resizeNonZeros(rows_.size());
+    for(int c=0; c<=n; c++)
+        pattern.outerIndexPtr()[c] = colStart_[c];
+    for(size_t k=0; k<rows_.size(); k++)
+    {
+        pattern.innerIndexPtr()[k] = rows_[k];
+        pattern.valuePtr()[k] = 1;
+    }
+
+    Eigen::PermutationMatrix<Eigen::Dynamic,Eigen::Dynamic,int> P;
+    Eigen::AMDOrdering<int> amd;
+    amd(pattern.selfadjointView<Eigen::Upper>(), P);   // P.indices()[new] = old
+
+    invPerm_.assign(P.indices().data(), P.indices().data() + n);
+    perm_.resize(n);
+    for(int j=0; j<n; j++)
+        perm_[invPerm_[j]] = j;
+}
+
+void PoseGraphSymbolicCache::ComputeFactorPattern()
+{
+    stats_.numAnalyses++;
+
+    const int n = keys_.size();
+
+    // strictly lower pattern of the permuted system, by columns
+    std::vector<int> AcolStart(n+1, 0);
+    for(int c=0; c<n; c++)
+        for(int k=colStart_[c]; k<colStart_[c+1]; k++)
+            if(rows_[k] != c)
+                AcolStart[std::min(perm_[rows_[k]], perm_[c]) + 1]++;
+    for(int j=0; j<n; j++)
+        AcolStart[j+1] += AcolStart[j];
+    std::vector<int> Arows(AcolStart[n]);
+    std::vector<int> next(AcolStart.begin(), AcolStart.end() - 1);
+    for(int c=0; c<n; c++)
+        for(int k=colStart_[c]; k<colStart_[c+1]; k++)
+            if(rows_[k] != c)
+            {
+                const int i = perm_[rows_[k]], j = perm_[c];
+                Arows[next[std::min(i,j)]++] = std::max(i,j);
+            }
+
+    // the pattern of column j of L is the union of the pattern of A and of the patterns of its children in the elimination tree
+    std::vector<int> mark(n, -1);
+    std::vector<int> childStart(n, -1), childNext(n, -1);  // linked lists of children
+    std::vector<int> pattern;
+    LcolStart_.assign(1, 0);
+    Lrows_.clear();
+    for(int j=0; j<n; j++)
+    {
+        mark[j] = j;
+        pattern.clear();
+        for(int k=AcolStart[j]; k<AcolStart[j+1]; k++)
+            if(mark[Arows[k]] != j)
+            {
+                mark[Arows[k]] = j;
+                pattern.push_back(Arows[k]);
+            }
+        for(int c=childStart[j]; c>=0; c=childNext[c])
+            for(int k=LcolStart_[c]; k<LcolStart_[c+1]; k++)
+            {
+                const int i = Lrows_[k];
+                if(mark[i] != j)
+                {
+                    mark[i] = j;
+                    pattern.push_back(i);
+                }
+            }
+        std::sort(pattern.begin(), pattern.end());
+        Lrows_.insert(Lrows_.end(), pattern.begin(), pattern.end());
+        LcolStart_.push_back(Lrows_.size());
+
+        if(!pattern.empty())
+        {
+            const int parent = pattern[0];
+            childNext[j] = childStart[parent];
+            childStart[parent] = j;
+        }
+    }
+
+    // rows of L (the columns are visited in ascending order)
+    LrowStart_.assign(n+1, 0);
+    for(const int i : Lrows_)
+        LrowStart_[i+1]++;
+    for(int i=0; i<n; i++)
+        LrowStart_[i+1] += LrowStart_[i];
+    LrowCols_.resize(Lrows_.size());
+    LrowPos_.resize(Lrows_.size());
+    next.assign(LrowStart_.begin(), LrowStart_.end() - 1);
+    for(int k=0; k<n; k++)
+        for(int p=LcolStart_[k]; p<LcolStart_[k+1]; p++)
+        {
+            const int q = next[Lrows_[p]]++;
+            LrowCols_[q] = k;
+            LrowPos_[q] = p;
+        }
+}
+
+
+template<int D>
+bool PoseGraphLinearSolver<D>::init()
+{
+    bInit_ = true;
+    return true;
+}
+
+template<int D>
+void PoseGraphLinearSolver<D>::SetBlockKeys(const g2o::SparseOptimizer& optimizer)
+{
+    const g2o::SparseOptimizer::VertexContainer& vertices = optimizer.indexMapping();
+    keys_.resize(vertices.size());
+    for(size_t i=0; i<vertices.size(); i++)
+        keys_[i] = vertices[i]->id();
+}
+
+template<int D>
+void PoseGraphLinearSolver<D>::SetupStructure(const g2o::SparseBlockMatrix<MatrixD>& A)
+{
+    const int n = A.blockCols().size();
+
+    std::vector<int> keys = keys_;
+    if((int)keys.size() != n)
+    {
+        keys.resize(n);
+        for(int i=0; i<n; i++)
+            keys[i] = i;
+    }
+
+    std::vector<int> colStart(1, 0), rows;
+    for(int c=0; c<n; c++)
+    {
+        for(const auto& entry : A.blockCols()[c])
+            if(entry.first <= c)
+                rows.push_back(entry.first);
+        colStart.push_back(rows.size());
+    }
+
+    pCache_->Analyze(keys, colStart, rows);
+
+    const std::vector<int>& perm = pCache_->Perm();
+    const std::vector<int>& LcolStart = pCache_->LcolStart();
+    const std::vector<int>& Lrows = pCache_->Lrows();
+
+    // blocks of A gathered into each column of L
+    diagSources_.assign(n, nullptr);
+    std::vector<int> gatherCount(n+1, 0);
+    for(int c=0; c<n; c++)
+        for(const auto& entry : A.blockCols()[c])
+            if(entry.first < c)
+                gatherCount[std::min(perm[entry.first], perm[c]) + 1]++;
+    for(int j=0; j<n; j++)
+        gatherCount[j+1] += gatherCount[j];
+    gatherStart_ = gatherCount;
+    gathers_.resize(gatherStart_[n]);
+    std::vector<int> next(gatherStart_.begin(), gatherStart_.end() - 1);
+    for(int c=0; c<n; c++)
+        for(const auto& entry : A.blockCols()[c])
+        {
+            const int r = entry.first;
+            if(r > c)
+                continue;
+            if(r == c)
+            {
+                diagSources_[perm[c]] = entry.second;
+                continue;
+            }
+            // block (r,c) of the upper triangle: it is L(i,j) (or its transpose) with i>j
+            const int i = std::max(perm[r], perm[c]);
+            const int j = std::min(perm[r], perm[c]);
+            Gather& gather = gathers_[next[j]++];
+            gather.block = std::lower_bound(Lrows.begin() + LcolStart[j], Lrows.begin() + LcolStart[j+1], i) - Lrows.begin();
+            gather.pSource = entry.second;
+            gather.bTranspose = (perm[c] == i);     // L(i,j) = H(c,r) = H(r,c)^T
+        }
+
+    Ldiag_.resize(n);
+    L_.resize(pCache_->NumFactorBlocks());
+    scatter_.assign(n, -1);
+    y_.resize(n);
+}
+
+template<int D>
+bool PoseGraphLinearSolver<D>::Factorize()
+{
+    const int n = Ldiag_.size();
+    const std::vector<int>& LcolStart = pCache_->LcolStart();
+    const std::vector<int>& Lrows = pCache_->Lrows();
+    const std::vector<int>& LrowStart = pCache_->LrowStart();
+    const std::vector<int>& LrowCols = pCache_->LrowCols();
+    const std::vector<int>& LrowPos = pCache_->LrowPos();
+
+    // left-looking factorization by block columns
+    for(int j=0; j<n; j++)
+    {
+        MatrixD Djj = diagSources_[j] ? *diagSources_[j] : MatrixD::Zero();
+        for(int p=LcolStart[j]; p<LcolStart[j+1]; p++)
+        {
+            L_[p].setZero();
+            scatter_[Lrows[p]] = p;
+        }
+        for(int g=gatherStart_[j]; g<gatherStart_[j+1]; g++)
+        {
+            const Gather& gather = gathers_[g];
+            if(gather.bTranspose)
+                L_[gather.block] = gather.pSource->transpose();
+            else
+                L_[gather.block] = *gather.pSource;
+        }
+
+        // updates from the columns k<j with a block in row j
+        for(int q=LrowStart[j]; q<LrowStart[j+1]; q++)
+        {
+            const int k = LrowCols[q];
+            const int pos = LrowPos[q];
+            const MatrixD LjkT = L_[pos].transpose();
+            Djj.noalias() -= L_[pos]*LjkT;
+            for(int p=pos+1; p<LcolStart[k+1]; p++)
+                L_[scatter_[Lrows[p]]].noalias() -= L_[p]*LjkT;
+        }
+
+        Eigen::LLT<MatrixD> llt(Djj);
+        if(llt.info() != Eigen::Success)
+            return false;
+        Ldiag_[j] = llt.matrixL();
+
+        // L(i,j) = X(i,j) * Ljj^-T
+        for(int p=LcolStart[j]; p<LcolStart[j+1]; p++)
+            Ldiag_[j].template triangularView<Eigen::Lower>().transpose().template solveInPlace<Eigen::OnTheRight>(L_[p]);
+    }
+    return true;
+}
+
+template<int D>
+bool PoseGraphLinearSolver<D>::solve(const g2o::SparseBlockMatrix<MatrixD>& A, double* x, double* b)
+{
+    if(bInit_)
+    {
+        SetupStructure(A);
+        bInit_ = false;
+    }
+
+    if(!Factorize())
+        return false;
+
+    const int n = Ldiag_.size();
+    const std::vector<int>& invPerm = pCache_->InvPerm();
+    const std::vector<int>& LcolStart = pCache_->LcolStart();
+    const std::vector<int>& Lrows = pCache_->Lrows();
+
+    for(int j=0; j<n; j++)
+        y_[j] = Eigen::Map<const VectorD>(b + D*invPerm[j]);
+
+    // L y = b
+    for(int j=0; j<n; j++)
+    {
+        Ldiag_[j].template triangularView<Eigen::Lower>().solveInPlace(y_[j]);
+        for(int p=LcolStart[j]; p<LcolStart[j+1]; p++)
+            y_[Lrows[p]].noalias() -= L_[p]*y_[j];
+    }
+
+    // L^T x = y
+    for(int j=n-1; j>=0; j--)
+    {
+        for(int p=LcolStart[j]; p<LcolStart[j+1]; p++)
+            y_[j].noalias() -= L_[p].transpose()*y_[Lrows[p]];
+        Ldiag_[j].template triangularView<Eigen::Lower>().transpose().solveInPlace(y_[j]);
+    }
+
+    for(int j=0; j<n; j++)
+        Eigen::Map<VectorD>(x + D*invPerm[j]) = y_[j];
+
+    return true;
+}
+
+template class PoseGraphLinearSolver<7>;
+template class PoseGraphLinearSolver<4>;
+
+} // namespace PLVS2
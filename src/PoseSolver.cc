@@ -0,0 +1,417 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "PoseSolver.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include <Eigen/Cholesky>
+
+
+namespace PLVS2
+{
+
+namespace
+{
+
+// Levenberg-Marquardt parameters (as in g2o::OptimizationAlgorithmLevenberg)
+const double kLambdaInitTau = 1e-5;
+const double kGoodStepLowerScale = 1./3.;
+const double kGoodStepUpperScale = 2./3.;
+const int kMaxTrialsAfterFailure = 10;
+
+typedef Eigen::Matrix<double,6,6> Matrix6d;
+typedef Eigen::Matrix<double,6,1> Vector6d;
+
+/// Huber weight of an observation with squared error chi2 (rho'(chi2))
+inline double HuberWeight(const double chi2, const double delta)
+{
+    return (chi2 <= delta*delta) ? 1.0 : delta/std::sqrt(chi2);
+}
+
+/// Huber cost of an observation with squared error chi2 (rho(chi2))
+inline double HuberCost(const double chi2, const double delta)
+{
+    if(chi2 <= delta*delta) return chi2;
+    return 2.0*delta*std::sqrt(chi2) - delta*delta;
+}
+
+/// Jacobian of the camera point Xc w.r.t. the pose increment [omega, upsilon] (T <- exp(dx)*T)
+inline void SetPointJacobian(const Eigen::Vector3d& Xc, Eigen::Matrix<double,3,6>& J)
+{
+    const double x = Xc(0), y = Xc(1), z = Xc(2);
+    J << 0.0,    z,   -y, 1.0, 0.0, 0.0,
+           -z, 0.0,    x, 0.0, 1.0, 0.0,
+            y,  -x,  0.0, 0.0, 0.0, 1.0;
+}
+
+/// Add the contribution w*J'*Omega*e, w*J'*Omega*J of a block with diagonal information omega
+template<int M>
+inline void Accumulate(const Eigen::Matrix<double,M,6>& J, const Eigen::Matrix<double,M,1>& e, const Eigen::Matrix<double,M,1>& omega,
+                       const double w, Matrix6d& H, Vector6d& g)
+{
+    const Eigen::Matrix<double,6,M> JtW = J.transpose() * (w*omega).asDiagonal();
+    H.noalias() += JtW * J;
+    g.noalias() += JtW * e;
+}
+
+} // namespace
+
+
+void PoseSolver::Reset(float fx, float fy, float cx, float cy, float bf)
+{
+    fx_ = fx; fy_ = fy; cx_ = cx; cy_ = cy; bf_ = bf;
+
+    mpX_.clear(); mpY_.clear(); mpZ_.clear(); mpU_.clear(); mpV_.clear(); mpInfo_.clear(); mpChi2_.clear(); mpOutlier_.clear();
+    spX_.clear(); spY_.clear(); spZ_.clear(); spU_.clear(); spV_.clear(); spUR_.clear(); spInfo_.clear(); spChi2_.clear(); spOutlier_.clear();
+    mlSX_.clear(); mlSY_.clear(); mlSZ_.clear(); mlEX_.clear(); mlEY_.clear(); mlEZ_.clear();
+    mlL1_.clear(); mlL2_.clear(); mlL3_.clear(); mlInfo_.clear(); mlChi2_.clear(); mlOutlier_.clear();
+    slSX_.clear(); slSY_.clear(); slSZ_.clear(); slEX_.clear(); slEY_.clear(); slEZ_.clear();
+    slL1_.clear(); slL2_.clear(); slL3_.clear(); slBS_.clear(); slBE_.clear(); slLengthInv_.clear();
+    slInfo2D_.clear(); slInfo3D_.clear(); slChi2_.clear(); slOutlier_.clear();
+
+    nPointOutliers_ = 0;
+    nLineOutliers_ = 0;
+}
+
+void PoseSolver::AddMonoPoint(const Eigen::Vector3f& Xw, float u, float v, float invSigma2)
+{
+    mpX_.push_back(Xw(0)); mpY_.push_back(Xw(1)); mpZ_.push_back(Xw(2));
+    mpU_.push_back(u); mpV_.push_back(v);
+    mpInfo_.push_back(invSigma2);
+    mpChi2_.push_back(0);
+    mpOutlier_.push_back(0);
+}
+
+void PoseSolver::AddStereoPoint(const Eigen::Vector3f& Xw, float u, float v, float uR, float invSigma2)
+{
+    spX_.push_back(Xw(0)); spY_.push_back(Xw(1)); spZ_.push_back(Xw(2));
+    spU_.push_back(u); spV_.push_back(v); spUR_.push_back(uR);
+    spInfo_.push_back(invSigma2);
+    spChi2_.push_back(0);
+    spOutlier_.push_back(0);
+}
+
+void PoseSolver::AddMonoLine(const Eigen::Vector3f& XSw, const Eigen::Vector3f& XEw, const Eigen::Vector3d& l, float invSigma2)
+{
+    mlSX_.push_back(XSw(0)); mlSY_.push_back(XSw(1)); mlSZ_.push_back(XSw(2));
+    mlEX_.push_back(XEw(0)); mlEY_.push_back(XEw(1)); mlEZ_.push_back(XEw(2));
+    mlL1_.push_back(l(0)); mlL2_.push_back(l(1)); mlL3_.push_back(l(2));
+    mlInfo_.push_back(invSigma2);
+    mlChi2_.push_back(0);
+    mlOutlier_.push_back(0);
+}
+
+void PoseSolver::AddStereoLine(const Eigen::Vector3f& XSw, const Eigen::Vector3f& XEw, const Eigen::Vector3d& l,
+                               const Eigen::Vector3d& XSc, const Eigen::Vector3d& XEc, float invSigma2, float invSigma2PointLineDistance)
+{
+    slSX_.push_back(XSw(0)); slSY_.push_back(XSw(1)); slSZ_.push_back(XSw(2));
+    slEX_.push_back(XEw(0)); slEY_.push_back(XEw(1)); slEZ_.push_back(XEw(2));
+    slL1_.push_back(l(0)); slL2_.push_back(l(1)); slL3_.push_back(l(2));
+    slBS_.push_back(XSc); slBE_.push_back(XEc);
+    slLengthInv_.push_back(1.0/(XSc - XEc).norm()); // use the length of the 3D detected line
+    slInfo2D_.push_back(invSigma2);
+    slInfo3D_.push_back(invSigma2PointLineDistance);
+    slChi2_.push_back(0);
+    slOutlier_.push_back(0);
+}
+
+void PoseSolver::CheckStereoLineEndpoints(const Sophus::SE3d& T)
+{
+    // as in g2o::EdgeSE3ProjectStereoLineOnlyPose::init()
+    for(size_t i=0; i<slL1_.size(); i++)
+    {
+        const Eigen::Vector3d XSc = T * Eigen::Vector3d(slSX_[i], slSY_[i], slSZ_[i]);
+        const Eigen::Vector3d XEc = T * Eigen::Vector3d(slEX_[i], slEY_[i], slEZ_[i]);
+        const Eigen::Vector3d mapLineSE = (XSc - XEc).normalized();
+        const Eigen::Vector3d lineSE = (slBS_[i] - slBE_[i]).normalized();
+        if(mapLineSE.dot(lineSE) < 0)
+            std::swap(slBS_[i], slBE_[i]);
+    }
+}
+
+double PoseSolver::Evaluate(const Sophus::SE3d& T, const EvalMode mode, const bool bRobust, Matrix6d* H, Vector6d* g)
+{
+    const uint8_t evalOutlier = (mode == kEvalInactive) ? 1 : 0;
+    const bool bBuild = (H != nullptr);
+    const Eigen::Matrix3d R = T.rotationMatrix();
+    const Eigen::Vector3d t = T.translation();
+
+    double cost = 0;
+    Eigen::Matrix<double,3,6> JX;
+
+    // mono points: e = obs - proj(Xc)
+    for(size_t i=0, iend=mpU_.size(); i<iend; i++)
+    {
+        if(mpOutlier_[i] != evalOutlier) continue;
+        const Eigen::Vector3d Xc = R * Eigen::Vector3d(mpX_[i], mpY_[i], mpZ_[i]) + t;
+        const double invz = 1.0/Xc(2);
+        const Eigen::Vector2d e(mpU_[i] - (fx_*Xc(0)*invz + cx_), mpV_[i] - (fy_*Xc(1)*invz + cy_));
+        const double chi2 = e.squaredNorm()*mpInfo_[i];
+        mpChi2_[i] = chi2;
+        cost += bRobust ? HuberCost(chi2, params_.deltaMono) : chi2;
+        if(!bBuild) continue;
+
+        Eigen::Matrix<double,2,3> Jproj;
+        Jproj << fx_*invz, 0.0, -fx_*Xc(0)*invz*invz,
+                 0.0, fy_*invz, -fy_*Xc(1)*invz*invz;
+        SetPointJacobian(Xc, JX);
+        const Eigen::Matrix<double,2,6> J = -Jproj*JX;
+        const double w = bRobust ? HuberWeight(chi2, params_.deltaMono) : 1.0;
+        Accumulate<2>(J, e, Eigen::Vector2d::Constant(mpInfo_[i]), w, *H, *g);
+    }
+
+    // stereo points: e = obs - [proj(Xc); u - bf/z]
+    for(size_t i=0, iend=spU_.size(); i<iend; i++)
+    {
+        if(spOutlier_[i] != evalOutlier) continue;
+        const Eigen::Vector3d Xc = R * Eigen::Vector3d(spX_[i], spY_[i], spZ_[i]) + t;
+        const double invz = 1.0/Xc(2);
+        const double u = fx_*Xc(0)*invz + cx_;
+        const Eigen::Vector3d e(spU_[i] - u, spV_[i] - (fy_*Xc(1)*invz + cy_), spUR_[i] - (u - bf_*invz));
+        const double chi2 = e.squaredNorm()*spInfo_[i];
+        spChi2_[i] = chi2;
+        cost += bRobust ? HuberCost(chi2, params_.deltaStereo) : chi2;
+        if(!bBuild) continue;
+
+        const double invz2 = invz*invz;
+        Eigen::Matrix3d Jproj;
+        Jproj << fx_*invz, 0.0, -fx_*Xc(0)*invz2,
+                 0.0, fy_*invz, -fy_*Xc(1)*invz2,
+                 fx_*invz, 0.0, -fx_*Xc(0)*invz2 + bf_*invz2;
+        SetPointJacobian(Xc, JX);
+        const Eigen::Matrix<double,3,6> J = -Jproj*JX;
+        const double w = bRobust ? HuberWeight(chi2, params_.deltaStereo) : 1.0;
+        Accumulate<3>(J, e, Eigen::Vector3d::Constant(spInfo_[i]), w, *H, *g);
+    }
+
+    // mono lines: e_k = l . [proj(Xk); 1]   (constraint, the "observation" is zero)
+    Eigen::Matrix<double,1,3> JlineS, JlineE;
+    for(size_t i=0, iend=mlL1_.size(); i<iend; i++)
+    {
+        if(mlOutlier_[i] != evalOutlier) continue;
+        const Eigen::Vector3d XSc = R * Eigen::Vector3d(mlSX_[i], mlSY_[i], mlSZ_[i]) + t;
+        const Eigen::Vector3d XEc = R * Eigen::Vector3d(mlEX_[i], mlEY_[i], mlEZ_[i]) + t;
+        const double l1 = mlL1_[i], l2 = mlL2_[i], l3 = mlL3_[i];
+        const double invzS = 1.0/XSc(2), invzE = 1.0/XEc(2);
+        const Eigen::Vector2d e(l1*(fx_*XSc(0)*invzS + cx_) + l2*(fy_*XSc(1)*invzS + cy_) + l3,
+                                l1*(fx_*XEc(0)*invzE + cx_) + l2*(fy_*XEc(1)*invzE + cy_) + l3);
+        const double chi2 = e.squaredNorm()*mlInfo_[i];
+        mlChi2_[i] = chi2;
+        cost += bRobust ? HuberCost(chi2, params_.deltaLineMono) : chi2;
+        if(!bBuild) continue;
+
+        JlineS << l1*fx_*invzS, l2*fy_*invzS, -(l1*fx_*XSc(0) + l2*fy_*XSc(1))*invzS*invzS;
+        JlineE << l1*fx_*invzE, l2*fy_*invzE, -(l1*fx_*XEc(0) + l2*fy_*XEc(1))*invzE*invzE;
+        Eigen::Matrix<double,2,6> J;
+        SetPointJacobian(XSc, JX);
+        J.row(0) = JlineS*JX;
+        SetPointJacobian(XEc, JX);
+        J.row(1) = JlineE*JX;
+        const double w = bRobust ? HuberWeight(chi2, params_.deltaLineMono) : 1.0;
+        Accumulate<2>(J, e, Eigen::Vector2d::Constant(mlInfo_[i]), w, *H, *g);
+    }
+
+    // stereo lines: mono line errors + distances of the map line endpoints from the back-projected 3D line
+    for(size_t i=0, iend=slL1_.size(); i<iend; i++)
+    {
+        if(slOutlier_[i] != evalOutlier) continue;
+        const Eigen::Vector3d XSc = R * Eigen::Vector3d(slSX_[i], slSY_[i], slSZ_[i]) + t;
+        const Eigen::Vector3d XEc = R * Eigen::Vector3d(slEX_[i], slEY_[i], slEZ_[i]) + t;
+        const double l1 = slL1_[i], l2 = slL2_[i], l3 = slL3_[i];
+        const double invzS = 1.0/XSc(2), invzE = 1.0/XEc(2);
+        const Eigen::Vector3d& BS = slBS_[i];
+        const Eigen::Vector3d& BE = slBE_[i];
+        const Eigen::Vector3d crossS = (XSc - BS).cross(XSc - BE);
+        const Eigen::Vector3d crossE = (XEc - BS).cross(XEc - BE);
+        const double normCrossS = crossS.norm();
+        const double normCrossE = crossE.norm();
+
+        Eigen::Vector4d e;
+        e << l1*(fx_*XSc(0)*invzS + cx_) + l2*(fy_*XSc(1)*invzS + cy_) + l3,
+             l1*(fx_*XEc(0)*invzE + cx_) + l2*(fy_*XEc(1)*invzE + cy_) + l3,
+             normCrossS*slLengthInv_[i],
+             normCrossE*slLengthInv_[i];
+        const Eigen::Vector4d omega(slInfo2D_[i], slInfo2D_[i], slInfo3D_[i], slInfo3D_[i]);
+        const double chi2 = e.cwiseAbs2().dot(omega);
+        slChi2_[i] = chi2;
+        cost += bRobust ? HuberCost(chi2, params_.deltaLineStereo) : chi2;
+        if(!bBuild) continue;
+
+        JlineS << l1*fx_*invzS, l2*fy_*invzS, -(l1*fx_*XSc(0) + l2*fy_*XSc(1))*invzS*invzS;
+        JlineE << l1*fx_*invzE, l2*fy_*invzE, -(l1*fx_*XEc(0) + l2*fy_*XEc(1))*invzE*invzE;
+
+        // d|(P-Bs)x(P-Be)|/dP = normalized((P-Bs)x(P-Be))' * [Be-Bs]x
+        const Eigen::Vector3d BEmBS = BE - BS;
+        Eigen::Matrix3d skewBEmBS;
+        skewBEmBS <<          0.0, -BEmBS(2),  BEmBS(1),
+                         BEmBS(2),       0.0, -BEmBS(0),
+                        -BEmBS(1),  BEmBS(0),       0.0;
+        const Eigen::Matrix<double,1,3> J3DS = (crossS.normalized()*slLengthInv_[i]).transpose()*skewBEmBS;
+        const Eigen::Matrix<double,1,3> J3DE = (crossE.normalized()*slLengthInv_[i]).transpose()*skewBEmBS;
+
+        Eigen::Matrix<double,4,6> J;
+        SetPointJacobian(XSc, JX);
+        J.row(0) = JlineS*JX;
+        J.row(2) = J3DS*JX;
+        SetPointJacobian(XEc, JX);
+        J.row(1) = JlineE*JX;
+        J.row(3) = J3DE*JX;
+        const double w = bRobust ? HuberWeight(chi2, params_.deltaLineStereo) : 1.0;
+        Accumulate<4>(J, e, omega, w, *H, *g);
+    }
+
+    return cost;
+}
+
+void PoseSolver::Minimize(Sophus::SE3d& T, const int numIterations, const bool bRobust)
+{
+    Matrix6d H;
+    Vector6d g;
+    double lambda = 0;
+    double ni = 2;
+    int nBad = 0;
+
+    for(int iter=0; iter<numIterations; iter++)
+    {
+        H.setZero();
+        g.setZero();
+        double currentChi = Evaluate(T, kEvalActive, bRobust, &H, &g);
+        const double iniChi = currentChi;
+
+        if(iter == 0)
+        {
+            lambda = kLambdaInitTau * H.diagonal().maxCoeff();
+            ni = 2;
+        }
+
+        double rho = 0;
+        int qmax = 0;
+        do
+        {
+            Matrix6d Hl = H;
+            Hl.diagonal().array() += lambda;
+            const Eigen::LLT<Matrix6d> llt(Hl);
+            const bool bOk = (llt.info() == Eigen::Success);
+            const Vector6d dx = bOk ? Vector6d(llt.solve(-g)) : Vector6d::Zero();
+
+            Vector6d tangent; // Sophus order: [upsilon, omega]
+            tangent << dx.tail<3>(), dx.head<3>();
+            const Sophus::SE3d Tnew = Sophus::SE3d::exp(tangent) * T;
+
+            double tempChi = Evaluate(Tnew, kEvalActive, bRobust, nullptr, nullptr);
+            if(!bOk) tempChi = std::numeric_limits<double>::max();
+
+            const double scale = dx.dot(lambda*dx - g) + 1e-3;
+            rho = (currentChi - tempChi)/scale;
+            if(rho > 0 && std::isfinite(tempChi))
+            {
+                // good step
+                const double alpha = std::min(1. - std::pow(2*rho - 1, 3), kGoodStepUpperScale);
+                lambda *= std::max(kGoodStepLowerScale, alpha);
+                ni = 2;
+                currentChi = tempChi;
+                T = Tnew;
+            }
+            else
+            {
+                // restore the last state (the errors of the rejected state are kept, as in g2o)
+                lambda *= ni;
+                ni *= 2;
+            }
+            qmax++;
+        }
+        while(rho < 0 && qmax < kMaxTrialsAfterFailure);
+
+        if(qmax == kMaxTrialsAfterFailure || rho == 0)
+            break;
+
+        // stop after 3 iterations with a small relative decrease of the cost
+        if((iniChi - currentChi)*1e3 < iniChi)
+            nBad++;
+        else
+            nBad = 0;
+        if(nBad >= 3)
+            break;
+    }
+}
+
+void PoseSolver::Optimize(Sophus::SE3f& Tcw)
+{
+    const Sophus::SE3d T0 = Tcw.cast<double>();
+    Sophus::SE3d T = T0;
+
+    CheckStereoLineEndpoints(T0);
+
+    std::fill(mpOutlier_.begin(), mpOutlier_.end(), 0);
+    std::fill(spOutlier_.begin(), spOutlier_.end(), 0);
+    std::fill(mlOutlier_.begin(), mlOutlier_.end(), 0);
+    std::fill(slOutlier_.begin(), slOutlier_.end(), 0);
+
+    bool bRobust = true;
+    for(int it=0; it<kNumRounds; it++)
+    {
+        // each round restarts from the input pose
+        T = T0;
+        const bool bHasActive = std::find(mpOutlier_.begin(), mpOutlier_.end(), 0) != mpOutlier_.end() ||
+                                std::find(spOutlier_.begin(), spOutlier_.end(), 0) != spOutlier_.end() ||
+                                std::find(mlOutlier_.begin(), mlOutlier_.end(), 0) != mlOutlier_.end() ||
+                                std::find(slOutlier_.begin(), slOutlier_.end(), 0) != slOutlier_.end();
+        if(bHasActive)
+            Minimize(T, params_.its[it], bRobust);
+
+        // the outliers of this round are evaluated at the final estimate
+        Evaluate(T, kEvalInactive, bRobust, nullptr, nullptr);
+
+        nPointOutliers_ = 0;
+        nLineOutliers_ = 0;
+        for(size_t i=0; i<mpChi2_.size(); i++)
+        {
+            mpOutlier_[i] = (float)mpChi2_[i] > params_.chi2Mono[it];
+            nPointOutliers_ += mpOutlier_[i];
+        }
+        for(size_t i=0; i<spChi2_.size(); i++)
+        {
+            spOutlier_[i] = (float)spChi2_[i] > params_.chi2Stereo[it];
+            nPointOutliers_ += spOutlier_[i];
+        }
+        for(size_t i=0; i<mlChi2_.size(); i++)
+        {
+            mlOutlier_[i] = (float)mlChi2_[i] > params_.chi2LineMono[it];
+            nLineOutliers_ += mlOutlier_[i];
+        }
+        for(size_t i=0; i<slChi2_.size(); i++)
+        {
+            slOutlier_[i] = (float)slChi2_[i] > params_.chi2LineStereo[it];
+            nLineOutliers_ += slOutlier_[i];
+        }
+
+        if(it == params_.roundRobustKernelOff)
+            bRobust = false;
+
+        if((int)NumObservations() < params_.minNumObservations)
+            break;
+    }
+
+    Tcw = T.cast<float>();
+}
+
+} // namespace PLVS2
@@ -631,6 +631,7 @@ namespace PLVS2 {
         lines_.lsdOptions.density_th = Utils::GetParam(fSettings, "Line.LSD.densityTh", 0.6);
         lines_.lsdOptions.n_bins = Utils::GetParam(fSettings, "Line.LSD.nbins", 1024);
         lines_.lsdOptions.min_length = Utils::GetParam(fSettings, "Line.minLineLength", 0.025);
+        lines_.lsdOptions.parallelOctaves = static_cast<int> (Utils::GetParam(fSettings, "Line.LSD.parallelOctaves", 0)) != 0;
         
         // Luigi: TODO remove the static global params 
         
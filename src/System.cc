@@ -71,6 +71,7 @@
 #include "PointCloudDrawer.h"
 #include "Stopwatch.h"
 #include "PointCloudAtlas.h"
+#include "LatencyTrace.h"
 
 #define ENABLE_LOOP_CLOSURE 1
 
@@ -161,8 +162,15 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
     if(activeLC)
     {
     bool bVocLoad = false;  // chose loading method based on file extension
+    std::string vocabularyFileNameFlat = Utils::getFileNameWithouExtension(strVocFile) + ".flat";
     std::string vocabularyFileNameBin = Utils::getFileNameWithouExtension(strVocFile) + ".bin";
-    if( Utils::fileExist(vocabularyFileNameBin) )
+    if( Utils::fileExist(vocabularyFileNameFlat) && mpVocabulary->loadFromFlatFile(vocabularyFileNameFlat) )
+    {
+        // the flat file is mapped read-only and used in place (see Vocabulary/bin_vocabulary.cpp)
+        bVocLoad = true;
+        bBinVocLoaded = true;
+    }
+    else if( Utils::fileExist(vocabularyFileNameBin) )
     {
         bVocLoad = mpVocabulary->loadFromBinaryFile(vocabularyFileNameBin);
         bBinVocLoaded = true;
@@ -190,7 +198,7 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
         cerr << "Failed to open at: " << strVocFile << endl;
         exit(-1);
     }
-    std::string binString = bBinVocLoaded ? "(binary)" : "";
+    std::string binString = mpVocabulary->isMapped() ? "(mapped)" : bBinVocLoaded ? "(binary)" : "";
     cout << "Vocabulary " << strVocFile << " " << binString << " loaded!" << endl << endl;
     }
 #endif
@@ -492,10 +500,7 @@ Sophus::SE3f System::TrackStereo(const cv::Mat &imLeft, const cv::Mat &imRight,
             mpLocalMapper->RequestStop();
 
             // Wait until Local Mapping has effectively stopped
-            while(!mpLocalMapper->isStopped())
-            {
-                usleep(1000);
-            }
+            mpLocalMapper->WaitUntilStopped();
 
             mpTracker->InformOnlyTracking(true);
             mbActivateLocalizationMode = false;
@@ -581,10 +586,7 @@ Sophus::SE3f System::TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap, const
             mpLocalMapper->RequestStop();
 
             // Wait until Local Mapping has effectively stopped
-            while(!mpLocalMapper->isStopped())
-            {
-                usleep(1000);
-            }
+            mpLocalMapper->WaitUntilStopped();
 
             mpTracker->InformOnlyTracking(true);
             mbActivateLocalizationMode = false;
@@ -676,10 +678,7 @@ Sophus::SE3f System::TrackMonocular(const cv::Mat &im, const double &timestamp,
             mpLocalMapper->RequestStop();
 
             // Wait until Local Mapping has effectively stopped
-            while(!mpLocalMapper->isStopped())
-            {
-                usleep(1000);
-            }
+            mpLocalMapper->WaitUntilStopped();
 
             mpTracker->InformOnlyTracking(true);
             mbActivateLocalizationMode = false;
@@ -817,6 +816,8 @@ void System::Shutdown()
     }
     std::cout << "System::Shutdown() - done" << std::endl;
 
+    LatencyTrace::GetInstance().Print(std::cout);
+
     if(!mStrSaveAtlasToFile.empty())
     {
         Verbose::PrintMess("Atlas saving to file " + mStrSaveAtlasToFile, Verbose::VERBOSITY_NORMAL);
@@ -1766,7 +1767,7 @@ void System::SaveAtlas(const string &filename, int type)
         return; 
     }
     
-    std::string strVocabularyChecksum = CalculateCheckSum(mStrVocabularyFilePath, type);
+    std::string strVocabularyChecksum = GetVocabularyDigest(type);
     std::size_t found = mStrVocabularyFilePath.find_last_of("/\\");
     std::string strVocabularyName = mStrVocabularyFilePath.substr(found+1);
 
@@ -1841,9 +1842,10 @@ bool System::LoadAtlas(const string &filename, int type)
     if(isRead)
     {
         //Check if the vocabulary is the same
-        string strInputVocabularyChecksum = CalculateCheckSum(mStrVocabularyFilePath, type);
+        string strInputVocabularyChecksum = GetVocabularyDigest(type);
 
-        if(strInputVocabularyChecksum.compare(strVocChecksum) != 0)
+        if(strInputVocabularyChecksum.compare(strVocChecksum) != 0 && 
+           CalculateCheckSum(mStrVocabularyFilePath, type).compare(strVocChecksum) != 0) // atlas saved with the file checksum
         {
             cout << "The load vocabulary " << mStrVocabularyFilePath << " isn't the same which the load session was created " << endl;
             cout << "\tVocabulary name: " << strFileVoc << endl;
@@ -2062,6 +2064,16 @@ bool System::LoadAtlas(int type)
 }
 #endif
 
+std::string System::GetVocabularyDigest(int type)
+{
+    // the digest is computed when the vocabulary is loaded (or read from the header of a flat file)
+    if(!mpVocabulary->empty())
+        return mpVocabulary->getDigest();
+    
+    // vocabulary not loaded (loop closing disabled)
+    return CalculateCheckSum(mStrVocabularyFilePath, type);
+}
+
 std::string System::CalculateCheckSum(std::string filename, int type)
 {
     string checksum = "";
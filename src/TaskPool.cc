@@ -0,0 +1,171 @@
+/*
+ * This file is part of PLVS
+ * Copyright (C) 2018-present Luigi Freda <luigifreda at gmail dot com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "TaskPool.h"
+
+#include <iostream>
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+namespace PLVS2
+{
+
+static thread_local int tlsWorkerId = -1;
+
+
+void TaskPool::TaskGroup::Run(Task&& task)
+{
+    if( !pPool_ || pPool_->GetNumThreads() == 0 )
+    {
+        task();
+        return;
+    }
+    numPending_++;
+    pPool_->Push(std::move(task), this);
+}
+
+void TaskPool::TaskGroup::Wait()
+{
+    while(numPending_ > 0)
+    {
+        // help the workers instead of just sleeping; this also avoids deadlocks when a group is waited inside a worker
+        if( pPool_ && pPool_->RunPendingTask() )
+            continue;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this]{ return numPending_ == 0; });
+    }
+    // make sure the last NotifyDone() has released the group before it can be destroyed
+    std::unique_lock<std::mutex> lock(mutex_);
+}
+
+void TaskPool::TaskGroup::NotifyDone()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    numPending_--;
+    if(numPending_ == 0)
+        cond_.notify_all();
+}
+
+
+TaskPool::TaskPool(int numThreads, int firstCore): bStop_(false)
+{
+    const int numCores = std::max(1,(int)std::thread::hardware_concurrency());
+
+    for(int i=0; i<numThreads; i++)
+    {
+        workers_.emplace_back(&TaskPool::WorkerLoop, this, i);
+        if(firstCore >= 0)
+        {
+            PinToCore(workers_.back(), (firstCore + i) % numCores);
+        }
+    }
+}
+
+TaskPool::~TaskPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(jobsMutex_);
+        bStop_ = true;
+    }
+    jobsCond_.notify_all();
+
+    for(auto& worker: workers_)
+    {
+        if(worker.joinable())
+            worker.join();
+    }
+}
+
+int TaskPool::GetWorkerId()
+{
+    return tlsWorkerId;
+}
+
+void TaskPool::Push(Task&& task, TaskGroup* pGroup)
+{
+    {
+        std::unique_lock<std::mutex> lock(jobsMutex_);
+        jobs_.push_back(Job{std::move(task), pGroup});
+    }
+    jobsCond_.notify_one();
+}
+
+bool TaskPool::RunPendingTask()
+{
+    Job job;
+    {
+        std::unique_lock<std::mutex> lock(jobsMutex_);
+        if(jobs_.empty())
+            return false;
+        job = std::move(jobs_.front());
+        jobs_.pop_front();
+    }
+
+    job.task();
+    if(job.pGroup)
+        job.pGroup->NotifyDone();
+
+    return true;
+}
+
+void TaskPool::WorkerLoop(int workerId)
+{
+    tlsWorkerId = workerId;
+
+    while(true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(jobsMutex_);
+            jobsCond_.wait(lock, [this]{ return bStop_ || !jobs_.empty(); });
+            if(bStop_ && jobs_.empty())
+                break;
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+
+        job.task();
+        if(job.pGroup)
+            job.pGroup->NotifyDone();
+    }
+}
+
+void TaskPool::PinToCore(std::thread& thread, int core)
+{
+#ifdef __linux__
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(core, &cpuset);
+    const int rc = pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpuset);
+    if(rc != 0)
+    {
+        std::cerr << "TaskPool::PinToCore() - error " << rc << " while pinning worker to core " << core << std::endl;
+    }
+#else
+    (void)thread; (void)core;
+#endif
+}
+
+} // namespace PLVS2
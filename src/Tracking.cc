@@ -96,6 +96,8 @@ bool Tracking::skUsePyramidPrecomputation = false; // use pyramid pre-computatio
                                                    // this will force the use of the same scale on both feature extractors 
                                                    // (at present time, this does not actually seem beneficial) 
 
+bool Tracking::skUseBatchFrustumCulling = true; // project the local map with LocalMapProjector (SoA snapshot) instead of Frame::isInFrustum() on each feature 
+
 /*
 // Tracking states
 enum eTrackingState{
@@ -198,11 +200,43 @@ Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer,
     Frame::mbUseFovCentersKfGenCriterion = mbUseFovCentersKfGenCriterion;
     skMaxDistFovCenters = Utils::GetParam(fSettings, "KeyFrame.maxFovCentersDistance", skMaxDistFovCenters);
 
+    // Persistent worker pool for feature extraction 
+    cout << endl  << "Feature Extraction Pool Parameters: " << endl;
+    const int numExtractionThreads = Utils::GetParam(fSettings, "Tracking.extractionPool.numThreads", 4);
+    const int extractionFirstCore = Utils::GetParam(fSettings, "Tracking.extractionPool.firstCore", -1); // -1: no core pinning
+    if(numExtractionThreads > 0)
+    {
+        mpExtractionPool = std::make_shared<TaskPool>(numExtractionThreads, extractionFirstCore);
+    }
+    Frame::spExtractionPool = mpExtractionPool.get();
+
+    // Intra-image parallel ORB extraction (levels and cells are split in tasks executed by the extraction pool)
+    const bool bParallelORBextraction = Utils::GetParam(fSettings, "ORBextractor.parallel", false);
+    if(bParallelORBextraction && mpExtractionPool)
+    {
+        mpORBextractorLeft->SetTaskPool(mpExtractionPool.get());
+        if(sensor==System::STEREO || sensor==System::IMU_STEREO)
+            mpORBextractorRight->SetTaskPool(mpExtractionPool.get());
+        if(sensor==System::MONOCULAR || sensor==System::IMU_MONOCULAR)
+            mpIniORBextractor->SetTaskPool(mpExtractionPool.get());
+    }
+
+    // Batched frustum culling of the local map in SearchLocalPoints() and SearchLocalLines()
+    skUseBatchFrustumCulling = Utils::GetParam(fSettings, "Tracking.batchFrustumCulling", skUseBatchFrustumCulling);
+
     // ---- ---- ---- 
     // Depth Model parameters 
     
     cout << endl  << "Depth Model Parameters: " << endl;    
     Optimizer::skSigmaZFactor = Utils::GetParam(fSettings, "Depth.sigmaZfactor", Optimizer::skSigmaZFactor);
+    Optimizer::skUseFixedSizePoseSolver = Utils::GetParam(fSettings, "Optimizer.fixedSizePoseSolver", Optimizer::skUseFixedSizePoseSolver);
+    LocalMapping::skUseAsyncScaleRefinement = Utils::GetParam(fSettings, "LocalMapping.asyncScaleRefinement", LocalMapping::skUseAsyncScaleRefinement);
+    Optimizer::skNumOptimizerThreads = Utils::GetParam(fSettings, "Optimizer.numThreads", Optimizer::skNumOptimizerThreads);
+    Optimizer::skUseSchurBASolver = Utils::GetParam(fSettings, "Optimizer.schurBASolver", Optimizer::skUseSchurBASolver);
+    Optimizer::skUsePoseGraphSolver = Utils::GetParam(fSettings, "Optimizer.poseGraphSolver", Optimizer::skUsePoseGraphSolver);
+    LoopClosing::skUseIncrementalGBA = Utils::GetParam(fSettings, "LoopClosing.incrementalGBA", LoopClosing::skUseIncrementalGBA);
+    LoopClosing::skMaxAffectedKeyFramesRatio = Utils::GetParam(fSettings, "LoopClosing.maxAffectedKeyFramesRatio", LoopClosing::skMaxAffectedKeyFramesRatio);
+    LoopClosing::skNumVerificationThreads = Utils::GetParam(fSettings, "LoopClosing.numVerificationThreads", LoopClosing::skNumVerificationThreads);
 
     mEnableDepthFilter = static_cast<int> (Utils::GetParam(fSettings, "DepthFilter.Morphological.on", 0)) != 0; 
     mDepthCutoff = Utils::GetParam(fSettings, "DepthFilter.Morphological.cutoff", 20);
@@ -561,6 +595,26 @@ void Tracking::PrintTimeStats()
     deviation = calcDeviation(mpLoopClosing->vdEstSim3_ms, average);
     f << "SE3 estimation: " << average << "$\\pm$" << deviation << std::endl;
     std::cout << "SE3 estimation: " << average << "$\\pm$" << deviation << std::endl;
+    average = calcAverage(mpLoopClosing->vdBoWCandMatching_ms);
+    deviation = calcDeviation(mpLoopClosing->vdBoWCandMatching_ms, average);
+    f << " - BoW candidate matching: " << average << "$\\pm$" << deviation << std::endl;
+    std::cout << " - BoW candidate matching: " << average << "$\\pm$" << deviation << std::endl;
+    average = calcAverage(mpLoopClosing->vdBoWCandSim3_ms);
+    deviation = calcDeviation(mpLoopClosing->vdBoWCandSim3_ms, average);
+    f << " - BoW candidate Sim3 RANSAC: " << average << "$\\pm$" << deviation << std::endl;
+    std::cout << " - BoW candidate Sim3 RANSAC: " << average << "$\\pm$" << deviation << std::endl;
+    average = calcAverage(mpLoopClosing->vdBoWCandProjection_ms);
+    deviation = calcDeviation(mpLoopClosing->vdBoWCandProjection_ms, average);
+    f << " - BoW candidate projection: " << average << "$\\pm$" << deviation << std::endl;
+    std::cout << " - BoW candidate projection: " << average << "$\\pm$" << deviation << std::endl;
+    average = calcAverage(mpLoopClosing->vdBoWCandOptimization_ms);
+    deviation = calcDeviation(mpLoopClosing->vdBoWCandOptimization_ms, average);
+    f << " - BoW candidate Sim3 optimization: " << average << "$\\pm$" << deviation << std::endl;
+    std::cout << " - BoW candidate Sim3 optimization: " << average << "$\\pm$" << deviation << std::endl;
+    average = calcAverage(mpLoopClosing->vdBoWCandCovisibility_ms);
+    deviation = calcDeviation(mpLoopClosing->vdBoWCandCovisibility_ms, average);
+    f << " - BoW candidate covisibility check: " << average << "$\\pm$" << deviation << std::endl;
+    std::cout << " - BoW candidate covisibility check: " << average << "$\\pm$" << deviation << std::endl;
     average = calcAverage(mpLoopClosing->vdPRTotal_ms);
     deviation = calcDeviation(mpLoopClosing->vdPRTotal_ms, average);
     f << "Total Place Recognition: " << average << "$\\pm$" << deviation << std::endl << std::endl;
@@ -655,6 +709,7 @@ void Tracking::PrintTimeStats()
 Tracking::~Tracking()
 {
     //f_track_stats.close();
+    Frame::spExtractionPool = NULL;
 
 }
 
@@ -1490,6 +1545,7 @@ bool Tracking::ParseFeaturesParamFile(cv::FileStorage &fSettings)
     lsdOptions.density_th = Utils::GetParam(fSettings, "Line.LSD.densityTh", 0.6);
     lsdOptions.n_bins = Utils::GetParam(fSettings, "Line.LSD.nbins", 1024);
     lsdOptions.min_length = Utils::GetParam(fSettings, "Line.minLineLength", 0.025);
+    lsdOptions.parallelOctaves = static_cast<int> (Utils::GetParam(fSettings, "Line.LSD.parallelOctaves", 0)) != 0;
         
     Tracking::sknLineTrackWeigth = 0;
     if(mbLineTrackerOn) 
@@ -1984,6 +2040,10 @@ void Tracking::PreintegrateIMU()
 
     IMU::Preintegrated* pImuPreintegratedFromLastFrame = new IMU::Preintegrated(mLastFrame.mImuBias,mCurrentFrame.mImuCalib);
 
+    // collect the interpolated samples and integrate them in a single batch
+    std::vector<IMU::Preintegrated::integrable> vMeasurements;
+    vMeasurements.reserve(n);
+
     for(int i=0; i<n; i++)
     {
         //float tstep; // [Luigi] BugFix timestamps should always be represented with double!
@@ -2022,12 +2082,14 @@ void Tracking::PreintegrateIMU()
             tstep = mCurrentFrame.mTimeStamp-mCurrentFrame.mpPrevFrame->mTimeStamp;
         }
 
-        if (!mpImuPreintegratedFromLastKF)
-            cout << "mpImuPreintegratedFromLastKF does not exist" << endl;
-        mpImuPreintegratedFromLastKF->IntegrateNewMeasurement(acc,angVel,tstep);
-        pImuPreintegratedFromLastFrame->IntegrateNewMeasurement(acc,angVel,tstep);
+        vMeasurements.push_back(IMU::Preintegrated::integrable(acc,angVel,tstep));
     }
 
+    if (!mpImuPreintegratedFromLastKF)
+        cout << "mpImuPreintegratedFromLastKF does not exist" << endl;
+    mpImuPreintegratedFromLastKF->IntegrateNewMeasurements(vMeasurements);
+    pImuPreintegratedFromLastFrame->IntegrateNewMeasurements(vMeasurements);
+
     mCurrentFrame.mpImuPreintegratedFrame = pImuPreintegratedFromLastFrame;
     mCurrentFrame.mpImuPreintegrated = mpImuPreintegratedFromLastKF;
     mCurrentFrame.mpLastKeyFrame = mpLastKeyFrame;
@@ -4404,24 +4466,56 @@ void Tracking::SearchLocalPoints()
 
     int nToMatch=0;
 
-    // Project points in frame and check its visibility
-    for(vector<MapPointPtr>::iterator vit=mvpLocalMapPoints.begin(), vend=mvpLocalMapPoints.end(); vit!=vend; vit++)
+    // Batched projection: the projections go in the side tables instead of the MapPoint tracking variables (but mTrackDepth)
+    const bool bBatchFrustumCulling = skUseBatchFrustumCulling && LocalMapProjector::IsSupported(mCurrentFrame) && 
+                                      mLocalMapProjector.NumMapPoints() == mvpLocalMapPoints.size();
+
+    if(bBatchFrustumCulling)
     {
-        MapPointPtr pMP = *vit;
+        mLocalMapProjector.ProjectMapPoints(mCurrentFrame, 0.5, mvbLocalMapPointsInView, mvLocalMapPointsProjections);
 
-        if(pMP->mnLastFrameSeen == mCurrentFrame.mnId)
-            continue;
-        if(pMP->isBad())
-            continue;
-        // Project (this fills MapPoint variables for matching)
-        if(mCurrentFrame.isInFrustum(pMP,0.5))
+        for(size_t i=0; i<mvpLocalMapPoints.size(); i++)
         {
+            if(!mvbLocalMapPointsInView[i])
+                continue;
+
+            MapPointPtr pMP = mvpLocalMapPoints[i];
+            if(pMP->mnLastFrameSeen == mCurrentFrame.mnId || pMP->isBad())
+            {
+                mvbLocalMapPointsInView[i] = 0;
+                continue;
+            }
+
             pMP->IncreaseVisible();
             nToMatch++;
+
+            const MapPointProjection& proj = mvLocalMapPointsProjections[i];
+            // as Frame::isInFrustum(): the inertial optimizations read the tracking depth
+            pMP->mTrackDepth = proj.depth;
+            mCurrentFrame.mmProjectPoints[pMP->mnId] = cv::Point2f(proj.u, proj.v);
         }
-        if(pMP->mbTrackInView)
+    }
+    else
+    {
+        // Project points in frame and check its visibility
+        for(vector<MapPointPtr>::iterator vit=mvpLocalMapPoints.begin(), vend=mvpLocalMapPoints.end(); vit!=vend; vit++)
         {
-            mCurrentFrame.mmProjectPoints[pMP->mnId] = cv::Point2f(pMP->mTrackProjX, pMP->mTrackProjY);
+            MapPointPtr pMP = *vit;
+
+            if(pMP->mnLastFrameSeen == mCurrentFrame.mnId)
+                continue;
+            if(pMP->isBad())
+                continue;
+            // Project (this fills MapPoint variables for matching)
+            if(mCurrentFrame.isInFrustum(pMP,0.5))
+            {
+                pMP->IncreaseVisible();
+                nToMatch++;
+            }
+            if(pMP->mbTrackInView)
+            {
+                mCurrentFrame.mmProjectPoints[pMP->mnId] = cv::Point2f(pMP->mTrackProjX, pMP->mTrackProjY);
+            }
         }
     }
 
@@ -4450,7 +4544,9 @@ void Tracking::SearchLocalPoints()
         if(mState==LOST || mState==RECENTLY_LOST) // Lost for less than 1 second
             th=15; // 15
 
-        int matches = matcher.SearchByProjection(mCurrentFrame, mvpLocalMapPoints, th, mpLocalMapper->mbFarPoints, mpLocalMapper->mThFarPoints);
+        int matches = bBatchFrustumCulling ? 
+            matcher.SearchByProjection(mCurrentFrame, mvpLocalMapPoints, mvbLocalMapPointsInView, mvLocalMapPointsProjections, th, mpLocalMapper->mbFarPoints, mpLocalMapper->mThFarPoints) :
+            matcher.SearchByProjection(mCurrentFrame, mvpLocalMapPoints, th, mpLocalMapper->mbFarPoints, mpLocalMapper->mThFarPoints);
     }
 }
 
@@ -4480,6 +4576,36 @@ void Tracking::SearchLocalLines()
 
     int nToMatch=0;
 
+    // Batched projection: the results go in the side tables instead of the MapLine tracking variables 
+    // (the KNN search reads the MapLine tracking variables)
+    const bool bBatchFrustumCulling = !USE_LINE_MATCHING_BY_KNN && skUseBatchFrustumCulling && LocalMapProjector::IsSupportedLines(mCurrentFrame) && 
+                                      mLocalMapProjector.NumMapLines() == mvpLocalMapLines.size();
+
+    if(bBatchFrustumCulling)
+    {
+        mLocalMapProjector.ProjectMapLines(mCurrentFrame, 0.5, mvbLocalMapLinesInView, mvLocalMapLinesProjections);
+
+        for(size_t i=0; i<mvpLocalMapLines.size(); i++)
+        {
+            if(!mvbLocalMapLinesInView[i])
+                continue;
+
+            MapLinePtr pML = mvpLocalMapLines[i];
+            if(pML->mnLastFrameSeen == mCurrentFrame.mnId || pML->isBad())
+            {
+                mvbLocalMapLinesInView[i] = 0;
+                continue;
+            }
+
+            pML->IncreaseVisible();
+            nToMatch++;
+
+            const MapLineProjection& proj = mvLocalMapLinesProjections[i];
+            mCurrentFrame.mmProjectLines[pML->mnId] = std::make_pair(cv::Point2f(proj.uS, proj.vS), cv::Point2f(proj.uE, proj.vE));
+        }
+    }
+    else
+    {
     // Project lines in frame and check its visibility
     for(vector<MapLinePtr>::iterator vit=mvpLocalMapLines.begin(), vend=mvpLocalMapLines.end(); vit!=vend; vit++)
     {
@@ -4500,6 +4626,7 @@ void Tracking::SearchLocalLines()
                                                                      cv::Point2f(pML->mTrackProjEndX, pML->mTrackProjEndY));        
         }        
     }
+    }
 
     bool bLargerLineSearch = false; 
 
@@ -4526,7 +4653,10 @@ void Tracking::SearchLocalLines()
 #if USE_LINE_MATCHING_BY_KNN        
         matcher.SearchByKnn(mCurrentFrame, mvpLocalMapLines);
 #else
-        matcher.SearchByProjection(mCurrentFrame, mvpLocalMapLines, bLargerLineSearch);
+        if(bBatchFrustumCulling)
+            matcher.SearchByProjection(mCurrentFrame, mvpLocalMapLines, mvbLocalMapLinesInView, mvLocalMapLinesProjections, bLargerLineSearch);
+        else
+            matcher.SearchByProjection(mCurrentFrame, mvpLocalMapLines, bLargerLineSearch);
 #endif
     }
 }
@@ -4546,7 +4676,14 @@ void Tracking::UpdateLocalMap()
     // Update
     UpdateLocalKeyFrames();
     UpdateLocalFeatures();
-    
+
+    // Snapshot of the local map for the batched frustum culling 
+    if(skUseBatchFrustumCulling)
+    {
+        mLocalMapProjector.SetMapPoints(mvpLocalMapPoints);
+        if(mbLineTrackerOn)
+            mLocalMapProjector.SetMapLines(mvpLocalMapLines);
+    }
 }
 
 void Tracking::UpdateLocalFeatures()
@@ -4824,6 +4961,111 @@ void Tracking::UpdateLocalKeyFrames()
 }
 
 /// < TODO: add line processing here 
+// RANSAC and refinement state of a relocalization candidate keyframe (see Tracking::Relocalization())
+struct RelocalizationCandidate
+{
+    KeyFramePtr pKF;
+    vector<MapPointPtr> vpMapPointMatches;
+    std::unique_ptr<MLPnPsolver> pSolver;
+    std::unique_ptr<Frame> pFrame;     // copy of the current frame refined with the poses of this candidate
+    bool bDiscarded = true;
+};
+
+enum RelocalizationRoundResult
+{
+    kRelocalizationContinue = 0,
+    kRelocalizationDiscarded,          // RANSAC reached its max number of iterations
+    kRelocalizationMatch               // pose supported by enough inliers
+};
+
+// Perform 5 RANSAC iterations on a candidate and, if a camera pose is computed, optimize it (with a search by projection
+// if few inliers). Only the candidate state is modified: rounds of different candidates can run concurrently.
+static RelocalizationRoundResult RelocalizationRound(RelocalizationCandidate& candidate, const Frame& currentFrame)
+{
+    vector<bool> vbInliers;
+    int nInliers;
+    bool bNoMore;
+
+    Eigen::Matrix4f eigTcw;
+    const bool bTcw = candidate.pSolver->iterate(5,bNoMore,vbInliers,nInliers, eigTcw);
+
+    // If Ransac reachs max. iterations discard keyframe
+    const RelocalizationRoundResult result = bNoMore ? kRelocalizationDiscarded : kRelocalizationContinue;
+    if(!bTcw)
+        return result;
+
+    // If a Camera Pose is computed, optimize
+    if(!candidate.pFrame)
+        candidate.pFrame.reset(new Frame(currentFrame));
+    Frame& frame = *candidate.pFrame;
+
+    Sophus::SE3f Tcw(eigTcw);
+    frame.SetPose(Tcw);
+
+    set<MapPointPtr> sFound;
+
+    const int np = vbInliers.size();
+
+    for(int j=0; j<np; j++)
+    {
+        if(vbInliers[j])
+        {
+            frame.mvpMapPoints[j]=candidate.vpMapPointMatches[j];
+            sFound.insert(candidate.vpMapPointMatches[j]);
+        }
+        else
+            frame.mvpMapPoints[j]=NULL;
+    }
+
+    int nGood = Optimizer::PoseOptimization(&frame);
+
+    if(nGood<10)
+        return result;
+
+    for(int io =0; io<frame.N; io++)
+        if(frame.mvbOutlier[io])
+            frame.mvpMapPoints[io]=static_cast<MapPointPtr>(NULL);
+
+    // If few inliers, search by projection in a coarse window and optimize again
+    if(nGood<50)
+    {
+        ORBmatcher matcher2(0.9,true);
+        int nadditional =matcher2.SearchByProjection(frame,candidate.pKF,sFound,10,100);
+
+        if(nadditional+nGood>=50)
+        {
+            nGood = Optimizer::PoseOptimization(&frame);
+
+            // If many inliers but still not enough, search by projection again in a narrower window
+            // the camera has been already optimized with many points
+            if(nGood>30 && nGood<50)
+            {
+                sFound.clear();
+                for(int ip =0; ip<frame.N; ip++)
+                    if(frame.mvpMapPoints[ip])
+                        sFound.insert(frame.mvpMapPoints[ip]);
+                nadditional =matcher2.SearchByProjection(frame,candidate.pKF,sFound,3,64);
+
+                // Final optimization
+                if(nGood+nadditional>=50)
+                {
+                    nGood = Optimizer::PoseOptimization(&frame);
+
+                    for(int io =0; io<frame.N; io++)
+                        if(frame.mvbOutlier[io])
+                            frame.mvpMapPoints[io]=NULL;
+                }
+            }
+        }
+    }
+
+    // If the pose is supported by enough inliers stop ransacs and continue
+    if(nGood>=50)
+        return kRelocalizationMatch;
+
+    return result;
+}
+
 bool Tracking::Relocalization()
 {
     Verbose::PrintMess("Starting relocalization", Verbose::VERBOSITY_NORMAL);
@@ -4842,155 +5084,123 @@ bool Tracking::Relocalization()
 
     const int nKFs = vpCandidateKFs.size();
 
+    // The candidates are processed concurrently on the extraction pool (idle at this point of the frame)
+    TaskPool* pPool = (mpExtractionPool && mpExtractionPool->GetNumThreads() > 0) ? mpExtractionPool.get() : NULL;
+
     // We perform first an ORB matching with each candidate
     // If enough matches are found we setup a PnP solver
-    ORBmatcher matcher(0.75,true);
-
-    vector<MLPnPsolver*> vpMLPnPsolvers;
-    vpMLPnPsolvers.resize(nKFs);
-
-    vector<vector<MapPointPtr> > vvpMapPointMatches;
-    vvpMapPointMatches.resize(nKFs);
-
-    vector<bool> vbDiscarded;
-    vbDiscarded.resize(nKFs);
-
-    int nCandidates=0;
-
-    for(int i=0; i<nKFs; i++)
+    vector<RelocalizationCandidate> vCandidates(nKFs);
     {
-        KeyFramePtr pKF = vpCandidateKFs[i];
-        if(pKF->isBad())
-        {
-            vbDiscarded[i] = true;
-        }
-        else
+        TaskPool::TaskGroup matchingTasks(pPool);
+        for(int i=0; i<nKFs; i++)
         {
-            int nmatches = matcher.SearchByBoW(pKF,mCurrentFrame,vvpMapPointMatches[i]);
-            if(nmatches<15)
+            matchingTasks.Run([this, &vCandidates, &vpCandidateKFs, i]()
             {
-                vbDiscarded[i] = true;
-                continue;
-            }
-            else
-            {
-                MLPnPsolver* pSolver = new MLPnPsolver(mCurrentFrame,vvpMapPointMatches[i]);
-                pSolver->SetRansacParameters(0.99,10,300,6,0.5,5.991);  //This solver needs at least 6 points
-                vpMLPnPsolvers[i] = pSolver;
-                nCandidates++;
-            }
+                RelocalizationCandidate& candidate = vCandidates[i];
+                candidate.pKF = vpCandidateKFs[i];
+                if(candidate.pKF->isBad())
+                    return;
+
+                ORBmatcher matcher(0.75,true);
+                int nmatches = matcher.SearchByBoW(candidate.pKF,mCurrentFrame,candidate.vpMapPointMatches);
+                if(nmatches<15)
+                    return;
+
+                candidate.pSolver.reset(new MLPnPsolver(mCurrentFrame,candidate.vpMapPointMatches));
+                candidate.pSolver->SetRansacParameters(0.99,10,300,6,0.5,5.991);  //This solver needs at least 6 points
+                candidate.pSolver->SetRandomSeed(i); // hypotheses independent of the scheduling of the candidates
+                candidate.bDiscarded = false;
+            });
         }
     }
 
-    // Alternatively perform some iterations of P4P RANSAC
-    // Until we found a camera pose supported by enough inliers
-    bool bMatch = false;
-    ORBmatcher matcher2(0.9,true);
+    int nCandidates=0;
+    for(int i=0; i<nKFs; i++)
+        if(!vCandidates[i].bDiscarded)
+            nCandidates++;
 
-    while(nCandidates>0 && !bMatch)
-    {
+    // Alternatively perform some iterations of P4P RANSAC
+    // Until we found a camera pose supported by enough inliers.
+    // The selected candidate is the first one to reach enough inliers in the round-robin order of the sequential
+    // scheme (round, then candidate index): with the pool, each candidate runs its rounds independently and stops as soon
+    // as a match is found in an earlier round or in the same round by a candidate with a smaller index.
+    int nMatchRound = 0;
+    int nMatchCandidate = -1;
+    if(pPool && nCandidates>1)
+    {
+        std::mutex mutexMatch;
+        auto isPreceded = [&](const int round, const int i)
+        {
+            unique_lock<mutex> lock(mutexMatch);
+            return nMatchCandidate>=0 && (nMatchRound<round || (nMatchRound==round && nMatchCandidate<i));
+        };
+
+        TaskPool::TaskGroup ransacTasks(pPool);
         for(int i=0; i<nKFs; i++)
         {
-            if(vbDiscarded[i])
+            if(vCandidates[i].bDiscarded)
                 continue;
 
-            // Perform 5 Ransac Iterations
-            vector<bool> vbInliers;
-            int nInliers;
-            bool bNoMore;
-
-            MLPnPsolver* pSolver = vpMLPnPsolvers[i];
-            Eigen::Matrix4f eigTcw;
-            bool bTcw = pSolver->iterate(5,bNoMore,vbInliers,nInliers, eigTcw);
-
-            // If Ransac reachs max. iterations discard keyframe
-            if(bNoMore)
+            ransacTasks.Run([this, &vCandidates, &mutexMatch, &nMatchRound, &nMatchCandidate, &isPreceded, i]()
             {
-                vbDiscarded[i]=true;
-                nCandidates--;
-            }
-
-            // If a Camera Pose is computed, optimize
-            if(bTcw)
-            {
-                Sophus::SE3f Tcw(eigTcw);
-                mCurrentFrame.SetPose(Tcw);
-                // Tcw.copyTo(mCurrentFrame.mTcw);
-
-                set<MapPointPtr> sFound;
-
-                const int np = vbInliers.size();
-
-                for(int j=0; j<np; j++)
-                {
-                    if(vbInliers[j])
-                    {
-                        mCurrentFrame.mvpMapPoints[j]=vvpMapPointMatches[i][j];
-                        sFound.insert(vvpMapPointMatches[i][j]);
-                    }
-                    else
-                        mCurrentFrame.mvpMapPoints[j]=NULL;
-                }
-
-                int nGood = Optimizer::PoseOptimization(&mCurrentFrame);
-
-                if(nGood<10)
-                    continue;
-
-                for(int io =0; io<mCurrentFrame.N; io++)
-                    if(mCurrentFrame.mvbOutlier[io])
-                        mCurrentFrame.mvpMapPoints[io]=static_cast<MapPointPtr>(NULL);
-
-                // If few inliers, search by projection in a coarse window and optimize again
-                if(nGood<50)
+                for(int round=0; !isPreceded(round,i); round++)
                 {
-                    int nadditional =matcher2.SearchByProjection(mCurrentFrame,vpCandidateKFs[i],sFound,10,100);
-
-                    if(nadditional+nGood>=50)
+                    const RelocalizationRoundResult result = RelocalizationRound(vCandidates[i], mCurrentFrame);
+                    if(result==kRelocalizationMatch)
                     {
-                        nGood = Optimizer::PoseOptimization(&mCurrentFrame);
-
-                        // If many inliers but still not enough, search by projection again in a narrower window
-                        // the camera has been already optimized with many points
-                        if(nGood>30 && nGood<50)
+                        unique_lock<mutex> lock(mutexMatch);
+                        if(nMatchCandidate<0 || round<nMatchRound || (round==nMatchRound && i<nMatchCandidate))
                         {
-                            sFound.clear();
-                            for(int ip =0; ip<mCurrentFrame.N; ip++)
-                                if(mCurrentFrame.mvpMapPoints[ip])
-                                    sFound.insert(mCurrentFrame.mvpMapPoints[ip]);
-                            nadditional =matcher2.SearchByProjection(mCurrentFrame,vpCandidateKFs[i],sFound,3,64);
-
-                            // Final optimization
-                            if(nGood+nadditional>=50)
-                            {
-                                nGood = Optimizer::PoseOptimization(&mCurrentFrame);
-
-                                for(int io =0; io<mCurrentFrame.N; io++)
-                                    if(mCurrentFrame.mvbOutlier[io])
-                                        mCurrentFrame.mvpMapPoints[io]=NULL;
-                            }
+                            nMatchRound = round;
+                            nMatchCandidate = i;
                         }
                     }
+                    if(result!=kRelocalizationContinue)
+                        break;
                 }
+            });
+        }
+        ransacTasks.Wait();
+    }
+    else
+    {
+        while(nCandidates>0 && nMatchCandidate<0)
+        {
+            for(int i=0; i<nKFs; i++)
+            {
+                if(vCandidates[i].bDiscarded)
+                    continue;
 
-
-                // If the pose is supported by enough inliers stop ransacs and continue
-                if(nGood>=50)
+                const RelocalizationRoundResult result = RelocalizationRound(vCandidates[i], mCurrentFrame);
+                if(result==kRelocalizationMatch)
                 {
-                    bMatch = true;
+                    nMatchCandidate = i;
                     break;
                 }
+                if(result==kRelocalizationDiscarded)
+                {
+                    vCandidates[i].bDiscarded=true;
+                    nCandidates--;
+                }
             }
         }
     }
 
-    if(!bMatch)
+    if(nMatchCandidate<0)
     {
         std::cout << "Relocalization FAILURE!" << std::endl; 
         return false;
     }
     else
     {
+        // take the pose and the associations refined with the selected candidate
+        const Frame& matchFrame = *vCandidates[nMatchCandidate].pFrame;
+        mCurrentFrame.SetPose(matchFrame.GetPose());
+        mCurrentFrame.mvpMapPoints = matchFrame.mvpMapPoints;
+        mCurrentFrame.mvbOutlier = matchFrame.mvbOutlier;
+        mCurrentFrame.mvbLineOutlier = matchFrame.mvbLineOutlier;
+        mCurrentFrame.mvuNumLinePosOptFailures = matchFrame.mvuNumLinePosOptFailures;
+
         mnLastRelocFrameId = mCurrentFrame.mnId;
         cout << "Relocalized!!" << endl;
         return true;